@@ -1,6 +1,6 @@
 import sys
 import argparse
-from pyrfsim import RfSimulator
+from pyrfsim import RfSimulator, SpectralDopplerProcessor
 import numpy as np
 import h5py
 from scipy.signal import hilbert, gausspulse
@@ -127,28 +127,17 @@ if __name__ == "__main__":
     if args.save_pdf:
         plt.savefig("figure2.pdf")
     
+    # Range gating, windowed STFT and log-compression in C++
     fft_len = 256
     nd = 5
-    num_spectrums = int( (len(slowtime_samples)-fft_len)/nd )
-    
-    pixels = np.empty( (fft_len, num_spectrums))
-    hann_win = np.hanning(fft_len)
-    for spect_no in range(num_spectrums):
-        i0 = spect_no*nd
-        temp = slowtime_samples[i0:(i0+fft_len)]*hann_win
-        temp_fft = np.fft.fftshift(np.fft.fft(temp))
-        temp_fft = temp_fft[::-1] # flip y axis
-        pixels[:, spect_no] = abs(temp_fft)
-    
-    # Normalize to [0, 1]
-    max_value = np.max(abs(pixels.flatten()))
-    pixels = pixels / max_value
     db_range = 60
+    # Keep all spectra, since they are fetched at once.
+    spectral_doppler = SpectralDopplerProcessor(fft_length=fft_len, hop=nd, gate_start=sample_idx,
+                                                gate_length=1, dyn_range=db_range, max_spectra=args.num_beams)
+    spectral_doppler.add_firings(iq_lines)
     
-    # log-compress
-    pixels = 127*30*np.log10(pixels)/db_range + 127
-    # var np.log10(pixels) frr
-    pixels[pixels < 0] = 0
+    # [fft_len, num_spectrums] with positive frequencies at the top
+    pixels = spectral_doppler.get_spectrogram().T[::-1, :]
     
     # spectrum freq. limits
     min_freq = -0.5*args.prf
@@ -172,19 +161,8 @@ if __name__ == "__main__":
         plt.show()
     
     if args.store_audio:
-        from scipy.io.wavfile import write
-        from scipy.interpolate import interp1d
-        fs_wav = 44100
-        f = interp1d(timestamps, np.real(slowtime_samples))
-        new_times = np.arange(timestamps[0], timestamps[-1], 1.0/fs_wav)
-        new_samples = f(new_times)
-        
-        new_samples = new_samples / np.max(abs(new_samples))
-        new_samples = new_samples*32000
-        new_samples = np.array(new_samples, dtype="int16")
-        
         audio_file = "pw_audio.wav"
-        write(audio_file, fs_wav, new_samples)
-        print "Audio written to %s" % audio_file
+        spectral_doppler.write_audio(audio_file, args.prf)
+        print "Audio written to %s (forward flow left, reverse flow right)" % audio_file
     
  
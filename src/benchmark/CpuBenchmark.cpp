@@ -0,0 +1,892 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <complex>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include <boost/program_options.hpp>
+#include "../core/LibBCSim.hpp"
+#include "../core/BeamConvolver.hpp"
+#include "../core/bspline.hpp"
+#include "../core/fft.hpp"
+#include "../core/algorithm/CpuAlgorithm.hpp"
+#include "../core/algorithm/common_utils.hpp"
+#include "../core/algorithm/PerfCounters.hpp"
+#include "../utils/BCSimConvenience.hpp"
+#include "../utils/GaussPulse.hpp"
+#include "../utils/DefaultPhantoms.hpp"
+#include "../utils/cartesianator/Cartesianator.hpp"
+
+/*
+ * Benchmarks of the CPU simulator hot paths.
+ *
+ * Micro-benchmarks time one stage in isolation on a single thread. Macro-
+ * benchmarks time complete frames on synthetic versions of DefaultPhantoms
+ * and the phantoms in phantom_scripts/, using all configured threads.
+ * The headline metric is nanoseconds per scatterer per line, which is
+ * reported for the projection loops and the full frames. Other stages are
+ * reported per sample, per pixel or per line.
+ */
+
+namespace po = boost::program_options;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<std::pair<std::string, std::string>> Params;
+typedef std::vector<std::pair<std::string, double>> Metrics;
+
+// Prevents the optimizer from removing the benchmarked work.
+volatile float g_sink = 0.0f;
+
+// What one iteration of a benchmark does.
+struct Workload {
+    std::function<void()>   run;
+    double                  work_units;     // work done by each call of run()
+    std::function<Metrics()> metrics;       // optional details about the last run
+};
+
+struct Benchmark {
+    std::string                 name;
+    std::string                 kind;       // "micro" or "macro"
+    Params                      params;
+    std::string                 unit;       // name of the work unit
+    std::function<Workload()>   prepare;    // creates data, called only if selected
+
+    std::string full_name() const {
+        std::string res = name;
+        for (const auto& p : params) {
+            res += "/" + p.first + "=" + p.second;
+        }
+        return res;
+    }
+};
+
+struct Result {
+    const Benchmark*    benchmark;
+    size_t              num_iterations;
+    double              min_ns;
+    double              median_ns;
+    double              mean_ns;
+    double              work_units;
+    Metrics             metrics;
+
+    double ns_per_unit() const {
+        return median_ns/work_units;
+    }
+};
+
+struct Options {
+    double      scale;
+    double      min_time;
+    int         min_repetitions;
+    int         num_threads;
+    int         num_lines;
+    bool        perf_counters;
+    std::string spatial_sort;
+};
+
+bcsim::ExcitationSignal make_excitation() {
+    bcsim::ExcitationSignal ex;
+    std::vector<float> times;
+    bcsim::MakeGaussianExcitation<float>(2.5e6f, 0.1f, 50e6f, times, ex.samples, ex.center_index);
+    ex.sampling_frequency = 50e6f;
+    ex.demod_freq = 2.5e6f;
+    return ex;
+}
+
+bcsim::ScanSequence::s_ptr make_sector_scan_sequence(int num_lines, float depth, float timestamp) {
+    auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+    geometry->width = 1.2f;
+    geometry->depth = depth;
+    geometry->tilt = 0.0f;
+    return std::make_shared<bcsim::ScanSequence>(bcsim::CreateScanSequence(geometry, num_lines, timestamp));
+}
+
+bcsim::ScanSequence::s_ptr make_linear_scan_sequence(int num_lines, float width, float range_max, float timestamp) {
+    auto geometry = std::make_shared<bcsim::LinearScanGeometry>();
+    geometry->width = width;
+    geometry->range_max = range_max;
+    return std::make_shared<bcsim::ScanSequence>(bcsim::CreateScanSequence(geometry, num_lines, timestamp));
+}
+
+size_t scaled(double num, const Options& opts) {
+    return std::max<size_t>(1, static_cast<size_t>(num*opts.scale));
+}
+
+// Uniformly random fixed scatterers in a box.
+bcsim::FixedScatterers::s_ptr make_box_scatterers(size_t num_scatterers, float half_width, float z_min, float z_max, std::mt19937& gen) {
+    std::uniform_real_distribution<float> xy_dist(-half_width, half_width);
+    std::uniform_real_distribution<float> z_dist(z_min, z_max);
+    std::uniform_real_distribution<float> amplitude_dist(-1.0f, 1.0f);
+    auto res = std::make_shared<bcsim::FixedScatterers>();
+    res->scatterers.resize(num_scatterers);
+    for (auto& s : res->scatterers) {
+        s.pos = bcsim::vector3(xy_dist(gen), xy_dist(gen), z_dist(gen));
+        s.amplitude = amplitude_dist(gen);
+    }
+    return res;
+}
+
+// Spline scatterers oscillating around random positions in a box.
+bcsim::SplineScatterers::s_ptr make_box_spline_scatterers(size_t num_scatterers, int spline_degree, int num_cs,
+                                                          float half_width, float z_min, float z_max, std::mt19937& gen) {
+    std::uniform_real_distribution<float> xy_dist(-half_width, half_width);
+    std::uniform_real_distribution<float> z_dist(z_min, z_max);
+    std::uniform_real_distribution<float> amplitude_dist(-1.0f, 1.0f);
+    auto res = std::make_shared<bcsim::SplineScatterers>();
+    res->spline_degree = spline_degree;
+    res->knot_vector = bspline_storve::uniform_regular_knot_vector(num_cs, spline_degree, 0.0f, 1.0f);
+    res->control_points.resize(num_scatterers*num_cs);
+    res->amplitudes.resize(num_scatterers);
+    for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+        const bcsim::vector3 p0(xy_dist(gen), xy_dist(gen), z_dist(gen));
+        for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+            const auto offset = 1e-3f*std::sin(6.2831853f*cs_no/num_cs);
+            res->control_points[scatterer_no*num_cs + cs_no] = p0 + bcsim::vector3(offset, 0.0f, 0.5f*offset);
+        }
+        res->amplitudes[scatterer_no] = amplitude_dist(gen);
+    }
+    return res;
+}
+
+// Gives access to the projection loops of the CPU algorithm.
+class ProjectionHarness : public bcsim::CpuAlgorithm {
+public:
+    // Project all scatterers of a collection onto all lines in the scan sequence.
+    template <typename ScatterersPtr>
+    void project_all_lines(ScatterersPtr scatterers, std::vector<std::complex<float>>& time_proj_signal) {
+        time_proj_signal.resize(m_rf_line_num_samples);
+        const auto num_lines = m_scan_sequence->get_num_lines();
+        for (int line_no = 0; line_no < num_lines; line_no++) {
+            std::fill(time_proj_signal.begin(), time_proj_signal.end(), std::complex<float>(0.0f, 0.0f));
+            projection_loop(scatterers, m_scan_sequence->get_scanline(line_no), time_proj_signal.data(), m_rf_line_num_samples);
+        }
+    }
+};
+
+std::shared_ptr<ProjectionHarness> make_projection_harness(int num_lines, bool phase_delay) {
+    auto harness = std::make_shared<ProjectionHarness>();
+    harness->set_parameter("num_cpu_cores", "1");
+    harness->set_parameter("phase_delay", phase_delay ? "on" : "off");
+    harness->set_excitation(make_excitation());
+    harness->set_scan_sequence(make_sector_scan_sequence(num_lines, 0.1f, 0.5f));
+    harness->set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 3e-3f));
+    return harness;
+}
+
+void add_micro_benchmarks(std::vector<Benchmark>& benchmarks, const Options& opts) {
+    const int num_projection_lines = 16;
+    for (double base_num : {1e5, 1e6}) {
+        for (bool phase_delay : {false, true}) {
+            const auto num_scatterers = scaled(base_num, opts);
+            Benchmark b;
+            b.name = "projection_fixed";
+            b.kind = "micro";
+            b.params = {{"num_scatterers", std::to_string(num_scatterers)}, {"phase_delay", phase_delay ? "on" : "off"}};
+            b.unit = "scatterer_per_line";
+            b.prepare = [=]() {
+                std::mt19937 gen(1);
+                auto scatterers = make_box_scatterers(num_scatterers, 0.04f, 0.0f, 0.1f, gen);
+                auto harness = make_projection_harness(num_projection_lines, phase_delay);
+                auto buffer = std::make_shared<std::vector<std::complex<float>>>();
+                Workload w;
+                w.run = [=]() {
+                    harness->project_all_lines(scatterers, *buffer);
+                    g_sink = g_sink + (*buffer)[buffer->size()/2].real();
+                };
+                w.work_units = static_cast<double>(num_scatterers)*num_projection_lines;
+                return w;
+            };
+            benchmarks.push_back(b);
+        }
+    }
+
+    for (double base_num : {1e5, 1e6}) {
+        for (int spline_degree : {1, 3}) {
+            const auto num_scatterers = scaled(base_num, opts);
+            const int num_cs = (spline_degree == 1) ? 2 : 10;
+            Benchmark b;
+            b.name = "projection_spline";
+            b.kind = "micro";
+            b.params = {{"num_scatterers", std::to_string(num_scatterers)}, {"spline_degree", std::to_string(spline_degree)},
+                        {"num_cs", std::to_string(num_cs)}};
+            b.unit = "scatterer_per_line";
+            b.prepare = [=]() {
+                std::mt19937 gen(2);
+                auto scatterers = make_box_spline_scatterers(num_scatterers, spline_degree, num_cs, 0.04f, 0.0f, 0.1f, gen);
+                auto harness = make_projection_harness(num_projection_lines, true);
+                auto buffer = std::make_shared<std::vector<std::complex<float>>>();
+                Workload w;
+                w.run = [=]() {
+                    harness->project_all_lines(scatterers, *buffer);
+                    g_sink = g_sink + (*buffer)[buffer->size()/2].real();
+                };
+                w.work_units = static_cast<double>(num_scatterers)*num_projection_lines;
+                return w;
+            };
+            benchmarks.push_back(b);
+        }
+    }
+
+    for (const std::string profile_type : {"gaussian", "lut"}) {
+        const auto num_points = scaled(1e6, opts);
+        Benchmark b;
+        b.name = "beam_profile";
+        b.kind = "micro";
+        b.params = {{"type", profile_type}, {"num_points", std::to_string(num_points)}};
+        b.unit = "sample";
+        b.prepare = [=]() {
+            bcsim::IBeamProfile::s_ptr profile;
+            if (profile_type == "gaussian") {
+                profile = std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 3e-3f);
+            } else {
+                const int num_rad = 64, num_lat = 32, num_ele = 32;
+                auto lut = std::make_shared<bcsim::LUTBeamProfile>(num_rad, num_lat, num_ele, bcsim::Interval(0.0f, 0.1f),
+                                                                   bcsim::Interval(-0.01f, 0.01f), bcsim::Interval(-0.01f, 0.01f));
+                for (int ir = 0; ir < num_rad; ir++) {
+                    for (int il = 0; il < num_lat; il++) {
+                        for (int ie = 0; ie < num_ele; ie++) {
+                            const float l = (il - 0.5f*num_lat)/num_lat;
+                            const float e = (ie - 0.5f*num_ele)/num_ele;
+                            lut->setDiscreteSample(ir, il, ie, std::exp(-8.0f*(l*l + e*e)));
+                        }
+                    }
+                }
+                profile = lut;
+            }
+            std::mt19937 gen(3);
+            std::uniform_real_distribution<float> r_dist(0.0f, 0.1f);
+            std::uniform_real_distribution<float> le_dist(-0.01f, 0.01f);
+            auto points = std::make_shared<std::vector<bcsim::vector3>>(num_points);
+            for (auto& p : *points) {
+                p = bcsim::vector3(r_dist(gen), le_dist(gen), le_dist(gen));
+            }
+            Workload w;
+            w.run = [=]() {
+                float sum = 0.0f;
+                for (const auto& p : *points) {
+                    sum += profile->sampleProfile(p.x, p.y, p.z);
+                }
+                g_sink = g_sink + sum;
+            };
+            w.work_units = static_cast<double>(num_points);
+            return w;
+        };
+        benchmarks.push_back(b);
+    }
+
+    for (size_t num_samples : {1000, 4000, 16000}) {
+        Benchmark b;
+        b.name = "beam_convolver";
+        b.kind = "micro";
+        b.params = {{"num_samples", std::to_string(num_samples)}};
+        b.unit = "sample";
+        b.prepare = [=]() {
+            std::shared_ptr<bcsim::IBeamConvolver> convolver(bcsim::IBeamConvolver::Create(num_samples, make_excitation()).release());
+            Workload w;
+            w.run = [=]() {
+                auto time_proj_signal = convolver->get_zeroed_time_proj_signal();
+                for (size_t i = 0; i < num_samples; i += 7) {
+                    time_proj_signal[i] = std::complex<float>(1.0f, 0.0f);
+                }
+                const auto res = convolver->process();
+                g_sink = g_sink + res[res.size()/2].real();
+            };
+            w.work_units = static_cast<double>(num_samples);
+            return w;
+        };
+        benchmarks.push_back(b);
+    }
+
+    for (size_t fft_length : {1024, 8192, 65536}) {
+        Benchmark b;
+        b.name = "fft";
+        b.kind = "micro";
+        b.params = {{"length", std::to_string(fft_length)}};
+        b.unit = "sample";
+        b.prepare = [=]() {
+            std::mt19937 gen(4);
+            std::normal_distribution<float> dist;
+            auto x = std::make_shared<std::vector<std::complex<float>>>(fft_length);
+            for (auto& v : *x) {
+                v = std::complex<float>(dist(gen), dist(gen));
+            }
+            Workload w;
+            w.run = [=]() {
+                const auto res = fft(*x);
+                g_sink = g_sink + res[1].real();
+            };
+            w.work_units = static_cast<double>(fft_length);
+            return w;
+        };
+        benchmarks.push_back(b);
+    }
+
+    for (size_t num_samples : {4000, 16000}) {
+        for (int radial_decimation : {1, 4}) {
+            Benchmark b;
+            b.name = "demodulation";
+            b.kind = "micro";
+            b.params = {{"num_samples", std::to_string(num_samples)}, {"radial_decimation", std::to_string(radial_decimation)}};
+            b.unit = "sample";
+            b.prepare = [=]() {
+                std::mt19937 gen(5);
+                std::normal_distribution<float> dist;
+                auto line = std::make_shared<std::vector<std::complex<float>>>(num_samples);
+                for (auto& v : *line) {
+                    v = std::complex<float>(dist(gen), dist(gen));
+                }
+                Workload w;
+                w.run = [=]() {
+                    const auto res = bcsim::demodulate_and_decimate(*line, 0.05f, radial_decimation);
+                    g_sink = g_sink + res.back().real();
+                };
+                w.work_units = static_cast<double>(num_samples);
+                return w;
+            };
+            benchmarks.push_back(b);
+        }
+    }
+
+    for (const std::string geometry_type : {"sector", "linear"}) {
+        const int num_beams = 128;
+        const int num_range = 1024;
+        const int output_size = 512;
+        Benchmark b;
+        b.name = "cartesianator";
+        b.kind = "micro";
+        b.params = {{"geometry", geometry_type}, {"num_beams", std::to_string(num_beams)}, {"num_range", std::to_string(num_range)},
+                    {"output_size", std::to_string(output_size)}};
+        b.unit = "pixel";
+        b.prepare = [=]() {
+            bcsim::ScanGeometry::ptr geometry;
+            if (geometry_type == "sector") {
+                auto sector = std::make_shared<bcsim::SectorScanGeometry>();
+                sector->width = 1.2f;
+                sector->depth = 0.1f;
+                sector->tilt = 0.0f;
+                geometry = sector;
+            } else {
+                auto linear = std::make_shared<bcsim::LinearScanGeometry>();
+                linear->width = 0.04f;
+                linear->range_max = 0.05f;
+                geometry = linear;
+            }
+            auto cartesianator = std::make_shared<CpuCartesianator<unsigned char>>();
+            cartesianator->SetGeometry(geometry);
+            cartesianator->SetOutputSize(output_size, output_size);
+            auto beam_space = std::make_shared<std::vector<unsigned char>>(num_beams*num_range);
+            for (size_t i = 0; i < beam_space->size(); i++) {
+                (*beam_space)[i] = static_cast<unsigned char>((i*31) % 251);
+            }
+            Workload w;
+            w.run = [=]() {
+                cartesianator->Process(beam_space->data(), num_beams, num_range);
+                g_sink = g_sink + cartesianator->GetOutputBuffer()[output_size*output_size/2];
+            };
+            w.work_units = static_cast<double>(output_size)*output_size;
+            return w;
+        };
+        benchmarks.push_back(b);
+    }
+
+    for (const std::string method : {"fused_iq", "envelope_frame"}) {
+        const int num_lines = 256;
+        const int num_samples = 2048;
+        Benchmark b;
+        b.name = "log_compression";
+        b.kind = "micro";
+        b.params = {{"method", method}, {"num_lines", std::to_string(num_lines)}, {"num_samples", std::to_string(num_samples)}};
+        b.unit = "sample";
+        b.prepare = [=]() {
+            std::mt19937 gen(6);
+            std::normal_distribution<float> dist;
+            auto iq_samples = std::make_shared<std::vector<std::complex<float>>>(num_lines*num_samples);
+            for (auto& v : *iq_samples) {
+                v = std::complex<float>(dist(gen), dist(gen));
+            }
+            auto pixels = std::make_shared<std::vector<unsigned char>>(iq_samples->size());
+            Workload w;
+            if (method == "fused_iq") {
+                w.run = [=]() {
+                    bcsim::log_compress_iq_frame(iq_samples->data(), iq_samples->size(), pixels->data(), 60.0f, 0.0f, 1.0f);
+                    g_sink = g_sink + (*pixels)[pixels->size()/2];
+                };
+            } else {
+                w.run = [=]() {
+                    std::vector<std::vector<float>> env_lines(num_lines, std::vector<float>(num_samples));
+                    for (int line_no = 0; line_no < num_lines; line_no++) {
+                        for (int i = 0; i < num_samples; i++) {
+                            env_lines[line_no][i] = std::abs((*iq_samples)[line_no*num_samples + i]);
+                        }
+                    }
+                    bcsim::log_compress_frame(env_lines, 60.0f, bcsim::get_max_value(env_lines), 1.0f);
+                    g_sink = g_sink + env_lines[num_lines/2][num_samples/2];
+                };
+            }
+            w.work_units = static_cast<double>(num_lines)*num_samples;
+            return w;
+        };
+        benchmarks.push_back(b);
+    }
+}
+
+// Synthetic phantoms with the default parameters of the generator scripts,
+// with the number of scatterers multiplied by the scale option.
+struct Phantom {
+    std::vector<bcsim::FixedScatterers::s_ptr>  fixed;
+    std::vector<bcsim::SplineScatterers::s_ptr> spline;
+    bcsim::ScanSequence::s_ptr                  scan_sequence;
+};
+
+// phantom_scripts/cyst_phantom_2d.py
+Phantom make_cyst_phantom(const Options& opts) {
+    const float x_min = -34.5e-3f, x_max = 34.5e-3f, z_min = 20e-3f, z_max = 90e-3f;
+    const float density = 500.0f;
+    const float cyst_scale = 0.3f;
+    const auto num_scatterers = scaled(density*(x_max-x_min)*(z_max-z_min)*1e6, opts);
+    std::mt19937 gen(10);
+    std::uniform_real_distribution<float> x_dist(x_min, x_max);
+    std::uniform_real_distribution<float> z_dist(z_min, z_max);
+    std::uniform_real_distribution<float> amplitude_dist(-1.0f, 1.0f);
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    scatterers->scatterers.resize(num_scatterers);
+    for (auto& s : scatterers->scatterers) {
+        s.pos = bcsim::vector3(x_dist(gen), 0.0f, z_dist(gen));
+        s.amplitude = amplitude_dist(gen);
+        const float cysts[3][2] = {{40e-3f, 10e-3f}, {60e-3f, 5e-3f}, {80e-3f, 2.5e-3f}};
+        for (const auto& cyst : cysts) {
+            const auto dz = s.pos.z - cyst[0];
+            if (s.pos.x*s.pos.x + dz*dz <= cyst[1]*cyst[1]) {
+                s.amplitude *= cyst_scale;
+            }
+        }
+        if (std::abs(s.pos.x) > 10e-3f) {
+            s.amplitude *= cyst_scale;
+        }
+    }
+    Phantom phantom;
+    phantom.fixed.push_back(scatterers);
+    phantom.scan_sequence = make_sector_scan_sequence(opts.num_lines, 0.1f, 0.0f);
+    return phantom;
+}
+
+// phantom_scripts/tissue_with_flow.py
+Phantom make_tissue_with_flow_phantom(const Options& opts) {
+    const float box_dim = 0.03f, radius = 0.008f, tissue_length = 8e-2f;
+    const float flow_ampl_factor = 0.3f, peak_velocity = 15e-2f, end_time = 1.0f;
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> amplitude_dist(-1.0f, 1.0f);
+
+    auto tissue = std::make_shared<bcsim::FixedScatterers>();
+    {
+        std::uniform_real_distribution<float> x_dist(-0.5f*tissue_length, 0.5f*tissue_length);
+        std::uniform_real_distribution<float> y_dist(-0.5f*box_dim, 0.5f*box_dim);
+        std::uniform_real_distribution<float> z_dist(0.0f, box_dim);
+        std::vector<bcsim::PointScatterer> kept;
+        const auto num_scatterers = scaled(1e6, opts);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            bcsim::PointScatterer s;
+            s.pos = bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen));
+            s.amplitude = amplitude_dist(gen);
+            const auto dz = s.pos.z - 0.5f*box_dim;
+            if (dz*dz + s.pos.y*s.pos.y >= radius*radius) {
+                kept.push_back(s);
+            }
+        }
+        tissue->scatterers = kept;
+    }
+
+    // Degree-1 splines moving with a parabolic velocity profile.
+    auto flow = std::make_shared<bcsim::SplineScatterers>();
+    {
+        flow->spline_degree = 1;
+        flow->knot_vector = {-1.0f, 0.0f, end_time, end_time + 1.0f};
+        std::uniform_real_distribution<float> yz_dist(-radius, radius);
+        std::uniform_real_distribution<float> x_dist(-0.5f*tissue_length - peak_velocity*end_time, 0.5f*tissue_length);
+        std::vector<bcsim::vector3> control_points;
+        std::vector<float> amplitudes;
+        const auto num_scatterers = scaled(1e6, opts);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            const auto y = yz_dist(gen);
+            const auto z = yz_dist(gen);
+            const auto x = x_dist(gen);
+            const auto r = std::sqrt(y*y + z*z);
+            const auto velocity = peak_velocity*(1.0f - (r/radius)*(r/radius));
+            const auto end_x = x + end_time*velocity;
+            if ((r > radius) || (end_x < -0.5f*tissue_length)) {
+                continue;
+            }
+            control_points.push_back(bcsim::vector3(x, y, z + 0.5f*box_dim));
+            control_points.push_back(bcsim::vector3(end_x, y, z + 0.5f*box_dim));
+            amplitudes.push_back(flow_ampl_factor*amplitude_dist(gen));
+        }
+        flow->control_points = control_points;
+        flow->amplitudes = amplitudes;
+    }
+
+    Phantom phantom;
+    phantom.fixed.push_back(tissue);
+    phantom.spline.push_back(flow);
+    phantom.scan_sequence = make_linear_scan_sequence(opts.num_lines, 0.04f, 0.03f, 0.5f);
+    return phantom;
+}
+
+// phantom_scripts/rotating_cube.py
+Phantom make_rotating_cube_phantom(const Options& opts) {
+    const float half_width = 0.03f, z0 = 0.06f;
+    const int num_cs = 20, spline_degree = 3;
+    const float angular_velocity[3] = {3.14f, 1.0f, 0.4f};
+    const auto num_scatterers = scaled(1e5, opts);
+    std::mt19937 gen(12);
+    std::uniform_real_distribution<float> pos_dist(-half_width, half_width);
+    std::uniform_real_distribution<float> amplitude_dist(-1.0f, 1.0f);
+
+    auto scatterers = std::make_shared<bcsim::SplineScatterers>();
+    scatterers->spline_degree = spline_degree;
+    scatterers->knot_vector = bspline_storve::uniform_regular_knot_vector(num_cs, spline_degree, 0.0f, 1.0f);
+    const auto cs_times = bspline_storve::control_points(spline_degree, scatterers->knot_vector);
+    scatterers->control_points.resize(num_scatterers*num_cs);
+    scatterers->amplitudes.resize(num_scatterers);
+    for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+        const bcsim::vector3 p0(pos_dist(gen), pos_dist(gen), pos_dist(gen));
+        for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+            // Rotate around x, y and z in turn with the angles reached at the knot average.
+            const auto t = cs_times[cs_no];
+            auto p = p0;
+            const float ax = angular_velocity[0]*t, ay = angular_velocity[1]*t, az = angular_velocity[2]*t;
+            p = bcsim::vector3(p.x, std::cos(ax)*p.y - std::sin(ax)*p.z, std::sin(ax)*p.y + std::cos(ax)*p.z);
+            p = bcsim::vector3(std::cos(ay)*p.x + std::sin(ay)*p.z, p.y, -std::sin(ay)*p.x + std::cos(ay)*p.z);
+            p = bcsim::vector3(std::cos(az)*p.x - std::sin(az)*p.y, std::sin(az)*p.x + std::cos(az)*p.y, p.z);
+            scatterers->control_points[scatterer_no*num_cs + cs_no] = p + bcsim::vector3(0.0f, 0.0f, z0);
+        }
+        scatterers->amplitudes[scatterer_no] = amplitude_dist(gen);
+    }
+
+    Phantom phantom;
+    phantom.spline.push_back(scatterers);
+    phantom.scan_sequence = make_sector_scan_sequence(opts.num_lines, 0.1f, 0.5f);
+    return phantom;
+}
+
+// DefaultPhantoms: the LV phantom of the GUI, with a synthetic contraction signal.
+Phantom make_left_ventricle_phantom(const Options& opts) {
+    default_phantoms::LeftVentriclePhantomParameters params;
+    params.num_scatterers = scaled(static_cast<double>(params.num_scatterers), opts);
+    std::stringstream csv_stream;
+    csv_stream << "times;factors\n";
+    const int num_samples = 100;
+    for (int i = 0; i < num_samples; i++) {
+        const auto t = static_cast<float>(i)/(num_samples-1);
+        csv_stream << t << ";" << 1.0f - 0.5f*std::sin(3.1415927f*t) << "\n";
+    }
+    default_phantoms::LeftVentricle3dPhantomFactory factory(params, csv_stream);
+    Phantom phantom;
+    phantom.spline.push_back(bcsim::SplineScatterers::s_ptr(factory.get()));
+    phantom.scan_sequence = make_sector_scan_sequence(opts.num_lines, 0.1f, 0.5f);
+    return phantom;
+}
+
+void add_macro_benchmarks(std::vector<Benchmark>& benchmarks, const Options& opts) {
+    const std::vector<std::pair<std::string, std::function<Phantom(const Options&)>>> phantoms = {
+        {"cyst_phantom_2d",     make_cyst_phantom},
+        {"tissue_with_flow",    make_tissue_with_flow_phantom},
+        {"rotating_cube",       make_rotating_cube_phantom},
+        {"left_ventricle",      make_left_ventricle_phantom},
+    };
+    for (const auto& phantom_entry : phantoms) {
+        Benchmark b;
+        b.name = "frame";
+        b.kind = "macro";
+        b.params = {{"phantom", phantom_entry.first}, {"num_lines", std::to_string(opts.num_lines)}};
+        b.unit = "scatterer_per_line";
+        const auto make_phantom = phantom_entry.second;
+        b.prepare = [=]() {
+            const auto phantom = make_phantom(opts);
+            auto sim = bcsim::Create("cpu");
+            sim->set_parameter("num_cpu_cores", std::to_string(opts.num_threads));
+            sim->set_parameter("phase_delay", "on");
+            sim->set_parameter("radial_decimation", "4");
+            sim->set_parameter("perf_counters", opts.perf_counters ? "on" : "off");
+            sim->set_parameter("spatial_sort", opts.spatial_sort);
+            for (const auto& scatterers : phantom.fixed) {
+                sim->add_fixed_scatterers(scatterers);
+            }
+            for (const auto& scatterers : phantom.spline) {
+                sim->add_spline_scatterers(scatterers);
+            }
+            sim->set_excitation(make_excitation());
+            sim->set_scan_sequence(phantom.scan_sequence);
+            sim->set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 3e-3f));
+            auto rf_lines = std::make_shared<std::vector<std::vector<std::complex<float>>>>();
+            Workload w;
+            w.run = [=]() {
+                sim->simulate_lines(*rf_lines);
+                g_sink = g_sink + (*rf_lines)[0][0].real();
+            };
+            w.work_units = static_cast<double>(sim->get_total_num_scatterers())*phantom.scan_sequence->get_num_lines();
+            w.metrics = [=]() {
+                // Stage breakdown of the last frame (summed over threads), if recorded.
+                Metrics res;
+                for (const std::string key : {"cpu_frame_ns", "cpu_projection_ns", "cpu_noise_ns", "cpu_fft_ns", "cpu_demodulation_ns",
+                                              "cpu_scatterers_visited", "cpu_scatterers_contributing", "perf_memory_bandwidth"}) {
+                    try {
+                        res.emplace_back(key, sim->get_debug_data(key).at(0));
+                    } catch (std::exception&) {
+                    }
+                }
+                // Hardware counters summed over threads, if enabled and available.
+                for (const std::string stage : {"projection", "convolution"}) {
+                    std::vector<std::string> keys = {"perf_" + stage + "_ipc"};
+                    for (int i = 0; i < bcsim::PerfCounterGroup::NUM_COUNTERS; i++) {
+                        const auto counter = bcsim::PerfCounterGroup::get_counter_name(static_cast<bcsim::PerfCounterGroup::Counter>(i));
+                        keys.push_back("perf_" + stage + "_" + counter + "_per_scatterer_line");
+                    }
+                    for (const auto& key : keys) {
+                        try {
+                            res.emplace_back(key, sim->get_debug_data(key).at(0));
+                        } catch (std::exception&) {
+                        }
+                    }
+                }
+                return res;
+            };
+            return w;
+        };
+        benchmarks.push_back(b);
+    }
+}
+
+// Collects the hardware counters of the calling thread during each run
+// and reports them per work unit. Only suitable for single-threaded workloads.
+Workload with_perf_counters(Workload workload, const std::string& unit) {
+    auto counts = std::make_shared<bcsim::PerfCounterGroup::Values>();
+    const auto run = workload.run;
+    const auto metrics = workload.metrics;
+    const auto work_units = workload.work_units;
+    workload.run = [=]() {
+        counts->fill(0);
+        bcsim::ScopedPerfCounters perf_counters(counts.get());
+        run();
+    };
+    workload.metrics = [=]() {
+        Metrics res = metrics ? metrics() : Metrics();
+        for (int i = 0; i < bcsim::PerfCounterGroup::NUM_COUNTERS; i++) {
+            const auto counter = bcsim::PerfCounterGroup::get_counter_name(static_cast<bcsim::PerfCounterGroup::Counter>(i));
+            if ((*counts)[i] >= 0) {
+                res.emplace_back(std::string(counter) + "_per_" + unit, (*counts)[i]/work_units);
+            }
+        }
+        const auto cycles = (*counts)[bcsim::PerfCounterGroup::CYCLES];
+        const auto instructions = (*counts)[bcsim::PerfCounterGroup::INSTRUCTIONS];
+        if ((cycles > 0) && (instructions >= 0)) {
+            res.emplace_back("ipc", static_cast<double>(instructions)/cycles);
+        }
+        return res;
+    };
+    return workload;
+}
+
+Result run_benchmark(const Benchmark& b, const Options& opts) {
+    auto workload = b.prepare();
+    if (opts.perf_counters && (b.kind == "micro")) {
+        workload = with_perf_counters(workload, b.unit);
+    }
+    workload.run(); // warm-up
+
+    std::vector<double> durations;
+    double total_sec = 0.0;
+    while ((total_sec < opts.min_time) || (static_cast<int>(durations.size()) < opts.min_repetitions)) {
+        const auto start = Clock::now();
+        workload.run();
+        const auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        durations.push_back(1e9*elapsed);
+        total_sec += elapsed;
+    }
+    std::sort(durations.begin(), durations.end());
+
+    Result res;
+    res.benchmark = &b;
+    res.num_iterations = durations.size();
+    res.min_ns = durations.front();
+    res.median_ns = durations[durations.size()/2];
+    res.mean_ns = std::accumulate(durations.begin(), durations.end(), 0.0)/durations.size();
+    res.work_units = workload.work_units;
+    if (workload.metrics) {
+        res.metrics = workload.metrics();
+    }
+    return res;
+}
+
+std::string json_string(const std::string& s) {
+    std::string res = "\"";
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+        }
+        res += c;
+    }
+    return res + "\"";
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results, const Options& opts) {
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"benchmark\": \"BCSimCpuBenchmark\",\n";
+    out << "  \"context\": {\"num_threads\": " << opts.num_threads << ", \"scale\": " << opts.scale
+        << ", \"min_time\": " << opts.min_time << ", \"min_repetitions\": " << opts.min_repetitions
+        << ", \"spatial_sort\": \"" << opts.spatial_sort << "\"},\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        const auto& b = *r.benchmark;
+        out << "    {\"name\": " << json_string(b.full_name()) << ", \"benchmark\": " << json_string(b.name)
+            << ", \"kind\": " << json_string(b.kind) << ", \"params\": {";
+        for (size_t j = 0; j < b.params.size(); j++) {
+            out << (j > 0 ? ", " : "") << json_string(b.params[j].first) << ": " << json_string(b.params[j].second);
+        }
+        out << "}, \"iterations\": " << r.num_iterations
+            << ", \"min_ns\": " << r.min_ns << ", \"median_ns\": " << r.median_ns << ", \"mean_ns\": " << r.mean_ns
+            << ", \"work_units\": " << r.work_units << ", \"unit\": " << json_string(b.unit)
+            << ", \"ns_per_" << b.unit << "\": " << r.ns_per_unit();
+        for (const auto& metric : r.metrics) {
+            out << ", " << json_string(metric.first) << ": " << metric.second;
+        }
+        out << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+int run(int argc, char** argv) {
+#ifdef BCSIM_ENABLE_OPENMP
+    const int max_threads = omp_get_max_threads();
+#else
+    const int max_threads = 1;
+#endif
+    Options opts;
+    std::string output_file;
+    std::string filter;
+    std::string kind;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("list", "list the benchmarks and exit")
+        ("output", po::value<std::string>(&output_file)->default_value("-"), "JSON output file (\"-\" for standard output)")
+        ("filter", po::value<std::string>(&filter)->default_value(""), "only run benchmarks whose name contains this string")
+        ("kind", po::value<std::string>(&kind)->default_value("all"), "\"micro\", \"macro\" or \"all\"")
+        ("scale", po::value<double>(&opts.scale)->default_value(0.1), "scale factor for the number of scatterers (1 gives phantom script defaults)")
+        ("min_time", po::value<double>(&opts.min_time)->default_value(0.5), "minimum time to run each benchmark [s]")
+        ("min_repetitions", po::value<int>(&opts.min_repetitions)->default_value(3), "minimum number of timed iterations")
+        ("num_cpu_cores", po::value<int>(&opts.num_threads)->default_value(max_threads), "number of threads in the macro-benchmarks")
+        ("num_lines", po::value<int>(&opts.num_lines)->default_value(128), "number of lines in the macro-benchmarks")
+        ("spatial_sort", po::value<std::string>(&opts.spatial_sort)->default_value("none"), "sort the scatterers in the macro-benchmarks: \"none\", \"morton\" or \"hilbert\"")
+        ("perf_counters", "report cache misses, instructions and cycles from hardware counters (Linux only)")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    po::notify(var_map);
+    if (var_map.count("help") != 0) {
+        std::cout << "Usage: BCSimCpuBenchmark [options]\n" << desc << std::endl;
+        return 0;
+    }
+    opts.perf_counters = (var_map.count("perf_counters") != 0);
+    if (opts.perf_counters && (bcsim::PerfCounterGroup::for_current_thread().get_num_available() == 0)) {
+        std::cerr << "Warning: hardware performance counters are not available, only timings will be reported." << std::endl;
+    }
+    if ((opts.scale <= 0.0) || (opts.min_repetitions < 1) || (opts.num_threads < 1) || (opts.num_lines < 1)
+        || ((opts.spatial_sort != "none") && (opts.spatial_sort != "morton") && (opts.spatial_sort != "hilbert"))) {
+        throw std::runtime_error("invalid option value");
+    }
+
+    std::vector<Benchmark> benchmarks;
+    if (kind == "micro" || kind == "all") {
+        add_micro_benchmarks(benchmarks, opts);
+    }
+    if (kind == "macro" || kind == "all") {
+        add_macro_benchmarks(benchmarks, opts);
+    }
+    benchmarks.erase(std::remove_if(benchmarks.begin(), benchmarks.end(), [&](const Benchmark& b) {
+        return b.full_name().find(filter) == std::string::npos;
+    }), benchmarks.end());
+
+    if (var_map.count("list") != 0) {
+        for (const auto& b : benchmarks) {
+            std::cout << b.full_name() << std::endl;
+        }
+        return 0;
+    }
+
+    // The progress log goes to stderr if the JSON goes to stdout.
+    auto& log = (output_file == "-") ? std::cerr : std::cout;
+    std::vector<Result> results;
+    for (const auto& b : benchmarks) {
+        log << std::left << std::setw(72) << b.full_name() << std::flush;
+        results.push_back(run_benchmark(b, opts));
+        log << std::right << std::setw(12) << std::setprecision(4) << results.back().ns_per_unit() << " ns/" << b.unit << std::endl;
+    }
+
+    if (output_file == "-") {
+        write_json(std::cout, results, opts);
+    } else {
+        std::ofstream out(output_file);
+        if (!out) {
+            throw std::runtime_error("unable to open " + output_file);
+        }
+        write_json(out, results, opts);
+        log << "Results written to " << output_file << std::endl;
+    }
+    return 0;
+}
+
+}   // end anonymous namespace
+
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
+    } catch (std::exception& e) {
+        std::cout << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
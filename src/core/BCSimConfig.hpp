@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include "export_macros.hpp"
 #include "vector3.hpp"
+#include "ScattererArray.hpp"
 
 #ifdef __GNUC__
 #if (__GNUC__ <= 4) && (__GNUC__MINOR <= 8)
@@ -117,7 +118,7 @@ struct FixedScatterers : public Scatterers {
         return static_cast<int>( scatterers.size() );
     }
 
-    std::vector<PointScatterer> scatterers;
+    ScattererArray<PointScatterer> scatterers;
 };
 
 // Scatterers follow trajectory described by splines.
@@ -128,8 +129,7 @@ struct SplineScatterers : public Scatterers {
     typedef std::shared_ptr<SplineScatterers> s_ptr;
 
     virtual int num_scatterers() const {
-        // assert(control_points.size() == amplitudes.size());
-        return static_cast<int>(control_points.size());
+        return static_cast<int>(amplitudes.size());
     }
 
     // Returns the number of control points for each spline
@@ -138,7 +138,12 @@ struct SplineScatterers : public Scatterers {
         if (num_scatterers() == 0) {
             throw std::runtime_error("No scatterers in dataset");
         }
-        return control_points[0].size();
+        return control_points.size() / amplitudes.size();
+    }
+
+    // Returns pointer to the first control point of a scatterer.
+    const vector3* get_control_points(size_t scatterer_no) const {
+        return control_points.data() + scatterer_no*get_num_control_points();
     }
 
     // returns the start time
@@ -158,10 +163,13 @@ struct SplineScatterers : public Scatterers {
     int                         spline_degree;
     std::vector<float>          knot_vector;
     
-    // For each scatterer: list of control points in space and a scalar amplitude
-    // Indexed by scatterer no.
-    std::vector<std::vector<vector3>> control_points;
-    std::vector<float>                amplitudes;
+    // For each scatterer: list of control points in space and a scalar amplitude.
+    // The control points are stored contiguously, scatterer by scatterer, so that
+    // control point cs_no of scatterer scatterer_no is at index
+    // scatterer_no*get_num_control_points() + cs_no. This is the same layout as
+    // the [num_scatterers, num_cs, 3] "control_points" dataset in HDF5 files.
+    ScattererArray<vector3>     control_points;
+    ScattererArray<float>       amplitudes;
 };
 
 
@@ -27,6 +27,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include "BeamProfile.hpp"
 
 namespace bcsim {
@@ -136,5 +137,16 @@ void LUTBeamProfile::setDiscreteSample(int ir, int il, int ie, float new_sample)
     m_samples[getIndex(ir, il, ie)] = new_sample;
 }
 
+void LUTBeamProfile::setSamples(const float* samples) {
+    std::copy(samples, samples + m_samples.size(), m_samples.begin());
+}
+
+float LUTBeamProfile::getDiscreteSample(int ir, int il, int ie) const {
+    if (ir < 0 || ir >= m_num_samples_rad) return 0.0f;
+    if (il < 0 || il >= m_num_samples_lat) return 0.0f;
+    if (ie < 0 || ie >= m_num_samples_ele) return 0.0f;
+    return m_samples[getIndex(ir, il, ie)];
+}
+
 }   // namespace
 
@@ -97,6 +97,12 @@ public:
     // Set sample based on discrete indices.
     void setDiscreteSample(int ir, int il, int ie, float new_sample);
 
+    // Get sample based on discrete indices (zero if outside).
+    float getDiscreteSample(int ir, int il, int ie) const;
+
+    // Set all samples from a row-major [radial, lateral, elevational] array.
+    void setSamples(const float* samples);
+
     Interval getRangeRange() const {
         return m_range_range;
     }
@@ -124,7 +130,7 @@ public:
 protected:
     // row-major indexing
     // dim0: radial, dim1: lateral, dim2: elevational
-    long getIndex(int r, int l, int e) {
+    long getIndex(int r, int l, int e) const {
         return e+m_num_samples_ele*l+m_num_samples_lat*m_num_samples_ele*r;
     }
 
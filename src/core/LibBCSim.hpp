@@ -31,10 +31,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <vector>
 #include <complex>
+#include <functional>
 #include "export_macros.hpp"
 #include "BCSimConfig.hpp"
 #include "ScanSequence.hpp"
 #include "BeamProfile.hpp"
+#include "ProceduralScatterers.hpp"
 
 namespace bcsim {
 
@@ -43,6 +45,19 @@ class IAlgorithm {
 public:
     typedef std::shared_ptr<IAlgorithm> s_ptr;
     typedef std::unique_ptr<IAlgorithm> u_ptr;
+
+    // Receives the intermediate frames of a progressive simulation. Arguments are
+    // the number of passes done, the total number of passes and the frame.
+    // Return false to stop refining, in which case simulate_lines() returns the
+    // frame that was just published.
+    typedef std::function<bool (int, int, const std::vector<std::vector<std::complex<float>>>&)> IntermediateFrameCallback;
+
+    // Receives the number of RF lines simulated so far in the current call to
+    // simulate_lines(), counting every pass of a progressive simulation. It is
+    // called from all simulating threads and must be thread-safe. Return false
+    // to cancel, in which case simulate_lines() returns without simulating the
+    // remaining lines and the output is incomplete.
+    typedef std::function<bool (int)> LineCallback;
     
     virtual ~IAlgorithm() { }
 
@@ -55,15 +70,23 @@ public:
     // Clear all fixed point scatterers.
     virtual void clear_fixed_scatterers()                                               = 0;
 
-    // Add a new set of fixed point scatterers.
+    // Add a new set of fixed point scatterers. Positions must not be changed
+    // afterwards, since the set may be copied or bounded when it is added.
     virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                           = 0;
 
     // Clear all spline scatterers.
     virtual void clear_spline_scatterers()                                              = 0;
 
-    // Add a new set of spline point scatterers.
+    // Add a new set of spline point scatterers. As for fixed scatterers, the
+    // control points must not be changed afterwards.
     virtual void add_spline_scatterers(SplineScatterers::s_ptr)                         = 0;
 
+    // Clear all procedural scatterers.
+    virtual void clear_procedural_scatterers()                                          = 0;
+
+    // Add a region of scatterers that are generated when simulating.
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                 = 0;
+
     // Set scan sequence to use when simulating all RF lines.
     virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)               = 0;
 
@@ -88,6 +111,14 @@ public:
 
     // Set log object to use (optional)
     virtual void set_logger(ILog::ptr log_object) = 0;
+
+    // Set function to call after each pass but the last when simulating
+    // progressively (optional). Pass an empty function to disable.
+    virtual void set_intermediate_frame_callback(IntermediateFrameCallback callback) = 0;
+
+    // Set function to call after each simulated RF line (optional). Pass an
+    // empty function to disable. The GPU algorithms never call it.
+    virtual void set_line_callback(LineCallback callback) = 0;
 };
 
 // Factory function for creating simulator instances.
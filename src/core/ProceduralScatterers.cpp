@@ -0,0 +1,316 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "ProceduralScatterers.hpp"
+
+namespace bcsim {
+
+namespace {
+
+// The splitmix64 finalizer.
+inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Small counter-based generator, cheap enough to create one per cell.
+class CellRandom {
+public:
+    explicit CellRandom(uint64_t seed) : m_state(seed) { }
+
+    // Uniform in [0, 1).
+    double uniform() {
+        m_state += 0x9e3779b97f4a7c15ull;
+        return (mix64(m_state) >> 11)*(1.0/9007199254740992.0);
+    }
+
+    double normal() {
+        const auto u1 = 1.0 - uniform();
+        const auto u2 = uniform();
+        return std::sqrt(-2.0*std::log(u1))*std::cos(6.283185307179586*u2);
+    }
+
+    // Multiplication method for small means, normal approximation otherwise.
+    int poisson(double mean) {
+        if (mean <= 0.0) {
+            return 0;
+        } else if (mean < 30.0) {
+            const auto limit = std::exp(-mean);
+            int k = 0;
+            for (double p = uniform(); p > limit; p *= uniform()) {
+                k++;
+            }
+            return k;
+        } else {
+            return static_cast<int>(std::max(0.0, std::floor(mean + std::sqrt(mean)*normal() + 0.5)));
+        }
+    }
+
+private:
+    uint64_t m_state;
+};
+
+}   // end anonymous namespace
+
+ProceduralScatterers::ProceduralScatterers(const vector3& box_min, const vector3& box_max, float cell_size, uint32_t seed)
+    : m_box_min(box_min),
+      m_box_max(box_max),
+      m_cell_size(cell_size),
+      m_seed(seed),
+      m_expected_num_scatterers(0.0) {
+    if (!(cell_size > 0.0f)) {
+        throw std::runtime_error("cell size must be positive");
+    }
+    const float extents[3] = {box_max.x - box_min.x, box_max.y - box_min.y, box_max.z - box_min.z};
+    for (int k = 0; k < 3; k++) {
+        if (!(extents[k] > 0.0f)) {
+            throw std::runtime_error("procedural scatterer box is empty");
+        }
+        const auto num_cells = std::ceil(extents[k]/cell_size);
+        if (num_cells > (1 << 20)) {
+            throw std::runtime_error("too many procedural scatterer cells");
+        }
+        m_num_cells[k] = static_cast<int>(num_cells);
+    }
+    set_density(0.0f);
+    set_amplitude(1.0f);
+}
+
+float ProceduralScatterers::FieldSource::evaluate(const ProceduralScatterers& owner, const vector3& pos) const {
+    if (function) {
+        return function(pos);
+    } else if (!samples.empty()) {
+        const float rel[3] = {(pos.x - owner.m_box_min.x)/(owner.m_box_max.x - owner.m_box_min.x),
+                              (pos.y - owner.m_box_min.y)/(owner.m_box_max.y - owner.m_box_min.y),
+                              (pos.z - owner.m_box_min.z)/(owner.m_box_max.z - owner.m_box_min.z)};
+        int inds[3];
+        for (int k = 0; k < 3; k++) {
+            inds[k] = std::min(std::max(static_cast<int>(rel[k]*num_samples[k]), 0), num_samples[k] - 1);
+        }
+        return samples[(static_cast<size_t>(inds[0])*num_samples[1] + inds[1])*num_samples[2] + inds[2]];
+    } else {
+        return constant;
+    }
+}
+
+void ProceduralScatterers::set_voxels(FieldSource& field, int num_x, int num_y, int num_z, const std::vector<float>& samples) {
+    if ((num_x <= 0) || (num_y <= 0) || (num_z <= 0)) {
+        throw std::runtime_error("invalid voxel field dimensions");
+    }
+    if (samples.size() != static_cast<size_t>(num_x)*num_y*num_z) {
+        throw std::runtime_error("voxel field size does not match dimensions");
+    }
+    field.function = Field();
+    field.num_samples[0] = num_x;
+    field.num_samples[1] = num_y;
+    field.num_samples[2] = num_z;
+    field.samples = samples;
+}
+
+void ProceduralScatterers::set_density(float density) {
+    m_density.constant = density;
+    m_density.function = Field();
+    m_density.samples.clear();
+    update_expected_num_scatterers();
+}
+
+void ProceduralScatterers::set_density(Field density) {
+    m_density.function = density;
+    m_density.samples.clear();
+    update_expected_num_scatterers();
+}
+
+void ProceduralScatterers::set_density(int num_x, int num_y, int num_z, const std::vector<float>& samples) {
+    set_voxels(m_density, num_x, num_y, num_z, samples);
+    update_expected_num_scatterers();
+}
+
+void ProceduralScatterers::set_amplitude(float amplitude) {
+    m_amplitude.constant = amplitude;
+    m_amplitude.function = Field();
+    m_amplitude.samples.clear();
+}
+
+void ProceduralScatterers::set_amplitude(Field amplitude) {
+    m_amplitude.function = amplitude;
+    m_amplitude.samples.clear();
+}
+
+void ProceduralScatterers::set_amplitude(int num_x, int num_y, int num_z, const std::vector<float>& samples) {
+    set_voxels(m_amplitude, num_x, num_y, num_z, samples);
+}
+
+void ProceduralScatterers::update_expected_num_scatterers() {
+    const double box_volume = static_cast<double>(m_box_max.x - m_box_min.x)*(m_box_max.y - m_box_min.y)*(m_box_max.z - m_box_min.z);
+    if (m_density.function) {
+        // Midpoint rule on a grid of at most 64^3 points.
+        int num_points[3];
+        for (int k = 0; k < 3; k++) {
+            num_points[k] = std::min(m_num_cells[k], 64);
+        }
+        double sum = 0.0;
+        for (int ix = 0; ix < num_points[0]; ix++) {
+            for (int iy = 0; iy < num_points[1]; iy++) {
+                for (int iz = 0; iz < num_points[2]; iz++) {
+                    const vector3 pos(m_box_min.x + (m_box_max.x - m_box_min.x)*(ix + 0.5f)/num_points[0],
+                                      m_box_min.y + (m_box_max.y - m_box_min.y)*(iy + 0.5f)/num_points[1],
+                                      m_box_min.z + (m_box_max.z - m_box_min.z)*(iz + 0.5f)/num_points[2]);
+                    sum += std::max(0.0f, m_density.function(pos));
+                }
+            }
+        }
+        m_expected_num_scatterers = sum*box_volume/(static_cast<double>(num_points[0])*num_points[1]*num_points[2]);
+    } else if (!m_density.samples.empty()) {
+        double sum = 0.0;
+        for (auto sample : m_density.samples) {
+            sum += std::max(0.0f, sample);
+        }
+        m_expected_num_scatterers = sum*box_volume/m_density.samples.size();
+    } else {
+        m_expected_num_scatterers = std::max(0.0f, m_density.constant)*box_volume;
+    }
+}
+
+int ProceduralScatterers::num_scatterers() const {
+    return static_cast<int>(std::min<double>(std::floor(m_expected_num_scatterers + 0.5), std::numeric_limits<int>::max()));
+}
+
+void ProceduralScatterers::get_num_cells(int& num_x, int& num_y, int& num_z) const {
+    num_x = m_num_cells[0];
+    num_y = m_num_cells[1];
+    num_z = m_num_cells[2];
+}
+
+void ProceduralScatterers::generate_cell(int ix, int iy, int iz, ScattererArray<PointScatterer>& out) const {
+    if ((ix < 0) || (iy < 0) || (iz < 0) || (ix >= m_num_cells[0]) || (iy >= m_num_cells[1]) || (iz >= m_num_cells[2])) {
+        return;
+    }
+    const auto cell_no = (static_cast<uint64_t>(ix)*m_num_cells[1] + iy)*m_num_cells[2] + iz;
+    CellRandom random(mix64(cell_no + mix64(m_seed + 0x9e3779b97f4a7c15ull)));
+
+    const vector3 cell_min(m_box_min.x + ix*m_cell_size, m_box_min.y + iy*m_cell_size, m_box_min.z + iz*m_cell_size);
+    const auto center = cell_min + vector3(0.5f, 0.5f, 0.5f)*m_cell_size;
+    const auto mean = m_density.evaluate(*this, center)*static_cast<double>(m_cell_size)*m_cell_size*m_cell_size;
+    const auto num_points = random.poisson(mean);
+    for (int point_no = 0; point_no < num_points; point_no++) {
+        PointScatterer scatterer;
+        scatterer.pos = cell_min + vector3(static_cast<float>(random.uniform()),
+                                           static_cast<float>(random.uniform()),
+                                           static_cast<float>(random.uniform()))*m_cell_size;
+        const auto gaussian = static_cast<float>(random.normal());
+        // The last cells may extend past the box.
+        if ((scatterer.pos.x >= m_box_max.x) || (scatterer.pos.y >= m_box_max.y) || (scatterer.pos.z >= m_box_max.z)) {
+            continue;
+        }
+        scatterer.amplitude = m_amplitude.evaluate(*this, scatterer.pos)*gaussian;
+        out.push_back(scatterer);
+    }
+}
+
+void ProceduralScatterers::generate_in_beam(const vector3& origin, const vector3& direction, const vector3& lateral_dir, const vector3& elevational_dir,
+                                            float length, float lateral_extent, float elevational_extent,
+                                            ScattererArray<PointScatterer>& out, int pass_no, int num_passes) const {
+    if (!(length > 0.0f)) {
+        return;
+    }
+    // No point in a cell is further than half the diagonal from its center.
+    const float margin = 0.8660254f*m_cell_size;
+    const float box_min[3] = {m_box_min.x, m_box_min.y, m_box_min.z};
+    const float dir[3] = {direction.x, direction.y, direction.z};
+    const float lat[3] = {lateral_dir.x, lateral_dir.y, lateral_dir.z};
+    const float ele[3] = {elevational_dir.x, elevational_dir.y, elevational_dir.z};
+
+    // Step along the beam and collect the cells overlapping the axis-aligned
+    // bounding box of each piece, keeping those whose center is close enough.
+    const int num_steps = std::max(1, static_cast<int>(std::ceil(length/m_cell_size)));
+    const float step = length/num_steps;
+    float half_size[3];
+    for (int k = 0; k < 3; k++) {
+        half_size[k] = 0.5f*step*std::abs(dir[k]) + lateral_extent*std::abs(lat[k]) + elevational_extent*std::abs(ele[k]);
+    }
+    std::vector<uint64_t> cells;
+    for (int step_no = 0; step_no < num_steps; step_no++) {
+        const auto center = origin + direction*((step_no + 0.5f)*step);
+        const float pos[3] = {center.x, center.y, center.z};
+        int lo[3], hi[3];
+        bool is_outside = false;
+        for (int k = 0; k < 3; k++) {
+            lo[k] = static_cast<int>(std::floor((pos[k] - half_size[k] - box_min[k])/m_cell_size));
+            hi[k] = static_cast<int>(std::floor((pos[k] + half_size[k] - box_min[k])/m_cell_size));
+            is_outside = is_outside || (hi[k] < 0) || (lo[k] >= m_num_cells[k]);
+            lo[k] = std::max(lo[k], 0);
+            hi[k] = std::min(hi[k], m_num_cells[k] - 1);
+        }
+        if (is_outside) {
+            continue;
+        }
+        for (int ix = lo[0]; ix <= hi[0]; ix++) {
+            for (int iy = lo[1]; iy <= hi[1]; iy++) {
+                for (int iz = lo[2]; iz <= hi[2]; iz++) {
+                    const vector3 cell_center(box_min[0] + (ix + 0.5f)*m_cell_size,
+                                              box_min[1] + (iy + 0.5f)*m_cell_size,
+                                              box_min[2] + (iz + 0.5f)*m_cell_size);
+                    const auto temp = cell_center - origin;
+                    const auto r = temp.dot(direction);
+                    if ((r < -margin) || (r > length + margin)
+                        || (std::abs(temp.dot(lateral_dir)) > lateral_extent + margin)
+                        || (std::abs(temp.dot(elevational_dir)) > elevational_extent + margin)) {
+                        continue;
+                    }
+                    cells.push_back((static_cast<uint64_t>(ix)*m_num_cells[1] + iy)*m_num_cells[2] + iz);
+                }
+            }
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+    for (auto cell_no : cells) {
+        const auto iz = static_cast<int>(cell_no % m_num_cells[2]);
+        const auto iy = static_cast<int>((cell_no/m_num_cells[2]) % m_num_cells[1]);
+        const auto ix = static_cast<int>(cell_no/(static_cast<uint64_t>(m_num_cells[2])*m_num_cells[1]));
+        if ((num_passes > 1) && (get_progressive_pass(ix, iy, iz, num_passes) != pass_no)) {
+            continue;
+        }
+        generate_cell(ix, iy, iz, out);
+    }
+}
+
+int ProceduralScatterers::get_progressive_pass(int ix, int iy, int iz, int num_passes) const {
+    const auto cell_no = (static_cast<uint64_t>(ix)*m_num_cells[1] + iy)*m_num_cells[2] + iz;
+    // Salted, so that it does not correlate with the contents of the cell.
+    return static_cast<int>(mix64(cell_no ^ 0xd6e8feb86659fd93ull) % static_cast<uint64_t>(num_passes));
+}
+
+}   // end namespace
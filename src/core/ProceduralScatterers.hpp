@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "export_macros.hpp"
+#include "BCSimConfig.hpp"
+
+namespace bcsim {
+
+// Scatterers that are never stored, but generated on demand inside the
+// cells of a regular grid covering a box. The number of scatterers in a
+// cell is Poisson distributed with mean given by the density field at the
+// cell center, positions are uniform within the cell, and amplitudes are
+// standard Gaussian scaled by the amplitude field at the scatterer position.
+// All random numbers are derived from a hash of the seed and the cell index,
+// so a cell contains the same scatterers no matter which beams touch it and
+// memory use only depends on the size of the fields.
+class DLL_PUBLIC ProceduralScatterers : public Scatterers {
+public:
+    typedef std::shared_ptr<ProceduralScatterers> s_ptr;
+
+    // A scalar field in global coordinates. Fields are evaluated concurrently
+    // from the simulation threads, so the function must be thread-safe (e.g.
+    // only read shared state) and must not throw.
+    typedef std::function<float (const vector3&)> Field;
+
+    // The density is initially zero and the amplitude scale one.
+    ProceduralScatterers(const vector3& box_min, const vector3& box_max, float cell_size, uint32_t seed);
+
+    // Set the density [scatterers per m^3] to a constant value.
+    void set_density(float density);
+
+    // Set the density to an analytical field, which is evaluated at cell centers.
+    void set_density(Field density);
+
+    // Set the density to a voxelized field spanning the box. Samples are
+    // indexed row-major [x, y, z] and looked up with nearest neighbour.
+    void set_density(int num_x, int num_y, int num_z, const std::vector<float>& samples);
+
+    // Same as the above for the amplitude scale.
+    void set_amplitude(float amplitude);
+    void set_amplitude(Field amplitude);
+    void set_amplitude(int num_x, int num_y, int num_z, const std::vector<float>& samples);
+
+    // Expected number of scatterers, clamped to the range of int.
+    virtual int num_scatterers() const override;
+
+    // Expected number of scatterers. Approximate for an analytical density.
+    double get_expected_num_scatterers() const {
+        return m_expected_num_scatterers;
+    }
+
+    vector3 get_box_min() const     { return m_box_min; }
+    vector3 get_box_max() const     { return m_box_max; }
+    float get_cell_size() const     { return m_cell_size; }
+    uint32_t get_seed() const       { return m_seed; }
+
+    // Number of cells along x, y and z.
+    void get_num_cells(int& num_x, int& num_y, int& num_z) const;
+
+    // Append the scatterers of a cell to out. Cells outside the grid are empty.
+    void generate_cell(int ix, int iy, int iz, ScattererArray<PointScatterer>& out) const;
+
+    // Append the scatterers of all cells that may have points inside the box
+    // [0, length] x [-lateral_extent, lateral_extent] x [-elevational_extent, elevational_extent]
+    // in the coordinate system of a beam. Cells are visited in index order.
+    // If num_passes is larger than one, the cells are split pseudo-randomly
+    // into that many progressive passes and only those in pass_no are generated.
+    void generate_in_beam(const vector3& origin, const vector3& direction, const vector3& lateral_dir, const vector3& elevational_dir,
+                          float length, float lateral_extent, float elevational_extent,
+                          ScattererArray<PointScatterer>& out, int pass_no = 0, int num_passes = 1) const;
+
+    // The progressive pass a cell belongs to when there are num_passes passes.
+    int get_progressive_pass(int ix, int iy, int iz, int num_passes) const;
+
+private:
+    // A constant, analytical or voxelized field.
+    struct FieldSource {
+        float               constant;
+        Field               function;
+        int                 num_samples[3];
+        std::vector<float>  samples;
+
+        float evaluate(const ProceduralScatterers& owner, const vector3& pos) const;
+    };
+
+    void set_voxels(FieldSource& field, int num_x, int num_y, int num_z, const std::vector<float>& samples);
+
+    void update_expected_num_scatterers();
+
+private:
+    vector3         m_box_min;
+    vector3         m_box_max;
+    float           m_cell_size;
+    uint32_t        m_seed;
+    int             m_num_cells[3];
+    FieldSource     m_density;
+    FieldSource     m_amplitude;
+    double          m_expected_num_scatterers;
+};
+
+}   // end namespace
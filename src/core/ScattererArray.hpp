@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <initializer_list>
+
+namespace bcsim {
+
+// Vector-like array of scatterer data. Normally owns its elements like a
+// std::vector, but can also be a view into memory owned by someone else,
+// e.g. a memory-mapped phantom file, so that large phantoms can be used
+// without copying. Elements of a view can be modified in place (the owner
+// must make that possible, e.g. a private writable mapping), while any
+// operation that changes the size first copies the elements into owned
+// storage. Copying a ScattererArray always gives an owning copy.
+template <typename T>
+class ScattererArray {
+public:
+    typedef T                   value_type;
+    typedef size_t              size_type;
+    typedef T&                  reference;
+    typedef const T&            const_reference;
+    typedef T*                  iterator;
+    typedef const T*            const_iterator;
+
+    ScattererArray() : m_data(nullptr), m_size(0) { }
+
+    explicit ScattererArray(size_t count) : m_owned(count) {
+        update_from_owned();
+    }
+
+    ScattererArray(const std::vector<T>& v) : m_owned(v) {
+        update_from_owned();
+    }
+
+    ScattererArray(std::vector<T>&& v) : m_owned(std::move(v)) {
+        update_from_owned();
+    }
+
+    ScattererArray(std::initializer_list<T> init) : m_owned(init) {
+        update_from_owned();
+    }
+
+    ScattererArray(const ScattererArray& other) : m_owned(other.begin(), other.end()) {
+        update_from_owned();
+    }
+
+    ScattererArray(ScattererArray&& other) : m_data(nullptr), m_size(0) {
+        swap(other);
+    }
+
+    ScattererArray& operator=(ScattererArray other) {
+        swap(other);
+        return *this;
+    }
+
+    // Create a view of count elements at data. keep_alive is held for as
+    // long as the view exists and should own the memory.
+    static ScattererArray wrap(T* data, size_t count, std::shared_ptr<void> keep_alive) {
+        ScattererArray res;
+        res.m_data = data;
+        res.m_size = count;
+        res.m_keep_alive = keep_alive;
+        return res;
+    }
+
+    // True if the elements are owned by someone else.
+    bool is_view() const {
+        return static_cast<bool>(m_keep_alive);
+    }
+
+    size_t size() const     { return m_size; }
+    bool   empty() const    { return m_size == 0; }
+    T*       data()         { return m_data; }
+    const T* data() const   { return m_data; }
+
+    T&       operator[](size_t i)          { return m_data[i]; }
+    const T& operator[](size_t i) const    { return m_data[i]; }
+
+    iterator       begin()          { return m_data; }
+    iterator       end()            { return m_data + m_size; }
+    const_iterator begin() const    { return m_data; }
+    const_iterator end() const      { return m_data + m_size; }
+
+    void resize(size_t count) {
+        detach();
+        m_owned.resize(count);
+        update_from_owned();
+    }
+
+    void resize(size_t count, const T& value) {
+        const auto keep_alive = detach();
+        m_owned.resize(count, value);
+        update_from_owned();
+    }
+
+    void reserve(size_t count) {
+        detach();
+        m_owned.reserve(count);
+        update_from_owned();
+    }
+
+    void clear() {
+        m_keep_alive.reset();
+        m_owned.clear();
+        update_from_owned();
+    }
+
+    void push_back(const T& value) {
+        const auto keep_alive = detach();
+        m_owned.push_back(value);
+        update_from_owned();
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        const auto keep_alive = detach();
+        m_owned.emplace_back(std::forward<Args>(args)...);
+        update_from_owned();
+    }
+
+    // The range may be part of this array, also when it is a view.
+    template <typename InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<T> temp(first, last);
+        m_owned.swap(temp);
+        m_keep_alive.reset();
+        update_from_owned();
+    }
+
+    void swap(ScattererArray& other) {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        m_owned.swap(other.m_owned);
+        m_keep_alive.swap(other.m_keep_alive);
+    }
+
+private:
+    // Turn a view into owned storage. Returns the keep-alive of the view,
+    // which callers hold while their arguments may still refer into it.
+    std::shared_ptr<void> detach() {
+        std::shared_ptr<void> keep_alive;
+        if (m_keep_alive) {
+            m_owned.assign(m_data, m_data + m_size);
+            keep_alive.swap(m_keep_alive);
+        }
+        return keep_alive;
+    }
+
+    void update_from_owned() {
+        m_data = m_owned.data();
+        m_size = m_owned.size();
+    }
+
+private:
+    T*                      m_data;
+    size_t                  m_size;
+    std::vector<T>          m_owned;
+    std::shared_ptr<void>   m_keep_alive;
+};
+
+}   // end namespace
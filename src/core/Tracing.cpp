@@ -0,0 +1,251 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include "Tracing.hpp"
+
+namespace bcsim {
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    const char* arg_name;
+    int64_t     start_ns;
+    int64_t     duration_ns;
+    int64_t     arg_value;
+};
+
+// Events of one thread. The owning thread and the writer of the trace
+// are the only users, so the lock is practically never contended.
+struct ThreadBuffer {
+    ThreadBuffer(int thread_id, const std::string& name)
+        : thread_id(thread_id),
+          name(name.empty() ? "Thread " + std::to_string(thread_id) : name),
+          num_written(0),
+          finished(false)
+    {
+    }
+
+    std::mutex              mutex;
+    const int               thread_id;
+    std::string             name;
+    std::vector<TraceEvent> events;
+    size_t                  num_written;
+    // Set when the thread has exited. The buffer is dropped once its
+    // events have been written or cleared.
+    bool                    finished;
+};
+
+std::atomic<bool>                           g_enabled(false);
+std::mutex                                  g_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>>  g_buffers;
+int                                         g_next_thread_id = 1;
+
+// Drop the buffers of exited threads. Caller must hold g_registry_mutex.
+void remove_finished_buffers() {
+    g_buffers.erase(std::remove_if(g_buffers.begin(), g_buffers.end(), [](const std::shared_ptr<ThreadBuffer>& buffer) {
+        std::lock_guard<std::mutex> guard(buffer->mutex);
+        return buffer->finished;
+    }), g_buffers.end());
+}
+
+// Per-thread state. The buffer is made when the thread records its first
+// event, so threads that never record cost nothing.
+struct ThreadState {
+    ~ThreadState() {
+        if (!buffer) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(g_registry_mutex);
+        std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+        buffer->finished = true;
+        if (buffer->num_written == 0) {
+            g_buffers.erase(std::find(g_buffers.begin(), g_buffers.end(), buffer));
+        } else if (buffer->num_written < buffer->events.size()) {
+            // Keep only the events until they are written.
+            buffer->events.resize(buffer->num_written);
+            buffer->events.shrink_to_fit();
+        }
+    }
+
+    std::string                     name;
+    std::shared_ptr<ThreadBuffer>   buffer;
+};
+
+thread_local ThreadState t_state;
+
+// The buffer of the calling thread, registered on first use. Buffers outlive
+// their threads so that events of finished threads are kept until written.
+ThreadBuffer& get_thread_buffer() {
+    if (!t_state.buffer) {
+        std::vector<TraceEvent> events(TraceRecorder::EVENTS_PER_THREAD);
+        std::lock_guard<std::mutex> guard(g_registry_mutex);
+        t_state.buffer = std::make_shared<ThreadBuffer>(g_next_thread_id++, t_state.name);
+        t_state.buffer->events.swap(events);
+        g_buffers.push_back(t_state.buffer);
+    }
+    return *t_state.buffer;
+}
+
+std::string json_escape(const std::string& s) {
+    std::string res;
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+            res += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            res += ' ';
+        } else {
+            res += c;
+        }
+    }
+    return res;
+}
+
+}   // end anonymous namespace
+
+const size_t TraceRecorder::EVENTS_PER_THREAD;
+
+void TraceRecorder::set_enabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool TraceRecorder::is_enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void TraceRecorder::set_thread_name(const std::string& name) {
+    t_state.name = name;
+    if (t_state.buffer) {
+        std::lock_guard<std::mutex> guard(t_state.buffer->mutex);
+        t_state.buffer->name = name;
+    }
+}
+
+int64_t TraceRecorder::now_ns() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+void TraceRecorder::record(const char* name, const char* category, int64_t start_ns, int64_t end_ns,
+                           const char* arg_name, int64_t arg_value) {
+    auto& buffer = get_thread_buffer();
+    std::lock_guard<std::mutex> guard(buffer.mutex);
+    auto& event = buffer.events[buffer.num_written % EVENTS_PER_THREAD];
+    event.name          = name;
+    event.category      = category;
+    event.arg_name      = arg_name;
+    event.start_ns      = start_ns;
+    event.duration_ns   = end_ns - start_ns;
+    event.arg_value     = arg_value;
+    buffer.num_written++;
+}
+
+void TraceRecorder::clear() {
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    remove_finished_buffers();
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+        buffer->num_written = 0;
+    }
+}
+
+size_t TraceRecorder::get_num_threads() {
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    return g_buffers.size();
+}
+
+size_t TraceRecorder::get_num_events() {
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    size_t res = 0;
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+        res += std::min<size_t>(buffer->num_written, EVENTS_PER_THREAD);
+    }
+    return res;
+}
+
+void TraceRecorder::write_chrome_trace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("unable to open trace file " + path);
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+
+    // Timestamps are in microseconds relative to the first event.
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    int64_t first_ns = -1;
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+        const auto num_events = std::min<size_t>(buffer->num_written, EVENTS_PER_THREAD);
+        for (size_t i = 0; i < num_events; i++) {
+            const auto start_ns = buffer->events[i].start_ns;
+            if ((first_ns < 0) || (start_ns < first_ns)) {
+                first_ns = start_ns;
+            }
+        }
+    }
+
+    bool first_entry = true;
+    for (auto& buffer : g_buffers) {
+        std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+        const auto num_events = std::min<size_t>(buffer->num_written, EVENTS_PER_THREAD);
+        out << (first_entry ? "" : ",\n");
+        first_entry = false;
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread_id
+            << ", \"args\": {\"name\": \"" << json_escape(buffer->name) << "\"}}";
+        for (size_t i = 0; i < num_events; i++) {
+            const auto& event = buffer->events[i];
+            out << ",\n{\"name\": \"" << json_escape(event.name) << "\", \"cat\": \"" << json_escape(event.category)
+                << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->thread_id
+                << ", \"ts\": " << 1e-3*(event.start_ns - first_ns) << ", \"dur\": " << 1e-3*event.duration_ns;
+            if (event.arg_name != nullptr) {
+                out << ", \"args\": {\"" << json_escape(event.arg_name) << "\": " << event.arg_value << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    if (!out) {
+        throw std::runtime_error("failed to write trace file " + path);
+    }
+    remove_finished_buffers();
+}
+
+}   // end namespace
@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <string>
+#include <cstdint>
+#include "export_macros.hpp"
+
+namespace bcsim {
+
+// Process-wide recorder of timed events for viewing simulation, convolution,
+// scan conversion and I/O on one timeline. Every thread records into its own
+// ring buffer, which keeps the newest events if it overflows. The result is
+// written in the Chrome trace event format, which can be opened in
+// chrome://tracing or https://ui.perfetto.dev.
+//
+// Recording is off by default, and then an event costs one flag check.
+class DLL_PUBLIC TraceRecorder {
+public:
+    // Number of events kept per thread.
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    static void set_enabled(bool enabled);
+
+    static bool is_enabled();
+
+    // Name shown for the calling thread. Cheap, also when recording is off:
+    // the event buffer of a thread is allocated when it records its first event.
+    static void set_thread_name(const std::string& name);
+
+    // Nanoseconds since an arbitrary fixed point.
+    static int64_t now_ns();
+
+    // Add a finished event for the calling thread. Name, category and
+    // arg_name must be string literals (or otherwise outlive the recorder).
+    // arg_name may be null if the event has no argument.
+    static void record(const char* name, const char* category, int64_t start_ns, int64_t end_ns,
+                       const char* arg_name, int64_t arg_value);
+
+    // Discard all recorded events.
+    static void clear();
+
+    // Number of threads with an event buffer. The buffers of exited threads
+    // are freed when the thread exits without events, or else when the trace
+    // is written or cleared.
+    static size_t get_num_threads();
+
+    // Total number of events currently kept.
+    static size_t get_num_events();
+
+    // Write all recorded events as Chrome trace JSON. Events of exited
+    // threads are discarded afterwards.
+    // Throws std::runtime_error if the file cannot be written.
+    static void write_chrome_trace(const std::string& path);
+};
+
+// Records an event covering the lifetime of the object if recording was
+// enabled when it was created.
+class ScopedTraceEvent {
+public:
+    ScopedTraceEvent(const char* name, const char* category)
+        : m_name(name),
+          m_category(category),
+          m_arg_name(nullptr),
+          m_arg_value(0),
+          m_start_ns(TraceRecorder::is_enabled() ? TraceRecorder::now_ns() : -1)
+    {
+    }
+
+    ~ScopedTraceEvent() {
+        if (m_start_ns >= 0) {
+            TraceRecorder::record(m_name, m_category, m_start_ns, TraceRecorder::now_ns(), m_arg_name, m_arg_value);
+        }
+    }
+
+    // Attach a named value, shown as an argument of the event.
+    void set_arg(const char* arg_name, int64_t value) {
+        m_arg_name = arg_name;
+        m_arg_value = value;
+    }
+
+    ScopedTraceEvent(const ScopedTraceEvent&) = delete;
+    ScopedTraceEvent& operator=(const ScopedTraceEvent&) = delete;
+
+private:
+    const char*     m_name;
+    const char*     m_category;
+    const char*     m_arg_name;
+    int64_t         m_arg_value;
+    int64_t         m_start_ns;
+};
+
+}   // end namespace
@@ -101,6 +101,14 @@ void BaseAlgorithm::set_logger(ILog::ptr log_object) {
     m_log_object = log_object;
 }
 
+void BaseAlgorithm::set_intermediate_frame_callback(IntermediateFrameCallback callback) {
+    m_intermediate_frame_callback = callback;
+}
+
+void BaseAlgorithm::set_line_callback(LineCallback callback) {
+    m_line_callback = callback;
+}
+
 
 }   // end namespace
 
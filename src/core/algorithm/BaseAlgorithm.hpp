@@ -57,6 +57,10 @@ public:
 
     virtual void set_logger(ILog::ptr log_object) override;
 
+    virtual void set_intermediate_frame_callback(IntermediateFrameCallback callback) override;
+
+    virtual void set_line_callback(LineCallback callback) override;
+
 protected:
     float       m_param_sound_speed;
     int         m_param_verbose;
@@ -72,6 +76,12 @@ protected:
     std::map<std::string, std::vector<double>>  m_debug_data;
     
     ILog::ptr   m_log_object;   // class invariant: always valid (default dummy object)
+
+    // Called with intermediate frames by algorithms that support progressive simulation.
+    IntermediateFrameCallback   m_intermediate_frame_callback;
+
+    // Called after each line by algorithms that support cancellation.
+    LineCallback                m_line_callback;
 };
 
 }   // end namespace
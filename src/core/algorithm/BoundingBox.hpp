@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include "../vector3.hpp"
+#include "../ScanSequence.hpp"
+
+namespace bcsim {
+
+// Axis-aligned box. Empty (contains nothing) if min is above max.
+struct BoundingBox {
+    BoundingBox()
+        : min(1.0f, 1.0f, 1.0f),
+          max(-1.0f, -1.0f, -1.0f) { }
+
+    BoundingBox(const vector3& box_min, const vector3& box_max)
+        : min(box_min),
+          max(box_max) { }
+
+    bool empty() const {
+        return (min.x > max.x) || (min.y > max.y) || (min.z > max.z);
+    }
+
+    void add(const vector3& p) {
+        if (empty()) {
+            min = p;
+            max = p;
+        } else {
+            min = vector3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+            max = vector3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+        }
+    }
+
+    void add(const BoundingBox& other) {
+        if (!other.empty()) {
+            add(other.min);
+            add(other.max);
+        }
+    }
+
+    vector3 min;
+    vector3 max;
+};
+
+// Bounds of position(i) for 0 <= i < num_points, computed in parallel.
+template <typename PositionFunction>
+BoundingBox compute_bounding_box(int num_points, PositionFunction position) {
+#ifdef BCSIM_ENABLE_OPENMP
+    std::vector<BoundingBox> partial_boxes(omp_get_max_threads());
+    #pragma omp parallel
+#else
+    std::vector<BoundingBox> partial_boxes(1);
+#endif
+    {
+#ifdef BCSIM_ENABLE_OPENMP
+        auto& box = partial_boxes[omp_get_thread_num()];
+        #pragma omp for
+#else
+        auto& box = partial_boxes[0];
+#endif
+        for (int i = 0; i < num_points; i++) {
+            box.add(position(i));
+        }
+    }
+    BoundingBox res;
+    for (const auto& box : partial_boxes) {
+        res.add(box);
+    }
+    return res;
+}
+
+// True unless the box is separated from the part of the beam of a scanline
+// that is between radial_min and radial_max along the beam axis and within
+// lateral and elevational distance from it. Conservative: only the beam axes
+// and the coordinate axes are tried as separating axes.
+inline bool box_may_intersect_beam(const BoundingBox& box, const Scanline& line, float radial_min, float radial_max,
+                                   float lateral, float elevational) {
+    if (box.empty()) {
+        return false;
+    }
+    const vector3 axes[3] = {line.get_direction(), line.get_lateral_dir(), line.get_elevational_dir()};
+    const float beam_half[3] = {0.5f*(radial_max - radial_min), lateral, elevational};
+    const auto beam_center = line.get_origin() + axes[0]*(0.5f*(radial_min + radial_max));
+    const auto box_center = (box.min + box.max)*0.5f;
+    const auto box_half = (box.max - box.min)*0.5f;
+    const auto d = box_center - beam_center;
+
+    for (int k = 0; k < 3; k++) {
+        const auto& u = axes[k];
+        const auto box_radius = box_half.x*std::abs(u.x) + box_half.y*std::abs(u.y) + box_half.z*std::abs(u.z);
+        if (std::abs(d.dot(u)) > beam_half[k] + box_radius) {
+            return false;
+        }
+    }
+    const float box_half_k[3] = {box_half.x, box_half.y, box_half.z};
+    const float d_k[3] = {d.x, d.y, d.z};
+    for (int k = 0; k < 3; k++) {
+        float beam_radius = 0.0f;
+        for (int j = 0; j < 3; j++) {
+            const float u_k[3] = {axes[j].x, axes[j].y, axes[j].z};
+            beam_radius += beam_half[j]*std::abs(u_k[k]);
+        }
+        if (std::abs(d_k[k]) > box_half_k[k] + beam_radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}   // end namespace
@@ -34,6 +34,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdexcept>
 #include <algorithm>
 #include <tuple>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <atomic>
 #ifdef BCSIM_ENABLE_OPENMP
     #include <omp.h>
 #endif
@@ -42,15 +46,76 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../to_string.hpp"
 #include "../LibBCSim.hpp"
 #include "../BeamConvolver.hpp"
-#include "common_utils.hpp" // for compute_num_rf_samples
+#include "common_utils.hpp" // for compute_num_rf_samples and demodulate_and_decimate
 #include "../bspline.hpp"
+#include "../Tracing.hpp"
 
 namespace bcsim {
 
-void CpuAlgorithm::projection_loop(FixedScatterers::s_ptr fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples) {
+namespace {
 
-    const int num_scatterers = fixed_scatterers->scatterers.size();
-    for (int scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+// Reproducible pseudo-random assignment of scatterers to progressive passes.
+// Hashing the index avoids spatial bias if the scatterers are sorted.
+inline int progressive_pass_of(int scatterer_no, int num_passes) {
+    uint32_t h = static_cast<uint32_t>(scatterer_no);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return static_cast<int>(h % static_cast<uint32_t>(num_passes));
+}
+
+// Group the indices of a collection by pass with a counting sort, keeping
+// the original order within each pass.
+ProgressivePassIndices make_progressive_pass_indices(size_t num_scatterers, int num_passes) {
+    ProgressivePassIndices res;
+    res.offsets.assign(num_passes + 1, 0);
+    for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+        res.offsets[progressive_pass_of(static_cast<int>(scatterer_no), num_passes) + 1]++;
+    }
+    for (int pass_no = 0; pass_no < num_passes; pass_no++) {
+        res.offsets[pass_no + 1] += res.offsets[pass_no];
+    }
+    res.indices.resize(num_scatterers);
+    auto next = res.offsets;
+    for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+        res.indices[next[progressive_pass_of(static_cast<int>(scatterer_no), num_passes)]++] = static_cast<uint32_t>(scatterer_no);
+    }
+    return res;
+}
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+// The projection loops may be used outside of simulate_lines(), in which
+// case there are no stage timings to update.
+inline void add_scatterer_counts(PerThreadStageTimings& stage_timings, int64_t num_visited, int64_t num_contributing) {
+#ifdef BCSIM_ENABLE_OPENMP
+    const size_t thread_idx = omp_get_thread_num();
+#else
+    const size_t thread_idx = 0;
+#endif
+    if (thread_idx < stage_timings.size()) {
+        stage_timings[thread_idx].num_visited += num_visited;
+        stage_timings[thread_idx].num_contributing += num_contributing;
+    }
+}
+#endif
+
+}   // end anonymous namespace
+
+void CpuAlgorithm::projection_loop(FixedScatterers::s_ptr fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                                   const uint32_t* scatterer_indices, size_t num_indices) {
+
+    const size_t num_loop = scatterer_indices ? num_indices : fixed_scatterers->scatterers.size();
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    int64_t num_visited = 0;
+    int64_t num_contributing = 0;
+#endif
+    for (size_t loop_no = 0; loop_no < num_loop; loop_no++) {
+        const size_t scatterer_no = scatterer_indices ? scatterer_indices[loop_no] : loop_no;
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+        num_visited++;
+#endif
         const PointScatterer& scatterer = fixed_scatterers->scatterers[scatterer_no];
         
         // Map the global cartesian scatterer position into the beam's local
@@ -80,6 +145,9 @@ void CpuAlgorithm::projection_loop(FixedScatterers::s_ptr fixed_scatterers, cons
         if (closest_index < 0 || closest_index >= num_time_samples) {
             continue;
         }
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+        num_contributing++;
+#endif
 
 
         if (m_enable_phase_delay) {
@@ -94,11 +162,15 @@ void CpuAlgorithm::projection_loop(FixedScatterers::s_ptr fixed_scatterers, cons
             time_proj_signal[closest_index] += std::complex<float>(scaled_ampl, 0.0f);
         }
     }
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    add_scatterer_counts(m_stage_timings, num_visited, num_contributing);
+#endif
 }
 
-void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples) {
+void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                                   const uint32_t* scatterer_indices, size_t num_indices) {
 
-    const int num_scatterers = spline_scatterers->num_scatterers();
+    const size_t num_loop = scatterer_indices ? num_indices : spline_scatterers->num_scatterers();
     
     // The number of control points most be at least one more than the degree
     const int num_control_points = spline_scatterers->get_num_control_points();
@@ -131,12 +203,22 @@ void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, co
                                                         spline_scatterers->knot_vector);
         basis_functions[i] = b;
     }
-    for (int scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+    const vector3* control_points = spline_scatterers->control_points.data();
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    int64_t num_visited = 0;
+    int64_t num_contributing = 0;
+#endif
+    for (size_t loop_no = 0; loop_no < num_loop; loop_no++) {
+        const size_t scatterer_no = scatterer_indices ? scatterer_indices[loop_no] : loop_no;
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+        num_visited++;
+#endif
 
         // Compute position of current scatterer by evaluating spline in current timestep        
         vector3 scatterer_pos(0.0f, 0.0f, 0.0f);
+        const vector3* cs = control_points + scatterer_no*num_control_points;
         for (int i = lower_lim; i <= upper_lim; i++) {
-            scatterer_pos += spline_scatterers->control_points[scatterer_no][i]*basis_functions[i];
+            scatterer_pos += cs[i]*basis_functions[i];
         }
         
         // Map the global cartesian scatterer position into the beam's local
@@ -167,6 +249,9 @@ void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, co
         if (closest_index < 0 || closest_index >= num_time_samples) {
             continue;
         }
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+        num_contributing++;
+#endif
 
         if (m_enable_phase_delay) {
             // handle sub-sample displacement with a complex phase
@@ -180,6 +265,28 @@ void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, co
             time_proj_signal[closest_index] += std::complex<float>(scaled_ampl, 0.0f);
         }
     }
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    add_scatterer_counts(m_stage_timings, num_visited, num_contributing);
+#endif
+}
+
+void CpuAlgorithm::projection_loop(ProceduralScatterers::s_ptr procedural_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                                   int pass_no, int num_passes) {
+#ifdef BCSIM_ENABLE_OPENMP
+    const size_t thread_idx = omp_get_thread_num();
+#else
+    const size_t thread_idx = 0;
+#endif
+    auto buffer = (thread_idx < m_procedural_buffers.size()) ? m_procedural_buffers[thread_idx] : std::make_shared<FixedScatterers>();
+    buffer->scatterers.clear();
+
+    float lateral_extent, elevational_extent;
+    get_beam_extent(lateral_extent, elevational_extent);
+    const float line_length = num_time_samples*m_param_sound_speed/(2.0f*m_excitation.sampling_frequency);
+    procedural_scatterers->generate_in_beam(line.get_origin(), line.get_direction(), line.get_lateral_dir(), line.get_elevational_dir(),
+                                            line_length, lateral_extent, elevational_extent, buffer->scatterers,
+                                            pass_no, num_passes);
+    projection_loop(buffer, line, time_proj_signal, num_time_samples);
 }
 
 
@@ -187,12 +294,39 @@ CpuAlgorithm::CpuAlgorithm()
         : m_scan_sequence_configured(false),
           m_excitation_configured(false),
           m_omp_num_threads(1),
-          m_param_sum_all_cs(false) {
+          m_param_sum_all_cs(false),
+          m_param_thread_binding("none"),
+          m_param_numa_replicate(false),
+          m_param_numa_benchmark(false),
+          m_threads_are_bound(false),
+          m_param_progressive_passes(1),
+          m_param_beam_cutoff(1e-4f),
+          m_param_perf_counters(false),
+          m_param_spatial_sort(SpaceFillingCurve::NONE),
+          m_numa_replicas_valid(false) {
     
     // use all cores by default
     set_use_all_available_cores();
 }
 
+CpuAlgorithm::~CpuAlgorithm() {
+    if (!m_param_trace_file.empty()) {
+        try {
+            stop_tracing();
+        } catch (const std::exception& e) {
+            m_log_object->write(ILog::WARNING, std::string("Unable to write trace: ") + e.what());
+        }
+    }
+}
+
+void CpuAlgorithm::stop_tracing() {
+    const auto path = m_param_trace_file;
+    m_param_trace_file.clear();
+    TraceRecorder::set_enabled(false);
+    TraceRecorder::write_chrome_trace(path);
+    m_log_object->write(ILog::INFO, "Wrote " + std::to_string(TraceRecorder::get_num_events()) + " trace events to " + path);
+}
+
 void CpuAlgorithm::set_use_all_available_cores() {
 #ifdef BCSIM_ENABLE_OPENMP
     set_use_specific_num_cores(omp_get_max_threads());
@@ -215,6 +349,7 @@ void CpuAlgorithm::set_use_specific_num_cores(int num_threads) {
     }
     m_omp_num_threads = num_threads;
     m_log_object->write(ILog::INFO, "Number of OpenMP threads is " + std::to_string(m_omp_num_threads));
+    update_thread_placement();
     
     // number of convolvers must match number of threads
     configure_convolvers_if_possible();
@@ -245,11 +380,283 @@ void CpuAlgorithm::set_parameter(const std::string& key, const std::string& valu
     } else if (key == "noise_amplitude") { 
         BaseAlgorithm::set_parameter(key, value);
         m_normal_dist = std::normal_distribution<float>(0.0f, m_param_noise_amplitude);
+    } else if (key == "thread_binding") {
+        if ((value != "none") && (value != "compact") && (value != "spread")) {
+            throw std::runtime_error("invalid value for " + key);
+        }
+        m_param_thread_binding = value;
+        update_thread_placement();
+    } else if (key == "numa_replicate") {
+        if ((value == "on") || (value == "true")) {
+            m_param_numa_replicate = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_numa_replicate = false;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+        update_thread_placement();
+    } else if (key == "numa_benchmark") {
+        if ((value == "on") || (value == "true")) {
+            m_param_numa_benchmark = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_numa_benchmark = false;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+    } else if (key == "progressive_passes") {
+        const auto num_passes = std::stoi(value);
+        if (num_passes <= 0) {
+            throw std::runtime_error("number of progressive passes must be at least one");
+        }
+        if (num_passes != m_param_progressive_passes) {
+            m_param_progressive_passes = num_passes;
+            update_progressive_pass_indices();
+        }
+    } else if (key == "beam_cutoff") {
+        const auto cutoff = std::stof(value);
+        if (!((cutoff > 0.0f) && (cutoff < 1.0f))) {
+            throw std::runtime_error("beam cutoff must be between zero and one");
+        }
+        m_param_beam_cutoff = cutoff;
+    } else if (key == "perf_counters") {
+        if ((value == "on") || (value == "true")) {
+            m_param_perf_counters = true;
+            if (PerfCounterGroup::for_current_thread().get_num_available() == 0) {
+                m_log_object->write(ILog::WARNING, "Hardware performance counters are not available. "
+                                                   "Check perf_event_paranoid and container restrictions.");
+            }
+        } else if ((value == "off") || (value == "false")) {
+            m_param_perf_counters = false;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+    } else if (key == "spatial_sort") {
+        // Only applies to scatterers added afterwards. See m_param_spatial_sort.
+        m_param_spatial_sort = parse_space_filling_curve(value);
+    } else if (key == "trace_file") {
+        // A path starts recording, the empty string stops it and writes the trace.
+        if (value.empty()) {
+            if (!m_param_trace_file.empty()) {
+                stop_tracing();
+            }
+        } else {
+            TraceRecorder::clear();
+            TraceRecorder::set_enabled(true);
+            m_param_trace_file = value;
+        }
     } else {
         BaseAlgorithm::set_parameter(key, value);
     }
 }
 
+std::string CpuAlgorithm::get_parameter(const std::string& key) const {
+    if (key == "numa_num_nodes") {
+        return std::to_string(m_numa_topology.get_num_nodes());
+    } else if (key == "thread_binding") {
+        return m_param_thread_binding;
+    } else if (key == "numa_replicate") {
+        return m_param_numa_replicate ? "on" : "off";
+    } else if (key == "progressive_passes") {
+        return std::to_string(m_param_progressive_passes);
+    } else if (key == "beam_cutoff") {
+        return std::to_string(m_param_beam_cutoff);
+    } else if (key == "spatial_sort") {
+        switch (m_param_spatial_sort) {
+        case SpaceFillingCurve::MORTON:  return "morton";
+        case SpaceFillingCurve::HILBERT: return "hilbert";
+        default:                         return "none";
+        }
+    } else if (key == "trace_file") {
+        return m_param_trace_file;
+    } else {
+        return BaseAlgorithm::get_parameter(key);
+    }
+}
+
+bool CpuAlgorithm::numa_replication_active() const {
+    return m_param_numa_replicate && (m_numa_topology.get_num_nodes() > 1);
+}
+
+void CpuAlgorithm::update_thread_placement() {
+    // Replicas are useless unless threads stay on their node, so
+    // replication implies binding.
+    auto policy = m_param_thread_binding;
+    if ((policy == "none") && numa_replication_active()) {
+        policy = "spread";
+    }
+
+    if (policy == "none") {
+        m_thread_cpus.clear();
+        m_thread_nodes.assign(m_omp_num_threads, 0);
+    } else {
+        m_thread_cpus = m_numa_topology.assign_cpus(m_omp_num_threads, policy);
+        m_thread_nodes.resize(m_omp_num_threads);
+        for (int thread_no = 0; thread_no < m_omp_num_threads; thread_no++) {
+            m_thread_nodes[thread_no] = m_numa_topology.get_node_of_cpu(m_thread_cpus[thread_no]);
+        }
+    }
+    m_numa_replicas_valid = false;
+    m_numa_replicas.clear();
+}
+
+void CpuAlgorithm::bind_current_thread() {
+#ifdef BCSIM_ENABLE_OPENMP
+    const int thread_idx = omp_get_thread_num();
+#else
+    const int thread_idx = 0;
+#endif
+    if (!m_thread_cpus.empty()) {
+        if (!bind_current_thread_to_cpu(m_thread_cpus[thread_idx]) && m_param_verbose) {
+            m_log_object->write(ILog::WARNING, "Failed to bind thread " + std::to_string(thread_idx));
+        }
+    } else if (m_threads_are_bound) {
+        unbind_current_thread(m_numa_topology);
+    }
+    // the calling thread keeps its own name
+    if ((thread_idx > 0) && TraceRecorder::is_enabled()) {
+        TraceRecorder::set_thread_name("OpenMP worker " + std::to_string(thread_idx));
+    }
+}
+
+void CpuAlgorithm::create_numa_replicas_if_needed() {
+    if (!numa_replication_active() || m_numa_replicas_valid) {
+        return;
+    }
+    const auto num_nodes = m_numa_topology.get_num_nodes();
+    m_numa_replicas.assign(num_nodes, PointScattererCollection());
+    
+    // The first thread placed on a node makes the copy for that node.
+    std::vector<int> copying_thread(num_nodes, -1);
+    for (int thread_no = m_omp_num_threads-1; thread_no >= 0; thread_no--) {
+        copying_thread[m_thread_nodes[thread_no]] = thread_no;
+    }
+
+#ifdef BCSIM_ENABLE_OPENMP
+    omp_set_num_threads(m_omp_num_threads);
+    #pragma omp parallel
+#endif
+    {
+        bind_current_thread();
+#ifdef BCSIM_ENABLE_OPENMP
+        const int thread_idx = omp_get_thread_num();
+#else
+        const int thread_idx = 0;
+#endif
+        const auto node_idx = m_thread_nodes[thread_idx];
+        if (copying_thread[node_idx] == thread_idx) {
+            auto& replica = m_numa_replicas[node_idx];
+            for (const auto& fixed_scatterers : m_scatterers_collection.fixed_collections) {
+                replica.fixed_collections.push_back(std::make_shared<FixedScatterers>(*fixed_scatterers));
+            }
+            for (const auto& spline_scatterers : m_scatterers_collection.spline_collections) {
+                replica.spline_collections.push_back(std::make_shared<SplineScatterers>(*spline_scatterers));
+            }
+            // the fields are small and read-only, so they are shared
+            replica.procedural_collections = m_scatterers_collection.procedural_collections;
+            replica.fixed_bounds = m_scatterers_collection.fixed_bounds;
+            replica.spline_bounds = m_scatterers_collection.spline_bounds;
+        }
+    }
+    m_numa_replicas_valid = true;
+    
+    if (m_param_verbose) {
+        for (int node_idx = 0; node_idx < num_nodes; node_idx++) {
+            const auto num_copied = m_numa_replicas[node_idx].total_num_scatterers();
+            m_log_object->write(ILog::INFO, "NUMA node " + std::to_string(m_numa_topology.get_node_id(node_idx))
+                                            + ": " + std::to_string(num_copied) + " scatterers");
+        }
+    }
+}
+
+const PointScattererCollection& CpuAlgorithm::get_scatterers_for_thread(int thread_idx) const {
+    if (m_numa_replicas_valid) {
+        return m_numa_replicas[m_thread_nodes[thread_idx]];
+    }
+    return m_scatterers_collection;
+}
+
+void CpuAlgorithm::run_numa_benchmark() {
+    const auto num_nodes = m_numa_topology.get_num_nodes();
+    const auto num_data_nodes = m_numa_replicas_valid ? num_nodes : 1;
+    std::vector<double> bandwidths(num_nodes*num_data_nodes, 0.0);
+    std::vector<double> node_ids(num_nodes);
+    for (int node_idx = 0; node_idx < num_nodes; node_idx++) {
+        node_ids[node_idx] = m_numa_topology.get_node_id(node_idx);
+    }
+
+    // Read all scatterer data of one collection, split over the threads on one node.
+    auto stream_collection = [](const PointScattererCollection& collection, int part, int num_parts, size_t& num_bytes) {
+        float sum = 0.0f;
+        num_bytes = 0;
+        for (const auto& fixed_scatterers : collection.fixed_collections) {
+            const auto& v = fixed_scatterers->scatterers;
+            const auto begin = v.size()*part/num_parts;
+            const auto end = v.size()*(part+1)/num_parts;
+            for (size_t i = begin; i < end; i++) {
+                sum += v[i].amplitude + v[i].pos.x + v[i].pos.y + v[i].pos.z;
+            }
+            num_bytes += (end-begin)*sizeof(PointScatterer);
+        }
+        for (const auto& spline_scatterers : collection.spline_collections) {
+            const auto& cs = spline_scatterers->control_points;
+            const auto begin = cs.size()*part/num_parts;
+            const auto end = cs.size()*(part+1)/num_parts;
+            for (size_t i = begin; i < end; i++) {
+                sum += cs[i].x + cs[i].y + cs[i].z;
+            }
+            num_bytes += (end-begin)*sizeof(vector3);
+        }
+        return sum;
+    };
+
+    // rank of each thread among the threads on its node
+    std::vector<int> rank_in_node(m_omp_num_threads);
+    std::vector<int> threads_on_node(num_nodes, 0);
+    for (int thread_no = 0; thread_no < m_omp_num_threads; thread_no++) {
+        rank_in_node[thread_no] = threads_on_node[m_thread_nodes[thread_no]]++;
+    }
+
+    // The checksum is stored so that the reads cannot be optimized away.
+    double total_checksum = 0.0;
+    for (int thread_node = 0; thread_node < num_nodes; thread_node++) {
+        if (threads_on_node[thread_node] == 0) continue;
+        for (int data_node = 0; data_node < num_data_nodes; data_node++) {
+            const auto& collection = m_numa_replicas_valid ? m_numa_replicas[data_node] : m_scatterers_collection;
+            size_t total_bytes = 0;
+            float checksum = 0.0f;
+            const auto start = std::chrono::steady_clock::now();
+#ifdef BCSIM_ENABLE_OPENMP
+            omp_set_num_threads(m_omp_num_threads);
+            #pragma omp parallel reduction(+:total_bytes, checksum)
+#endif
+            {
+#ifdef BCSIM_ENABLE_OPENMP
+                const int thread_idx = omp_get_thread_num();
+#else
+                const int thread_idx = 0;
+#endif
+                if (m_thread_nodes[thread_idx] == thread_node) {
+                    size_t num_bytes;
+                    checksum += stream_collection(collection, rank_in_node[thread_idx], threads_on_node[thread_node], num_bytes);
+                    total_bytes += num_bytes;
+                }
+            }
+            const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            total_checksum += checksum;
+            const auto gb_per_sec = (elapsed > 0.0) ? total_bytes/elapsed*1e-9 : 0.0;
+            bandwidths[thread_node*num_data_nodes + data_node] = gb_per_sec;
+            m_log_object->write(ILog::INFO, "NUMA benchmark: threads on node " + std::to_string(m_numa_topology.get_node_id(thread_node))
+                                            + " reading data on node " + std::to_string(m_numa_topology.get_node_id(data_node))
+                                            + ": " + std::to_string(gb_per_sec) + " GB/s");
+        }
+    }
+
+    // Row-major matrix: row is node of reading threads, column is node holding the data.
+    m_debug_data["numa_bandwidth_gbs"] = bandwidths;
+    m_debug_data["numa_node_ids"]      = node_ids;
+    m_debug_data["numa_checksum"]      = std::vector<double>(1, total_checksum);
+}
+
 void CpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
     if (!new_scan_sequence->is_valid()) {
         throw std::runtime_error("scan sequence is invalid");
@@ -262,10 +669,14 @@ void CpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
     m_scan_sequence = new_scan_sequence;
     m_scan_sequence_configured = true;
 
+    // The convolvers only depend on the number of samples, so they are kept
+    // when a long sequence is simulated a few lines at a time.
     const auto line_length = m_scan_sequence->line_length;
-    m_rf_line_num_samples = compute_num_rf_samples(m_param_sound_speed, line_length, m_excitation.sampling_frequency);
-
-    configure_convolvers_if_possible();
+    const auto num_samples = compute_num_rf_samples(m_param_sound_speed, line_length, m_excitation.sampling_frequency);
+    if (convolvers.empty() || (num_samples != m_rf_line_num_samples)) {
+        m_rf_line_num_samples = num_samples;
+        configure_convolvers_if_possible();
+    }
 }
 
 
@@ -279,6 +690,8 @@ void CpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float>> >
     throw_if_not_configured();
     const auto num_scanlines = m_scan_sequence->get_num_lines();
     rfLines.resize(num_scanlines);
+    ScopedTraceEvent trace_event("simulate_lines", "simulation");
+    trace_event.set_arg("num_lines", num_scanlines);
 
     if (m_param_verbose) {
         m_log_object->write(ILog::INFO, "Sound speed: " + std::to_string(m_param_sound_speed));
@@ -286,17 +699,232 @@ void CpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float>> >
         m_log_object->write(ILog::INFO, "Number of OpenMP threads: " + std::to_string(m_omp_num_threads));
         m_log_object->write(ILog::INFO, "IQ demodulation frequency: " + std::to_string(m_excitation.demod_freq));
     }    
+
+    // The calling thread is thread 0 of every parallel region below, and
+    // must not stay bound to a CPU once this returns.
+    const ScopedAffinityRestore caller_affinity;
+    create_numa_replicas_if_needed();
+    if (m_param_numa_benchmark) {
+        run_numa_benchmark();
+    }
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    m_stage_timings.assign(m_omp_num_threads, StageTimings());
+    const auto frame_start = ScopedStageTimer::Clock::now();
+#endif
+    const auto perf_frame_start = std::chrono::steady_clock::now();
+    if (m_param_perf_counters) {
+        PerfCounterGroup::Values zeros;
+        zeros.fill(0);
+        m_perf_projection.assign(m_omp_num_threads, zeros);
+        m_perf_convolution.assign(m_omp_num_threads, zeros);
+    }
+    if (!m_scatterers_collection.procedural_collections.empty()) {
+        while (m_procedural_buffers.size() < static_cast<size_t>(m_omp_num_threads)) {
+            m_procedural_buffers.push_back(std::make_shared<FixedScatterers>());
+        }
+    } else {
+        m_procedural_buffers.clear();
+    }
+
+    if (m_param_progressive_passes > 1) {
+        simulate_lines_progressive(rfLines);
+    } else {
+        std::atomic<int>  num_lines_done(0);
+        std::atomic<bool> cancelled(false);
 #ifdef BCSIM_ENABLE_OPENMP
-    omp_set_num_threads(m_omp_num_threads);
-    #pragma omp parallel for
+        omp_set_num_threads(m_omp_num_threads);
+        #pragma omp parallel
+#endif
+        {
+            bind_current_thread();
+#ifdef BCSIM_ENABLE_OPENMP
+            #pragma omp for
 #endif
-    for (int line_no = 0; line_no < num_scanlines; line_no++) {
-        const auto& line = m_scan_sequence->get_scanline(line_no);
+            for (int line_no = 0; line_no < num_scanlines; line_no++) {
+                if (cancelled.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                const auto& line = m_scan_sequence->get_scanline(line_no);
+                if (m_param_verbose) {
+                    m_log_object->write(ILog::INFO, "Simulating line number " + std::to_string(line_no));
+                }
+                rfLines[line_no] = simulate_line(line);
+                if (m_line_callback && !m_line_callback(++num_lines_done)) {
+                    cancelled.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+        m_threads_are_bound = !m_thread_cpus.empty();
+    }
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    const auto frame_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(ScopedStageTimer::Clock::now() - frame_start).count();
+    store_stage_timings(frame_ns);
+#endif
+    if (m_param_perf_counters) {
+        store_perf_counters(std::chrono::duration<double>(std::chrono::steady_clock::now() - perf_frame_start).count());
+    }
+}
+
+void CpuAlgorithm::store_perf_counters(double frame_seconds) {
+    const auto num_scatterer_lines = static_cast<double>(m_scatterers_collection.total_num_scatterers())*m_scan_sequence->get_num_lines();
+    std::array<bool, PerfCounterGroup::NUM_COUNTERS> available;
+    available.fill(false);
+    int64_t llc_misses = 0;
+    for (const auto& stage : {std::make_pair("projection", &m_perf_projection), std::make_pair("convolution", &m_perf_convolution)}) {
+        PerfCounterGroup::Values sum;
+        sum.fill(0);
+        for (const auto& values : *stage.second) {
+            for (int i = 0; i < PerfCounterGroup::NUM_COUNTERS; i++) {
+                sum[i] = ((sum[i] < 0) || (values[i] < 0)) ? -1 : sum[i] + values[i];
+            }
+        }
+        // Unavailable counters are left out.
+        const std::string prefix = std::string("perf_") + stage.first + "_";
+        for (int i = 0; i < PerfCounterGroup::NUM_COUNTERS; i++) {
+            const std::string name = prefix + PerfCounterGroup::get_counter_name(static_cast<PerfCounterGroup::Counter>(i));
+            m_debug_data.erase(name);
+            m_debug_data.erase(name + "_per_scatterer_line");
+            if (sum[i] >= 0) {
+                available[i] = true;
+                m_debug_data[name] = std::vector<double>(1, static_cast<double>(sum[i]));
+                if (num_scatterer_lines > 0.0) {
+                    m_debug_data[name + "_per_scatterer_line"] = std::vector<double>(1, sum[i]/num_scatterer_lines);
+                }
+            }
+        }
+        m_debug_data.erase(prefix + "ipc");
+        if ((sum[PerfCounterGroup::CYCLES] > 0) && (sum[PerfCounterGroup::INSTRUCTIONS] >= 0)) {
+            m_debug_data[prefix + "ipc"] = std::vector<double>(1, static_cast<double>(sum[PerfCounterGroup::INSTRUCTIONS])/sum[PerfCounterGroup::CYCLES]);
+        }
+        llc_misses = ((llc_misses < 0) || (sum[PerfCounterGroup::LLC_MISSES] < 0)) ? -1 : llc_misses + sum[PerfCounterGroup::LLC_MISSES];
+    }
+    m_debug_data["perf_counters_available"] = std::vector<double>(1, static_cast<double>(std::count(available.begin(), available.end(), true)));
+
+    // Memory traffic estimated as one cache line per last-level cache miss.
+    // Write-backs and prefetches are not counted, so this is a lower bound.
+    m_debug_data.erase("perf_memory_bytes");
+    m_debug_data.erase("perf_memory_bandwidth");
+    if (llc_misses >= 0) {
+        const double memory_bytes = static_cast<double>(llc_misses)*PerfCounterGroup::get_cache_line_size();
+        m_debug_data["perf_memory_bytes"] = std::vector<double>(1, memory_bytes);
+        if (frame_seconds > 0.0) {
+            m_debug_data["perf_memory_bandwidth"] = std::vector<double>(1, memory_bytes/frame_seconds);
+        }
+    }
+}
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+void CpuAlgorithm::store_stage_timings(int64_t frame_ns) {
+    StageTimings sum;
+    std::vector<double> thread_busy_ns;
+    for (const auto& timings : m_stage_timings) {
+        sum.projection_ns       += timings.projection_ns;
+        sum.noise_ns            += timings.noise_ns;
+        sum.fft_ns              += timings.fft_ns;
+        sum.demodulation_ns     += timings.demodulation_ns;
+        sum.num_visited         += timings.num_visited;
+        sum.num_contributing    += timings.num_contributing;
+        thread_busy_ns.push_back(static_cast<double>(timings.total_ns()));
+    }
+    // Times are summed over threads, except the wall-clock frame time.
+    m_debug_data["cpu_frame_ns"]                = std::vector<double>(1, static_cast<double>(frame_ns));
+    m_debug_data["cpu_projection_ns"]           = std::vector<double>(1, static_cast<double>(sum.projection_ns));
+    m_debug_data["cpu_noise_ns"]                = std::vector<double>(1, static_cast<double>(sum.noise_ns));
+    m_debug_data["cpu_fft_ns"]                  = std::vector<double>(1, static_cast<double>(sum.fft_ns));
+    m_debug_data["cpu_demodulation_ns"]         = std::vector<double>(1, static_cast<double>(sum.demodulation_ns));
+    m_debug_data["cpu_thread_busy_ns"]          = thread_busy_ns;
+    m_debug_data["cpu_scatterers_visited"]      = std::vector<double>(1, static_cast<double>(sum.num_visited));
+    m_debug_data["cpu_scatterers_contributing"] = std::vector<double>(1, static_cast<double>(sum.num_contributing));
+}
+#endif
+
+void CpuAlgorithm::simulate_lines_progressive(std::vector<std::vector<std::complex<float>> >& rfLines) {
+    const auto num_scanlines = m_scan_sequence->get_num_lines();
+    const int num_passes = m_param_progressive_passes;
+
+    // Number of scatterers in each pass, needed to rescale the partial sums.
+    std::vector<size_t> pass_sizes(num_passes, 0);
+    for (int i = 0; i < num_passes; i++) {
+        for (const auto& pass_indices : m_fixed_pass_indices) {
+            pass_sizes[i] += pass_indices.size(i);
+        }
+        for (const auto& pass_indices : m_spline_pass_indices) {
+            pass_sizes[i] += pass_indices.size(i);
+        }
+    }
+    // Procedural scatterers are generated per line, so their pass sizes are only expected values.
+    const auto num_procedural = m_scatterers_collection.total_num_procedural_scatterers();
+    for (int i = 0; i < num_passes; i++) {
+        pass_sizes[i] += num_procedural/num_passes + ((static_cast<size_t>(i) < num_procedural % num_passes) ? 1 : 0);
+    }
+    const auto total_num_scatterers = m_scatterers_collection.total_num_scatterers();
+
+    m_progressive_time_proj.assign(num_scanlines*m_rf_line_num_samples, std::complex<float>(0.0f, 0.0f));
+    std::atomic<int>  num_lines_done(0);
+    std::atomic<bool> cancelled(false);
+    size_t num_included = 0;
+    int pass_no = 0;
+    while (pass_no < num_passes) {
+        num_included += pass_sizes[pass_no];
+        
+        // Speckle is an incoherent sum, so its energy is proportional to the number
+        // of scatterers. Scale amplitudes by sqrt(N/n) to make a subset of n look
+        // like the full set of N. The last pass is unscaled.
+        const float amplitude_scale = (num_included > 0) ? static_cast<float>(std::sqrt(static_cast<double>(total_num_scatterers)/num_included)) : 0.0f;
+        ScopedTraceEvent trace_event("progressive_pass", "simulation");
+        trace_event.set_arg("pass_no", pass_no);
+
+#ifdef BCSIM_ENABLE_OPENMP
+        omp_set_num_threads(m_omp_num_threads);
+        #pragma omp parallel
+#endif
+        {
+            bind_current_thread();
+#ifdef BCSIM_ENABLE_OPENMP
+            const int thread_idx = omp_get_thread_num();
+            #pragma omp for
+#else
+            const int thread_idx = 0;
+#endif
+            for (int line_no = 0; line_no < num_scanlines; line_no++) {
+                if (cancelled.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                const auto& line = m_scan_sequence->get_scanline(line_no);
+                auto accumulated = m_progressive_time_proj.data() + static_cast<size_t>(line_no)*m_rf_line_num_samples;
+                if (!project_scatterers(line, accumulated, pass_no, num_passes) && (m_param_noise_amplitude <= 0.0f)) {
+                    rfLines[line_no] = get_empty_line();
+                } else {
+                    auto time_proj_signal = convolvers[thread_idx]->get_zeroed_time_proj_signal();
+                    for (size_t i = 0; i < m_rf_line_num_samples; i++) {
+                        time_proj_signal[i] = accumulated[i]*amplitude_scale;
+                    }
+                    rfLines[line_no] = convolve_and_demodulate(thread_idx, time_proj_signal);
+                }
+                if (m_line_callback && !m_line_callback(++num_lines_done)) {
+                    cancelled.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+        m_threads_are_bound = !m_thread_cpus.empty();
+        if (cancelled.load()) {
+            break;
+        }
+        pass_no++;
+
         if (m_param_verbose) {
-            m_log_object->write(ILog::INFO, "Simulating line number " + std::to_string(line_no));
+            m_log_object->write(ILog::INFO, "Progressive pass " + std::to_string(pass_no) + " of " + std::to_string(num_passes)
+                                            + ": " + std::to_string(num_included) + " scatterers");
+        }
+        if ((pass_no < num_passes) && m_intermediate_frame_callback) {
+            if (!m_intermediate_frame_callback(pass_no, num_passes, rfLines)) {
+                break;
+            }
         }
-        rfLines[line_no] = simulate_line(line);
     }
+    m_debug_data["progressive_passes_done"] = std::vector<double>(1, static_cast<double>(pass_no));
 }
 
 std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& line) {
@@ -312,21 +940,107 @@ std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& lin
     
     // this will have length num_time_samples [which is valid before padding starts]
     auto time_proj_signal = convolvers[thread_idx]->get_zeroed_time_proj_signal();
+    if (!project_scatterers(line, time_proj_signal, 0, 1) && (m_param_noise_amplitude <= 0.0f)) {
+        return get_empty_line();
+    }
+    return convolve_and_demodulate(thread_idx, time_proj_signal);
+}
+
+std::vector<std::complex<float>> CpuAlgorithm::get_empty_line() const {
+    const auto num_samples = (m_rf_line_num_samples + m_radial_decimation - 1)/m_radial_decimation;
+    return std::vector<std::complex<float>>(num_samples, std::complex<float>(0.0f, 0.0f));
+}
+
+bool CpuAlgorithm::project_scatterers(const Scanline& line, std::complex<float>* time_proj_signal, int pass_no, int num_passes) {
+#ifdef BCSIM_ENABLE_OPENMP
+    const int thread_idx = omp_get_thread_num();
+#else
+    const int thread_idx = 0;
+#endif
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    ScopedStageTimer timer(m_stage_timings[thread_idx].projection_ns);
+#endif
+    ScopedTraceEvent trace_event("project", "simulation");
+    ScopedPerfCounters perf_counters((m_param_perf_counters && (thread_idx < static_cast<int>(m_perf_projection.size())))
+                                     ? &m_perf_projection[thread_idx] : nullptr);
+
+    // node-local copy if NUMA replication is active
+    const auto& scatterers_collection = get_scatterers_for_thread(thread_idx);
+
+    // Part of the beam where scatterers can contribute: from half a sample before
+    // the origin to the end of the line, and where the profile is above the cutoff.
+    float lateral_extent, elevational_extent;
+    get_beam_extent(lateral_extent, elevational_extent);
+    const float sample_length = m_param_sound_speed/(2.0f*m_excitation.sampling_frequency);
+    const float radial_min = -sample_length;
+    const float radial_max = m_rf_line_num_samples*sample_length;
+    const auto in_beam = [&](const BoundingBox& bounds) {
+        return box_may_intersect_beam(bounds, line, radial_min, radial_max, lateral_extent, elevational_extent);
+    };
+    bool any_projected = false;
 
     // Project all fixed scatterers
-    const auto num_fixed_collections = m_scatterers_collection.fixed_collections.size();
+    const auto num_fixed_collections = scatterers_collection.fixed_collections.size();
     for (size_t i = 0; i < num_fixed_collections; i++) {
-        const auto fixed_scatterers = m_scatterers_collection.fixed_collections[i];
-        projection_loop(fixed_scatterers, line, time_proj_signal, m_rf_line_num_samples);
+        if (!in_beam(scatterers_collection.fixed_bounds[i])) {
+            continue;
+        }
+        const auto fixed_scatterers = scatterers_collection.fixed_collections[i];
+        if (num_passes > 1) {
+            const auto& pass_indices = m_fixed_pass_indices[i];
+            projection_loop(fixed_scatterers, line, time_proj_signal, m_rf_line_num_samples, pass_indices.begin(pass_no), pass_indices.size(pass_no));
+        } else {
+            projection_loop(fixed_scatterers, line, time_proj_signal, m_rf_line_num_samples);
+        }
+        any_projected = true;
     }
     
     // Project all spline scatterers
-    const auto num_spline_collections = m_scatterers_collection.spline_collections.size();
+    const auto num_spline_collections = scatterers_collection.spline_collections.size();
     for (size_t i = 0; i < num_spline_collections; i++) {
-        const auto spline_scatterers = m_scatterers_collection.spline_collections[i];
-        projection_loop(spline_scatterers, line, time_proj_signal, m_rf_line_num_samples);
+        if (!in_beam(scatterers_collection.spline_bounds[i])) {
+            continue;
+        }
+        const auto spline_scatterers = scatterers_collection.spline_collections[i];
+        if (num_passes > 1) {
+            const auto& pass_indices = m_spline_pass_indices[i];
+            projection_loop(spline_scatterers, line, time_proj_signal, m_rf_line_num_samples, pass_indices.begin(pass_no), pass_indices.size(pass_no));
+        } else {
+            projection_loop(spline_scatterers, line, time_proj_signal, m_rf_line_num_samples);
+        }
+        any_projected = true;
     }
-    
+
+    // Generate and project scatterers of all procedural regions
+    for (const auto& procedural_scatterers : scatterers_collection.procedural_collections) {
+        if (!in_beam(BoundingBox(procedural_scatterers->get_box_min(), procedural_scatterers->get_box_max()))) {
+            continue;
+        }
+        projection_loop(procedural_scatterers, line, time_proj_signal, m_rf_line_num_samples, pass_no, num_passes);
+        any_projected = true;
+    }
+    trace_event.set_arg("any_projected", any_projected ? 1 : 0);
+    return any_projected;
+}
+
+void CpuAlgorithm::get_beam_extent(float& lateral, float& elevational) const {
+    if (m_cur_beam_profile_type == BeamProfileType::ANALYTICAL) {
+        const auto gaussian = std::static_pointer_cast<GaussianBeamProfile>(m_beam_profile);
+        const auto num_sigmas = std::sqrt(-2.0f*std::log(m_param_beam_cutoff));
+        lateral = num_sigmas*gaussian->getSigmaLateral();
+        elevational = num_sigmas*gaussian->getSigmaElevational();
+    } else if (m_cur_beam_profile_type == BeamProfileType::LOOKUP) {
+        // the lookup table is zero outside its range
+        const auto lut = std::static_pointer_cast<LUTBeamProfile>(m_beam_profile);
+        lateral = std::max(std::abs(lut->getLateralRange().first), std::abs(lut->getLateralRange().last));
+        elevational = std::max(std::abs(lut->getElevationalRange().first), std::abs(lut->getElevationalRange().last));
+    } else {
+        throw std::runtime_error("Beam profile not configured.");
+    }
+}
+
+std::vector<std::complex<float>> CpuAlgorithm::convolve_and_demodulate(int thread_idx, std::complex<float>* time_proj_signal) {
 #ifdef BCSIM_ENABLE_NAN_CHECK
     for (size_t i = 0; i < m_rf_line_num_samples; i++) {
         // NOTE: will probably not work if compile with "fast-math", so it makes
@@ -339,6 +1053,10 @@ std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& lin
 
     // add Gaussian noise if desirable.
     if (m_param_noise_amplitude > 0.0f) {
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+        ScopedStageTimer timer(m_stage_timings[thread_idx].noise_ns);
+#endif
+        ScopedTraceEvent trace_event("noise", "simulation");
         std::transform(time_proj_signal, time_proj_signal + m_rf_line_num_samples, time_proj_signal, [&](std::complex<float> v) {
             const auto noise_real = m_normal_dist(m_random_engine);
             const auto noise_imag = m_normal_dist(m_random_engine);
@@ -347,24 +1065,23 @@ std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& lin
     }
 
     // get the convolver associated with this thread and do FFT-based convolution
-    // complex down-shifting to form a proper IQ signal. TODO: consider precomputing the complex exponential
-    auto temp_line = convolvers[thread_idx]->process();
-    // TODO: Consider merging decimateion. No need to compute samples that we later discard..
-    const auto f_demod = m_excitation.demod_freq;
-    const float norm_f_demod = f_demod/m_excitation.sampling_frequency;
-    const float TWO_PI = static_cast<float>(2.0*4.0*std::atan(1));
-    for (size_t i = 0; i < temp_line.size(); i++) {
-        temp_line[i] *= std::exp(-TWO_PI*std::complex<float>(0.0f, 1.0)*norm_f_demod*static_cast<float>(i));
-    }
-    
-    // Decimate
-    // TODO: Consider reserve to avoid unneeded allocations resulting from push_back()?
-    std::vector<std::complex<float>> res;
-    for (int i = 0; i < static_cast<int>(temp_line.size()); i += m_radial_decimation) {
-        res.push_back(temp_line[i]);
+    std::vector<std::complex<float>> temp_line;
+    {
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+        ScopedStageTimer timer(m_stage_timings[thread_idx].fft_ns);
+#endif
+        ScopedTraceEvent trace_event("convolve", "simulation");
+        ScopedPerfCounters perf_counters((m_param_perf_counters && (thread_idx < static_cast<int>(m_perf_convolution.size())))
+                                         ? &m_perf_convolution[thread_idx] : nullptr);
+        temp_line = convolvers[thread_idx]->process();
     }
 
-    return res;
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    ScopedStageTimer timer(m_stage_timings[thread_idx].demodulation_ns);
+#endif
+    ScopedTraceEvent trace_event("demodulate", "simulation");
+    const float norm_f_demod = m_excitation.demod_freq/m_excitation.sampling_frequency;
+    return demodulate_and_decimate(temp_line, norm_f_demod, m_radial_decimation);
 }
 
 void CpuAlgorithm::configure_convolvers_if_possible() {
@@ -419,10 +1136,26 @@ void CpuAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
 
 void CpuAlgorithm::clear_fixed_scatterers() {
     m_scatterers_collection.fixed_collections.clear();
+    m_scatterers_collection.fixed_bounds.clear();
+    m_fixed_pass_indices.clear();
+    m_numa_replicas_valid = false;
+    m_numa_replicas.clear();
 }
 
 void CpuAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    // Sorted in place if the caller has no reference left, else a sorted copy is kept.
+    if (m_param_spatial_sort != SpaceFillingCurve::NONE) {
+        fixed_scatterers = sort_fixed_scatterers(std::move(fixed_scatterers), m_param_spatial_sort);
+    }
     m_scatterers_collection.fixed_collections.push_back(fixed_scatterers);
+    const auto& scatterers = fixed_scatterers->scatterers;
+    m_scatterers_collection.fixed_bounds.push_back(compute_bounding_box(static_cast<int>(scatterers.size()), [&](int i) {
+        return scatterers[i].pos;
+    }));
+    if (m_param_progressive_passes > 1) {
+        m_fixed_pass_indices.push_back(make_progressive_pass_indices(scatterers.size(), m_param_progressive_passes));
+    }
+    m_numa_replicas_valid = false;
     if (m_param_verbose) {
         m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
         m_log_object->write(ILog::INFO, "Number of spline scatterers: " + std::to_string(m_scatterers_collection.total_num_spline_scatterers()));
@@ -431,16 +1164,59 @@ void CpuAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers)
 
 void CpuAlgorithm::clear_spline_scatterers() {
     m_scatterers_collection.spline_collections.clear();
+    m_scatterers_collection.spline_bounds.clear();
+    m_spline_pass_indices.clear();
+    m_numa_replicas_valid = false;
+    m_numa_replicas.clear();
 }
 
 void CpuAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    if (m_param_spatial_sort != SpaceFillingCurve::NONE) {
+        spline_scatterers = sort_spline_scatterers(std::move(spline_scatterers), m_param_spatial_sort);
+    }
     m_scatterers_collection.spline_collections.push_back(spline_scatterers);
+    const auto& control_points = spline_scatterers->control_points;
+    m_scatterers_collection.spline_bounds.push_back(compute_bounding_box(static_cast<int>(control_points.size()), [&](int i) {
+        return control_points[i];
+    }));
+    if (m_param_progressive_passes > 1) {
+        m_spline_pass_indices.push_back(make_progressive_pass_indices(spline_scatterers->num_scatterers(), m_param_progressive_passes));
+    }
+    m_numa_replicas_valid = false;
     if (m_param_verbose) {
         m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
         m_log_object->write(ILog::INFO, "Number of spline scatterers: " + std::to_string(m_scatterers_collection.total_num_spline_scatterers()));
     }
 }
 
+void CpuAlgorithm::update_progressive_pass_indices() {
+    m_fixed_pass_indices.clear();
+    m_spline_pass_indices.clear();
+    if (m_param_progressive_passes <= 1) {
+        return;
+    }
+    for (const auto& fixed_scatterers : m_scatterers_collection.fixed_collections) {
+        m_fixed_pass_indices.push_back(make_progressive_pass_indices(fixed_scatterers->num_scatterers(), m_param_progressive_passes));
+    }
+    for (const auto& spline_scatterers : m_scatterers_collection.spline_collections) {
+        m_spline_pass_indices.push_back(make_progressive_pass_indices(spline_scatterers->num_scatterers(), m_param_progressive_passes));
+    }
+}
+
+void CpuAlgorithm::clear_procedural_scatterers() {
+    m_scatterers_collection.procedural_collections.clear();
+    m_numa_replicas_valid = false;
+    m_numa_replicas.clear();
+}
+
+void CpuAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    m_scatterers_collection.procedural_collections.push_back(procedural_scatterers);
+    m_numa_replicas_valid = false;
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Expected number of procedural scatterers: " + std::to_string(m_scatterers_collection.total_num_procedural_scatterers()));
+    }
+}
+
 size_t CpuAlgorithm::get_total_num_scatterers() const {
     return m_scatterers_collection.total_num_scatterers();
 }
@@ -35,13 +35,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../ScanSequence.hpp"
 #include "../BeamProfile.hpp"
 #include "../BeamConvolver.hpp"
+#include "NumaTopology.hpp"
+#include "StageTimings.hpp"
+#include "PerfCounters.hpp"
+#include "SpatialSort.hpp"
+#include "BoundingBox.hpp"
 
 namespace bcsim {
 
-// A collection or zero or more fixed and spline scatterer sets.
+// A collection or zero or more fixed, spline and procedural scatterer sets.
 struct PointScattererCollection {
-    std::vector<FixedScatterers::s_ptr>     fixed_collections;
-    std::vector<SplineScatterers::s_ptr>    spline_collections;
+    std::vector<FixedScatterers::s_ptr>         fixed_collections;
+    std::vector<SplineScatterers::s_ptr>        spline_collections;
+    std::vector<ProceduralScatterers::s_ptr>    procedural_collections;
+
+    // Bounds of each fixed and spline collection, in the same order. The bounds
+    // of spline scatterers contain all control points, and therefore the whole
+    // trajectories by the convex hull property of B-splines.
+    std::vector<BoundingBox>                    fixed_bounds;
+    std::vector<BoundingBox>                    spline_bounds;
 
     // Compute the total number of fixed scatterers.
     size_t total_num_fixed_scatterers() const {
@@ -61,20 +73,41 @@ struct PointScattererCollection {
         return num_scatterers;
     }
 
-    // Compute the overall total number of scatterers (fixed and spline)
+    // Compute the expected total number of procedural scatterers.
+    size_t total_num_procedural_scatterers() const {
+        double num_scatterers = 0.0;
+        for (const auto& scatterers : procedural_collections) {
+            num_scatterers += scatterers->get_expected_num_scatterers();
+        }
+        return static_cast<size_t>(num_scatterers + 0.5);
+    }
+
+    // Compute the overall total number of scatterers (fixed, spline and procedural)
     size_t total_num_scatterers() const {
-        return total_num_fixed_scatterers() + total_num_spline_scatterers();
+        return total_num_fixed_scatterers() + total_num_spline_scatterers() + total_num_procedural_scatterers();
     }
 };
 
+// Scatterer indices of a collection grouped by progressive pass. Pass p
+// consists of indices[offsets[p]], ..., indices[offsets[p+1]-1].
+struct ProgressivePassIndices {
+    std::vector<uint32_t>   indices;
+    std::vector<size_t>     offsets;
+
+    const uint32_t* begin(int pass_no) const { return indices.data() + offsets[pass_no]; }
+    size_t size(int pass_no) const           { return offsets[pass_no + 1] - offsets[pass_no]; }
+};
+
 // Concrete CPU simulator implementation.
 class CpuAlgorithm : public BaseAlgorithm {
 public:
     CpuAlgorithm();
 
-    virtual ~CpuAlgorithm() { }
+    virtual ~CpuAlgorithm();
         
     virtual void set_parameter(const std::string& key, const std::string& value)                    override;
+
+    virtual std::string get_parameter(const std::string& key)                                 const override;
     
     virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)                           override;
 
@@ -94,14 +127,27 @@ public:
 
     virtual void add_spline_scatterers(SplineScatterers::s_ptr)                                     override;
 
+    virtual void clear_procedural_scatterers()                                                      override;
+
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                             override;
+
     virtual size_t get_total_num_scatterers() const                                                 override;
 
 protected:
-    // Projection loop for a single fixed scatterer dataset.
-    void projection_loop(FixedScatterers::s_ptr fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples);
+    // Projection loop for a single fixed scatterer dataset. If scatterer_indices
+    // is given, only those num_indices scatterers are projected.
+    void projection_loop(FixedScatterers::s_ptr fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                         const uint32_t* scatterer_indices = nullptr, size_t num_indices = 0);
     
     // Projection loop for a single spline scatterer dataset.
-    void projection_loop(SplineScatterers::s_ptr spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples);
+    void projection_loop(SplineScatterers::s_ptr spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                         const uint32_t* scatterer_indices = nullptr, size_t num_indices = 0);
+
+    // Projection loop for a single procedural scatterer region. Only the cells
+    // inside the beam, and in pass pass_no if num_passes is larger than one,
+    // are generated, and then projected as fixed scatterers.
+    void projection_loop(ProceduralScatterers::s_ptr procedural_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                         int pass_no = 0, int num_passes = 1);
 
 protected:
     // Use as many cores as possible for simulation.
@@ -119,11 +165,68 @@ protected:
     // Throw a runtime_error if everything isn't properly configured.
     void throw_if_not_configured();
     
+    // Recompute the thread-to-CPU mapping and invalidate the
+    // per-node scatterer replicas.
+    void update_thread_placement();
+
+    // Bind the calling OpenMP thread according to the current placement.
+    void bind_current_thread();
+
+    // (Re)create node-local copies of all scatterer collections if NUMA
+    // replication is active. Each copy is made by a thread bound to the
+    // node it belongs to, so that first-touch puts the pages there.
+    void create_numa_replicas_if_needed();
+
+    // Measure read bandwidth from threads on every node to the scatterer
+    // data on every node and store it as debug data.
+    void run_numa_benchmark();
+
+    // True if one copy of the scatterers is kept per NUMA node.
+    bool numa_replication_active() const;
+
+    // The scatterer collection a given thread should read from.
+    const PointScattererCollection& get_scatterers_for_thread(int thread_idx) const;
+
+    // Lateral and elevational distance from the beam axis beyond which the
+    // beam profile is below m_param_beam_cutoff.
+    void get_beam_extent(float& lateral, float& elevational) const;
+
     // Simulate a single RF line.
     // Returns a std::vector of IQ signal samples.
     // Sampling frequency is the same as for the excitation signal. TODO: Not so with decimation...
     std::vector<std::complex<float>> simulate_line(const Scanline& line);
 
+    // Add the scatterers of one progressive pass to a time-projected signal.
+    // Collections outside of the beam are skipped. Returns false if all were.
+    bool project_scatterers(const Scanline& line, std::complex<float>* time_proj_signal, int pass_no, int num_passes);
+
+    // Convolve the time-projected signal (which must be the one owned by the
+    // thread's convolver) with the excitation, then demodulate and decimate.
+    std::vector<std::complex<float>> convolve_and_demodulate(int thread_idx, std::complex<float>* time_proj_signal);
+
+    // Demodulated line of zeros, for lines without scatterers in the beam.
+    std::vector<std::complex<float>> get_empty_line() const;
+
+    // Simulate all lines in a number of passes, each adding a random subset of
+    // the scatterers to the same time projections.
+    void simulate_lines_progressive(std::vector<std::vector<std::complex<float>> >& rf_lines);
+
+    // Recompute the pass indices of all fixed and spline collections for the
+    // current number of progressive passes, or drop them if it is one.
+    void update_progressive_pass_indices();
+
+    // Stop trace recording and write the trace to m_param_trace_file.
+    void stop_tracing();
+
+    // Store hardware counter totals of the last frame as debug data, and the
+    // memory bandwidth estimated from them over frame_seconds.
+    void store_perf_counters(double frame_seconds);
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    // Sum the per-thread stage timings of a frame and store them as debug data.
+    void store_stage_timings(int64_t frame_ns);
+#endif
+
 protected:
     // Geometry of all lines to be simulated in a frame.
     ScanSequence::s_ptr                      m_scan_sequence;
@@ -156,6 +259,76 @@ protected:
     // Debug parameter: If true, sum over all B-spline basis functions instead of
     // only those with non-zero basis functions. Result should be the same.
     bool                       m_param_sum_all_cs;
+
+    // NUMA nodes and CPUs available to this process.
+    NumaTopology                            m_numa_topology;
+
+    // Thread binding policy: "none", "compact", or "spread".
+    std::string                             m_param_thread_binding;
+
+    // Keep one copy of the scatterers on each NUMA node in use (only
+    // has an effect on machines with more than one node). Off by default,
+    // since it copies the whole phantom once per node, also when the
+    // phantom is memory-mapped, and it implies thread binding.
+    bool                                    m_param_numa_replicate;
+
+    // Measure per-node memory bandwidth each time a frame is simulated.
+    bool                                    m_param_numa_benchmark;
+
+    // CPU and node index for each OpenMP thread. The CPU list is empty
+    // if threads are not bound.
+    std::vector<int>                        m_thread_cpus;
+    std::vector<int>                        m_thread_nodes;
+    bool                                    m_threads_are_bound;
+
+    // Number of passes in progressive simulation. One disables it.
+    int                                     m_param_progressive_passes;
+
+    // Accumulated time projections of all lines in progressive simulation.
+    std::vector<std::complex<float>>        m_progressive_time_proj;
+
+    // Pass indices of each fixed and spline collection. Empty unless
+    // m_param_progressive_passes is larger than one.
+    std::vector<ProgressivePassIndices>     m_fixed_pass_indices;
+    std::vector<ProgressivePassIndices>     m_spline_pass_indices;
+
+    // Beam profile level below which scatterers may be skipped: whole
+    // collections whose bounding box is outside this level, and cells of
+    // procedural regions. Default 1e-4, which is 4.3 sigma of a Gaussian
+    // profile, so results are approximate with an error of about this
+    // level relative to the in-beam scatterers (see the validate_beam_cutoff
+    // test). Lookup-table profiles are cut at the table extent instead.
+    float                                   m_param_beam_cutoff;
+
+    // Scatterers generated from procedural regions for the current line, one entry per thread.
+    std::vector<FixedScatterers::s_ptr>     m_procedural_buffers;
+
+    // Where to write the Chrome trace. Empty when not recording.
+    std::string                             m_param_trace_file;
+
+    // Collect hardware counters around projection and convolution.
+    bool                                    m_param_perf_counters;
+
+    // Curve along which added fixed and spline scatterers are sorted. If the
+    // caller keeps a reference to the scatterers, the simulator keeps a sorted
+    // copy, so memory use doubles until the caller releases its reference.
+    // Scatterers loaded from a native phantom are always copied to the heap,
+    // and processes no longer share the mapped file. Such phantoms should be
+    // sorted once before they are saved instead.
+    SpaceFillingCurve                       m_param_spatial_sort;
+
+    // Hardware counters of the current frame, one entry per thread.
+    std::vector<PerfCounterGroup::Values>   m_perf_projection;
+    std::vector<PerfCounterGroup::Values>   m_perf_convolution;
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    // Stage timings of the current frame, one entry per thread.
+    PerThreadStageTimings                   m_stage_timings;
+#endif
+
+    // Node-local copies of m_scatterers_collection indexed by node index.
+    std::vector<PointScattererCollection>   m_numa_replicas;
+    bool                                    m_numa_replicas_valid;
 };
 
 }   // end namespace
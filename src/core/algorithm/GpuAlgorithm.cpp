@@ -588,6 +588,14 @@ void GpuAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scattere
     m_device_spline_datasets.add(spline_scatterers);
 }
 
+void GpuAlgorithm::clear_procedural_scatterers() {
+    // nothing to clear since they can't be added
+}
+
+void GpuAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    throw std::runtime_error("procedural scatterers are not supported by the GPU algorithm");
+}
+
 void GpuAlgorithm::fixed_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceFixedScatterers::s_ptr dataset) {
     auto cur_stream = m_stream_wrappers[stream_no]->get();
 
@@ -77,6 +77,10 @@ public:
 
     virtual void add_spline_scatterers(SplineScatterers::s_ptr)                                     override;
 
+    virtual void clear_procedural_scatterers()                                                      override;
+
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                             override;
+
     virtual size_t get_total_num_scatterers() const                                     override;
 
 protected:
@@ -252,11 +252,12 @@ void DeviceSplineScatterers::transfer_to_device(bcsim::SplineScatterers::s_ptr h
 
     for (size_t spline_no = 0; spline_no < m_num_scatterers; spline_no++) {
         host_control_as[spline_no] = host_scatterers->amplitudes[spline_no];
+        const auto cs = host_scatterers->control_points.data() + spline_no*m_num_cs;
         for (size_t i = 0; i < m_num_cs; i++) {
             const size_t offset = spline_no + i*m_num_scatterers;
-            host_control_xs[offset] = host_scatterers->control_points[spline_no][i].x;
-            host_control_ys[offset] = host_scatterers->control_points[spline_no][i].y;
-            host_control_zs[offset] = host_scatterers->control_points[spline_no][i].z;
+            host_control_xs[offset] = cs[i].x;
+            host_control_ys[offset] = cs[i].y;
+            host_control_zs[offset] = cs[i].z;
         }
     }
     
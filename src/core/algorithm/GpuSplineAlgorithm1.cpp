@@ -81,11 +81,12 @@ void GpuSplineAlgorithm1::set_scatterers(Scatterers::s_ptr new_scatterers) {
 
     for (size_t spline_no = 0; spline_no < m_num_splines; spline_no++) {
         host_control_as[spline_no] = scatterers->amplitudes[spline_no];
+        const auto cs = scatterers->control_points.data() + spline_no*m_num_cs;
         for (size_t i = 0; i < m_num_cs; i++) {
             const size_t offset = spline_no + i*m_num_splines;
-            host_control_xs[offset] = scatterers->control_points[spline_no][i].x;
-            host_control_ys[offset] = scatterers->control_points[spline_no][i].y;
-            host_control_zs[offset] = scatterers->control_points[spline_no][i].z;
+            host_control_xs[offset] = cs[i].x;
+            host_control_ys[offset] = cs[i].y;
+            host_control_zs[offset] = cs[i].z;
         }
     }
     
@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#ifdef __linux__
+    #include <sched.h>
+    #include <pthread.h>
+    #include <dirent.h>
+#endif
+#include "NumaTopology.hpp"
+
+namespace bcsim {
+
+namespace {
+
+#ifdef __linux__
+bool cpu_is_allowed(const cpu_set_t& mask, int cpu) {
+    return (cpu >= 0) && (cpu < CPU_SETSIZE) && CPU_ISSET(cpu, &mask);
+}
+#endif
+
+}   // end anonymous namespace
+
+std::vector<int> parse_cpu_list(const std::string& s) {
+    std::vector<int> res;
+    std::stringstream ss(s);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        const auto dash_pos = range.find('-');
+        if (dash_pos == std::string::npos) {
+            res.push_back(std::stoi(range));
+        } else {
+            const auto first = std::stoi(range.substr(0, dash_pos));
+            const auto last  = std::stoi(range.substr(dash_pos+1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                res.push_back(cpu);
+            }
+        }
+    }
+    return res;
+}
+
+NumaTopology::NumaTopology() {
+#ifdef __linux__
+    cpu_set_t allowed_mask;
+    CPU_ZERO(&allowed_mask);
+    if (sched_getaffinity(0, sizeof(allowed_mask), &allowed_mask) != 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &allowed_mask);
+    }
+
+    std::vector<int> node_ids;
+    if (auto dir = opendir("/sys/devices/system/node")) {
+        while (auto entry = readdir(dir)) {
+            const std::string name(entry->d_name);
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0
+                && std::all_of(name.begin()+4, name.end(), ::isdigit)) {
+                node_ids.push_back(std::stoi(name.substr(4)));
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(node_ids.begin(), node_ids.end());
+
+    for (const auto node_id : node_ids) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node_id) + "/cpulist");
+        std::string cpu_list;
+        if (!in || !std::getline(in, cpu_list)) continue;
+        std::vector<int> cpus;
+        for (const auto cpu : parse_cpu_list(cpu_list)) {
+            if (cpu_is_allowed(allowed_mask, cpu)) cpus.push_back(cpu);
+        }
+        // memory-only nodes and nodes outside our cpuset are of no use
+        if (!cpus.empty()) {
+            m_node_ids.push_back(node_id);
+            m_node_cpus.push_back(cpus);
+        }
+    }
+
+    if (m_node_ids.empty()) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed_mask)) cpus.push_back(cpu);
+        }
+        m_node_ids.push_back(0);
+        m_node_cpus.push_back(cpus);
+    }
+#else
+    const auto num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> cpus(num_cpus);
+    for (unsigned int cpu = 0; cpu < num_cpus; cpu++) cpus[cpu] = static_cast<int>(cpu);
+    m_node_ids.push_back(0);
+    m_node_cpus.push_back(cpus);
+#endif
+}
+
+NumaTopology::NumaTopology(const std::vector<int>& node_ids, const std::vector<std::vector<int>>& node_cpus)
+    : m_node_ids(node_ids),
+      m_node_cpus(node_cpus)
+{
+    if (node_ids.empty() || (node_ids.size() != node_cpus.size())) {
+        throw std::runtime_error("invalid NUMA topology");
+    }
+    for (const auto& cpus : node_cpus) {
+        if (cpus.empty()) {
+            throw std::runtime_error("invalid NUMA topology: node without CPUs");
+        }
+    }
+}
+
+int NumaTopology::get_num_nodes() const {
+    return static_cast<int>(m_node_ids.size());
+}
+
+int NumaTopology::get_node_id(int node_idx) const {
+    return m_node_ids.at(node_idx);
+}
+
+const std::vector<int>& NumaTopology::get_node_cpus(int node_idx) const {
+    return m_node_cpus.at(node_idx);
+}
+
+int NumaTopology::get_num_cpus() const {
+    size_t num_cpus = 0;
+    for (const auto& cpus : m_node_cpus) {
+        num_cpus += cpus.size();
+    }
+    return static_cast<int>(num_cpus);
+}
+
+std::vector<int> NumaTopology::assign_cpus(int num_threads, const std::string& policy) const {
+    std::vector<int> res;
+    res.reserve(num_threads);
+    if (policy == "compact") {
+        std::vector<int> all_cpus;
+        for (const auto& cpus : m_node_cpus) {
+            all_cpus.insert(all_cpus.end(), cpus.begin(), cpus.end());
+        }
+        for (int thread_no = 0; thread_no < num_threads; thread_no++) {
+            res.push_back(all_cpus[thread_no % all_cpus.size()]);
+        }
+    } else if (policy == "spread") {
+        const auto num_nodes = get_num_nodes();
+        std::vector<size_t> next_in_node(num_nodes, 0);
+        for (int thread_no = 0; thread_no < num_threads; thread_no++) {
+            const auto node_idx = thread_no % num_nodes;
+            const auto& cpus = m_node_cpus[node_idx];
+            res.push_back(cpus[next_in_node[node_idx]++ % cpus.size()]);
+        }
+    } else {
+        throw std::runtime_error("invalid thread binding policy: " + policy);
+    }
+    return res;
+}
+
+int NumaTopology::get_node_of_cpu(int cpu) const {
+    for (size_t node_idx = 0; node_idx < m_node_cpus.size(); node_idx++) {
+        const auto& cpus = m_node_cpus[node_idx];
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+            return static_cast<int>(node_idx);
+        }
+    }
+    return -1;
+}
+
+ScopedAffinityRestore::ScopedAffinityRestore() {
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &mask)) m_cpus.push_back(cpu);
+        }
+    }
+#endif
+}
+
+ScopedAffinityRestore::~ScopedAffinityRestore() {
+#ifdef __linux__
+    if (m_cpus.empty()) {
+        return;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (const auto cpu : m_cpus) {
+        CPU_SET(cpu, &mask);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#endif
+}
+
+bool bind_current_thread_to_cpu(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+    return false;
+#endif
+}
+
+bool unbind_current_thread(const NumaTopology& topology) {
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int node_idx = 0; node_idx < topology.get_num_nodes(); node_idx++) {
+        for (const auto cpu : topology.get_node_cpus(node_idx)) {
+            CPU_SET(cpu, &mask);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+    return false;
+#endif
+}
+
+}   // end namespace
@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <string>
+
+namespace bcsim {
+
+// Description of the NUMA nodes available to this process and the
+// logical CPUs belonging to each of them. On systems where the topology
+// cannot be determined (non-Linux, or /sys not mounted) a single node
+// containing all CPUs is reported.
+class NumaTopology {
+public:
+    // Detect the topology. Only CPUs in the affinity mask of the
+    // calling process are included.
+    NumaTopology();
+
+    // Use a known topology: node_cpus[i] are the CPUs of node node_ids[i].
+    NumaTopology(const std::vector<int>& node_ids, const std::vector<std::vector<int>>& node_cpus);
+
+    // Number of nodes with at least one usable CPU.
+    int get_num_nodes() const;
+
+    // Operating system id of node number node_idx, where 0 <= node_idx < get_num_nodes().
+    int get_node_id(int node_idx) const;
+
+    // Logical CPU numbers belonging to node number node_idx.
+    const std::vector<int>& get_node_cpus(int node_idx) const;
+
+    // Total number of usable CPUs over all nodes.
+    int get_num_cpus() const;
+
+    // Compute CPU number to use for each of num_threads threads.
+    //     "compact" - fill up one node before moving on to the next
+    //     "spread"  - distribute threads round-robin over the nodes
+    // Throws std::runtime_error on invalid policy.
+    std::vector<int> assign_cpus(int num_threads, const std::string& policy) const;
+
+    // Returns the node number (index, not OS id) of a CPU, or -1 if unknown.
+    int get_node_of_cpu(int cpu) const;
+
+private:
+    std::vector<int>                m_node_ids;
+    std::vector<std::vector<int>>   m_node_cpus;
+};
+
+// Parse a Linux cpulist string such as "0-3,8-11,16".
+std::vector<int> parse_cpu_list(const std::string& s);
+
+// Restores the CPU affinity that the calling thread had when this was
+// created, so that a thread lent to an OpenMP team is not left bound.
+class ScopedAffinityRestore {
+public:
+    ScopedAffinityRestore();
+    ~ScopedAffinityRestore();
+
+    ScopedAffinityRestore(const ScopedAffinityRestore&) = delete;
+    ScopedAffinityRestore& operator=(const ScopedAffinityRestore&) = delete;
+
+private:
+    // Empty if the affinity could not be read.
+    std::vector<int>    m_cpus;
+};
+
+// Bind the calling thread to a single logical CPU.
+// Returns false if not supported or if the call failed.
+bool bind_current_thread_to_cpu(int cpu);
+
+// Remove any CPU binding of the calling thread, allowing it on
+// all CPUs in the process affinity mask.
+bool unbind_current_thread(const NumaTopology& topology);
+
+}   // end namespace
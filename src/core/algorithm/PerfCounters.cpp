@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <cstring>
+#include "PerfCounters.hpp"
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+
+namespace bcsim {
+
+namespace {
+
+#ifdef __linux__
+int open_counter(uint32_t type, uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = (group_fd == -1) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid 0 and cpu -1: the calling thread on any CPU.
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+uint64_t cache_config(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+#endif
+
+}   // end anonymous namespace
+
+PerfCounterGroup::PerfCounterGroup()
+    : m_leader_fd(-1)
+{
+    m_fds.fill(-1);
+#ifdef __linux__
+    const std::array<std::pair<uint32_t, uint64_t>, NUM_COUNTERS> events = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    }};
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        m_fds[i] = open_counter(events[i].first, events[i].second, m_leader_fd);
+        if ((m_fds[i] >= 0) && (m_leader_fd < 0)) {
+            m_leader_fd = m_fds[i];
+        }
+    }
+    if (m_leader_fd >= 0) {
+        ioctl(m_leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+PerfCounterGroup::~PerfCounterGroup() {
+#ifdef __linux__
+    for (auto fd : m_fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+PerfCounterGroup& PerfCounterGroup::for_current_thread() {
+    thread_local PerfCounterGroup group;
+    return group;
+}
+
+const char* PerfCounterGroup::get_counter_name(Counter counter) {
+    switch (counter) {
+    case CYCLES:        return "cycles";
+    case INSTRUCTIONS:  return "instructions";
+    case L1D_MISSES:    return "l1d_misses";
+    case LLC_MISSES:    return "llc_misses";
+    default:            return "unknown";
+    }
+}
+
+int PerfCounterGroup::get_cache_line_size() {
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_LINESIZE)
+    const auto size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (size > 0) {
+        return static_cast<int>(size);
+    }
+#endif
+    return 64;
+}
+
+int PerfCounterGroup::get_num_available() const {
+    int res = 0;
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (is_available(static_cast<Counter>(i))) {
+            res++;
+        }
+    }
+    return res;
+}
+
+PerfCounterGroup::Values PerfCounterGroup::read() const {
+    Values res;
+    res.fill(-1);
+#ifdef __linux__
+    if (m_leader_fd < 0) {
+        return res;
+    }
+    // Layout with PERF_FORMAT_GROUP: number of counters, time enabled,
+    // time running, then one value per counter in the order they were opened.
+    uint64_t buffer[3 + NUM_COUNTERS];
+    if (::read(m_leader_fd, buffer, sizeof(buffer)) < static_cast<ssize_t>(3*sizeof(uint64_t))) {
+        return res;
+    }
+    const auto num_values = buffer[0];
+    const auto time_enabled = buffer[1];
+    const auto time_running = buffer[2];
+    const double scale = (time_running > 0) ? static_cast<double>(time_enabled)/time_running : 0.0;
+    uint64_t value_no = 0;
+    for (int i = 0; (i < NUM_COUNTERS) && (value_no < num_values); i++) {
+        if (m_fds[i] >= 0) {
+            res[i] = static_cast<int64_t>(scale*buffer[3 + value_no]);
+            value_no++;
+        }
+    }
+#endif
+    return res;
+}
+
+}   // end namespace
@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace bcsim {
+
+// Hardware event counters of the calling thread, read through the Linux
+// perf_event_open interface. Only events in user space are counted, which
+// is allowed for unprivileged processes with the default
+// perf_event_paranoid setting. Counters that can not be opened (other
+// operating systems, containers without access, virtual machines without
+// a PMU) are reported as unavailable instead of causing errors.
+class PerfCounterGroup {
+public:
+    enum Counter {
+        CYCLES = 0,
+        INSTRUCTIONS,
+        L1D_MISSES,     // L1 data cache read misses
+        LLC_MISSES,     // last-level cache misses
+        NUM_COUNTERS
+    };
+
+    // One value per counter. Negative for unavailable counters.
+    typedef std::array<int64_t, NUM_COUNTERS> Values;
+
+    // Opens and starts the counters for the calling thread.
+    PerfCounterGroup();
+
+    ~PerfCounterGroup();
+
+    // The counters of the calling thread, opened on first use and
+    // closed when the thread exits.
+    static PerfCounterGroup& for_current_thread();
+
+    // Name used in debug data and benchmark output, e.g. "llc_misses".
+    static const char* get_counter_name(Counter counter);
+
+    // Bytes transferred per cache miss. 64 if it can not be queried.
+    static int get_cache_line_size();
+
+    bool is_available(Counter counter) const {
+        return m_fds[counter] >= 0;
+    }
+
+    int get_num_available() const;
+
+    // Current counter values, scaled up if the kernel had to multiplex
+    // the counters. Unavailable counters are -1.
+    Values read() const;
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+private:
+    // File descriptors of the counters, -1 if unavailable. The first
+    // available counter is the group leader.
+    std::array<int, NUM_COUNTERS>   m_fds;
+    int                             m_leader_fd;
+};
+
+// Adds the counter increments during the lifetime of the object to an
+// accumulator of the calling thread's counters. Does nothing if the
+// accumulator is null, so that it can always be put on the stack. An
+// accumulated value becomes -1 once a counter has turned out to be
+// unavailable.
+class ScopedPerfCounters {
+public:
+    explicit ScopedPerfCounters(PerfCounterGroup::Values* accumulated)
+        : m_accumulated(accumulated),
+          m_group(accumulated ? &PerfCounterGroup::for_current_thread() : nullptr)
+    {
+        if (m_group) {
+            m_start = m_group->read();
+        }
+    }
+
+    ~ScopedPerfCounters() {
+        if (!m_group) {
+            return;
+        }
+        const auto end = m_group->read();
+        auto& accumulated = *m_accumulated;
+        for (int i = 0; i < PerfCounterGroup::NUM_COUNTERS; i++) {
+            if ((m_start[i] < 0) || (accumulated[i] < 0)) {
+                accumulated[i] = -1;
+            } else {
+                accumulated[i] += end[i] - m_start[i];
+            }
+        }
+    }
+
+    ScopedPerfCounters(const ScopedPerfCounters&) = delete;
+    ScopedPerfCounters& operator=(const ScopedPerfCounters&) = delete;
+
+private:
+    PerfCounterGroup::Values*   m_accumulated;
+    const PerfCounterGroup*     m_group;
+    PerfCounterGroup::Values    m_start;
+};
+
+}   // end namespace
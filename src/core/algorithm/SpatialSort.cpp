@@ -0,0 +1,298 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include "SpatialSort.hpp"
+#include "BoundingBox.hpp"
+#include "../Tracing.hpp"
+
+namespace bcsim {
+namespace {
+
+const int BITS_PER_AXIS = 21;
+
+struct SortEntry {
+    uint64_t    key;
+    uint32_t    index;
+
+    bool operator<(const SortEntry& other) const {
+        return (key < other.key) || ((key == other.key) && (index < other.index));
+    }
+};
+
+// Spread the lower 21 bits of v so that there are two zero bits between each.
+inline uint64_t spread_bits(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | (x << 32)) & 0x001f00000000ffffull;
+    x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+    x = (x | (x <<  8)) & 0x100f00f00f00f00full;
+    x = (x | (x <<  4)) & 0x10c30c30c30c30c3ull;
+    x = (x | (x <<  2)) & 0x1249249249249249ull;
+    return x;
+}
+
+inline uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z) {
+    return (spread_bits(x) << 2) | (spread_bits(y) << 1) | spread_bits(z);
+}
+
+// Skilling's transform from coordinates to the transposed Hilbert index,
+// which is then interleaved like a Morton code.
+inline uint64_t hilbert_key(uint32_t x, uint32_t y, uint32_t z) {
+    uint32_t coords[3] = {x, y, z};
+    for (uint32_t q = 1u << (BITS_PER_AXIS - 1); q > 1; q >>= 1) {
+        const auto p = q - 1;
+        for (int i = 0; i < 3; i++) {
+            if (coords[i] & q) {
+                coords[0] ^= p;
+            } else {
+                const auto t = (coords[0] ^ coords[i]) & p;
+                coords[0] ^= t;
+                coords[i] ^= t;
+            }
+        }
+    }
+    coords[1] ^= coords[0];
+    coords[2] ^= coords[1];
+    uint32_t t = 0;
+    for (uint32_t q = 1u << (BITS_PER_AXIS - 1); q > 1; q >>= 1) {
+        if (coords[2] & q) {
+            t ^= q - 1;
+        }
+    }
+    return morton_key(coords[0] ^ t, coords[1] ^ t, coords[2] ^ t);
+}
+
+int get_num_threads() {
+#ifdef BCSIM_ENABLE_OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Sort blocks in parallel, then merge pairs of runs in parallel.
+void parallel_sort(std::vector<SortEntry>& entries) {
+    const auto num_entries = entries.size();
+    const auto num_blocks = static_cast<size_t>(std::max(1, get_num_threads()));
+    if ((num_blocks == 1) || (num_entries < 2*num_blocks)) {
+        std::sort(entries.begin(), entries.end());
+        return;
+    }
+    std::vector<size_t> bounds(num_blocks + 1);
+    for (size_t i = 0; i <= num_blocks; i++) {
+        bounds[i] = num_entries*i/num_blocks;
+    }
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int block_no = 0; block_no < static_cast<int>(num_blocks); block_no++) {
+        std::sort(entries.begin() + bounds[block_no], entries.begin() + bounds[block_no + 1]);
+    }
+
+    std::vector<SortEntry> buffer(num_entries);
+    for (size_t width = 1; width < num_blocks; width *= 2) {
+        const auto num_merges = static_cast<int>((num_blocks + 2*width - 1)/(2*width));
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp parallel for
+#endif
+        for (int merge_no = 0; merge_no < num_merges; merge_no++) {
+            const auto first  = bounds[merge_no*2*width];
+            const auto middle = bounds[std::min(num_blocks, (merge_no*2 + 1)*width)];
+            const auto last   = bounds[std::min(num_blocks, (merge_no + 1)*2*width)];
+            std::merge(entries.begin() + first, entries.begin() + middle,
+                       entries.begin() + middle, entries.begin() + last,
+                       buffer.begin() + first);
+        }
+        entries.swap(buffer);
+    }
+}
+
+// Rearrange groups of stride values so that group i becomes the old group
+// order[i]. Follows one cycle of the permutation at a time, so the extra
+// memory is one bit per group and a single group.
+template <typename T>
+void permute_in_place(T* values, size_t stride, const std::vector<uint32_t>& order) {
+    std::vector<bool> done(order.size(), false);
+    std::vector<T> first(stride);
+    for (size_t start = 0; start < order.size(); start++) {
+        if (done[start]) continue;
+        std::copy(values + start*stride, values + (start + 1)*stride, first.begin());
+        size_t i = start;
+        for (;;) {
+            done[i] = true;
+            const size_t next = order[i];
+            if (next == start) {
+                std::copy(first.begin(), first.end(), values + i*stride);
+                break;
+            }
+            std::copy(values + next*stride, values + (next + 1)*stride, values + i*stride);
+            i = next;
+        }
+    }
+}
+
+}   // end anonymous namespace
+
+SpaceFillingCurve parse_space_filling_curve(const std::string& name) {
+    if (name == "none") {
+        return SpaceFillingCurve::NONE;
+    } else if (name == "morton") {
+        return SpaceFillingCurve::MORTON;
+    } else if (name == "hilbert") {
+        return SpaceFillingCurve::HILBERT;
+    }
+    throw std::runtime_error("invalid space-filling curve: " + name);
+}
+
+std::vector<uint32_t> compute_space_filling_order(const std::vector<vector3>& points, SpaceFillingCurve curve) {
+    ScopedTraceEvent trace_event("spatial_sort", "setup");
+    if (points.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("too many scatterers to sort");
+    }
+    const auto num_points = static_cast<int>(points.size());
+    std::vector<uint32_t> order(num_points);
+    if (curve == SpaceFillingCurve::NONE || num_points == 0) {
+        for (int i = 0; i < num_points; i++) {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        return order;
+    }
+
+    const auto box = compute_bounding_box(num_points, [&](int i) { return points[i]; });
+    const auto& box_min = box.min;
+    const auto& box_max = box.max;
+
+    // Quantize to cells and compute the keys.
+    const float max_cell = static_cast<float>((1 << BITS_PER_AXIS) - 1);
+    const auto cell_scale = [&](float lo, float hi) {
+        return (hi > lo) ? max_cell/(hi - lo) : 0.0f;
+    };
+    const vector3 scale(cell_scale(box_min.x, box_max.x), cell_scale(box_min.y, box_max.y), cell_scale(box_min.z, box_max.z));
+    const auto to_cell = [&](float v, float lo, float s) {
+        return static_cast<uint32_t>(std::min(max_cell, std::max(0.0f, (v - lo)*s)));
+    };
+    std::vector<SortEntry> entries(num_points);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_points; i++) {
+        const auto& p = points[i];
+        const auto x = to_cell(p.x, box_min.x, scale.x);
+        const auto y = to_cell(p.y, box_min.y, scale.y);
+        const auto z = to_cell(p.z, box_min.z, scale.z);
+        entries[i].key = (curve == SpaceFillingCurve::HILBERT) ? hilbert_key(x, y, z) : morton_key(x, y, z);
+        entries[i].index = static_cast<uint32_t>(i);
+    }
+
+    parallel_sort(entries);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_points; i++) {
+        order[i] = entries[i].index;
+    }
+    return order;
+}
+
+FixedScatterers::s_ptr sort_fixed_scatterers(FixedScatterers::s_ptr scatterers, SpaceFillingCurve curve) {
+    const auto num_scatterers = static_cast<int>(scatterers->scatterers.size());
+    std::vector<vector3> points(num_scatterers);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_scatterers; i++) {
+        points[i] = scatterers->scatterers[i].pos;
+    }
+    const auto order = compute_space_filling_order(points, curve);
+
+    if (scatterers.use_count() == 1 && !scatterers->scatterers.is_view()) {
+        permute_in_place(scatterers->scatterers.data(), 1, order);
+        return scatterers;
+    }
+    auto res = std::make_shared<FixedScatterers>();
+    res->scatterers.resize(num_scatterers);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_scatterers; i++) {
+        res->scatterers[i] = scatterers->scatterers[order[i]];
+    }
+    return res;
+}
+
+SplineScatterers::s_ptr sort_spline_scatterers(SplineScatterers::s_ptr scatterers, SpaceFillingCurve curve) {
+    const auto num_scatterers = scatterers->num_scatterers();
+    if (num_scatterers == 0) {
+        return scatterers;
+    }
+    const auto num_cs = static_cast<int>(scatterers->get_num_control_points());
+
+    // The mean of the control points represents the whole trajectory.
+    std::vector<vector3> points(num_scatterers);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_scatterers; i++) {
+        const auto cs = scatterers->get_control_points(i);
+        vector3 sum(0.0f, 0.0f, 0.0f);
+        for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+            sum += cs[cs_no];
+        }
+        points[i] = sum/static_cast<float>(num_cs);
+    }
+    const auto order = compute_space_filling_order(points, curve);
+
+    if (scatterers.use_count() == 1 && !scatterers->control_points.is_view() && !scatterers->amplitudes.is_view()) {
+        permute_in_place(scatterers->control_points.data(), num_cs, order);
+        permute_in_place(scatterers->amplitudes.data(), 1, order);
+        return scatterers;
+    }
+    auto res = std::make_shared<SplineScatterers>();
+    res->spline_degree = scatterers->spline_degree;
+    res->knot_vector   = scatterers->knot_vector;
+    res->control_points.resize(scatterers->control_points.size());
+    res->amplitudes.resize(num_scatterers);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_scatterers; i++) {
+        const auto cs = scatterers->get_control_points(order[i]);
+        std::copy(cs, cs + num_cs, res->control_points.data() + static_cast<size_t>(i)*num_cs);
+        res->amplitudes[i] = scatterers->amplitudes[order[i]];
+    }
+    return res;
+}
+
+}   // end namespace
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../BCSimConfig.hpp"
+
+namespace bcsim {
+
+// Space-filling curves used to sort scatterers so that scatterers that are
+// close in memory are also close in space, which gives better cache reuse
+// of the time-projected signal and the beam profile lookup table.
+enum class SpaceFillingCurve {
+    NONE,
+    MORTON,
+    HILBERT
+};
+
+// Parse "none", "morton" or "hilbert". Throws std::runtime_error otherwise.
+SpaceFillingCurve parse_space_filling_curve(const std::string& name);
+
+// Order of the points along the curve through their bounding box, with a
+// resolution of 2^21 cells along each axis. Ties are broken by index, so
+// the result does not depend on the number of threads.
+std::vector<uint32_t> compute_space_filling_order(const std::vector<vector3>& points, SpaceFillingCurve curve);
+
+// Sort the scatterers along the curve (by position, and by the mean of the
+// control points for splines). If the argument is the only reference and the
+// scatterers are not views, they are sorted in place and returned. Otherwise
+// a sorted copy is returned and the input is not modified.
+FixedScatterers::s_ptr sort_fixed_scatterers(FixedScatterers::s_ptr scatterers, SpaceFillingCurve curve);
+SplineScatterers::s_ptr sort_spline_scatterers(SplineScatterers::s_ptr scatterers, SpaceFillingCurve curve);
+
+}   // end namespace
@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace bcsim {
+
+// Time spent in each stage of simulating RF lines, and the number of
+// scatterers processed, accumulated by one thread. Only used when compiled
+// with BCSIM_ENABLE_STAGE_TIMING. Each object fills whole cache lines so the
+// counters of different threads never share one.
+struct alignas(64) StageTimings {
+    StageTimings() {
+        reset();
+    }
+
+    void reset() {
+        projection_ns       = 0;
+        noise_ns            = 0;
+        fft_ns              = 0;
+        demodulation_ns     = 0;
+        num_visited         = 0;
+        num_contributing    = 0;
+    }
+
+    int64_t total_ns() const {
+        return projection_ns + noise_ns + fft_ns + demodulation_ns;
+    }
+
+    int64_t projection_ns;
+    int64_t noise_ns;
+    int64_t fft_ns;
+    int64_t demodulation_ns;
+
+    // Scatterers looped over, and those that ended up inside the line.
+    int64_t num_visited;
+    int64_t num_contributing;
+};
+
+// Allocator that honours the alignment of over-aligned types, which the
+// default allocator does not guarantee before C++17.
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() { }
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) { }
+
+    // The address returned by operator new is stored just before the block.
+    T* allocate(size_t n) {
+        const size_t alignment = alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*);
+        auto raw = static_cast<char*>(::operator new(n*sizeof(T) + alignment + sizeof(void*)));
+        auto aligned = raw + sizeof(void*);
+        aligned += (alignment - reinterpret_cast<uintptr_t>(aligned) % alignment) % alignment;
+        std::memcpy(aligned - sizeof(void*), &raw, sizeof(void*));
+        return reinterpret_cast<T*>(aligned);
+    }
+
+    void deallocate(T* p, size_t) {
+        void* raw;
+        std::memcpy(&raw, reinterpret_cast<char*>(p) - sizeof(void*), sizeof(void*));
+        ::operator delete(raw);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Stage timings of all threads, one cache-line aligned entry per thread.
+typedef std::vector<StageTimings, AlignedAllocator<StageTimings>> PerThreadStageTimings;
+
+// Adds the lifetime of the object to a nanosecond counter.
+class ScopedStageTimer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit ScopedStageTimer(int64_t& counter_ns)
+        : m_counter_ns(counter_ns),
+          m_start(Clock::now())
+    {
+    }
+
+    ~ScopedStageTimer() {
+        m_counter_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count();
+    }
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+private:
+    int64_t&            m_counter_ns;
+    Clock::time_point   m_start;
+};
+
+}   // end namespace
@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include <cmath>
+#include <vector>
+#include <complex>
 
 namespace bcsim {
 
@@ -59,4 +61,19 @@ bool sanity_check_spline_lower_upper_bound(const std::vector<T>& all_basis_funct
     return true;
 }
 
+// Complex down-shifting of a convolved line to form a proper IQ signal,
+// followed by decimation. Only the samples that are kept are mixed.
+// norm_f_demod: Demodulation frequency divided by the sampling frequency.
+inline std::vector<std::complex<float>> demodulate_and_decimate(const std::vector<std::complex<float>>& line,
+                                                                 float norm_f_demod, int radial_decimation) {
+    const float TWO_PI = static_cast<float>(2.0*4.0*std::atan(1));
+    const auto num_samples = static_cast<int>(line.size());
+    std::vector<std::complex<float>> res;
+    res.reserve((num_samples + radial_decimation - 1)/radial_decimation);
+    for (int i = 0; i < num_samples; i += radial_decimation) {
+        res.push_back(line[i]*std::exp(-TWO_PI*std::complex<float>(0.0f, 1.0)*norm_f_demod*static_cast<float>(i)));
+    }
+    return res;
+}
+
 }   // end namespace
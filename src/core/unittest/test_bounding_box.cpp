@@ -0,0 +1,125 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_bounding_box
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include "test_simulator.hpp"
+#include "../algorithm/BoundingBox.hpp"
+
+const bcsim::Scanline straight_down(bcsim::vector3(0.0f, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                    bcsim::vector3(1.0f, 0.0f, 0.0f), 0.0f);
+
+BOOST_AUTO_TEST_CASE(BoxBeamIntersection) {
+    bcsim::BoundingBox box;
+    BOOST_CHECK(box.empty());
+    BOOST_CHECK(!bcsim::box_may_intersect_beam(box, straight_down, 0.0f, 0.05f, 1e-3f, 1e-3f));
+
+    box.add(bcsim::vector3(-0.001f, -0.001f, 0.01f));
+    box.add(bcsim::vector3(0.001f, 0.001f, 0.02f));
+    BOOST_CHECK(!box.empty());
+    BOOST_CHECK(bcsim::box_may_intersect_beam(box, straight_down, 0.0f, 0.05f, 1e-3f, 1e-3f));
+    // beyond the end of the line and beside the beam
+    BOOST_CHECK(!bcsim::box_may_intersect_beam(box, straight_down, 0.0f, 0.005f, 1e-3f, 1e-3f));
+    const bcsim::Scanline shifted(bcsim::vector3(0.005f, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                  bcsim::vector3(1.0f, 0.0f, 0.0f), 0.0f);
+    BOOST_CHECK(!bcsim::box_may_intersect_beam(box, shifted, 0.0f, 0.05f, 1e-3f, 1e-3f));
+    BOOST_CHECK(bcsim::box_may_intersect_beam(box, shifted, 0.0f, 0.05f, 5e-3f, 1e-3f));
+
+    // A tilted beam passing just outside a corner is only rejected along its own axes.
+    const float s = std::sqrt(0.5f);
+    const bcsim::Scanline tilted(bcsim::vector3(0.0f, 0.0f, 0.0f), bcsim::vector3(s, 0.0f, s),
+                                 bcsim::vector3(s, 0.0f, -s), 0.0f);
+    const bcsim::BoundingBox corner(bcsim::vector3(0.0f, -1.0f, 0.012f), bcsim::vector3(0.002f, 1.0f, 0.02f));
+    BOOST_CHECK(!bcsim::box_may_intersect_beam(corner, tilted, 0.0f, 0.05f, 1e-3f, 1e-3f));
+    BOOST_CHECK(bcsim::box_may_intersect_beam(corner, tilted, 0.0f, 0.05f, 8e-3f, 1e-3f));
+}
+
+BOOST_AUTO_TEST_CASE(ParallelBoundingBox) {
+    std::vector<bcsim::vector3> points;
+    for (int i = 0; i < 1000; i++) {
+        points.push_back(bcsim::vector3(std::sin(0.1f*i), 0.001f*i, -0.5f*i));
+    }
+    const auto box = bcsim::compute_bounding_box(static_cast<int>(points.size()), [&](int i) { return points[i]; });
+    BOOST_CHECK_EQUAL(box.min.y, 0.0f);
+    BOOST_CHECK_EQUAL(box.max.y, points.back().y);
+    BOOST_CHECK_EQUAL(box.max.z, 0.0f);
+    BOOST_CHECK_EQUAL(box.min.z, -499.5f);
+    BOOST_CHECK(bcsim::compute_bounding_box(0, [&](int i) { return points[i]; }).empty());
+}
+
+// Narrow Gaussian beam and lines from x = -10 mm to 10 mm.
+bcsim::IAlgorithm::s_ptr create_simulator() {
+    auto sim = create_test_simulator(make_linear_test_scan(11, -0.01f, 0.01f, 0.04f), 0.5e-3f, 1e-3f);
+    sim->set_parameter("radial_decimation", "3");
+    return sim;
+}
+
+// Random scatterers in a box.
+bcsim::FixedScatterers::s_ptr make_block(const bcsim::vector3& box_min, const bcsim::vector3& box_max, int num_scatterers, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < num_scatterers; i++) {
+        const bcsim::vector3 pos(box_min.x + u(gen)*(box_max.x - box_min.x),
+                                 box_min.y + u(gen)*(box_max.y - box_min.y),
+                                 box_min.z + u(gen)*(box_max.z - box_min.z));
+        scatterers->scatterers.push_back(bcsim::PointScatterer{pos, u(gen) - 0.5f});
+    }
+    return scatterers;
+}
+
+BOOST_AUTO_TEST_CASE(CollectionsOutsideBeamAreSkipped) {
+    // Scatterers near x = -10 mm (first line) and a second set near x = 5 mm (line 7).
+    const auto left = make_block(bcsim::vector3(-0.0105f, -0.001f, 0.01f), bcsim::vector3(-0.0095f, 0.001f, 0.03f), 2000, 1);
+    const auto right = make_block(bcsim::vector3(0.0045f, -0.001f, 0.01f), bcsim::vector3(0.0055f, 0.001f, 0.03f), 2000, 2);
+
+    Frame only_left, both;
+    auto sim = create_simulator();
+    sim->add_fixed_scatterers(left);
+    sim->simulate_lines(only_left);
+    sim->add_fixed_scatterers(right);
+    sim->simulate_lines(both);
+    BOOST_REQUIRE_EQUAL(both.size(), 11u);
+
+    // The first line does not see the right set, and lines 3 to 5 see nothing.
+    BOOST_CHECK(max_abs(both[0]) > 0.0);
+    BOOST_REQUIRE_EQUAL(both[0].size(), only_left[0].size());
+    for (size_t i = 0; i < both[0].size(); i++) {
+        BOOST_CHECK_EQUAL(both[0][i], only_left[0][i]);
+    }
+    for (int line_no = 3; line_no <= 5; line_no++) {
+        BOOST_CHECK_EQUAL(both[line_no].size(), both[0].size());
+        BOOST_CHECK_EQUAL(max_abs(both[line_no]), 0.0);
+    }
+    BOOST_CHECK(max_abs(both[7]) > 0.0);
+
+    // Same result with progressive simulation.
+    sim->set_parameter("progressive_passes", "3");
+    Frame progressive;
+    sim->simulate_lines(progressive);
+    for (size_t line_no = 0; line_no < both.size(); line_no++) {
+        BOOST_REQUIRE_EQUAL(progressive[line_no].size(), both[line_no].size());
+        BOOST_CHECK_SMALL(max_abs(progressive[line_no]) - max_abs(both[line_no]), 1e-4*max_abs(both[0]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SplineBoundsCoverTrajectory) {
+    // A single scatterer moving from x = -10 mm to 10 mm over one second.
+    auto splines = std::make_shared<bcsim::SplineScatterers>();
+    splines->spline_degree = 1;
+    splines->knot_vector = {0.0f, 0.0f, 1.0f, 1.0f};
+    splines->control_points = {bcsim::vector3(-0.01f, 0.0f, 0.02f), bcsim::vector3(0.01f, 0.0f, 0.02f)};
+    splines->amplitudes = {1.0f};
+
+    auto sim = create_simulator();
+    auto scanseq = std::make_shared<bcsim::ScanSequence>(0.04f);
+    scanseq->add_scanline(bcsim::Scanline(bcsim::vector3(0.0f, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                          bcsim::vector3(1.0f, 0.0f, 0.0f), 0.5f));
+    scanseq->add_scanline(bcsim::Scanline(bcsim::vector3(0.0f, 0.005f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                          bcsim::vector3(1.0f, 0.0f, 0.0f), 0.5f));
+    sim->set_scan_sequence(scanseq);
+    sim->add_spline_scatterers(splines);
+    Frame frame;
+    sim->simulate_lines(frame);
+    BOOST_CHECK(max_abs(frame[0]) > 0.0);
+    BOOST_CHECK_EQUAL(max_abs(frame[1]), 0.0);
+}
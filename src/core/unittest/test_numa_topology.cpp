@@ -0,0 +1,97 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_numa_topology
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+#include "../algorithm/NumaTopology.hpp"
+#include "test_simulator.hpp"
+
+// Two nodes with hyperthread siblings numbered after the cores, as on a
+// typical dual-socket server.
+bcsim::NumaTopology make_two_node_topology() {
+    return bcsim::NumaTopology({0, 1}, {{0, 1, 4, 5}, {2, 3, 6, 7}});
+}
+
+BOOST_AUTO_TEST_CASE(ParseCpuList) {
+    BOOST_CHECK(bcsim::parse_cpu_list("0-3,8-10,16") == std::vector<int>({0, 1, 2, 3, 8, 9, 10, 16}));
+    BOOST_CHECK(bcsim::parse_cpu_list("5") == std::vector<int>({5}));
+    BOOST_CHECK(bcsim::parse_cpu_list("0-1\n") == std::vector<int>({0, 1}));
+    BOOST_CHECK(bcsim::parse_cpu_list("").empty());
+    BOOST_CHECK_THROW(bcsim::parse_cpu_list("a-b"), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(AssignCompact) {
+    const auto topology = make_two_node_topology();
+    BOOST_CHECK_EQUAL(topology.get_num_cpus(), 8);
+    BOOST_CHECK(topology.assign_cpus(6, "compact") == std::vector<int>({0, 1, 4, 5, 2, 3}));
+    // more threads than CPUs wrap around
+    BOOST_CHECK(topology.assign_cpus(10, "compact") == std::vector<int>({0, 1, 4, 5, 2, 3, 6, 7, 0, 1}));
+}
+
+BOOST_AUTO_TEST_CASE(AssignSpread) {
+    const auto topology = make_two_node_topology();
+    BOOST_CHECK(topology.assign_cpus(5, "spread") == std::vector<int>({0, 2, 1, 3, 4}));
+    BOOST_CHECK(topology.assign_cpus(10, "spread") == std::vector<int>({0, 2, 1, 3, 4, 6, 5, 7, 0, 2}));
+    BOOST_CHECK_THROW(topology.assign_cpus(2, "scatter"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(NodeOfCpu) {
+    const auto topology = bcsim::NumaTopology({0, 3}, {{0, 1}, {8, 9}});
+    BOOST_CHECK_EQUAL(topology.get_node_of_cpu(1), 0);
+    BOOST_CHECK_EQUAL(topology.get_node_of_cpu(8), 1);
+    BOOST_CHECK_EQUAL(topology.get_node_id(1), 3);
+    BOOST_CHECK_EQUAL(topology.get_node_of_cpu(2), -1);
+    BOOST_CHECK_THROW(bcsim::NumaTopology({0}, {{}}), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(DetectedTopologyIsConsistent) {
+    const bcsim::NumaTopology topology;
+    BOOST_REQUIRE_GE(topology.get_num_nodes(), 1);
+    for (int node_idx = 0; node_idx < topology.get_num_nodes(); node_idx++) {
+        for (const auto cpu : topology.get_node_cpus(node_idx)) {
+            BOOST_CHECK_EQUAL(topology.get_node_of_cpu(cpu), node_idx);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ReplicationIsOffByDefault) {
+    auto sim = bcsim::Create("cpu");
+    BOOST_CHECK_EQUAL(sim->get_parameter("numa_replicate"), "off");
+    BOOST_CHECK_EQUAL(sim->get_parameter("thread_binding"), "none");
+}
+
+#ifdef __linux__
+int get_num_allowed_cpus() {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    BOOST_REQUIRE_EQUAL(pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask), 0);
+    return CPU_COUNT(&mask);
+}
+
+BOOST_AUTO_TEST_CASE(AffinityIsRestored) {
+    const bcsim::NumaTopology topology;
+    const auto last_cpu = topology.get_node_cpus(topology.get_num_nodes() - 1).back();
+    {
+        bcsim::ScopedAffinityRestore restore;
+        BOOST_REQUIRE(bcsim::bind_current_thread_to_cpu(last_cpu));
+        BOOST_CHECK_EQUAL(sched_getcpu(), last_cpu);
+    }
+    BOOST_CHECK_EQUAL(get_num_allowed_cpus(), topology.get_num_cpus());
+}
+
+// The calling thread is part of the OpenMP team, but is not left bound.
+BOOST_AUTO_TEST_CASE(SimulationLeavesCallerUnbound) {
+    const bcsim::NumaTopology topology;
+    auto sim = create_test_simulator(make_linear_test_scan(8, -0.01f, 0.01f, 0.04f));
+    sim->set_parameter("thread_binding", "compact");
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    scatterers->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.02f), 1.0f});
+    sim->add_fixed_scatterers(scatterers);
+    Frame frame;
+    sim->simulate_lines(frame);
+    BOOST_CHECK_EQUAL(get_num_allowed_cpus(), topology.get_num_cpus());
+}
+#endif
@@ -0,0 +1,137 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_procedural
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include "test_simulator.hpp"
+
+bcsim::ProceduralScatterers::s_ptr create_region(uint32_t seed) {
+    auto region = std::make_shared<bcsim::ProceduralScatterers>(bcsim::vector3(-0.01f, -0.004f, 0.005f),
+                                                                bcsim::vector3(0.01f, 0.004f, 0.045f), 5e-4f, seed);
+    region->set_density(4e10f);
+    return region;
+}
+
+BOOST_AUTO_TEST_CASE(CellsAreDeterministic) {
+    auto region = create_region(3);
+    bcsim::ScattererArray<bcsim::PointScatterer> first, second, other_seed;
+    region->generate_cell(4, 5, 6, first);
+    region->generate_cell(4, 5, 6, second);
+    create_region(4)->generate_cell(4, 5, 6, other_seed);
+    BOOST_REQUIRE(first.size() > 0);
+    BOOST_REQUIRE_EQUAL(first.size(), second.size());
+    for (size_t i = 0; i < first.size(); i++) {
+        BOOST_CHECK_EQUAL(first[i].pos.x, second[i].pos.x);
+        BOOST_CHECK_EQUAL(first[i].amplitude, second[i].amplitude);
+        BOOST_CHECK(first[i].pos.x >= -0.01f + 4*5e-4f);
+        BOOST_CHECK(first[i].pos.x <= -0.01f + 5*5e-4f);
+    }
+    BOOST_CHECK((other_seed.size() != first.size()) || (other_seed[0].pos.x != first[0].pos.x));
+}
+
+BOOST_AUTO_TEST_CASE(DensityAndAmplitudeFields) {
+    auto region = create_region(1);
+    // left half empty, right half silent
+    region->set_density(2, 1, 1, std::vector<float>{0.0f, 4e10f});
+    region->set_amplitude([](const bcsim::vector3& pos) { return (pos.z < 0.025f) ? 1.0f : 0.0f; });
+    BOOST_CHECK_CLOSE(region->get_expected_num_scatterers(), 0.5*4e10*0.02*0.008*0.04, 1e-3);
+
+    int num_x, num_y, num_z;
+    region->get_num_cells(num_x, num_y, num_z);
+    BOOST_CHECK_EQUAL(num_x, 40);
+    BOOST_CHECK_EQUAL(num_y, 16);
+    BOOST_CHECK_EQUAL(num_z, 80);
+    bcsim::ScattererArray<bcsim::PointScatterer> scatterers;
+    for (int ix = 0; ix < num_x; ix++) {
+        for (int iy = 0; iy < num_y; iy++) {
+            for (int iz = 0; iz < num_z; iz++) {
+                region->generate_cell(ix, iy, iz, scatterers);
+            }
+        }
+    }
+    BOOST_CHECK_CLOSE(static_cast<double>(scatterers.size()), region->get_expected_num_scatterers(), 2.0);
+    for (const auto& s : scatterers) {
+        BOOST_CHECK(s.pos.x >= 0.0f);
+        if (s.pos.z >= 0.025f) {
+            BOOST_CHECK_EQUAL(s.amplitude, 0.0f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EqualsStoredScatterers) {
+    auto region = create_region(11);
+    auto fixed = std::make_shared<bcsim::FixedScatterers>();
+    int num_x, num_y, num_z;
+    region->get_num_cells(num_x, num_y, num_z);
+    for (int ix = 0; ix < num_x; ix++) {
+        for (int iy = 0; iy < num_y; iy++) {
+            for (int iz = 0; iz < num_z; iz++) {
+                region->generate_cell(ix, iy, iz, fixed->scatterers);
+            }
+        }
+    }
+
+    // Sector lines crossing the region at an angle.
+    auto sim = create_test_simulator(make_sector_test_scan(8, 0.3f, 0.05f));
+    sim->add_fixed_scatterers(fixed);
+    Frame reference;
+    sim->simulate_lines(reference);
+
+    sim->clear_fixed_scatterers();
+    sim->add_procedural_scatterers(region);
+    BOOST_CHECK_EQUAL(sim->get_total_num_scatterers(), static_cast<size_t>(region->num_scatterers()));
+    Frame procedural;
+    sim->simulate_lines(procedural);
+    const auto num_generated = sim->get_debug_data("cpu_scatterers_visited")[0];
+    BOOST_CHECK(num_generated < 0.5*fixed->num_scatterers()*reference.size());
+
+    check_frames_close(reference, procedural, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidRegion) {
+    BOOST_CHECK_THROW(bcsim::ProceduralScatterers(bcsim::vector3(0.0f, 0.0f, 0.0f), bcsim::vector3(1.0f, 0.0f, 1.0f), 0.1f, 1), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::ProceduralScatterers(bcsim::vector3(0.0f, 0.0f, 0.0f), bcsim::vector3(1.0f, 1.0f, 1.0f), 0.0f, 1), std::runtime_error);
+    auto sim = bcsim::Create("cpu");
+    BOOST_CHECK_THROW(sim->set_parameter("beam_cutoff", "0"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(ProgressivePassesSplitCells) {
+    auto region = create_region(5);
+    const int num_passes = 4;
+    const bcsim::vector3 origin(0.0f, 0.0f, 0.0f);
+    const bcsim::vector3 direction(0.0f, 0.0f, 1.0f);
+    const bcsim::vector3 lateral_dir(1.0f, 0.0f, 0.0f);
+    const bcsim::vector3 elevational_dir(0.0f, 1.0f, 0.0f);
+    bcsim::ScattererArray<bcsim::PointScatterer> all, passes;
+    region->generate_in_beam(origin, direction, lateral_dir, elevational_dir, 0.05f, 2e-3f, 2e-3f, all);
+    for (int pass_no = 0; pass_no < num_passes; pass_no++) {
+        const auto num_before = passes.size();
+        region->generate_in_beam(origin, direction, lateral_dir, elevational_dir, 0.05f, 2e-3f, 2e-3f, passes, pass_no, num_passes);
+        BOOST_CHECK(passes.size() > num_before);
+    }
+    // Every scatterer is generated in exactly one pass.
+    BOOST_REQUIRE_EQUAL(passes.size(), all.size());
+    auto by_position = [](const bcsim::PointScatterer& a, const bcsim::PointScatterer& b) {
+        return std::make_tuple(a.pos.x, a.pos.y, a.pos.z) < std::make_tuple(b.pos.x, b.pos.y, b.pos.z);
+    };
+    std::vector<bcsim::PointScatterer> sorted_all(all.begin(), all.end());
+    std::vector<bcsim::PointScatterer> sorted_passes(passes.begin(), passes.end());
+    std::sort(sorted_all.begin(), sorted_all.end(), by_position);
+    std::sort(sorted_passes.begin(), sorted_passes.end(), by_position);
+    for (size_t i = 0; i < sorted_all.size(); i++) {
+        BOOST_CHECK_EQUAL(sorted_passes[i].pos.x, sorted_all[i].pos.x);
+        BOOST_CHECK_EQUAL(sorted_passes[i].amplitude, sorted_all[i].amplitude);
+    }
+
+    // The final progressive pass equals a normal simulation.
+    auto sim = create_test_simulator(make_sector_test_scan(8, 0.3f, 0.05f));
+    sim->add_procedural_scatterers(region);
+    Frame reference;
+    sim->simulate_lines(reference);
+    sim->set_parameter("progressive_passes", std::to_string(num_passes));
+    Frame progressive;
+    sim->simulate_lines(progressive);
+    BOOST_CHECK_EQUAL(sim->get_debug_data("progressive_passes_done")[0], static_cast<double>(num_passes));
+    check_frames_close(reference, progressive, 1e-4);
+}
@@ -0,0 +1,105 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_progressive
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <random>
+#include "test_simulator.hpp"
+
+// Simulator with a Gaussian beam and a block of random scatterers.
+bcsim::IAlgorithm::s_ptr create_simulator(int num_scatterers) {
+    auto sim = create_test_simulator(make_linear_test_scan(16, -0.01f, 0.01f, 0.05f));
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> x_dist(-0.012f, 0.012f);
+    std::uniform_real_distribution<float> y_dist(-0.005f, 0.005f);
+    std::uniform_real_distribution<float> z_dist(0.005f, 0.045f);
+    std::normal_distribution<float> amplitude_dist(0.0f, 1.0f);
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    scatterers->scatterers.resize(num_scatterers);
+    for (auto& s : scatterers->scatterers) {
+        s.pos = bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen));
+        s.amplitude = amplitude_dist(gen);
+    }
+    sim->add_fixed_scatterers(scatterers);
+    return sim;
+}
+
+BOOST_AUTO_TEST_CASE(FinalPassEqualsFullSimulation) {
+    auto sim = create_simulator(5000);
+    Frame reference;
+    sim->simulate_lines(reference);
+
+    sim->set_parameter("progressive_passes", "4");
+    BOOST_CHECK_EQUAL(sim->get_parameter("progressive_passes"), "4");
+    std::vector<int> passes_published;
+    sim->set_intermediate_frame_callback([&](int pass_no, int num_passes, const Frame& frame) {
+        BOOST_CHECK_EQUAL(num_passes, 4);
+        BOOST_CHECK_EQUAL(frame.size(), reference.size());
+        passes_published.push_back(pass_no);
+        return true;
+    });
+    Frame progressive;
+    sim->simulate_lines(progressive);
+    BOOST_CHECK_EQUAL(passes_published.size(), 3u);
+    for (size_t i = 0; i < passes_published.size(); i++) {
+        BOOST_CHECK_EQUAL(passes_published[i], static_cast<int>(i) + 1);
+    }
+    BOOST_CHECK_EQUAL(sim->get_debug_data("progressive_passes_done")[0], 4.0);
+
+    check_frames_close(reference, progressive, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(FirstPassPreservesSpeckleEnergy) {
+    auto sim = create_simulator(40000);
+    Frame reference;
+    sim->simulate_lines(reference);
+
+    sim->set_parameter("progressive_passes", "8");
+    Frame first_pass;
+    sim->set_intermediate_frame_callback([&](int, int, const Frame& frame) {
+        first_pass = frame;
+        return false;
+    });
+    Frame result;
+    sim->simulate_lines(result);
+    BOOST_CHECK_EQUAL(sim->get_debug_data("progressive_passes_done")[0], 1.0);
+    BOOST_REQUIRE_EQUAL(first_pass.size(), result.size());
+    BOOST_CHECK(first_pass[0] == result[0]);
+
+    const auto energy_ratio = frame_energy(first_pass)/frame_energy(reference);
+    BOOST_CHECK_CLOSE(energy_ratio, 1.0, 15.0);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidNumberOfPasses) {
+    auto sim = bcsim::Create("cpu");
+    BOOST_CHECK_THROW(sim->set_parameter("progressive_passes", "0"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(LineCallbackCancels) {
+    auto sim = create_simulator(2000);
+    std::atomic<int> num_calls(0);
+    sim->set_line_callback([&](int num_lines_done) {
+        num_calls++;
+        return num_lines_done < 3;
+    });
+    Frame frame;
+    sim->simulate_lines(frame);
+    BOOST_CHECK(num_calls.load() < 16);
+
+    // Passes after the one that was cancelled are not started.
+    sim->set_parameter("progressive_passes", "4");
+    num_calls = 0;
+    sim->set_line_callback([&](int num_lines_done) {
+        num_calls++;
+        return num_lines_done < 20;
+    });
+    sim->simulate_lines(frame);
+    BOOST_CHECK(num_calls.load() < 32);
+    BOOST_CHECK_EQUAL(sim->get_debug_data("progressive_passes_done")[0], 1.0);
+
+    num_calls = 0;
+    sim->set_line_callback(bcsim::IAlgorithm::LineCallback());
+    sim->simulate_lines(frame);
+    BOOST_CHECK_EQUAL(num_calls.load(), 0);
+    BOOST_CHECK_EQUAL(sim->get_debug_data("progressive_passes_done")[0], 4.0);
+}
@@ -0,0 +1,89 @@
+#pragma once
+// Common setup for the unit tests that simulate small frames. Include after
+// boost/test/unit_test.hpp.
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "../LibBCSim.hpp"
+
+typedef std::vector<std::vector<std::complex<float>>> Frame;
+
+// Gaussian-windowed 2.5 MHz pulse sampled at 50 MHz.
+inline bcsim::ExcitationSignal make_test_excitation() {
+    bcsim::ExcitationSignal ex;
+    ex.sampling_frequency = 50e6f;
+    ex.demod_freq = 2.5e6f;
+    const int half_length = 40;
+    for (int i = -half_length; i <= half_length; i++) {
+        const float t = i/ex.sampling_frequency;
+        ex.samples.push_back(std::exp(-t*t/(2.0f*0.25e-6f*0.25e-6f))*std::cos(2.0f*3.1415927f*ex.demod_freq*t));
+    }
+    ex.center_index = half_length;
+    return ex;
+}
+
+// Parallel lines along z, with origins evenly spaced from x_min to x_max.
+inline bcsim::ScanSequence::s_ptr make_linear_test_scan(int num_lines, float x_min, float x_max, float line_length) {
+    auto scanseq = std::make_shared<bcsim::ScanSequence>(line_length);
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const bcsim::vector3 origin(x_min + (x_max - x_min)*line_no/(num_lines-1), 0.0f, 0.0f);
+        scanseq->add_scanline(bcsim::Scanline(origin, bcsim::vector3(0.0f, 0.0f, 1.0f), bcsim::vector3(1.0f, 0.0f, 0.0f), 0.0f));
+    }
+    return scanseq;
+}
+
+// Lines from the origin with angles in the xz-plane evenly spaced in [-max_angle, max_angle].
+inline bcsim::ScanSequence::s_ptr make_sector_test_scan(int num_lines, float max_angle, float line_length) {
+    auto scanseq = std::make_shared<bcsim::ScanSequence>(line_length);
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const float angle = -max_angle + 2.0f*max_angle*line_no/(num_lines-1);
+        const bcsim::vector3 direction(std::sin(angle), 0.0f, std::cos(angle));
+        const bcsim::vector3 lateral_dir(std::cos(angle), 0.0f, -std::sin(angle));
+        scanseq->add_scanline(bcsim::Scanline(bcsim::vector3(0.0f, 0.0f, 0.0f), direction, lateral_dir, 0.0f));
+    }
+    return scanseq;
+}
+
+// CPU simulator with the test excitation and a Gaussian beam.
+inline bcsim::IAlgorithm::s_ptr create_test_simulator(bcsim::ScanSequence::s_ptr scan_sequence,
+                                                      float sigma_lateral = 1e-3f, float sigma_elevational = 2e-3f) {
+    auto sim = bcsim::Create("cpu");
+    sim->set_parameter("num_cpu_cores", "all");
+    sim->set_excitation(make_test_excitation());
+    sim->set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(sigma_lateral, sigma_elevational));
+    sim->set_scan_sequence(scan_sequence);
+    return sim;
+}
+
+inline double max_abs(const std::vector<std::complex<float>>& line) {
+    double res = 0.0;
+    for (auto v : line) {
+        res = std::max(res, static_cast<double>(std::abs(v)));
+    }
+    return res;
+}
+
+inline double frame_energy(const Frame& frame) {
+    double energy = 0.0;
+    for (const auto& line : frame) {
+        for (auto v : line) energy += std::norm(v);
+    }
+    return energy;
+}
+
+// Check that the largest difference is small relative to the largest reference value.
+inline void check_frames_close(const Frame& reference, const Frame& frame, double tolerance) {
+    BOOST_REQUIRE_EQUAL(frame.size(), reference.size());
+    double max_ref = 0.0;
+    double max_err = 0.0;
+    for (size_t line_no = 0; line_no < reference.size(); line_no++) {
+        BOOST_REQUIRE_EQUAL(frame[line_no].size(), reference[line_no].size());
+        for (size_t i = 0; i < reference[line_no].size(); i++) {
+            max_ref = std::max(max_ref, static_cast<double>(std::abs(reference[line_no][i])));
+            max_err = std::max(max_err, static_cast<double>(std::abs(frame[line_no][i] - reference[line_no][i])));
+        }
+    }
+    BOOST_CHECK(max_ref > 0.0);
+    BOOST_CHECK_SMALL(max_err/max_ref, tolerance);
+}
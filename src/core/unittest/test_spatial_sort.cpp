@@ -0,0 +1,150 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_spatial_sort
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <random>
+#include "test_simulator.hpp"
+#include "../algorithm/SpatialSort.hpp"
+
+std::vector<bcsim::vector3> random_points(int num_points, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dist(-0.02f, 0.02f);
+    std::vector<bcsim::vector3> points(num_points);
+    for (auto& p : points) {
+        p = bcsim::vector3(dist(gen), dist(gen), 0.5f*dist(gen) + 0.03f);
+    }
+    return points;
+}
+
+// Mean distance between consecutive points.
+double mean_step(const std::vector<bcsim::vector3>& points, const std::vector<uint32_t>& order) {
+    double sum = 0.0;
+    for (size_t i = 1; i < order.size(); i++) {
+        sum += (points[order[i]] - points[order[i-1]]).norm();
+    }
+    return sum/(order.size() - 1);
+}
+
+BOOST_AUTO_TEST_CASE(OrderIsLocalPermutation) {
+    const auto points = random_points(20000, 1);
+    std::vector<uint32_t> identity(points.size());
+    for (size_t i = 0; i < identity.size(); i++) identity[i] = static_cast<uint32_t>(i);
+    BOOST_CHECK(bcsim::compute_space_filling_order(points, bcsim::SpaceFillingCurve::NONE) == identity);
+
+    for (auto curve : {bcsim::SpaceFillingCurve::MORTON, bcsim::SpaceFillingCurve::HILBERT}) {
+        const auto order = bcsim::compute_space_filling_order(points, curve);
+        auto sorted = order;
+        std::sort(sorted.begin(), sorted.end());
+        BOOST_REQUIRE(sorted == identity);
+        BOOST_CHECK(mean_step(points, order) < 0.2*mean_step(points, identity));
+    }
+    // A Hilbert curve has no long jumps between octants.
+    BOOST_CHECK(mean_step(points, bcsim::compute_space_filling_order(points, bcsim::SpaceFillingCurve::HILBERT))
+                < mean_step(points, bcsim::compute_space_filling_order(points, bcsim::SpaceFillingCurve::MORTON)));
+}
+
+BOOST_AUTO_TEST_CASE(DegeneratePoints) {
+    std::vector<bcsim::vector3> points(100, bcsim::vector3(1.0f, 2.0f, 3.0f));
+    const auto order = bcsim::compute_space_filling_order(points, bcsim::SpaceFillingCurve::HILBERT);
+    for (size_t i = 0; i < order.size(); i++) {
+        BOOST_CHECK_EQUAL(order[i], i);
+    }
+    BOOST_CHECK(bcsim::compute_space_filling_order(std::vector<bcsim::vector3>(), bcsim::SpaceFillingCurve::MORTON).empty());
+    BOOST_CHECK_THROW(bcsim::parse_space_filling_curve("peano"), std::runtime_error);
+}
+
+bcsim::IAlgorithm::s_ptr create_simulator(const std::string& spatial_sort) {
+    auto sim = create_test_simulator(make_linear_test_scan(8, -0.01f, 0.01f, 0.05f));
+    sim->set_parameter("spatial_sort", spatial_sort);
+    BOOST_CHECK_EQUAL(sim->get_parameter("spatial_sort"), spatial_sort);
+    return sim;
+}
+
+BOOST_AUTO_TEST_CASE(SortingDoesNotChangeFixedResult) {
+    const auto points = random_points(5000, 2);
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    for (size_t i = 0; i < points.size(); i++) {
+        scatterers->scatterers.push_back(bcsim::PointScatterer{points[i], std::cos(0.1f*i)});
+    }
+    const auto first_pos = scatterers->scatterers[0].pos;
+
+    Frame reference;
+    auto sim = create_simulator("none");
+    sim->add_fixed_scatterers(scatterers);
+    sim->simulate_lines(reference);
+    for (const std::string curve : {"morton", "hilbert"}) {
+        Frame sorted;
+        sim = create_simulator(curve);
+        sim->add_fixed_scatterers(scatterers);
+        sim->simulate_lines(sorted);
+        check_frames_close(reference, sorted, 1e-4);
+    }
+    // The caller's scatterers are not reordered.
+    BOOST_CHECK_EQUAL(scatterers->scatterers[0].pos.x, first_pos.x);
+}
+
+BOOST_AUTO_TEST_CASE(SortingDoesNotChangeSplineResult) {
+    const int num_scatterers = 3000;
+    const int num_cs = 4;
+    const auto points = random_points(num_scatterers, 3);
+    auto scatterers = std::make_shared<bcsim::SplineScatterers>();
+    scatterers->spline_degree = 2;
+    scatterers->knot_vector = {0.0f, 0.0f, 0.0f, 0.5f, 1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < num_scatterers; i++) {
+        for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+            scatterers->control_points.push_back(points[i] + bcsim::vector3(1e-3f*cs_no, 0.0f, 0.0f));
+        }
+        scatterers->amplitudes.push_back(std::sin(0.3f*i));
+    }
+
+    Frame reference;
+    auto sim = create_simulator("none");
+    sim->add_spline_scatterers(scatterers);
+    sim->simulate_lines(reference);
+    Frame sorted;
+    sim = create_simulator("hilbert");
+    sim->add_spline_scatterers(scatterers);
+    sim->simulate_lines(sorted);
+    check_frames_close(reference, sorted, 1e-4);
+}
+
+// Unshared scatterers are sorted in place, into the same order as a copy.
+BOOST_AUTO_TEST_CASE(SortInPlaceWhenUnshared) {
+    const auto points = random_points(4000, 4);
+    auto fixed = std::make_shared<bcsim::FixedScatterers>();
+    auto spline = std::make_shared<bcsim::SplineScatterers>();
+    spline->spline_degree = 1;
+    spline->knot_vector = {0.0f, 0.0f, 1.0f, 1.0f};
+    for (size_t i = 0; i < points.size(); i++) {
+        fixed->scatterers.push_back(bcsim::PointScatterer{points[i], static_cast<float>(i)});
+        spline->control_points.push_back(points[i]);
+        spline->control_points.push_back(points[i] + bcsim::vector3(0.0f, 1e-3f, 0.0f));
+        spline->amplitudes.push_back(static_cast<float>(i));
+    }
+
+    const auto fixed_copy = bcsim::sort_fixed_scatterers(fixed, bcsim::SpaceFillingCurve::HILBERT);
+    BOOST_CHECK(fixed_copy != fixed);
+    BOOST_CHECK_EQUAL(fixed->scatterers[1].amplitude, 1.0f);
+    const auto fixed_ptr = fixed.get();
+    const auto fixed_sorted = bcsim::sort_fixed_scatterers(std::move(fixed), bcsim::SpaceFillingCurve::HILBERT);
+    BOOST_CHECK_EQUAL(fixed_sorted.get(), fixed_ptr);
+    BOOST_REQUIRE_EQUAL(fixed_sorted->scatterers.size(), fixed_copy->scatterers.size());
+    for (size_t i = 0; i < fixed_copy->scatterers.size(); i++) {
+        BOOST_CHECK_EQUAL(fixed_sorted->scatterers[i].amplitude, fixed_copy->scatterers[i].amplitude);
+        BOOST_CHECK_EQUAL(fixed_sorted->scatterers[i].pos.x, fixed_copy->scatterers[i].pos.x);
+    }
+
+    const auto spline_copy = bcsim::sort_spline_scatterers(spline, bcsim::SpaceFillingCurve::MORTON);
+    BOOST_CHECK(spline_copy != spline);
+    BOOST_CHECK_EQUAL(spline->amplitudes[1], 1.0f);
+    const auto spline_ptr = spline.get();
+    const auto spline_sorted = bcsim::sort_spline_scatterers(std::move(spline), bcsim::SpaceFillingCurve::MORTON);
+    BOOST_CHECK_EQUAL(spline_sorted.get(), spline_ptr);
+    BOOST_REQUIRE_EQUAL(spline_sorted->control_points.size(), spline_copy->control_points.size());
+    for (size_t i = 0; i < spline_copy->amplitudes.size(); i++) {
+        BOOST_CHECK_EQUAL(spline_sorted->amplitudes[i], spline_copy->amplitudes[i]);
+    }
+    for (size_t i = 0; i < spline_copy->control_points.size(); i++) {
+        BOOST_CHECK_EQUAL(spline_sorted->control_points[i].y, spline_copy->control_points[i].y);
+    }
+}
@@ -0,0 +1,81 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_stage_timings
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <random>
+#include "test_simulator.hpp"
+#include "../algorithm/StageTimings.hpp"
+#include "../algorithm/PerfCounters.hpp"
+
+BOOST_AUTO_TEST_CASE(TimingsOfThreadsAreOnSeparateCacheLines) {
+    BOOST_CHECK_EQUAL(alignof(bcsim::StageTimings), 64u);
+    BOOST_CHECK_EQUAL(sizeof(bcsim::StageTimings) % 64, 0u);
+    bcsim::PerThreadStageTimings timings(5);
+    for (const auto& t : timings) {
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(&t) % 64, 0u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DebugDataKeys) {
+    const int num_lines = 8;
+    const int num_scatterers = 2000;
+    auto sim = create_test_simulator(make_linear_test_scan(num_lines, -0.01f, 0.01f, 0.05f));
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < num_scatterers; i++) {
+        const bcsim::vector3 pos(0.02f*u(gen) - 0.01f, 0.004f*u(gen) - 0.002f, 0.005f + 0.04f*u(gen));
+        scatterers->scatterers.push_back(bcsim::PointScatterer{pos, u(gen) - 0.5f});
+    }
+    sim->add_fixed_scatterers(scatterers);
+    Frame frame;
+    sim->simulate_lines(frame);
+
+#ifdef BCSIM_ENABLE_STAGE_TIMING
+    const auto frame_ns = sim->get_debug_data("cpu_frame_ns")[0];
+    BOOST_CHECK(frame_ns > 0.0);
+    for (const std::string key : {"cpu_projection_ns", "cpu_fft_ns", "cpu_demodulation_ns"}) {
+        BOOST_REQUIRE_EQUAL(sim->get_debug_data(key).size(), 1u);
+        BOOST_CHECK(sim->get_debug_data(key)[0] > 0.0);
+    }
+    BOOST_CHECK(sim->get_debug_data("cpu_noise_ns")[0] >= 0.0);
+    const auto busy_ns = sim->get_debug_data("cpu_thread_busy_ns");
+    BOOST_REQUIRE(!busy_ns.empty());
+    for (auto ns : busy_ns) {
+        BOOST_CHECK(ns >= 0.0);
+    }
+    BOOST_CHECK_EQUAL(sim->get_debug_data("cpu_scatterers_visited")[0], static_cast<double>(num_scatterers)*num_lines);
+    const auto num_contributing = sim->get_debug_data("cpu_scatterers_contributing")[0];
+    BOOST_CHECK(num_contributing > 0.0);
+    BOOST_CHECK(num_contributing <= static_cast<double>(num_scatterers)*num_lines);
+#else
+    BOOST_CHECK_THROW(sim->get_debug_data("cpu_frame_ns"), std::runtime_error);
+#endif
+}
+
+// Counters may be unavailable in containers and virtual machines, so only
+// the consistency of what is reported is checked.
+BOOST_AUTO_TEST_CASE(PerfCounterDebugData) {
+    auto sim = create_test_simulator(make_linear_test_scan(8, -0.01f, 0.01f, 0.05f));
+    sim->set_parameter("perf_counters", "on");
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < 1000; i++) {
+        scatterers->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.005f + 4e-5f*i), 1.0f});
+    }
+    sim->add_fixed_scatterers(scatterers);
+    Frame frame;
+    sim->simulate_lines(frame);
+    sim->simulate_lines(frame);
+
+    const auto num_available = sim->get_debug_data("perf_counters_available")[0];
+    BOOST_CHECK(num_available >= 0.0);
+    BOOST_CHECK(num_available <= bcsim::PerfCounterGroup::NUM_COUNTERS);
+    if (bcsim::PerfCounterGroup::for_current_thread().is_available(bcsim::PerfCounterGroup::LLC_MISSES)) {
+        const auto llc_misses = sim->get_debug_data("perf_projection_llc_misses")[0] + sim->get_debug_data("perf_convolution_llc_misses")[0];
+        BOOST_CHECK_EQUAL(sim->get_debug_data("perf_memory_bytes")[0], llc_misses*bcsim::PerfCounterGroup::get_cache_line_size());
+        BOOST_CHECK(sim->get_debug_data("perf_memory_bandwidth")[0] >= 0.0);
+    } else {
+        BOOST_CHECK_THROW(sim->get_debug_data("perf_memory_bandwidth"), std::runtime_error);
+    }
+    BOOST_CHECK(bcsim::PerfCounterGroup::get_cache_line_size() > 0);
+}
@@ -0,0 +1,132 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_tracing
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "../Tracing.hpp"
+#include "../LibBCSim.hpp"
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+size_t count_occurrences(const std::string& s, const std::string& what) {
+    size_t res = 0;
+    for (auto pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + what.size())) {
+        res++;
+    }
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(DisabledRecordsNothing) {
+    bcsim::TraceRecorder::set_enabled(false);
+    bcsim::TraceRecorder::clear();
+    {
+        bcsim::ScopedTraceEvent event("ignored", "test");
+    }
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_events(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(RingBufferKeepsNewestEvents) {
+    bcsim::TraceRecorder::clear();
+    bcsim::TraceRecorder::set_enabled(true);
+    const auto capacity = bcsim::TraceRecorder::EVENTS_PER_THREAD;
+    for (size_t i = 0; i < capacity + 10; i++) {
+        bcsim::ScopedTraceEvent event("event", "test");
+    }
+    bcsim::TraceRecorder::set_enabled(false);
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_events(), capacity);
+}
+
+BOOST_AUTO_TEST_CASE(WritesEventsOfAllThreads) {
+    bcsim::TraceRecorder::clear();
+    bcsim::TraceRecorder::set_enabled(true);
+    {
+        bcsim::ScopedTraceEvent event("main_event", "test");
+        event.set_arg("value", 42);
+    }
+    std::thread worker([] {
+        bcsim::TraceRecorder::set_thread_name("Worker \"1\"");
+        bcsim::ScopedTraceEvent event("worker_event", "test");
+    });
+    worker.join();
+    bcsim::TraceRecorder::set_enabled(false);
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_events(), 2u);
+
+    const std::string path = "test_tracing_events.json";
+    bcsim::TraceRecorder::write_chrome_trace(path);
+    const auto trace = read_file(path);
+    std::remove(path.c_str());
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "\"ph\": \"X\""), 2u);
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "\"name\": \"main_event\""), 1u);
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "\"name\": \"worker_event\""), 1u);
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "{\"value\": 42}"), 1u);
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "Worker \\\"1\\\""), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(TraceFileParameter) {
+    const std::string path = "test_tracing_parameter.json";
+    auto sim = bcsim::Create("cpu");
+    BOOST_CHECK_EQUAL(sim->get_parameter("trace_file"), "");
+    sim->set_parameter("trace_file", path);
+    BOOST_CHECK(bcsim::TraceRecorder::is_enabled());
+    BOOST_CHECK_EQUAL(sim->get_parameter("trace_file"), path);
+    {
+        bcsim::ScopedTraceEvent event("between", "test");
+    }
+    sim->set_parameter("trace_file", "");
+    BOOST_CHECK(!bcsim::TraceRecorder::is_enabled());
+    BOOST_CHECK_EQUAL(sim->get_parameter("trace_file"), "");
+
+    const auto trace = read_file(path);
+    std::remove(path.c_str());
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "\"name\": \"between\""), 1u);
+}
+
+// Naming a thread does not allocate its event buffer, and buffers of exited
+// threads are freed on exit or once their events have been written.
+BOOST_AUTO_TEST_CASE(BuffersOfExitedThreadsAreFreed) {
+    bcsim::TraceRecorder::set_enabled(false);
+    bcsim::TraceRecorder::clear();
+    const auto num_threads = bcsim::TraceRecorder::get_num_threads();
+    std::thread idle_worker([num_threads] {
+        bcsim::TraceRecorder::set_thread_name("Idle");
+        bcsim::ScopedTraceEvent event("ignored", "test");
+        BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_threads(), num_threads);
+    });
+    idle_worker.join();
+
+    bcsim::TraceRecorder::set_enabled(true);
+    std::thread silent_worker([] {
+        {
+            bcsim::ScopedTraceEvent event("cleared", "test");
+        }
+        bcsim::TraceRecorder::clear();
+    });
+    silent_worker.join();
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_threads(), num_threads);
+
+    std::thread worker([] {
+        bcsim::TraceRecorder::set_thread_name("Worker");
+        bcsim::ScopedTraceEvent event("worker_event", "test");
+    });
+    worker.join();
+    bcsim::TraceRecorder::set_enabled(false);
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_threads(), num_threads + 1);
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_events(), 1u);
+
+    const std::string path = "test_tracing_exited.json";
+    bcsim::TraceRecorder::write_chrome_trace(path);
+    const auto trace = read_file(path);
+    std::remove(path.c_str());
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "\"name\": \"worker_event\""), 1u);
+    BOOST_CHECK_EQUAL(count_occurrences(trace, "\"Worker\""), 1u);
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_threads(), num_threads);
+    BOOST_CHECK_EQUAL(bcsim::TraceRecorder::get_num_events(), 0u);
+}
@@ -153,7 +153,7 @@ void example(int argc, char** argv) {
     for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
         spline_scatterers->amplitudes.push_back( a_dist(gen) );
         for (size_t i = 0; i < num_cs; i++) {
-            spline_scatterers->control_points[scatterer_no].push_back( bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen)) );
+            spline_scatterers->control_points.push_back( bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen)) );
         }
     }
 
@@ -36,10 +36,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstring>
+#include <algorithm>
 #include "../core/BCSimConfig.hpp"
 #include "../core/BeamProfile.hpp"
 #include "../core/to_string.hpp"
 #include "../core/LibBCSim.hpp"
+#include "../utils/DopplerProcessing.hpp"
+#include "../utils/SpectralDoppler.hpp"
 
 using namespace bcsim;
 
@@ -55,9 +59,76 @@ std::vector<size_t> get_dimensions(numpy_boost<T, Ndims> v) {
     return res;
 }
 
+// C-contiguous view of the data in a NumPy array. Refers to the array itself
+// when it is already C-contiguous, otherwise to a contiguous copy of it.
+// If transposed is true, the view is of the transposed array, which avoids
+// a copy for Fortran-ordered arrays such as those from simulate_lines().
+template <typename T, int Ndims>
+class ContiguousData {
+public:
+    ContiguousData(const numpy_boost<T, Ndims>& v, bool transposed = false) {
+        auto array = reinterpret_cast<PyArrayObject*>(v.py_ptr());
+        if (transposed) {
+            auto transposed_array = reinterpret_cast<PyArrayObject*>(PyArray_Transpose(array, nullptr));
+            if (transposed_array == nullptr) {
+                throw boost::python::error_already_set();
+            }
+            m_array = PyArray_GETCONTIGUOUS(transposed_array);
+            Py_DECREF(transposed_array);
+        } else {
+            m_array = PyArray_GETCONTIGUOUS(array);
+        }
+        if (m_array == nullptr) {
+            throw boost::python::error_already_set();
+        }
+    }
+
+    ~ContiguousData() {
+        Py_DECREF(m_array);
+    }
+
+    ContiguousData(const ContiguousData&) = delete;
+    ContiguousData& operator=(const ContiguousData&) = delete;
+
+    const T* data() const {
+        return static_cast<const T*>(PyArray_DATA(m_array));
+    }
+
+private:
+    PyArrayObject*  m_array;
+};
+
+// Releases the GIL for the lifetime of the object, so that other Python
+// threads can run. No Python API calls are allowed in the meantime.
+class ScopedGILRelease {
+public:
+    ScopedGILRelease() {
+        m_thread_state = PyEval_SaveThread();
+    }
+
+    ~ScopedGILRelease() {
+        PyEval_RestoreThread(m_thread_state);
+    }
+
+    ScopedGILRelease(const ScopedGILRelease&) = delete;
+    ScopedGILRelease& operator=(const ScopedGILRelease&) = delete;
+
+private:
+    PyThreadState*  m_thread_state;
+};
+
+// The memory layout of a PointScatterer must match a row [x, y, z, amplitude].
+static_assert(sizeof(PointScatterer) == 4*sizeof(float), "Unexpected PointScatterer layout");
+static_assert(sizeof(vector3) == 3*sizeof(float), "Unexpected vector3 layout");
+
+// Note: The simulator object is not thread-safe. The GIL is released during
+// simulation, so a RfSimulator must not be shared between Python threads.
+
 class RfSimulatorWrapper {
 public:
-    RfSimulatorWrapper(std::string sim_type) {
+    RfSimulatorWrapper(std::string sim_type)
+        : m_print_debug(false)
+    {
         if (m_print_debug) std::cout << "Creating simulator of type " << sim_type << std::endl;
         m_rf_simulator = Create(sim_type);
     }
@@ -84,13 +155,11 @@ public:
         }
         auto new_scatterers = FixedScatterers::s_ptr(new FixedScatterers);
 
-        for (size_t row = 0; row < numScatterers; row++) {
-            PointScatterer ps;
-            ps.pos = vector3(data[row][0], data[row][1], data[row][2]);
-            ps.amplitude = data[row][3];
-            new_scatterers->scatterers.push_back(ps);
-        }
-        m_rf_simulator->add_fixed_scatterers(new_scatterers);
+        // rows have the same layout as PointScatterer
+        const ContiguousData<float, 2> contiguous_data(data);
+        new_scatterers->scatterers.resize(numScatterers);
+        std::memcpy(new_scatterers->scatterers.data(), contiguous_data.data(), numScatterers*sizeof(PointScatterer));
+        m_rf_simulator->add_fixed_scatterers(std::move(new_scatterers));
     }
 
     void clear_spline_scatterers() {
@@ -111,10 +180,8 @@ public:
             throw std::runtime_error(std::string(__FUNCTION__) + " : invalid knot vector rank");
         }
         int num_knots = knot_vector_dims.at(0);
-        new_scatterers->knot_vector.resize(num_knots);
-        for (int knot_i = 0; knot_i < num_knots; knot_i++) {
-            new_scatterers->knot_vector[knot_i] = knot_vector[knot_i];
-        }
+        const ContiguousData<float, 1> knots_data(knot_vector);
+        new_scatterers->knot_vector.assign(knots_data.data(), knots_data.data() + num_knots);
         
         // Get size for all three dimensions of nodes array
         auto control_points_dims = get_dimensions(control_points);
@@ -141,24 +208,17 @@ public:
             throw std::runtime_error("Mismatch between control_points and amplitudes");
         }
                 
-        new_scatterers->control_points.resize(num_scatterers);
+        // [num_scatterers, num_control_points, 3] has the same layout as the
+        // flat control point storage.
+        const ContiguousData<float, 3> control_points_data(control_points);
+        const ContiguousData<float, 1> amplitudes_data(amplitudes);
+        const size_t total_num_control_points = static_cast<size_t>(num_scatterers)*num_control_points;
+        new_scatterers->control_points.resize(total_num_control_points);
         new_scatterers->amplitudes.resize(num_scatterers);
+        std::memcpy(new_scatterers->control_points.data(), control_points_data.data(), total_num_control_points*sizeof(vector3));
+        std::memcpy(new_scatterers->amplitudes.data(), amplitudes_data.data(), num_scatterers*sizeof(float));
 
-        for (int scatterer_i = 0; scatterer_i < num_scatterers; scatterer_i++) {
-            new_scatterers->amplitudes[scatterer_i] = amplitudes[scatterer_i];
-
-            new_scatterers->control_points[scatterer_i].resize(num_control_points);
-            for (int control_point_i = 0; control_point_i < num_control_points; control_point_i++) {
-               
-                const vector3 pos(control_points[scatterer_i][control_point_i][0],
-                                  control_points[scatterer_i][control_point_i][1],
-                                  control_points[scatterer_i][control_point_i][2]);
-                
-                new_scatterers->control_points[scatterer_i][control_point_i] = pos;
-            }
-        }
-
-        m_rf_simulator->add_spline_scatterers(new_scatterers);
+        m_rf_simulator->add_spline_scatterers(std::move(new_scatterers));
     }
 
     void set_scan_sequence(numpy_boost<float, 2> origins,
@@ -264,38 +324,38 @@ public:
         auto lut = new LUTBeamProfile(numSamplesRad, numSamplesLat, numSamplesEle,
                                       rangeRange, lateralRange, elevationalRange);
 
-        // Copy all samples from numpy array.
-        for (int ir=0; ir < numSamplesRad; ir++) {
-            for (int il=0; il < numSamplesLat; il++) {
-                for (int ie=0; ie < numSamplesEle; ie++) {
-                    lut->setDiscreteSample(ir, il, ie, samples[ir][il][ie]);       
-                }
-            }
-        }
+        // Copy all samples from numpy array (same row-major layout).
+        const ContiguousData<float, 3> samples_data(samples);
+        lut->setSamples(samples_data.data());
         m_rf_simulator->set_lookup_profile(IBeamProfile::s_ptr(lut));
     }
 
     PyObject* simulate_lines() {
-        // Simulate
-        std::vector<std::vector<std::complex<float>> > rf_lines;
-        m_rf_simulator->simulate_lines(rf_lines);
-        int num_rf_lines = rf_lines.size();
+        // Simulate without holding the GIL.
+        std::vector<std::vector<std::complex<float>>> rf_lines;
+        {
+            ScopedGILRelease gil_release;
+            m_rf_simulator->simulate_lines(rf_lines);
+        }
+        const npy_intp num_rf_lines = rf_lines.size();
+        if (num_rf_lines == 0) {
+            throw std::runtime_error("simulate_lines(): no lines were simulated");
+        }
         // all lines have same number of samples
-        int num_samples = rf_lines[0].size();
-        
-        // Copy over to a NumPy array.
-        int array_dims[] = {static_cast<int>(num_samples), static_cast<int>(num_rf_lines)};
-        numpy_boost<std::complex<float>, 2> array(array_dims);
-        
-        for (int sample_no = 0; sample_no < num_samples; sample_no++) {
-            for (int line_no = 0; line_no < num_rf_lines; line_no++) {
-                array[sample_no][line_no] = rf_lines[line_no][sample_no];
-            }
+        const npy_intp num_samples = rf_lines[0].size();
+
+        // The returned [num_samples, num_lines] array is Fortran-ordered,
+        // so that every line is a single contiguous block in memory.
+        npy_intp array_dims[] = {num_samples, num_rf_lines};
+        PyObject* array_object = PyArray_New(&PyArray_Type, 2, array_dims, NPY_CFLOAT,
+                                             nullptr, nullptr, 0, NPY_ARRAY_F_CONTIGUOUS, nullptr);
+        if (array_object == nullptr) {
+            throw boost::python::error_already_set();
+        }
+        auto dest = static_cast<std::complex<float>*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array_object)));
+        for (npy_intp line_no = 0; line_no < num_rf_lines; line_no++) {
+            std::copy(rf_lines[line_no].begin(), rf_lines[line_no].end(), dest + line_no*num_samples);
         }
-
-        // Return it as a PyObject
-        PyObject* array_object = array.py_ptr();
-        Py_INCREF(array_object);
         return array_object;
     }
 
@@ -308,6 +368,31 @@ public:
         return res;
     }
 
+    // Per-stage timings and scatterer counts of the last CPU frame as a dict.
+    // Empty if the simulator does not record them.
+    boost::python::dict get_stage_timings() {
+        const char* keys[] = {"cpu_frame_ns", "cpu_projection_ns", "cpu_noise_ns", "cpu_fft_ns", "cpu_demodulation_ns",
+                              "cpu_thread_busy_ns", "cpu_scatterers_visited", "cpu_scatterers_contributing"};
+        boost::python::dict res;
+        for (const auto key : keys) {
+            try {
+                const auto values = m_rf_simulator->get_debug_data(key);
+                if (std::string(key) == "cpu_thread_busy_ns") {
+                    boost::python::list per_thread;
+                    for (const auto value : values) {
+                        per_thread.append(value);
+                    }
+                    res[key] = per_thread;
+                } else if (!values.empty()) {
+                    res[key] = values[0];
+                }
+            } catch (std::runtime_error&) {
+                // not recorded
+            }
+        }
+        return res;
+    }
+
     std::string get_parameter(const std::string& key) {
         return m_rf_simulator->get_parameter(key);
     }
@@ -322,15 +407,164 @@ protected:
 
 };
 
+// Color Doppler estimation from an ensemble cube [num_lines, packet_size, num_samples]
+// as returned from stacking simulated frames. Returns (power, velocity, variance)
+// with shape [num_lines, num_samples]. Velocity is the lag-one phase in radians.
+class ColorDopplerProcessorWrapper {
+public:
+    void set_polynomial_filter(int order) {
+        m_processor.set_polynomial_filter(order);
+    }
+
+    void set_iir_filter(numpy_boost<float, 1> b, numpy_boost<float, 1> a, int num_discard) {
+        const ContiguousData<float, 1> b_data(b);
+        const ContiguousData<float, 1> a_data(a);
+        const std::vector<float> b_coeffs(b_data.data(), b_data.data() + b.shape()[0]);
+        const std::vector<float> a_coeffs(a_data.data(), a_data.data() + a.shape()[0]);
+        m_processor.set_iir_filter(b_coeffs, a_coeffs, num_discard);
+    }
+
+    void set_spatial_averaging(int num_lines, int num_samples) {
+        m_processor.set_spatial_averaging(num_lines, num_samples);
+    }
+
+    boost::python::tuple process(numpy_boost<std::complex<float>, 3> ensembles) {
+        const auto dims = get_dimensions(ensembles);
+        const int num_lines   = static_cast<int>(dims[0]);
+        const int packet_size = static_cast<int>(dims[1]);
+        const int num_samples = static_cast<int>(dims[2]);
+        const ContiguousData<std::complex<float>, 3> ensemble_data(ensembles);
+        {
+            ScopedGILRelease gil_release;
+            m_processor.process(ensemble_data.data(), num_lines, packet_size, num_samples, m_estimates);
+        }
+        return boost::python::make_tuple(to_numpy(m_estimates.power),
+                                         to_numpy(m_estimates.velocity),
+                                         to_numpy(m_estimates.variance));
+    }
+
+private:
+    boost::python::object to_numpy(const std::vector<float>& values) const {
+        npy_intp array_dims[] = {m_estimates.num_lines, m_estimates.num_samples};
+        PyObject* array_object = PyArray_SimpleNew(2, array_dims, NPY_FLOAT);
+        if (array_object == nullptr) {
+            throw boost::python::error_already_set();
+        }
+        std::copy(values.begin(), values.end(), static_cast<float*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array_object))));
+        return boost::python::object(boost::python::handle<>(array_object));
+    }
+
+    ColorDopplerProcessor   m_processor;
+    ColorDopplerEstimates   m_estimates;
+};
+
+// Spectral Doppler processing of firings along one line. Firings are added as
+// IQ arrays [num_samples, num_firings] as returned from simulate_lines(), so
+// the spectrogram can be updated while simulating in chunks.
+class SpectralDopplerProcessorWrapper {
+public:
+    SpectralDopplerProcessorWrapper(int fft_length, int hop, int gate_start, int gate_length,
+                                    float dyn_range, float normalize_factor, float gain_factor, int max_spectra) {
+        SpectralDopplerProcessor::Settings settings;
+        settings.fft_length         = fft_length;
+        settings.hop                = hop;
+        settings.gate_start         = gate_start;
+        settings.gate_length        = gate_length;
+        settings.dyn_range          = dyn_range;
+        settings.normalize_factor   = normalize_factor;
+        settings.gain_factor        = gain_factor;
+        settings.max_spectra        = max_spectra;
+        m_settings = settings;
+        m_processor = std::make_shared<SpectralDopplerProcessor>(settings);
+    }
+
+    void add_firings(numpy_boost<std::complex<float>, 2> iq_lines) {
+        const auto dims = get_dimensions(iq_lines);
+        const ContiguousData<std::complex<float>, 2> iq_data(iq_lines, true);
+        ScopedGILRelease gil_release;
+        m_processor->add_firings(iq_data.data(), static_cast<int>(dims[1]), static_cast<int>(dims[0]));
+    }
+
+    void clear() {
+        m_processor->clear();
+    }
+
+    size_t get_num_firings() const {
+        return m_processor->get_num_firings();
+    }
+
+    size_t get_num_spectra() const {
+        return m_processor->get_num_spectra();
+    }
+
+    size_t get_first_spectrum() const {
+        return m_processor->get_first_spectrum();
+    }
+
+    // Log-compressed spectrogram [num_spectra-first_spectrum, fft_length] as uint8.
+    PyObject* get_spectrogram(size_t first_spectrum) const {
+        const auto pixels = m_processor->get_spectrogram(first_spectrum);
+        npy_intp array_dims[] = {static_cast<npy_intp>(m_processor->get_num_spectra() - first_spectrum), m_settings.fft_length};
+        PyObject* array_object = PyArray_SimpleNew(2, array_dims, NPY_UINT8);
+        if (array_object == nullptr) {
+            throw boost::python::error_already_set();
+        }
+        std::copy(pixels.begin(), pixels.end(), static_cast<unsigned char*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array_object))));
+        return array_object;
+    }
+
+    // Spectrogram of all kept spectra.
+    PyObject* get_kept_spectrogram() const {
+        return get_spectrogram(m_processor->get_first_spectrum());
+    }
+
+    // Gated slow-time signal of the kept firings as complex64.
+    PyObject* get_slowtime_samples() const {
+        const auto samples = m_processor->get_slowtime_samples();
+        npy_intp array_dims[] = {static_cast<npy_intp>(samples.size())};
+        PyObject* array_object = PyArray_SimpleNew(1, array_dims, NPY_CFLOAT);
+        if (array_object == nullptr) {
+            throw boost::python::error_already_set();
+        }
+        std::copy(samples.begin(), samples.end(), static_cast<std::complex<float>*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array_object))));
+        return array_object;
+    }
+
+    void write_audio(const std::string& wav_file, float prf, int audio_sample_rate) const {
+        m_processor->write_audio(wav_file, prf, audio_sample_rate);
+    }
+
+private:
+    SpectralDopplerProcessor::Settings              m_settings;
+    std::shared_ptr<SpectralDopplerProcessor>       m_processor;
+};
+
+// import_array() is a macro that returns a value on failure in Python 3.
+#if PY_MAJOR_VERSION >= 3
+static void* init_numpy() {
+    import_array();
+    return nullptr;
+}
+#else
+static void init_numpy() {
+    import_array();
+}
+#endif
+
 BOOST_PYTHON_MODULE(pyrfsim) {
     using namespace boost::python;
 
-    import_array();
+    init_numpy();
+#if PY_VERSION_HEX < 0x03070000
+    // required before the GIL can be released in simulate_lines()
+    PyEval_InitThreads();
+#endif
 
     numpy_boost_python_register_type<float, 1>();
     numpy_boost_python_register_type<float, 2>();
     numpy_boost_python_register_type<float, 3>();
     numpy_boost_python_register_type<std::complex<float>, 2>();
+    numpy_boost_python_register_type<std::complex<float>, 3>();
 
     class_<RfSimulatorWrapper>("RfSimulator", init<std::string>())
         .def("set_print_debug",             &RfSimulatorWrapper::set_print_debug)
@@ -345,7 +579,32 @@ BOOST_PYTHON_MODULE(pyrfsim) {
         .def("set_lut_beam_profile",        &RfSimulatorWrapper::set_lut_beam_profile)
         .def("simulate_lines",              &RfSimulatorWrapper::simulate_lines)
         .def("get_debug_data",              &RfSimulatorWrapper::get_debug_data)
+        .def("get_stage_timings",           &RfSimulatorWrapper::get_stage_timings)
         .def("get_parameter",               &RfSimulatorWrapper::get_parameter)
         .def("get_total_num_scatterers",    &RfSimulatorWrapper::get_total_num_scatterers)
     ;
+
+    class_<ColorDopplerProcessorWrapper>("ColorDopplerProcessor")
+        .def("set_polynomial_filter",       &ColorDopplerProcessorWrapper::set_polynomial_filter)
+        .def("set_iir_filter",              &ColorDopplerProcessorWrapper::set_iir_filter)
+        .def("set_spatial_averaging",       &ColorDopplerProcessorWrapper::set_spatial_averaging)
+        .def("process",                     &ColorDopplerProcessorWrapper::process)
+    ;
+
+    class_<SpectralDopplerProcessorWrapper>("SpectralDopplerProcessor",
+                                            init<int, int, int, int, float, float, float, int>(
+                                                (arg("fft_length")=256, arg("hop")=5, arg("gate_start")=0, arg("gate_length")=1,
+                                                 arg("dyn_range")=60.0f, arg("normalize_factor")=0.0f, arg("gain_factor")=1.0f,
+                                                 arg("max_spectra")=1024)))
+        .def("add_firings",                 &SpectralDopplerProcessorWrapper::add_firings)
+        .def("clear",                       &SpectralDopplerProcessorWrapper::clear)
+        .def("get_num_firings",             &SpectralDopplerProcessorWrapper::get_num_firings)
+        .def("get_num_spectra",             &SpectralDopplerProcessorWrapper::get_num_spectra)
+        .def("get_first_spectrum",          &SpectralDopplerProcessorWrapper::get_first_spectrum)
+        .def("get_spectrogram",             &SpectralDopplerProcessorWrapper::get_kept_spectrogram)
+        .def("get_spectrogram",             &SpectralDopplerProcessorWrapper::get_spectrogram, (arg("first_spectrum")))
+        .def("get_slowtime_samples",        &SpectralDopplerProcessorWrapper::get_slowtime_samples)
+        .def("write_audio",                 &SpectralDopplerProcessorWrapper::write_audio,
+                                            (arg("wav_file"), arg("prf"), arg("audio_sample_rate")=44100))
+    ;
 }
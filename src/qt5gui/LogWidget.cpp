@@ -12,25 +12,32 @@ LogWidget::LogWidget(QWidget* parent, Qt::WindowFlags f)
     m_text_edit->setReadOnly(true);
     layout->addWidget(m_text_edit);
     setLayout(layout);
+
+    // Queued when emitted from another thread.
+    connect(this, &LogWidget::message_posted, this, &LogWidget::append_message);
 }
 
 void LogWidget::write(bcsim::ILog::LogType type, const std::string& msg) {
-    switch (type) {
+    emit message_posted(static_cast<int>(type), QString::fromStdString(msg));
+}
+
+void LogWidget::append_message(int type, QString msg) {
+    switch (static_cast<bcsim::ILog::LogType>(type)) {
     case bcsim::ILog::DEBUG:
         m_text_edit->setTextColor(QColor("grey"));
-        m_text_edit->append("[debug] " + QString::fromStdString(msg));
+        m_text_edit->append("[debug] " + msg);
         break;
     case bcsim::ILog::FATAL:
         m_text_edit->setTextColor(QColor("red"));
-        m_text_edit->append("[fatal] " + QString::fromStdString(msg));
+        m_text_edit->append("[fatal] " + msg);
         break;
     case bcsim::ILog::INFO:
         m_text_edit->setTextColor(QColor("green"));
-        m_text_edit->append("[info] " + QString::fromStdString(msg));
+        m_text_edit->append("[info] " + msg);
         break;
     case bcsim::ILog::WARNING:
         m_text_edit->setTextColor(QColor("black"));
-        m_text_edit->append("[warning] " + QString::fromStdString(msg));
+        m_text_edit->append("[warning] " + msg);
         break;
     }
 }
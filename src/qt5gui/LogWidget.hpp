@@ -9,9 +9,17 @@ Q_OBJECT
 public:
     LogWidget(QWidget* parent=Q_NULLPTR, Qt::WindowFlags f= Qt::WindowFlags());
         
+    // Can be called from any thread. Messages from other threads than the
+    // GUI thread are appended from the GUI event loop.
     virtual void write(bcsim::ILog::LogType type, const std::string& msg) override;
 
     void clear_contents();
+
+signals:
+    void message_posted(int type, QString msg);
+
+private slots:
+    void append_message(int type, QString msg);
         
 private:
     QTextEdit*  m_text_edit;
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cmath>
 #include <algorithm>
 #include <random> // for selecting scatterers
+#include <chrono>
 
 #include <QMenuBar>
 #include <QMenu>
@@ -41,6 +42,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QPixmap>
 #include <QFileDialog>
 #include <QStatusBar>
+#include <QLabel>
+#include <QProgressBar>
 #include <QInputDialog>
 #include <QTimer>
 #include <QGraphicsPixmapItem>
@@ -48,6 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "MainWindow.hpp"
 #include "../utils/HDFConvenience.hpp"
+#include "../utils/NativePhantom.hpp"
 #include "../core/LibBCSim.hpp"
 #include "utils.hpp" // needed for generating grayscale colortable
 #include "../utils/SimpleHDF.hpp"    // for reading scatterer splines for vis.
@@ -67,6 +71,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "SimTimeWidget.hpp"
 #include "GrayscaleTransformWidget.hpp"
 #include "RefreshWorker.hpp"
+#include "SimulationWorker.hpp"
 #include "QSettingsConfigAdapter.hpp"
 #include "QFileAdapter.hpp"
 #include "../utils/DefaultPhantoms.hpp"
@@ -78,6 +83,15 @@ MainWindow::MainWindow() {
     m_log_widget->resize(400, 400);
     onLoadIniSettings();
 
+    // Simulation runs in the background and must exist before the simulator is created.
+    qRegisterMetaType<simulation_worker::SimulationResult::ptr>();
+    m_simulation_worker = new simulation_worker::SimulationWorker(m_settings->value("sim_chunks_per_frame", 4).toInt(), this);
+    connect(m_simulation_worker, &simulation_worker::SimulationWorker::simulation_finished,
+            this, &MainWindow::onSimulationFinished);
+    connect(m_simulation_worker, &simulation_worker::SimulationWorker::simulation_failed, this, [&](QString msg) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Caught exception while simulating: " + msg.toStdString());
+    });
+
     // Simulation time manager
     m_sim_time_manager = new SimTimeManager(0.0f, 1.0f);
     m_sim_time_manager->set_time(0.0f);
@@ -169,7 +183,15 @@ MainWindow::MainWindow() {
     // refresh thread setup
     qRegisterMetaType<refresh_worker::WorkTask::ptr>();
     qRegisterMetaType<refresh_worker::WorkResult::ptr>();
-    m_refresh_worker = new refresh_worker::RefreshWorker(10);
+    m_refresh_worker = new refresh_worker::RefreshWorker;
+    m_refresh_status_label = new QLabel;
+    statusBar()->addPermanentWidget(m_refresh_status_label);
+    m_simulation_progress_bar = new QProgressBar;
+    m_simulation_progress_bar->setRange(0, 100);
+    m_simulation_progress_bar->setMaximumWidth(120);
+    statusBar()->addPermanentWidget(m_simulation_progress_bar);
+    connect(m_simulation_worker, &simulation_worker::SimulationWorker::progress,
+            m_simulation_progress_bar, &QProgressBar::setValue);
 
     connect(m_refresh_worker, &refresh_worker::RefreshWorker::processed_bmode_data_available, [&](refresh_worker::WorkResult::ptr work_result) {
         auto result_image = work_result->image.get_image();
@@ -197,6 +219,9 @@ MainWindow::MainWindow() {
             const auto written_image = m_opengl_image_exporter->add(m_gl_vis_widget->getGlImage());
             m_log_widget->write(bcsim::ILog::INFO, "Wrote grabbed OpenGL image to " + written_image.toStdString());
         }
+
+        const std::chrono::duration<float, std::milli> latency = refresh_worker::Clock::now() - work_result->submit_time;
+        updateRefreshStatus(latency.count());
     });
 
 
@@ -211,6 +236,9 @@ MainWindow::MainWindow() {
         m_display_widget->update_colorflow(QPixmap::fromImage(result_image), x_min, x_max, y_min, y_max);
         
         // TODO: Handle saving PNG images
+
+        const std::chrono::duration<float, std::milli> latency = refresh_worker::Clock::now() - work_result->submit_time;
+        updateRefreshStatus(latency.count());
     });
 
     createMenus();
@@ -327,13 +355,19 @@ void MainWindow::createMenus() {
     m_save_iq_act = new QAction(tr("Save IQ data"), this);
     m_save_iq_act->setCheckable(true);
     m_save_iq_act->setChecked(false);
+    connect(m_save_iq_act, &QAction::toggled, [&](bool checked) {
+        // ask for an output file the first time recording is enabled.
+        if (checked && !m_iq_writer) {
+            onSaveIqBufferAs();
+        }
+    });
     simulateMenu->addAction(m_save_iq_act);
 
-    m_save_iq_buffer_as_act = new QAction(tr("Save IQ buffer as"), this);
+    m_save_iq_buffer_as_act = new QAction(tr("Stream IQ data to file..."), this);
     connect(m_save_iq_buffer_as_act, SIGNAL(triggered()), this, SLOT(onSaveIqBufferAs()));
     simulateMenu->addAction(m_save_iq_buffer_as_act);
 
-    m_reset_iq_buffer_act = new QAction(tr("Reset IQ buffer"), this);
+    m_reset_iq_buffer_act = new QAction(tr("Close IQ file"), this);
     connect(m_reset_iq_buffer_act, SIGNAL(triggered()), this, SLOT(onResetIqBuffer()));
     simulateMenu->addAction(m_reset_iq_buffer_act);
 
@@ -383,6 +417,7 @@ void MainWindow::createMenus() {
     auto print_debug_act = new QAction(tr("Print debug info"), this);
     connect(print_debug_act, &QAction::triggered, this, [&]() {
         if (m_sim) {
+            simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
             std::vector<std::string> keys;
             keys.push_back("stream_numbers");
             keys.push_back("kernel_memset_ms");
@@ -436,7 +471,7 @@ void MainWindow::createMenus() {
 }
 
 void MainWindow::onLoadScatterers() {
-    auto h5_file = QFileDialog::getOpenFileName(this, tr("Load h5 scatterer dataset"), "", tr("h5 files (*.h5)"));
+    auto h5_file = QFileDialog::getOpenFileName(this, tr("Load h5 scatterer dataset"), "", tr("Scatterer files (*.h5 *.bcph)"));
     if (h5_file == "") {
         m_log_widget->write(bcsim::ILog::WARNING, "Invalid scatterer file. Skipping");
         return;
@@ -484,10 +519,12 @@ void MainWindow::onSetSimulatorNoise() {
     }
 
     m_log_widget->write(bcsim::ILog::DEBUG, "Setting new noise amplitude: " + std::to_string(noise_amplitude));
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     m_sim->set_parameter("noise_amplitude", std::to_string(noise_amplitude));
 }
 
 void MainWindow::createNewSimulator(const QString& sim_type) {
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     const int gpu_device_no = m_settings->value("cuda_device_no", 0).toInt();
     bool force_cpu = false;
     bool force_gpu = false;
@@ -512,6 +549,7 @@ void MainWindow::createNewSimulator(const QString& sim_type) {
         m_log_widget->write(bcsim::ILog::INFO, "Simulator will use " + std::to_string(num_cores) + " threads");
         m_sim = bcsim::Create("cpu");
         m_sim->set_parameter("num_cpu_cores", std::to_string(num_cores));
+        m_sim->set_parameter("progressive_passes", std::to_string(m_settings->value("cpu_sim_progressive_passes", 1).toInt()));
         window_title_extra = QString::number(num_cores) + " CPU threads";
     }
     if (!m_sim) throw std::runtime_error("This should never happen - simulator was not created!");
@@ -565,6 +603,7 @@ void MainWindow::createNewSimulator(const QString& sim_type) {
 }
 
 void MainWindow::updateWithNewFixedScatterers(bcsim::FixedScatterers::s_ptr fixed_scatterers) {
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     m_sim->add_fixed_scatterers(fixed_scatterers);
     try {
         initializeFixedVisualization(fixed_scatterers);
@@ -575,7 +614,10 @@ void MainWindow::updateWithNewFixedScatterers(bcsim::FixedScatterers::s_ptr fixe
 }
 
 void MainWindow::updateWithNewSplineScatterers(bcsim::SplineScatterers::s_ptr spline_scatterers) {
-    m_sim->add_spline_scatterers(spline_scatterers);
+    {
+        simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
+        m_sim->add_spline_scatterers(spline_scatterers);
+    }
 
     // Handle visualization in OpenGL - TODO: Update (sample some scatterers from all collections?)
     // This does not yet support hdf5 files with both types of scatterers!
@@ -600,9 +642,21 @@ void MainWindow::loadScatterers(const QString h5_file) {
         m_log_widget->write(bcsim::ILog::WARNING, "Invalid scatterer file. Skipping");
         return;
     }
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     m_sim->clear_fixed_scatterers();
     m_sim->clear_spline_scatterers();
 
+    // native phantom files are memory-mapped and contain only one type of scatterers.
+    const std::string filename = h5_file.toUtf8().constData();
+    const auto native_type = bcsim::getNativePhantomType(filename);
+    if (native_type == "fixed") {
+        updateWithNewFixedScatterers(bcsim::loadFixedScatterersFromNative(filename));
+        return;
+    } else if (native_type == "spline") {
+        updateWithNewSplineScatterers(bcsim::loadSplineScatterersFromNative(filename));
+        return;
+    }
+
     // load fixed scatterers (if found)
     try {
         updateWithNewFixedScatterers(bcsim::loadFixedScatterersFromHdf(h5_file.toUtf8().constData()));
@@ -634,7 +688,7 @@ void MainWindow::newScansequence(bcsim::ScanGeometry::ptr new_geometry, int new_
 
     new_scanseq->all_timestamps_equal = equal_timestamps;
 
-    m_sim->set_scan_sequence(new_scanseq);
+    // The simulation worker configures the simulator with the scan sequence
     m_cur_scanseq = new_scanseq;
     
     if (m_settings->value("enable_gl_widget", true).toBool()) {
@@ -646,6 +700,7 @@ void MainWindow::setExcitation(const QString h5_file) {
     throw std::runtime_error("this function should not be used");
     try {
         auto new_excitation = bcsim::loadExcitationFromHdf(h5_file.toUtf8().constData());
+        simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
         m_sim->set_excitation(new_excitation);
         m_log_widget->write(bcsim::ILog::INFO, "Configured excitation");
     } catch (const std::runtime_error& e) {
@@ -659,91 +714,101 @@ void MainWindow::doSimulation() {
     auto new_scan_geometry = m_scanseq_widget->get_geometry(new_num_scanlines);
     newScansequence(new_scan_geometry, new_num_scanlines, m_scanseq_widget->all_timestamps_equal());
     
-    typedef std::vector<std::vector<std::complex<float>>> IQ_Frame;
-    
+    auto request = std::make_shared<simulation_worker::SimulationRequest>();
+    request->simulator = m_sim;
+    request->geometry  = m_scan_geometry;
+    request->sim_time  = m_sim_time_manager->get_time();
+
     if (m_enable_color_act->isChecked()) {
         // Color Doppler scan
         const auto color_packet_size = m_settings->value("color_packet_size", 16).toInt();
         const auto color_prf         = m_settings->value("color_prf", 2500.0).toFloat();
         const auto color_prt         = 1.0f/color_prf;
-        std::vector<IQ_Frame> iq_frames_complex;
-
-        try {
-            int total_millisec = 0;
-            for (int packet_no = 0; packet_no < color_packet_size; packet_no++) {
-                // make a copy of current scan sequence to change timestamp
-                auto temp_scanseq = bcsim::ScanSequence::s_ptr(new bcsim::ScanSequence(m_cur_scanseq->line_length));
-                const auto num_lines = m_cur_scanseq->get_num_lines();
-                float packet_timestamp;
-                for (int line_no = 0; line_no < num_lines; line_no++) {
-                    auto scanline = m_cur_scanseq->get_scanline(line_no);
-                    const auto temp_direction = scanline.get_direction();
-                    const auto temp_lateral_dir = scanline.get_lateral_dir();
-                    const auto temp_origin = scanline.get_origin();
-                    packet_timestamp = scanline.get_timestamp()+packet_no*color_prt;
-                    temp_scanseq->add_scanline(bcsim::Scanline(temp_origin, temp_direction, temp_lateral_dir, packet_timestamp));
-                }
-                m_sim->set_scan_sequence(temp_scanseq);
-
-                IQ_Frame iq_frame;
-                {
-                ScopedCpuTimer timer([&](int millisec) { total_millisec += millisec; });
-                m_sim->simulate_lines(iq_frame);
-                }
-                iq_frames_complex.push_back(iq_frame);
-                m_log_widget->write(bcsim::ILog::DEBUG, "Simulated frame in packet: timestamp is " + std::to_string(packet_timestamp));
+        for (int packet_no = 0; packet_no < color_packet_size; packet_no++) {
+            // make a copy of current scan sequence to change timestamp
+            auto temp_scanseq = bcsim::ScanSequence::s_ptr(new bcsim::ScanSequence(m_cur_scanseq->line_length));
+            const auto num_lines = m_cur_scanseq->get_num_lines();
+            for (int line_no = 0; line_no < num_lines; line_no++) {
+                auto scanline = m_cur_scanseq->get_scanline(line_no);
+                const auto temp_direction = scanline.get_direction();
+                const auto temp_lateral_dir = scanline.get_lateral_dir();
+                const auto temp_origin = scanline.get_origin();
+                const auto packet_timestamp = scanline.get_timestamp()+packet_no*color_prt;
+                temp_scanseq->add_scanline(bcsim::Scanline(temp_origin, temp_direction, temp_lateral_dir, packet_timestamp));
             }
+            request->color_scanseqs.push_back(temp_scanseq);
+        }
+    }
+    if (m_enable_bmode_act->isChecked()) {
+        // B-Mode scan
+        request->bmode_scanseq = m_cur_scanseq;
+    }
+
+    if (request->bmode_scanseq || !request->color_scanseqs.empty()) {
+        m_simulation_worker->submit(request);
+    }
+}
 
+void MainWindow::onSimulationFinished(simulation_worker::SimulationResult::ptr result) {
+    const auto request = result->request;
+    const auto dots_per_meter = m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat();
 
+    if (!result->color_frames.empty()) {
+        try {
             auto color_task = std::make_shared<refresh_worker::WorkTask_ColorDoppler>();
-            color_task->set_geometry(m_scan_geometry);
-            color_task->set_data(iq_frames_complex);
-            color_task->set_dots_per_meter( m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat() );
+            color_task->set_geometry(request->geometry);
+            color_task->set_data(result->color_frames);
+            color_task->set_dots_per_meter(dots_per_meter);
     
             m_refresh_worker->process_data(color_task);
-            statusBar()->showMessage("Color Doppler simulation time per packet: " + QString::number(total_millisec/static_cast<float>(color_packet_size)) + " ms.");
-
+            const auto packet_size = static_cast<float>(result->color_frames.size());
+            statusBar()->showMessage("Color Doppler simulation time per packet: " + QString::number(result->color_millisec/packet_size) + " ms.");
 
         } catch (std::runtime_error& e) {
             m_log_widget->write(bcsim::ILog::WARNING, "Caught exception simulating color Doppler: " + std::string(e.what()));
         }
     }
-    if (m_enable_bmode_act->isChecked()) {
-        // B-Mode scan
+    if (!result->bmode_frame.empty()) {
         try {
-            IQ_Frame rf_lines_complex;
-            int total_millisec;
-            {
-            ScopedCpuTimer timer([&](int millisec) { total_millisec = millisec; });
-            m_sim->simulate_lines(rf_lines_complex);
-            }
-
+            const auto& rf_lines_complex = result->bmode_frame;
             m_display_widget->update_status(QString("Radial samples: %1").arg(rf_lines_complex[0].size()));
 
-            if (m_save_iq_act->isChecked()) {
-                m_iq_buffer.push_back(rf_lines_complex);
-                const auto timestamp = m_sim_time_manager->get_time();
-                m_iq_buffer_timestamps.push_back(timestamp);
+            if (m_save_iq_act->isChecked() && m_iq_writer && !result->is_preview()) {
+                try {
+                    m_iq_writer->append_frame(rf_lines_complex, request->sim_time);
+                } catch (std::runtime_error& e) {
+                    m_log_widget->write(bcsim::ILog::WARNING, "Stopped saving IQ data: " + std::string(e.what()));
+                    onResetIqBuffer();
+                }
             }
 
-            // Create refresh work task from current geometry and the beam space data
+            // Create refresh work task from the geometry used and the beam space data
             auto bmode_task = std::make_shared<refresh_worker::WorkTask_BMode>();
-            bmode_task->set_geometry(m_scan_geometry);
+            bmode_task->set_geometry(request->geometry);
             bmode_task->set_data(rf_lines_complex);
             auto grayscale_settings = m_grayscale_widget->get_values();
             bmode_task->set_normalize_const(grayscale_settings.normalization_const);
             bmode_task->set_auto_normalize(grayscale_settings.auto_normalize);
-            bmode_task->set_dots_per_meter( m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat() );
+            bmode_task->set_dots_per_meter(dots_per_meter);
             bmode_task->set_dyn_range(grayscale_settings.dyn_range);
             bmode_task->set_gain(grayscale_settings.gain); 
     
-            m_refresh_worker->process_data(bmode_task);
+            // Exported frames must not be dropped.
+            if (m_ultrasound_image_exporter && !result->is_preview()) {
+                m_refresh_worker->process_data_lossless(bmode_task);
+            } else {
+                m_refresh_worker->process_data(bmode_task);
+            }
 
-            const auto total_scatterers = m_sim->get_total_num_scatterers();
-            const auto ns_value = static_cast<float>(1e6*total_millisec/(new_num_scanlines*total_scatterers));
-            const auto msg = QString("Simulation time: %1 ms   ~   %2 nanosec. per scatterer per line")
+            const auto total_millisec = result->bmode_millisec;
+            const auto num_scanlines = rf_lines_complex.size();
+            const auto ns_value = static_cast<float>(1e6*total_millisec/(num_scanlines*result->num_scatterers));
+            auto msg = QString("Simulation time: %1 ms   ~   %2 nanosec. per scatterer per line")
                                 .arg(total_millisec, 3)
                                 .arg(ns_value, 3);
+            if (result->num_passes > 1) {
+                msg += QString("   (pass %1 of %2)").arg(result->pass_no).arg(result->num_passes);
+            }
             statusBar()->showMessage(msg);
 
         } catch (std::runtime_error& e) {
@@ -805,11 +870,9 @@ void MainWindow::initializeSplineVisualization(bcsim::SplineScatterers::s_ptr sp
         SplineCurve<float, bcsim::vector3> curve;
         curve.knots = spline_scatterers->knot_vector;
         curve.degree = spline_scatterers->spline_degree;
-        const auto num_cs = spline_scatterers->control_points[0].size();
-        curve.cs.resize(num_cs);
-        for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
-            curve.cs[cs_no] = spline_scatterers->control_points[ind][cs_no];
-        }
+        const auto num_cs = spline_scatterers->get_num_control_points();
+        const auto cs = spline_scatterers->get_control_points(ind);
+        curve.cs.assign(cs, cs + num_cs);
         splines[scatterer_no] = curve;
     }
 
@@ -820,11 +883,13 @@ void MainWindow::initializeSplineVisualization(bcsim::SplineScatterers::s_ptr sp
 }
 
 void MainWindow::onNewExcitation(bcsim::ExcitationSignal new_excitation) {
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     m_sim->set_excitation(new_excitation);
     m_log_widget->write(bcsim::ILog::INFO, "Configured excitation signal");
 }
 
 void MainWindow::onNewBeamProfile(bcsim::IBeamProfile::s_ptr new_beamprofile) {
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     if (std::dynamic_pointer_cast<bcsim::GaussianBeamProfile>(new_beamprofile)) {
         m_sim->set_analytical_profile(new_beamprofile);
     } else if (std::dynamic_pointer_cast<bcsim::LUTBeamProfile>(new_beamprofile)) {
@@ -864,6 +929,10 @@ void MainWindow::onSetSimTme() {
 }
 
 void MainWindow::onTimer() {
+    // Advance one time step per simulated frame. Skip ticks while busy.
+    if (m_simulation_worker->is_busy()) {
+        return;
+    }
     m_sim_time_manager->advance();
     ScopedCpuTimer timer([&](int millisec) {
         m_log_widget->write(bcsim::ILog::DEBUG, "onTimer() used " + std::to_string(millisec) + " milliseconds");
@@ -876,7 +945,11 @@ void MainWindow::onAboutScatterers() {
         m_log_widget->write(bcsim::ILog::WARNING, "No simulator is active");
         return;
     }
-    const auto n = m_sim->get_total_num_scatterers();
+    size_t n;
+    {
+        simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
+        n = m_sim->get_total_num_scatterers();
+    }
     QMessageBox::information(this, "Current scatterers", QString("Phantom consists of %1 scatterers").arg(n));
 }
 
@@ -910,6 +983,7 @@ void MainWindow::onLoadBeamProfileLUT() {
         m_log_widget->write(bcsim::ILog::WARNING, "No lookup-table file selected. Ignoring.");
         return;
     }
+    simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
     m_sim->set_lookup_profile(bcsim::loadBeamProfileFromHdf(h5_file.toUtf8().constData()));
 }
 
@@ -997,7 +1071,8 @@ void MainWindow::onLoadSimulatedData() {
         bmode_task->set_dots_per_meter( m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat() );
         bmode_task->set_dyn_range(grayscale_settings.dyn_range);
         bmode_task->set_gain(grayscale_settings.gain); 
-        m_refresh_worker->process_data(bmode_task);
+        // Every frame of the file is shown, and exported if enabled.
+        m_refresh_worker->process_data_lossless(bmode_task);
     }
 }
 
@@ -1018,6 +1093,7 @@ void MainWindow::onSetSimulatorParameter() {
         return;
     }
     try {
+        simulation_worker::SimulationWorker::SimulatorLock sim_lock(m_simulation_worker);
         m_sim->set_parameter(key.toUtf8().constData(), value.toUtf8().constData());
     } catch (std::runtime_error& e) {
         m_log_widget->write(bcsim::ILog::WARNING, "Caught exception: " + std::string(e.what()));
@@ -1027,78 +1103,47 @@ void MainWindow::onSetSimulatorParameter() {
 }
 
 void MainWindow::onSaveIqBufferAs() {
-    const auto num_frames = m_iq_buffer.size();
-    const auto num_timestamps = m_iq_buffer_timestamps.size();
-    m_log_widget->write(bcsim::ILog::INFO, "IQ Buffer contains data for " + std::to_string(num_frames) + " frames");
-    m_log_widget->write(bcsim::ILog::INFO, "Number of frame timestamps is " + std::to_string(num_timestamps));
-    if (num_timestamps != num_frames) {
-        m_log_widget->write(bcsim::ILog::WARNING, "Mismatch in number of samples. Aborting");
-        onResetIqBuffer();
-        return;
-    }
-
-    m_log_widget->write(bcsim::ILog::INFO, "Buffer contains IQ data for " + std::to_string(num_frames) + " frames.");
-
-    if (num_frames == 0) {
-        m_log_widget->write(bcsim::ILog::WARNING, "No frames in buffer. Skipping");
-        return;
-    }
+    // any recording in progress is finished first.
+    onResetIqBuffer();
 
-    auto h5_file = QFileDialog::getSaveFileName(this, "Save IQ buffer as HDF5", ".", "HDF5 files (*.h5)");
+    auto h5_file = QFileDialog::getSaveFileName(this, "Stream IQ data to HDF5", ".", "HDF5 files (*.h5)");
     if (h5_file == "") {
-        m_log_widget->write(bcsim::ILog::WARNING, "Ignoring IQ buffer save");
+        m_log_widget->write(bcsim::ILog::WARNING, "Not saving IQ data");
         return;
     }
 
-    // all frames must have same dimensions
-    const auto& frame = m_iq_buffer[0];
-    const auto num_lines   = frame.size();
-    const auto num_samples = frame[0].size();
-    m_log_widget->write(bcsim::ILog::INFO, "Each frame has " + std::to_string(num_lines) + " lines of " + std::to_string(num_samples) + " samples.");
-    
-    boost::array<size_t, 3> dims;
-    dims[0] = num_frames;
-    dims[1] = num_lines;
-    dims[2] = num_samples;
-
-    boost::multi_array<float, 3> iq_real;
-    boost::multi_array<float, 3> iq_imag;
-    iq_real.resize(dims);
-    iq_imag.resize(dims);
-
-    m_log_widget->write(bcsim::ILog::INFO, "Converting data");
-    for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
-        for (size_t line_no = 0; line_no < num_lines; line_no++) {
-            for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
-                iq_real[frame_no][line_no][sample_no] = m_iq_buffer[frame_no][line_no][sample_no].real();
-                iq_imag[frame_no][line_no][sample_no] = m_iq_buffer[frame_no][line_no][sample_no].imag();
-            }
+    try {
+        m_iq_writer.reset(new bcsim::IqStreamWriter(h5_file.toUtf8().constData()));
+        if (m_cur_scanseq) {
+            m_iq_writer->set_scan_sequence(m_cur_scanseq);
         }
+    } catch (std::runtime_error& e) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Unable to save IQ data: " + std::string(e.what()));
+        m_iq_writer.reset();
+        return;
     }
+    m_log_widget->write(bcsim::ILog::INFO, "Saving IQ data to " + std::string(h5_file.toUtf8().constData()));
+    m_save_iq_act->setChecked(true);
+}
 
-    auto file = H5::H5File(h5_file.toUtf8().constData(), H5F_ACC_TRUNC);
-    hsize_t dspace_dims[] = {num_frames, num_lines, num_samples};
-    H5::DataSpace dspace(3, dspace_dims);
-    
-    m_log_widget->write(bcsim::ILog::INFO, "Writing real part");
-    auto dset_real = file.createDataSet("iq_real", H5::PredType::NATIVE_FLOAT, dspace);
-    dset_real.write(iq_real.data(), H5::PredType::NATIVE_FLOAT);
-    
-    m_log_widget->write(bcsim::ILog::INFO, "Writing imaginary part");
-    auto dset_imag = file.createDataSet("iq_imag", H5::PredType::NATIVE_FLOAT, dspace);
-    dset_imag.write(iq_imag.data(), H5::PredType::NATIVE_FLOAT);
-    
-    m_log_widget->write(bcsim::ILog::INFO, "Writing timestamps");
-    hsize_t dspace_dims_timestamps[] = {num_frames};
-    H5::DataSpace dspace_timestamps(1, dspace_dims_timestamps);
-    auto dset_timestamps = file.createDataSet("frame_times", H5::PredType::NATIVE_FLOAT, dspace_timestamps);
-    dset_timestamps.write(m_iq_buffer_timestamps.data(), H5::PredType::NATIVE_FLOAT);
-
-    onResetIqBuffer();
+void MainWindow::updateRefreshStatus(float latency_millisec) {
+    const auto msg = QString("Display latency: %1 ms   Dropped frames: %2")
+                        .arg(latency_millisec, 0, 'f', 1)
+                        .arg(m_refresh_worker->get_num_dropped_frames());
+    m_refresh_status_label->setText(msg);
 }
 
 void MainWindow::onResetIqBuffer() {
-    m_iq_buffer.clear();
-    m_iq_buffer_timestamps.clear();
+    m_save_iq_act->setChecked(false);
+    if (!m_iq_writer) {
+        return;
+    }
+    try {
+        m_iq_writer->close();
+        m_log_widget->write(bcsim::ILog::INFO, "Wrote IQ data for " + std::to_string(m_iq_writer->get_num_frames_written()) + " frames.");
+    } catch (std::runtime_error& e) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Error saving IQ data: " + std::string(e.what()));
+    }
+    m_iq_writer.reset();
 }
 
@@ -41,6 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ImageExport.hpp"
 #include "LogWidget.hpp"
 #include "../utils/HardwareAutodetection.hpp"
+#include "../utils/IqStreamWriter.hpp"
 
 // Forward decl.
 class DisplayWidget;
@@ -55,9 +56,15 @@ class ProbeWidget;
 class SimTimeWidget;
 class GrayscaleTransformWidget;
 class QTimer;
+class QLabel;
+class QProgressBar;
 namespace refresh_worker {
     class RefreshWorker;
 }
+namespace simulation_worker {
+    class SimulationWorker;
+    class SimulationResult;
+}
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -80,7 +87,8 @@ public:
     // Define the excitation signal using data from hdf5 file
     void setExcitation(const QString h5_file);
 
-    // Do simulation using current config.
+    // Request simulation of a frame using current config. The frame is
+    // simulated in the background.
     void doSimulation();
 
 protected:
@@ -147,6 +155,12 @@ private:
 
     void initializeFixedVisualization(bcsim::FixedScatterers::s_ptr);
 
+    // Update the status bar readout after a frame has been displayed.
+    void updateRefreshStatus(float latency_millisec);
+
+    // Pass simulated frames on for display and storage. Called in the GUI thread.
+    void onSimulationFinished(std::shared_ptr<simulation_worker::SimulationResult> result);
+
     void updateWithNewFixedScatterers(bcsim::FixedScatterers::s_ptr fixed_scatterers);
 
     void updateWithNewSplineScatterers(bcsim::SplineScatterers::s_ptr spline_scatterers);
@@ -184,9 +198,15 @@ private:
     
     refresh_worker::RefreshWorker*  m_refresh_worker;
 
+    // Shows simulate-to-display latency and number of dropped frames.
+    QLabel*                         m_refresh_status_label;
+
+    // Runs the simulator. All other access to m_sim must hold a SimulatorLock.
+    simulation_worker::SimulationWorker*    m_simulation_worker;
+    QProgressBar*                   m_simulation_progress_bar;
+
     // Related to IQ-buffering
-    std::vector<std::vector<std::vector<std::complex<float>>>> m_iq_buffer;
-    std::vector<float>                                         m_iq_buffer_timestamps;
+    std::unique_ptr<bcsim::IqStreamWriter> m_iq_writer;
     QAction*                        m_save_iq_act;
     QAction*                        m_save_iq_buffer_as_act;
     QAction*                        m_reset_iq_buffer_act;
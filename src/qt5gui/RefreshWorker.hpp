@@ -30,46 +30,260 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <stdexcept>
 #include <memory>
+#include <vector>
+#include <complex>
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <QObject>
 #include <QThread>
-#include <QTimer>
-#include <QMutex>
-#include <QQueue>
-#include <QMutexLocker>
+#include <QMetaObject>
 #include <QImage>
 #include "../utils/cartesianator/Cartesianator.hpp"
 #include "../utils/ScanGeometry.hpp"
 #include "../utils/BCSimConvenience.hpp"
+#include "../utils/DopplerProcessing.hpp"
+#include "../core/Tracing.hpp"
 
 namespace refresh_worker {
 
-// A safe variant of QImage owning its pixel data.
-class SafeQImage {
+typedef std::chrono::steady_clock Clock;
+
+// Pool of pixel buffers. A buffer is reused when no image refers to it
+// anymore, so no memory is allocated per frame once the pool is warm.
+// Buffers are acquired on one thread and may be released on any thread.
+class ImageBufferPool {
+private:
+    struct Slot {
+        Slot()
+            : num_users(0)
+        {
+        }
+        std::vector<unsigned char>  pixels;
+        std::atomic<int>            num_users;
+    };
+
 public:
-    SafeQImage()
-        : m_pixels(nullptr)
+    // Handle to a pooled buffer. The buffer is returned to the pool when
+    // the last copy of the handle is destroyed.
+    class Buffer {
+    public:
+        Buffer() { }
+
+        Buffer(const Buffer& other)
+            : m_slot(other.m_slot)
+        {
+            retain();
+        }
+
+        Buffer& operator=(Buffer other) {
+            std::swap(m_slot, other.m_slot);
+            return *this;
+        }
+
+        ~Buffer() {
+            release();
+        }
+
+        unsigned char* data() const {
+            return m_slot->pixels.data();
+        }
+
+    private:
+        friend class ImageBufferPool;
+
+        explicit Buffer(std::shared_ptr<Slot> slot)
+            : m_slot(std::move(slot))
+        {
+            retain();
+        }
+
+        void retain() {
+            if (m_slot) m_slot->num_users.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Release ordering makes all reads of the pixels happen before the
+        // pool hands the buffer out again.
+        void release() {
+            if (m_slot) m_slot->num_users.fetch_sub(1, std::memory_order_release);
+        }
+
+        std::shared_ptr<Slot>   m_slot;
+    };
+
+    ImageBufferPool(size_t max_buffers = 4)
+        : m_max_buffers(max_buffers)
     {
     }
 
-    SafeQImage(const unsigned char* data, int width, int height, int bytes_per_sample, QImage::Format format) {
-        const auto num_bytes = width*height*bytes_per_sample;
-        m_pixels = new std::vector<unsigned char>;
-        m_pixels->reserve(num_bytes);
-        for (int i = 0; i < num_bytes; i++) {
-            m_pixels->push_back(data[i]);
+    // Get a buffer of num_bytes bytes. Must always be called from the same thread.
+    Buffer acquire(size_t num_bytes) {
+        for (const auto& slot : m_slots) {
+            if (slot->num_users.load(std::memory_order_acquire) == 0) {
+                slot->pixels.resize(num_bytes);
+                return Buffer(slot);
+            }
         }
-        m_img = QImage(m_pixels->data(), width, height, width*bytes_per_sample, format);
+        auto slot = std::make_shared<Slot>();
+        slot->pixels.resize(num_bytes);
+        if (m_slots.size() < m_max_buffers) {
+            m_slots.push_back(slot);
+        }
+        return Buffer(slot);
     }
 
+private:
+    size_t                              m_max_buffers;
+    std::vector<std::shared_ptr<Slot>>  m_slots;
+};
+
+// A safe variant of QImage sharing ownership of its pixel data.
+class SafeQImage {
+public:
+    SafeQImage() { }
+
+    SafeQImage(ImageBufferPool::Buffer pixels, int width, int height, int bytes_per_sample, QImage::Format format)
+        : m_pixels(pixels)
+    {
+        m_img = QImage(m_pixels.data(), width, height, width*bytes_per_sample, format);
+    }
+
+    // Only valid as long as this SafeQImage (or a copy of it) is alive.
     QImage get_image() const {
         return m_img;
     }
 
 private:
     QImage                      m_img;
-    
-    // Must be a pointer so that copying a SafeQImage is safe!
-    std::vector<unsigned char>* m_pixels;
+    ImageBufferPool::Buffer     m_pixels;
+};
+
+// Bounded lock-free handoff from one producer thread to one consumer thread.
+// The producer never blocks: when it wraps around to a slot that has not been
+// consumed yet, the old entry is dropped, so that the latest frame wins.
+// The consumer takes all pending entries at once, in the order produced.
+// Entries are preallocated: consumed entries go back to the producer through
+// a free list, so pushing does not allocate.
+template <typename T, size_t Capacity>
+class LatestFrameRing {
+public:
+    LatestFrameRing()
+        : m_write_index(0),
+          m_sequence_no(0),
+          m_free_head(0),
+          m_free_tail(0),
+          m_next_sequence_no(0)
+    {
+        for (auto& slot : m_slots) {
+            slot.store(nullptr);
+        }
+        m_spare = &m_entries[0];
+        for (size_t i = 1; i < NumEntries; i++) {
+            m_free_list[i-1] = &m_entries[i];
+        }
+        m_free_tail.store(NumEntries - 1);
+    }
+
+    LatestFrameRing(const LatestFrameRing&) = delete;
+    LatestFrameRing& operator=(const LatestFrameRing&) = delete;
+
+    // Producer only. Returns true if an unconsumed entry was dropped.
+    bool push(T value) {
+        auto entry = m_spare;
+        entry->value = std::move(value);
+        entry->sequence_no = m_sequence_no++;
+        auto old_entry = m_slots[m_write_index].exchange(entry, std::memory_order_acq_rel);
+        m_write_index = (m_write_index + 1) % Capacity;
+        if (old_entry) {
+            // Dropped, and reused for the next push.
+            old_entry->value = T();
+            m_spare = old_entry;
+            return true;
+        }
+        m_spare = pop_free();
+        return false;
+    }
+
+    // Consumer only. Replaces the contents of res with all pending entries.
+    // Entries older than an entry already taken can be found when the
+    // producer wraps around during the scan. These are discarded, and the
+    // number of such entries is returned.
+    size_t take_all(std::vector<T>& res) {
+        std::array<Entry*, Capacity> entries;
+        size_t num_entries = 0;
+        for (auto& slot : m_slots) {
+            auto entry = slot.exchange(nullptr, std::memory_order_acq_rel);
+            if (entry) {
+                entries[num_entries++] = entry;
+            }
+        }
+        std::sort(entries.begin(), entries.begin() + num_entries, [](const Entry* a, const Entry* b) {
+            return a->sequence_no < b->sequence_no;
+        });
+        res.clear();
+        size_t num_discarded = 0;
+        for (size_t i = 0; i < num_entries; i++) {
+            if (entries[i]->sequence_no >= m_next_sequence_no) {
+                res.push_back(std::move(entries[i]->value));
+                m_next_sequence_no = entries[i]->sequence_no + 1;
+            } else {
+                num_discarded++;
+            }
+            entries[i]->value = T();
+            push_free(entries[i]);
+        }
+        return num_discarded;
+    }
+
+private:
+    struct Entry {
+        T               value;
+        unsigned long   sequence_no;
+    };
+
+    // At most Capacity entries are in the slots and Capacity entries are held
+    // by the consumer, so the free list is never empty when the producer needs
+    // a new spare entry.
+    static const size_t NumEntries = 2*Capacity + 1;
+
+    // Consumer only.
+    void push_free(Entry* entry) {
+        const auto tail = m_free_tail.load(std::memory_order_relaxed);
+        m_free_list[tail % NumEntries] = entry;
+        m_free_tail.store(tail + 1, std::memory_order_release);
+    }
+
+    // Producer only.
+    Entry* pop_free() {
+        const auto head = m_free_head.load(std::memory_order_relaxed);
+        if (head == m_free_tail.load(std::memory_order_acquire)) {
+            throw std::logic_error("LatestFrameRing: free list is empty");
+        }
+        auto entry = m_free_list[head % NumEntries];
+        m_free_head.store(head + 1, std::memory_order_release);
+        return entry;
+    }
+
+    std::array<Entry, NumEntries>               m_entries;
+    std::array<std::atomic<Entry*>, Capacity>   m_slots;
+    std::array<Entry*, NumEntries>              m_free_list;
+
+    // Used by the producer only.
+    Entry*                                      m_spare;
+    size_t                                      m_write_index;
+    unsigned long                               m_sequence_no;
+
+    // Read positions are advanced by the producer, write positions by the consumer.
+    std::atomic<size_t>                         m_free_head;
+    std::atomic<size_t>                         m_free_tail;
+
+    // Used by the consumer only.
+    unsigned long                               m_next_sequence_no;
 };
 
 class WorkTask {
@@ -90,6 +304,7 @@ public:
 private:
     bcsim::ScanGeometry::ptr            m_scan_geometry;
     float                               m_dpm;
+    Clock::time_point                   m_submit_time;
 };
 
 class WorkTask_BMode : public WorkTask {
@@ -97,8 +312,23 @@ public:
     friend class Worker;
     typedef std::shared_ptr<WorkTask_BMode> ptr;
 
+    WorkTask_BMode()
+        : m_num_lines(0),
+          m_num_samples(0)
+    {
+    }
+
+    // All lines must have the same number of samples.
     void set_data(const std::vector<std::vector<std::complex<float>>>& data) {
-        m_data = data;
+        m_num_lines   = data.size();
+        m_num_samples = data.empty() ? 0 : data[0].size();
+        m_data.resize(m_num_lines*m_num_samples);
+        for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+            if (data[line_no].size() != m_num_samples) {
+                throw std::runtime_error("All lines must have the same number of samples");
+            }
+            std::copy(data[line_no].begin(), data[line_no].end(), m_data.begin() + line_no*m_num_samples);
+        }
     }
 
     void set_auto_normalize(bool status) {
@@ -115,7 +345,10 @@ public:
     }
 
 private:
-    std::vector<std::vector<std::complex<float>>>  m_data;
+    // Contiguous IQ frame, line by line.
+    std::vector<std::complex<float>>    m_data;
+    size_t                              m_num_lines;
+    size_t                              m_num_samples;
     bool                                m_auto_normalize;
     float                               m_normalize_const;
     float                               m_gain;
@@ -127,12 +360,19 @@ public:
     friend class Worker;
     typedef std::shared_ptr<WorkTask_ColorDoppler> ptr;
 
+    // Input is [packet][line][sample] and is stored as a contiguous ensemble cube.
     void set_data(const std::vector<std::vector<std::vector<std::complex<float>>>>& data) {
-        m_data = data;
+        m_data        = bcsim::make_ensemble_cube(data);
+        m_packet_size = static_cast<int>(data.size());
+        m_num_lines   = static_cast<int>(data[0].size());
+        m_num_samples = static_cast<int>(data[0][0].size());
     }
 
 private:
-    std::vector<std::vector<std::vector<std::complex<float>>>>  m_data;
+    std::vector<std::complex<float>>    m_data;
+    int                                 m_packet_size;
+    int                                 m_num_lines;
+    int                                 m_num_samples;
 };
 
 class WorkResult {
@@ -143,61 +383,128 @@ public:
     }
     SafeQImage  image;
     float   updated_normalization_const;
+
+    // Time when the task was handed to the refresh worker.
+    Clock::time_point   submit_time;
 };
 
 class Worker : public QObject {
 Q_OBJECT
 public:
-    Worker() : QObject() {
+    Worker()
+        : QObject(),
+          m_wakeup_pending(false),
+          m_num_dropped_frames(0)
+    {
         // Create geometry converters
         m_cartesianator       = ICartesianator<unsigned char>::u_ptr(new CpuCartesianator<unsigned char>);
         m_color_cartesianator = ICartesianator<float>::u_ptr(new CpuCartesianator<float>); 
+
+        // Remove stationary clutter by subtracting the ensemble mean
+        m_doppler_processor.set_polynomial_filter(0);
+    }
+
+    // Hand over a new work item. Called from the producer thread.
+    void submit(refresh_worker::WorkTask::ptr work_task) {
+        work_task->m_submit_time = Clock::now();
+        if (m_ring.push(work_task)) {
+            m_num_dropped_frames++;
+        }
+        wake_up();
+    }
+
+    // Hand over a work item that must not be dropped, e.g. when replaying a
+    // file or exporting images. Blocks while max_queued_tasks such items are
+    // waiting, so the producer can not run ahead of the worker.
+    void submit_lossless(refresh_worker::WorkTask::ptr work_task) {
+        {
+            std::unique_lock<std::mutex> lock(m_lossless_mutex);
+            m_lossless_space.wait(lock, [&]() { return m_lossless_tasks.size() < max_queued_tasks; });
+            work_task->m_submit_time = Clock::now();
+            m_lossless_tasks.push_back(work_task);
+        }
+        wake_up();
     }
 
-    // enqueue new work item
-    Q_SLOT void on_new_data(refresh_worker::WorkTask::ptr msg) {
-        QMutexLocker mutex_locker(&m_mutex);
-        m_queue.enqueue(msg);
+    // Number of frames that were never displayed because newer ones arrived.
+    unsigned long get_num_dropped_frames() const {
+        return m_num_dropped_frames.load();
     }
     
 private:
-    Q_SLOT void on_timeout() {
-        QMutexLocker mutex_locker(&m_mutex);
-        auto num_elements = m_queue.size();
-        if (!m_queue.isEmpty()) {
-            auto work_task = m_queue.dequeue();
-            if (std::dynamic_pointer_cast<WorkTask_BMode>(work_task)) {
-                process(std::dynamic_pointer_cast<WorkTask_BMode>(work_task));
-            } else if (std::dynamic_pointer_cast<WorkTask_ColorDoppler>(work_task)) {
-                process(std::dynamic_pointer_cast<WorkTask_ColorDoppler>(work_task));
+    static const size_t max_queued_tasks = 4;
+
+    // Wake up the worker thread unless a wakeup is already pending.
+    void wake_up() {
+        if (!m_wakeup_pending.exchange(true)) {
+            QMetaObject::invokeMethod(this, "on_wakeup", Qt::QueuedConnection);
+        }
+    }
+
+    Q_SLOT void on_wakeup() {
+        m_wakeup_pending.store(false);
+        if (bcsim::TraceRecorder::is_enabled()) {
+            bcsim::TraceRecorder::set_thread_name("RefreshWorker");
+        }
+
+        // Lossless tasks are all processed, in the order submitted.
+        while (true) {
+            WorkTask::ptr work_task;
+            {
+                std::lock_guard<std::mutex> guard(m_lossless_mutex);
+                if (m_lossless_tasks.empty()) break;
+                work_task = m_lossless_tasks.front();
+                m_lossless_tasks.pop_front();
+            }
+            m_lossless_space.notify_one();
+            if (auto temp = std::dynamic_pointer_cast<WorkTask_BMode>(work_task)) {
+                process(temp);
+            } else if (auto temp = std::dynamic_pointer_cast<WorkTask_ColorDoppler>(work_task)) {
+                process(temp);
             } else {
                 throw std::logic_error("Unable to cast WorkTask");
             }
         }
+
+        m_num_dropped_frames += static_cast<unsigned long>(m_ring.take_all(m_pending_tasks));
+
+        // Only the newest task of each kind is processed.
+        WorkTask_BMode::ptr         bmode_task;
+        WorkTask_ColorDoppler::ptr  color_task;
+        for (const auto& work_task : m_pending_tasks) {
+            if (auto temp = std::dynamic_pointer_cast<WorkTask_BMode>(work_task)) {
+                if (bmode_task) m_num_dropped_frames++;
+                bmode_task = temp;
+            } else if (auto temp = std::dynamic_pointer_cast<WorkTask_ColorDoppler>(work_task)) {
+                if (color_task) m_num_dropped_frames++;
+                color_task = temp;
+            } else {
+                throw std::logic_error("Unable to cast WorkTask");
+            }
+        }
+        m_pending_tasks.clear();
+        if (color_task) {
+            process(color_task);
+        }
+        if (bmode_task) {
+            process(bmode_task);
+        }
     }
 
     void process(WorkTask_BMode::ptr work_task) {
+        bcsim::ScopedTraceEvent trace_event("refresh_bmode", "display");
+
         // Create output package
         auto work_result = WorkResult::ptr(new WorkResult);
 
-        const auto& iq_data = work_task->m_data;
-
-        // Transform complex IQ samples to real-valued envelope.
-        if (iq_data.size() == 0) throw std::runtime_error("No lines returned");
-        const auto num_iq_samples = iq_data[0].size();;
-        std::vector<std::vector<float>> env_lines;
-        for (size_t line_no = 0; line_no < iq_data.size(); line_no++) {
-            std::vector<float> temp;
-            temp.reserve(num_iq_samples);
-            for (size_t i = 0; i < iq_data[line_no].size(); i++) {
-                temp.push_back(std::abs(iq_data[line_no][i]));
-            }
-            env_lines.push_back(temp);
+        const size_t num_beams = work_task->m_num_lines;
+        const size_t num_range = work_task->m_num_samples;
+        if (num_beams == 0 || num_range == 0) {
+            throw std::runtime_error("No lines were returned");
         }
 
         m_cartesianator->SetGeometry(work_task->m_scan_geometry);
 
-
         // update size of final image [pixels]
         float qimage_width_m, qimage_height_m;
         GetCartesianDimensions(work_task->m_scan_geometry, qimage_width_m, qimage_height_m);
@@ -208,105 +515,53 @@ private:
         // As long as the size doesn't change, this call is not expensive.
         m_cartesianator->SetOutputSize(width_pixels, height_pixels);
 
-        const size_t num_beams = env_lines.size();
-        const size_t num_range = env_lines[0].size();
-        if (num_beams <= 0) {
-            throw std::runtime_error("No lines were returned");
-        }
-    
-
+        // Envelope detection and grayscale log-compression directly to 8-bit
+        // beamspace data with sample index most rapidly varying.
+        m_beamspace_buffer.resize(num_beams*num_range);
+        const auto normalize_const = work_task->m_auto_normalize ? 0.0f : work_task->m_normalize_const;
+        const auto max_value = bcsim::log_compress_iq_frame(work_task->m_data.data(),
+                                                            work_task->m_data.size(),
+                                                            m_beamspace_buffer.data(),
+                                                            work_task->m_dyn_range,
+                                                            normalize_const,
+                                                            work_task->m_gain);
         if (work_task->m_auto_normalize) {
-            work_result->updated_normalization_const = bcsim::get_max_value(env_lines);
+            work_result->updated_normalization_const = max_value;
         } else {
             work_result->updated_normalization_const = work_task->m_normalize_const;
         }
 
-        // grayscale log-compression
-        bcsim::log_compress_frame(env_lines, work_task->m_dyn_range,
-                                    work_result->updated_normalization_const,
-                                    work_task->m_gain);
-            
-        // Copy beamspace data in order to get correct memory layout,
-        // i.e. sample index most rapidly varying. Convert to unsigned char.
-        std::vector<unsigned char> beamspace_data(num_beams*num_range);
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            std::transform(std::begin(env_lines[beam_no]),
-                            std::end(env_lines[beam_no]),
-                            beamspace_data.data()+num_range*beam_no,
-                            [=](float v) {
-                return static_cast<unsigned char>(v);
-            });
-        }
-
         // do geometry transform
-        m_cartesianator->Process(beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
+        m_cartesianator->Process(m_beamspace_buffer.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
     
         // make QImage from output of Cartesianator
         size_t out_x, out_y;
         m_cartesianator->GetOutputSize(out_x, out_y);
 
-        // copy output buffer
-        const auto num_out_pixels = out_x*out_y;
-        std::vector<unsigned char> temp_buffer(num_out_pixels);
-        for (size_t i = 0; i < num_out_pixels; i++) {
-            temp_buffer[i] = m_cartesianator->GetOutputBuffer()[i];
-        }
-
-        work_result->image = SafeQImage(m_cartesianator->GetOutputBuffer(),
+        auto pixels = m_bmode_image_pool.acquire(out_x*out_y);
+        std::memcpy(pixels.data(), m_cartesianator->GetOutputBuffer(), out_x*out_y);
+        work_result->image = SafeQImage(pixels,
                                         static_cast<int>(out_x),
                                         static_cast<int>(out_y),
                                         1,
                                         QImage::Format_Indexed8);
+        work_result->submit_time = work_task->m_submit_time;
         emit finished_processing_bmode(work_result);
     }
 
     void process(WorkTask_ColorDoppler::ptr work_task) {
+        bcsim::ScopedTraceEvent trace_event("refresh_color", "display");
+
         // Create output package
         auto work_result = WorkResult::ptr(new WorkResult);
 
-        const auto& iq_data = work_task->m_data;
-        
-        // Estimate R0 and R1
-        std::vector<std::vector<float>> r0_lines;
-        std::vector<std::vector<float>> velocity_lines;
-
-        const auto packet_size    = iq_data.size();
-        const auto num_iq_lines   = iq_data[0].size();
-        const auto num_iq_samples = iq_data[0][0].size();;
-        for (size_t line_no = 0; line_no < num_iq_lines; line_no++) {
-            std::vector<float> temp1;
-            std::vector<float> temp2;
-            temp1.reserve(num_iq_samples);
-            temp2.reserve(num_iq_samples);
-            for (size_t i = 0; i < num_iq_samples; i++) {
-                float r0 = 0.0f;
-                std::complex<float> r1 = 0.0f;
-
-                // simple clutter filter
-                std::complex<float> mean_val(0.0f);
-                for (int packet_no = 0; packet_no < packet_size; packet_no++) {
-                    mean_val += iq_data[packet_no][line_no][i];
-                }
-                mean_val = mean_val/static_cast<float>(packet_size);
-
-                // estimate R0
-                for (int packet_no = 0; packet_no < packet_size; packet_no++) {
-                    const auto z = iq_data[packet_no][line_no][i] - mean_val;
-                    r0 += (z*std::conj(z)).real();
-                }
-
-                // estimate R1
-                for (int packet_no = 0; packet_no < packet_size-1; packet_no++) {
-                    r1 += std::conj(iq_data[packet_no][line_no][i])*iq_data[packet_no+1][line_no][i];
-                }
-                temp1.push_back(r0);
-                temp2.push_back(std::arg(r1));
-            }
-            r0_lines.push_back(temp1);
-            velocity_lines.push_back(temp2);
-        }
-
-        const auto max_r0_value = bcsim::get_max_value(r0_lines);
+        // Mean-removal clutter filter and lag-one autocorrelation estimates
+        m_doppler_processor.process(work_task->m_data.data(),
+                                    work_task->m_num_lines,
+                                    work_task->m_packet_size,
+                                    work_task->m_num_samples,
+                                    m_doppler_estimates);
+        const auto max_r0_value = *std::max_element(m_doppler_estimates.power.begin(), m_doppler_estimates.power.end());
 
         m_color_cartesianator->SetGeometry(work_task->m_scan_geometry);
 
@@ -320,26 +575,21 @@ private:
         // As long as the size doesn't change, this call is not expensive.
         m_color_cartesianator->SetOutputSize(width_pixels, height_pixels);
 
-        const size_t num_beams = r0_lines.size();
-        const size_t num_range = r0_lines[0].size();
-        if (num_beams <= 0) {
-            throw std::runtime_error("No lines were returned");
-        }
+        const size_t num_beams = m_doppler_estimates.num_lines;
+        const size_t num_range = m_doppler_estimates.num_samples;
     
-        // Copy beamspace data in order to get correct memory layout,
-        // i.e. sample index most rapidly varying. Normalize power to [0, 1]
-        std::vector<float> beamspace_data(num_beams*num_range);
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            std::transform(std::begin(r0_lines[beam_no]),
-                            std::end(r0_lines[beam_no]),
-                            beamspace_data.data()+num_range*beam_no,
-                            [=](float v) {
-                return v/max_r0_value;
-            });
-        }
+        // Estimates are already stored with sample index most rapidly varying.
+        // Normalize power to [0, 1]
+        m_color_beamspace_buffer.resize(num_beams*num_range);
+        std::transform(m_doppler_estimates.power.begin(),
+                       m_doppler_estimates.power.end(),
+                       m_color_beamspace_buffer.begin(),
+                       [=](float v) {
+            return v/max_r0_value;
+        });
 
         // do geometry transform
-        m_color_cartesianator->Process(beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
+        m_color_cartesianator->Process(m_color_beamspace_buffer.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
     
         // make QImage from output of Cartesianator
         size_t out_x, out_y;
@@ -349,33 +599,24 @@ private:
         const float normalized_threshold = 0.001f;
 
         const auto num_output_samples = out_x*out_y;
-        std::vector<bool> thresholded_samples(num_output_samples);
+        m_color_mask.resize(num_output_samples);
         const auto out_ptr = m_color_cartesianator->GetOutputBuffer();
         for (size_t i = 0; i < num_output_samples; i++) {
-            thresholded_samples[i] = (out_ptr[i] >= normalized_threshold);
-        }
-
-        // Reorganize memory layout
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            std::transform(std::begin(velocity_lines[beam_no]),
-                            std::end(velocity_lines[beam_no]),
-                            beamspace_data.data()+num_range*beam_no,
-                            [=](float v) {
-                return v;
-            });
+            m_color_mask[i] = (out_ptr[i] >= normalized_threshold);
         }
 
         // do geometry transform
-        m_color_cartesianator->Process(beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
+        m_color_cartesianator->Process(m_doppler_estimates.velocity.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
 
-        std::vector<unsigned char> color_pixels(4*num_output_samples);
+        auto pixels = m_color_image_pool.acquire(4*num_output_samples);
+        auto color_pixels = pixels.data();
         for (size_t i = 0; i < num_output_samples; i++) {
             unsigned char alpha = 0;
             unsigned char red;
             unsigned char green = 0;
             unsigned char blue;
 
-            if (thresholded_samples[i]) {
+            if (m_color_mask[i]) {
                 const auto phase_angle = m_color_cartesianator->GetOutputBuffer()[i];
                 const auto color_value = static_cast<unsigned char>(255.0f*std::abs(phase_angle)/3.14159f); 
                 alpha = 255;
@@ -393,11 +634,12 @@ private:
             color_pixels[4*i + 0] = blue;
         }
 
-        work_result->image = SafeQImage(color_pixels.data(),
+        work_result->image = SafeQImage(pixels,
                                         static_cast<int>(out_x),
                                         static_cast<int>(out_y),
                                         4,
                                         QImage::Format_ARGB32);
+        work_result->submit_time = work_task->m_submit_time;
         emit finished_processing_color(work_result);
     }
 
@@ -407,19 +649,32 @@ private:
     Q_SIGNAL void finished_processing_color(refresh_worker::WorkResult::ptr);
 
 private:
-    QMutex                                  m_mutex;
-    QQueue<WorkTask::ptr>                   m_queue;
+    LatestFrameRing<WorkTask::ptr, 4>       m_ring;
+    std::atomic<bool>                       m_wakeup_pending;
+    std::atomic<unsigned long>              m_num_dropped_frames;
+    std::vector<WorkTask::ptr>              m_pending_tasks;
+    std::mutex                              m_lossless_mutex;
+    std::condition_variable                 m_lossless_space;
+    std::deque<WorkTask::ptr>               m_lossless_tasks;
     ICartesianator<unsigned char>::u_ptr    m_cartesianator;
     ICartesianator<float>::u_ptr            m_color_cartesianator;
+    std::vector<unsigned char>              m_beamspace_buffer;
+    std::vector<float>                      m_color_beamspace_buffer;
+    std::vector<unsigned char>              m_color_mask;
+    ImageBufferPool                         m_bmode_image_pool;
+    ImageBufferPool                         m_color_image_pool;
+    bcsim::ColorDopplerProcessor            m_doppler_processor;
+    bcsim::ColorDopplerEstimates            m_doppler_estimates;
 };
 
+// Geometry transform and colorization of simulated frames on a separate
+// thread. The worker thread is woken up when data arrives and always
+// processes the newest frames, so display latency stays bounded when
+// the simulation is faster than the refresh.
 class RefreshWorker : public QObject {
 Q_OBJECT
 public:
-    RefreshWorker(int millisec) {
-        connect(&m_timer, SIGNAL(timeout()), &m_worker, SLOT(on_timeout()));
-        m_timer.start(millisec);
-        m_timer.moveToThread(&m_thread);    // not neccessary according to tutorial.
+    RefreshWorker() {
         m_worker.moveToThread(&m_thread);
         m_thread.start();
         connect(&m_worker, SIGNAL(finished_processing_bmode(refresh_worker::WorkResult::ptr)),
@@ -428,9 +683,24 @@ public:
                 this, SIGNAL(processed_color_data_available(refresh_worker::WorkResult::ptr)));
     }
 
+    ~RefreshWorker() {
+        m_thread.quit();
+        m_thread.wait();
+    }
+
     // new beam space data for processing
     Q_SLOT void process_data(refresh_worker::WorkTask::ptr message) {
-        m_worker.on_new_data(message);
+        m_worker.submit(message);
+    }
+
+    // new beam space data that must be processed even if newer data arrives.
+    // May block until the refresh thread has caught up.
+    void process_data_lossless(refresh_worker::WorkTask::ptr message) {
+        m_worker.submit_lossless(message);
+    }
+
+    unsigned long get_num_dropped_frames() const {
+        return m_worker.get_num_dropped_frames();
     }
 
     // processed beam space data is ready
@@ -439,9 +709,8 @@ public:
     Q_SIGNAL void processed_color_data_available(refresh_worker::WorkResult::ptr);
 
 private:
-    QThread     m_thread;
-    QTimer      m_timer;
     Worker      m_worker;
+    QThread     m_thread;
 };
 
 }   // end namespace
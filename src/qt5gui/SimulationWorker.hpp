@@ -0,0 +1,417 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <memory>
+#include <vector>
+#include <complex>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <QObject>
+#include <QString>
+#include "../core/LibBCSim.hpp"
+#include "../core/ScanSequence.hpp"
+#include "../core/Tracing.hpp"
+#include "../utils/ScanGeometry.hpp"
+
+namespace simulation_worker {
+
+typedef std::vector<std::vector<std::complex<float>>> IQ_Frame;
+
+// Everything needed to simulate one B-mode frame and/or one color Doppler packet.
+class SimulationRequest {
+public:
+    typedef std::shared_ptr<SimulationRequest> ptr;
+
+    SimulationRequest()
+        : sim_time(0.0f)
+    {
+    }
+
+    bcsim::IAlgorithm::s_ptr                    simulator;
+    bcsim::ScanGeometry::ptr                    geometry;
+    float                                       sim_time;
+
+    // Scan sequence of the B-mode frame, or null if B-mode is disabled.
+    bcsim::ScanSequence::s_ptr                  bmode_scanseq;
+
+    // One scan sequence per frame in the color Doppler packet. Empty if
+    // color Doppler is disabled.
+    std::vector<bcsim::ScanSequence::s_ptr>     color_scanseqs;
+};
+
+class SimulationResult {
+public:
+    typedef std::shared_ptr<SimulationResult> ptr;
+
+    SimulationResult()
+        : bmode_millisec(0),
+          color_millisec(0),
+          num_scatterers(0),
+          pass_no(1),
+          num_passes(1)
+    {
+    }
+
+    // True if the B-mode frame is an intermediate frame of a progressive simulation.
+    bool is_preview() const {
+        return pass_no < num_passes;
+    }
+
+    SimulationRequest::ptr  request;
+    IQ_Frame                bmode_frame;
+    std::vector<IQ_Frame>   color_frames;
+    int                     bmode_millisec;
+    int                     color_millisec;
+    size_t                  num_scatterers;
+
+    // Number of progressive passes included in the B-mode frame.
+    int                     pass_no;
+    int                     num_passes;
+};
+
+// Runs simulations on a dedicated thread so that the GUI stays responsive.
+//
+// Only the latest submitted request is kept, so pending time steps are
+// coalesced when the simulation cannot keep up. The scan sequence of a frame
+// is set once and the frame is simulated in one go. Progress is reported a
+// number of times per frame, from the simulator's line callback.
+//
+// If the simulator does progressive simulation ("progressive_passes" larger
+// than one), the B-mode frame is instead simulated in one go and a preview
+// result is emitted after each pass but the last. Color Doppler frames are
+// never simulated progressively.
+//
+// The simulator must not be modified while it is in use. The GUI thread must
+// therefore hold a SimulatorLock while changing it. Requesting the lock
+// cancels the frame in flight after the lines currently being simulated. The cancelled request
+// is simulated again when the lock is released, unless a newer request has
+// arrived in the meantime. The lock is recursive, but must only be used from
+// one thread (the GUI thread).
+class SimulationWorker : public QObject {
+Q_OBJECT
+public:
+    class SimulatorLock {
+    public:
+        SimulatorLock(SimulationWorker* worker)
+            : m_worker(worker)
+        {
+            if (m_worker->m_lock_depth++ > 0) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> guard(m_worker->m_mutex);
+                m_worker->m_num_lock_requests++;
+            }
+            m_lock = std::unique_lock<std::mutex>(m_worker->m_sim_mutex);
+        }
+
+        ~SimulatorLock() {
+            if (--m_worker->m_lock_depth > 0) {
+                return;
+            }
+            m_lock.unlock();
+            {
+                std::lock_guard<std::mutex> guard(m_worker->m_mutex);
+                m_worker->m_num_lock_requests--;
+            }
+            m_worker->m_cond.notify_all();
+        }
+
+        SimulatorLock(const SimulatorLock&) = delete;
+        SimulatorLock& operator=(const SimulatorLock&) = delete;
+
+    private:
+        SimulationWorker*               m_worker;
+        std::unique_lock<std::mutex>    m_lock;
+    };
+
+    SimulationWorker(int num_chunks_per_frame, QObject* parent = nullptr)
+        : QObject(parent),
+          m_num_chunks_per_frame(std::max(1, num_chunks_per_frame)),
+          m_num_lock_requests(0),
+          m_stop(false),
+          m_busy(false),
+          m_lock_depth(0)
+    {
+        m_thread = std::thread(&SimulationWorker::thread_main, this);
+    }
+
+    // Cancels the frame in flight and stops the thread.
+    ~SimulationWorker() {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+
+    // Replace any pending request with a new one.
+    void submit(SimulationRequest::ptr request) {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_pending = request;
+        }
+        m_cond.notify_all();
+    }
+
+    // True if a request is pending or being simulated.
+    bool is_busy() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_busy || m_pending;
+    }
+
+    // Emitted from the worker thread. Connect with a receiver context in the
+    // GUI thread so that the slot is invoked from the GUI event loop. Also
+    // emitted with preview results.
+    Q_SIGNAL void simulation_finished(simulation_worker::SimulationResult::ptr result);
+
+    // Percentage of the current request that has been simulated.
+    Q_SIGNAL void progress(int percent);
+
+    Q_SIGNAL void simulation_failed(QString msg);
+
+private:
+    bool is_cancelled() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_num_lock_requests > 0 || m_stop;
+    }
+
+    void thread_main() {
+        bcsim::TraceRecorder::set_thread_name("SimulationWorker");
+        while (true) {
+            SimulationRequest::ptr request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_busy = false;
+                m_cond.wait(lock, [this]() { return m_stop || (m_pending && m_num_lock_requests == 0); });
+                if (m_stop) {
+                    return;
+                }
+                request = m_pending;
+                m_pending.reset();
+                m_busy = true;
+            }
+
+            SimulationResult::ptr result;
+            try {
+                std::lock_guard<std::mutex> sim_guard(m_sim_mutex);
+                result = simulate(request);
+            } catch (std::exception& e) {
+                emit simulation_failed(QString::fromStdString(e.what()));
+                continue;
+            }
+            if (result) {
+                emit simulation_finished(result);
+            } else {
+                // Cancelled: retry unless superseded by a newer request.
+                std::lock_guard<std::mutex> guard(m_mutex);
+                if (!m_pending) {
+                    m_pending = request;
+                }
+            }
+        }
+    }
+
+    // Returns null if cancelled.
+    SimulationResult::ptr simulate(SimulationRequest::ptr request) {
+        auto result = std::make_shared<SimulationResult>();
+        result->request = request;
+        auto sim = request->simulator;
+        if (!sim) {
+            throw std::runtime_error("No simulator");
+        }
+        result->num_scatterers = sim->get_total_num_scatterers();
+
+        const auto num_passes = get_num_progressive_passes(sim);
+        const int num_frames = static_cast<int>(request->color_scanseqs.size()) + (request->bmode_scanseq ? 1 : 0);
+        int num_frames_done = 0;
+        if (!request->color_scanseqs.empty()) {
+            ProgressiveSuspender suspender(sim, num_passes);
+            for (const auto& scanseq : request->color_scanseqs) {
+                const auto start_time = std::chrono::steady_clock::now();
+                IQ_Frame iq_frame;
+                if (!simulate_frame(sim, scanseq, iq_frame, num_frames_done, num_frames)) {
+                    return nullptr;
+                }
+                result->color_frames.push_back(std::move(iq_frame));
+                result->color_millisec += elapsed_millisec(start_time);
+                num_frames_done++;
+            }
+        }
+        if (request->bmode_scanseq) {
+            const auto start_time = std::chrono::steady_clock::now();
+            const auto ok = (num_passes > 1) ? simulate_frame_progressive(sim, result, num_frames_done, num_frames, start_time)
+                                             : simulate_frame(sim, request->bmode_scanseq, result->bmode_frame, num_frames_done, num_frames);
+            if (!ok) {
+                return nullptr;
+            }
+            result->bmode_millisec = elapsed_millisec(start_time);
+        }
+        return result;
+    }
+
+    // Simulate the B-mode frame of a result in passes, emitting a preview
+    // result after each pass but the last. Returns false if cancelled.
+    bool simulate_frame_progressive(bcsim::IAlgorithm::s_ptr sim, SimulationResult::ptr result, int frame_no, int num_frames,
+                                    std::chrono::steady_clock::time_point start_time) {
+        if (is_cancelled()) {
+            return false;
+        }
+        sim->set_scan_sequence(result->request->bmode_scanseq);
+        sim->set_line_callback([&](int) {
+            return !is_cancelled();
+        });
+        sim->set_intermediate_frame_callback([&](int pass_no, int num_passes, const IQ_Frame& iq_frame) {
+            auto preview = std::make_shared<SimulationResult>();
+            preview->request = result->request;
+            preview->num_scatterers = result->num_scatterers;
+            preview->bmode_frame = iq_frame;
+            preview->bmode_millisec = elapsed_millisec(start_time);
+            preview->pass_no = pass_no;
+            preview->num_passes = num_passes;
+            emit simulation_finished(preview);
+            emit progress(100*(frame_no*num_passes + pass_no)/(num_frames*num_passes));
+            return !is_cancelled();
+        });
+        try {
+            sim->simulate_lines(result->bmode_frame);
+        } catch (...) {
+            sim->set_intermediate_frame_callback(bcsim::IAlgorithm::IntermediateFrameCallback());
+            sim->set_line_callback(bcsim::IAlgorithm::LineCallback());
+            throw;
+        }
+        sim->set_intermediate_frame_callback(bcsim::IAlgorithm::IntermediateFrameCallback());
+        sim->set_line_callback(bcsim::IAlgorithm::LineCallback());
+        if (is_cancelled()) {
+            return false;
+        }
+        result->num_passes = get_num_progressive_passes(sim);
+        result->pass_no = result->num_passes;
+        emit progress(100*(frame_no + 1)/num_frames);
+        return true;
+    }
+
+    // Simulators without support for progressive simulation count as one pass.
+    static int get_num_progressive_passes(bcsim::IAlgorithm::s_ptr sim) {
+        try {
+            return std::max(1, std::stoi(sim->get_parameter("progressive_passes")));
+        } catch (std::exception&) {
+            return 1;
+        }
+    }
+
+    // Turns off progressive simulation while in scope.
+    class ProgressiveSuspender {
+    public:
+        ProgressiveSuspender(bcsim::IAlgorithm::s_ptr sim, int num_passes)
+            : m_sim(sim),
+              m_num_passes(num_passes)
+        {
+            if (m_num_passes > 1) {
+                m_sim->set_parameter("progressive_passes", "1");
+            }
+        }
+
+        ~ProgressiveSuspender() {
+            if (m_num_passes > 1) {
+                m_sim->set_parameter("progressive_passes", std::to_string(m_num_passes));
+            }
+        }
+
+    private:
+        bcsim::IAlgorithm::s_ptr    m_sim;
+        int                         m_num_passes;
+    };
+
+    // Simulate one frame, reporting progress m_num_chunks_per_frame times.
+    // Returns false if cancelled.
+    bool simulate_frame(bcsim::IAlgorithm::s_ptr sim, bcsim::ScanSequence::s_ptr scanseq, IQ_Frame& iq_frame,
+                        int frame_no, int num_frames) {
+        if (is_cancelled()) {
+            return false;
+        }
+        const int num_lines = scanseq->get_num_lines();
+        const int num_chunks = std::min(m_num_chunks_per_frame, std::max(1, num_lines));
+        sim->set_scan_sequence(scanseq);
+        // Called concurrently. Only the line completing a chunk reports progress.
+        sim->set_line_callback([&](int num_lines_done) {
+            if ((num_lines_done < num_lines) && (num_lines_done*num_chunks/num_lines != (num_lines_done - 1)*num_chunks/num_lines)) {
+                emit progress(100*(frame_no*num_lines + num_lines_done)/(num_frames*num_lines));
+            }
+            return !is_cancelled();
+        });
+        try {
+            sim->simulate_lines(iq_frame);
+        } catch (...) {
+            sim->set_line_callback(bcsim::IAlgorithm::LineCallback());
+            throw;
+        }
+        sim->set_line_callback(bcsim::IAlgorithm::LineCallback());
+        if (is_cancelled()) {
+            return false;
+        }
+        emit progress(100*(frame_no + 1)/num_frames);
+        return true;
+    }
+
+    static int elapsed_millisec(std::chrono::steady_clock::time_point start_time) {
+        const auto elapsed = std::chrono::steady_clock::now() - start_time;
+        return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    }
+
+private:
+    const int                   m_num_chunks_per_frame;
+
+    // Protects the request state below.
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_cond;
+    SimulationRequest::ptr      m_pending;
+    int                         m_num_lock_requests;
+    bool                        m_stop;
+    bool                        m_busy;
+
+    // Held while the simulator is in use.
+    std::mutex                  m_sim_mutex;
+
+    // Nesting depth of SimulatorLock in the locking thread.
+    int                         m_lock_depth;
+
+    std::thread                 m_thread;
+};
+
+}   // end namespace
+
+Q_DECLARE_METATYPE(simulation_worker::SimulationResult::ptr);
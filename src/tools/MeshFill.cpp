@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "../utils/MeshPhantom.hpp"
+#include "../utils/HDFConvenience.hpp"
+#include "../utils/NativePhantom.hpp"
+
+/*
+ * Fill one or more closed triangle meshes (Wavefront OBJ) with uniformly
+ * distributed fixed scatterers, each mesh with its own number of scatterers
+ * and amplitude distribution, and write them to a HDF5 (.h5) or native
+ * phantom file.
+ */
+
+namespace po = boost::program_options;
+
+namespace {
+
+// A per-mesh option may be given once for all meshes or once for each.
+template <typename T>
+T get_for_mesh(const po::variables_map& var_map, const std::string& key, size_t mesh_no, size_t num_meshes) {
+    const auto values = var_map[key].as<std::vector<T>>();
+    if (values.size() == 1) {
+        return values[0];
+    } else if (values.size() == num_meshes) {
+        return values[mesh_no];
+    }
+    throw std::runtime_error("--" + key + " must be given once or once for each mesh");
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return (s.size() >= suffix.size()) && (s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+void run(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("mesh", po::value<std::vector<std::string>>(), "closed OBJ mesh to fill (may be repeated)")
+        ("output", po::value<std::string>(), "output phantom, HDF5 if it ends with .h5 and native otherwise")
+        ("num_scatterers", po::value<std::vector<size_t>>()->default_value(std::vector<size_t>(1, 100000), "100000"), "number of scatterers in each mesh")
+        ("amplitude_mean", po::value<std::vector<float>>()->default_value(std::vector<float>(1, 0.0f), "0"), "mean scatterer amplitude of each mesh")
+        ("amplitude_std", po::value<std::vector<float>>()->default_value(std::vector<float>(1, 1.0f), "1"), "standard deviation of the amplitudes of each mesh")
+        ("scale", po::value<float>()->default_value(1.0f), "factor from mesh units to meters, e.g. 1e-3 for millimeters")
+        ("seed", po::value<uint32_t>()->default_value(1), "random seed (mesh i uses seed+i)")
+    ;
+    po::positional_options_description positional;
+    positional.add("mesh", -1);
+
+    po::variables_map var_map;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), var_map);
+    po::notify(var_map);
+    if (var_map.count("help") != 0 || var_map.count("mesh") == 0 || var_map.count("output") == 0) {
+        std::cout << "Usage: BCSimMeshFill --output <phantom.h5|phantom.bcph> <mesh.obj>...\n" << desc << std::endl;
+        return;
+    }
+    const auto mesh_files = var_map["mesh"].as<std::vector<std::string>>();
+    const auto output = var_map["output"].as<std::string>();
+    const auto scale = var_map["scale"].as<float>();
+    const auto num_meshes = mesh_files.size();
+
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    for (size_t mesh_no = 0; mesh_no < num_meshes; mesh_no++) {
+        const auto start = std::chrono::steady_clock::now();
+        auto mesh = bcsim::loadTriangleMeshFromObj(mesh_files[mesh_no]);
+        for (auto& v : mesh.vertices) {
+            v *= scale;
+        }
+        const auto loaded = std::chrono::steady_clock::now();
+
+        bcsim::MeshFillParameters params;
+        params.num_scatterers  = get_for_mesh<size_t>(var_map, "num_scatterers", mesh_no, num_meshes);
+        params.amplitude_mean  = get_for_mesh<float>(var_map, "amplitude_mean", mesh_no, num_meshes);
+        params.amplitude_std   = get_for_mesh<float>(var_map, "amplitude_std", mesh_no, num_meshes);
+        params.seed            = var_map["seed"].as<uint32_t>() + static_cast<uint32_t>(mesh_no);
+        const auto filled = bcsim::fillTriangleMesh(mesh, params);
+        scatterers->scatterers.reserve(scatterers->scatterers.size() + filled->scatterers.size());
+        for (const auto& scatterer : filled->scatterers) {
+            scatterers->scatterers.push_back(scatterer);
+        }
+        const auto done = std::chrono::steady_clock::now();
+        std::cout << mesh_files[mesh_no] << ": " << mesh.triangles.size() << " triangles loaded in "
+                  << std::chrono::duration<double>(loaded - start).count() << " s, "
+                  << filled->scatterers.size() << " scatterers in "
+                  << std::chrono::duration<double>(done - loaded).count() << " s" << std::endl;
+    }
+
+    if (ends_with(output, ".h5")) {
+        bcsim::saveFixedScatterersToHdf(scatterers, output);
+    } else {
+        bcsim::saveFixedScatterersToNative(scatterers, output);
+    }
+    std::cout << "Wrote " << scatterers->scatterers.size() << " scatterers to " << output << std::endl;
+}
+
+}   // end anonymous namespace
+
+int main(int argc, char** argv) {
+    try {
+        run(argc, argv);
+    } catch (std::exception& e) {
+        std::cout << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "../utils/NativePhantom.hpp"
+
+/*
+ * Convert a HDF5 phantom with fixed or spline scatterers to the
+ * memory-mapped native phantom format.
+ */
+
+namespace po = boost::program_options;
+
+namespace {
+
+void run(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("input", po::value<std::string>(), "HDF5 phantom file")
+        ("output", po::value<std::string>(), "native phantom file")
+    ;
+    po::positional_options_description positional;
+    positional.add("input", 1);
+    positional.add("output", 1);
+
+    po::variables_map var_map;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), var_map);
+    po::notify(var_map);
+    if (var_map.count("help") != 0 || var_map.count("input") == 0 || var_map.count("output") == 0) {
+        std::cout << "Usage: BCSimPhantomConverter <input.h5> <output.bcph>\n" << desc << std::endl;
+        return;
+    }
+    const auto input  = var_map["input"].as<std::string>();
+    const auto output = var_map["output"].as<std::string>();
+
+    bcsim::convertHdfPhantomToNative(input, output, [](size_t num_read, size_t num_total) {
+        std::cout << "\rRead " << num_read << " of " << num_total << " scatterers" << std::flush;
+    });
+    std::cout << "\nWrote " << bcsim::getNativePhantomType(output) << " scatterers to " << output << std::endl;
+}
+
+}   // end anonymous namespace
+
+int main(int argc, char** argv) {
+    try {
+        run(argc, argv);
+    } catch (std::exception& e) {
+        std::cout << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <boost/program_options.hpp>
+#include "../core/LibBCSim.hpp"
+#include "../utils/GaussPulse.hpp"
+#include "../utils/HDFConvenience.hpp"
+#include "../utils/NativePhantom.hpp"
+#include "../utils/BCSimConvenience.hpp"
+#include "../utils/ScanGeometry.hpp"
+#include "../utils/ShardedSimulation.hpp"
+
+/*
+ * Simulate a sequence of frames (e.g. a Doppler ensemble or a long
+ * sequence of a moving phantom) by splitting it into line ranges that
+ * are processed by several worker processes, and store the IQ data
+ * in a single HDF5 file.
+ *
+ * The worker processes are instances of this executable started with
+ * "--shard-worker <job file> <task fd> <result fd>".
+ */
+
+namespace po = boost::program_options;
+
+namespace {
+
+const char* WORKER_FLAG = "--shard-worker";
+
+std::string get_own_executable(const char* argv0) {
+    // Prefer the kernel's view of the running image so that PATH lookups don't matter.
+    if (FILE* f = std::fopen("/proc/self/exe", "r")) {
+        std::fclose(f);
+        return "/proc/self/exe";
+    }
+    return argv0;
+}
+
+void run(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("output", po::value<std::string>()->default_value("sharded_iq.h5"), "output HDF5 file with iq_real, iq_imag and frame_times")
+        ("job_file", po::value<std::string>(), "job file shared with the workers (default: <output>.job)")
+        ("keep_job_file", "do not delete the job file when done")
+        ("num_workers", po::value<int>()->default_value(2), "number of worker processes")
+        ("lines_per_shard", po::value<int>()->default_value(16), "max. number of lines in each unit of work")
+        ("sim_type", po::value<std::string>()->default_value("cpu"), "simulator type")
+        ("param", po::value<std::vector<std::string>>(), "simulator parameter as key=value (may be repeated)")
+        ("fixed_scatterers", po::value<std::vector<std::string>>(), "HDF5 or native file with fixed scatterers (may be repeated)")
+        ("spline_scatterers", po::value<std::vector<std::string>>(), "HDF5 or native file with spline scatterers (may be repeated)")
+        ("scanseq", po::value<std::string>(), "HDF5 file with scan sequence (default: sector scan)")
+        ("num_lines", po::value<int>()->default_value(128), "number of lines in default sector scan")
+        ("sector_width", po::value<float>()->default_value(1.1f), "width of default sector scan [radians]")
+        ("depth", po::value<float>()->default_value(0.12f), "depth of default sector scan [m]")
+        ("num_frames", po::value<int>()->default_value(1), "number of frames")
+        ("frame_interval", po::value<float>()->default_value(0.0f), "time between frames [s]")
+        ("start_time", po::value<float>()->default_value(0.0f), "time of first frame [s]")
+        ("center_freq", po::value<float>()->default_value(2.5e6f), "excitation center frequency [Hz]")
+        ("bandwidth", po::value<float>()->default_value(0.2f), "excitation fractional bandwidth")
+        ("fs", po::value<float>()->default_value(100e6f), "excitation sampling frequency [Hz]")
+        ("sigma_lateral", po::value<float>()->default_value(1e-3f), "Gaussian beam profile lateral sigma [m]")
+        ("sigma_elevational", po::value<float>()->default_value(1e-3f), "Gaussian beam profile elevational sigma [m]")
+        ("beam_profile", po::value<std::string>(), "HDF5 file with LUT beam profile (overrides Gaussian)")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    po::notify(var_map);
+    if (var_map.count("help") != 0) {
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    bcsim::SimulationJob job;
+    job.sim_type = var_map["sim_type"].as<std::string>();
+    job.parameters.push_back(std::make_pair("verbose", "0"));
+    if (var_map.count("param") != 0) {
+        for (const auto& param : var_map["param"].as<std::vector<std::string>>()) {
+            const auto pos = param.find('=');
+            if (pos == std::string::npos) {
+                throw std::runtime_error("parameter must be on the form key=value: " + param);
+            }
+            job.parameters.push_back(std::make_pair(param.substr(0, pos), param.substr(pos+1)));
+        }
+    }
+
+    const auto center_freq = var_map["center_freq"].as<float>();
+    job.excitation.sampling_frequency = var_map["fs"].as<float>();
+    std::vector<float> dummy_times;
+    bcsim::MakeGaussianExcitation(center_freq, var_map["bandwidth"].as<float>(), job.excitation.sampling_frequency,
+                                  dummy_times, job.excitation.samples, job.excitation.center_index);
+    job.excitation.demod_freq = center_freq;
+
+    if (var_map.count("beam_profile") != 0) {
+        job.beam_profile = bcsim::loadBeamProfileFromHdf(var_map["beam_profile"].as<std::string>());
+    } else {
+        job.beam_profile = bcsim::IBeamProfile::s_ptr(new bcsim::GaussianBeamProfile(var_map["sigma_lateral"].as<float>(),
+                                                                                     var_map["sigma_elevational"].as<float>()));
+    }
+
+    if (var_map.count("fixed_scatterers") != 0) {
+        for (const auto& file : var_map["fixed_scatterers"].as<std::vector<std::string>>()) {
+            const auto is_native = !bcsim::getNativePhantomType(file).empty();
+            job.fixed_scatterers.push_back(is_native ? bcsim::loadFixedScatterersFromNative(file)
+                                                     : bcsim::loadFixedScatterersFromHdf(file));
+        }
+    }
+    if (var_map.count("spline_scatterers") != 0) {
+        for (const auto& file : var_map["spline_scatterers"].as<std::vector<std::string>>()) {
+            const auto is_native = !bcsim::getNativePhantomType(file).empty();
+            job.spline_scatterers.push_back(is_native ? bcsim::loadSplineScatterersFromNative(file)
+                                                      : bcsim::loadSplineScatterersFromHdf(file));
+        }
+    }
+    if (job.fixed_scatterers.empty() && job.spline_scatterers.empty()) {
+        throw std::runtime_error("no scatterers given");
+    }
+
+    // One scan sequence per frame, time-shifted.
+    bcsim::ScanSequence::s_ptr base_scan_seq;
+    if (var_map.count("scanseq") != 0) {
+        base_scan_seq = bcsim::loadScanSequenceFromHdf(var_map["scanseq"].as<std::string>());
+    } else {
+        auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+        geometry->width = var_map["sector_width"].as<float>();
+        geometry->depth = var_map["depth"].as<float>();
+        geometry->tilt  = 0.0f;
+        const auto scan_seq = bcsim::CreateScanSequence(geometry, var_map["num_lines"].as<int>(), 0.0f);
+        base_scan_seq = bcsim::ScanSequence::s_ptr(new bcsim::ScanSequence(scan_seq));
+    }
+    const auto num_frames     = var_map["num_frames"].as<int>();
+    const auto frame_interval = var_map["frame_interval"].as<float>();
+    const auto start_time     = var_map["start_time"].as<float>();
+    for (int frame_no = 0; frame_no < num_frames; frame_no++) {
+        const auto time_offset = start_time + frame_no*frame_interval;
+        auto frame = bcsim::ScanSequence::s_ptr(new bcsim::ScanSequence(base_scan_seq->line_length));
+        for (int line_no = 0; line_no < base_scan_seq->get_num_lines(); line_no++) {
+            const auto& line = base_scan_seq->get_scanline(line_no);
+            frame->add_scanline(bcsim::Scanline(line.get_origin(), line.get_direction(), line.get_lateral_dir(),
+                                                line.get_timestamp() + time_offset));
+        }
+        job.frames.push_back(frame);
+    }
+
+    const auto output   = var_map["output"].as<std::string>();
+    const auto job_file = var_map.count("job_file") != 0 ? var_map["job_file"].as<std::string>() : output + ".job";
+    const auto num_workers = var_map["num_workers"].as<int>();
+
+    std::vector<std::string> worker_command;
+    worker_command.push_back(get_own_executable(argv[0]));
+    worker_command.push_back(WORKER_FLAG);
+    bcsim::ShardedSimulationRunner runner(worker_command, num_workers);
+    runner.set_lines_per_shard(var_map["lines_per_shard"].as<int>());
+    runner.set_progress_callback([](int num_completed, int num_total) {
+        std::cout << "\rCompleted " << num_completed << " of " << num_total << " shards" << std::flush;
+    });
+
+    std::cout << "Simulating " << num_frames << " frames of " << base_scan_seq->get_num_lines()
+              << " lines with " << num_workers << " workers" << std::endl;
+    try {
+        runner.run(job, job_file, output);
+    } catch (...) {
+        if (var_map.count("keep_job_file") == 0) std::remove(job_file.c_str());
+        throw;
+    }
+    if (var_map.count("keep_job_file") == 0) {
+        std::remove(job_file.c_str());
+    }
+    std::cout << "\nWrote " << output << std::endl;
+}
+
+}   // end anonymous namespace
+
+int main(int argc, char** argv) {
+    if (argc == 5 && std::string(argv[1]) == WORKER_FLAG) {
+        return bcsim::run_simulation_shard_worker(argv[2], std::stoi(argv[3]), std::stoi(argv[4]));
+    }
+    try {
+        run(argc, argv);
+    } catch (std::exception& e) {
+        std::cout << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,388 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "../core/LibBCSim.hpp"
+#include "../core/bspline.hpp"
+#include "../utils/GaussPulse.hpp"
+#include "../utils/HDFConvenience.hpp"
+#include "../utils/NativePhantom.hpp"
+#include "../utils/BCSimConvenience.hpp"
+#include "../utils/ScanGeometry.hpp"
+#include "../utils/AccuracyMetrics.hpp"
+
+/*
+ * Validate an approximate simulation mode against a reference: simulate
+ * the same phantom and scan with a reference configuration and with a
+ * candidate configuration, and compare the IQ frames. Reports NRMSE, peak
+ * error, envelope correlation and speckle statistics per frame together
+ * with the speedup, and exits with a non-zero status if any tolerance is
+ * exceeded.
+ *
+ * Example: check that four progressive passes reproduce the full result
+ *   BCSimValidateAccuracy --candidate_param progressive_passes=4 --max_nrmse 1e-4
+ */
+
+namespace po = boost::program_options;
+
+namespace {
+
+typedef std::vector<std::vector<std::complex<float>>> Frame;
+typedef std::chrono::steady_clock Clock;
+
+struct Configuration {
+    std::string                                         sim_type;
+    std::vector<std::pair<std::string, std::string>>    parameters;
+    std::string                                         beam_profile;   // "gaussian" or "lut"
+    int                                                 stop_after_pass;
+};
+
+struct Phantom {
+    std::vector<bcsim::FixedScatterers::s_ptr>  fixed;
+    std::vector<bcsim::SplineScatterers::s_ptr> spline;
+};
+
+Configuration parse_configuration(const po::variables_map& var_map, const std::string& prefix) {
+    Configuration res;
+    res.sim_type        = var_map[prefix + "_sim_type"].as<std::string>();
+    res.beam_profile    = var_map[prefix + "_beam_profile"].as<std::string>();
+    res.stop_after_pass = var_map[prefix + "_stop_after_pass"].as<int>();
+    if ((res.beam_profile != "gaussian") && (res.beam_profile != "lut")) {
+        throw std::runtime_error("invalid beam profile: " + res.beam_profile);
+    }
+    res.parameters.push_back(std::make_pair("verbose", "0"));
+    if (var_map.count(prefix + "_param") != 0) {
+        for (const auto& param : var_map[prefix + "_param"].as<std::vector<std::string>>()) {
+            const auto pos = param.find('=');
+            if (pos == std::string::npos) {
+                throw std::runtime_error("parameter must be on the form key=value: " + param);
+            }
+            res.parameters.push_back(std::make_pair(param.substr(0, pos), param.substr(pos+1)));
+        }
+    }
+    return res;
+}
+
+// Random scatterers with Gaussian amplitudes in front of the probe, with an
+// anechoic cyst for "cyst" and oscillating spline trajectories for "spline".
+// The fixed scatterers are split into num_collections slabs along x, which
+// lets the simulator skip the slabs that are outside the beam.
+Phantom make_synthetic_phantom(const std::string& type, int num_scatterers, float depth, unsigned int seed, int num_collections) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> x_dist(-0.6f*depth, 0.6f*depth);
+    std::uniform_real_distribution<float> y_dist(-0.005f, 0.005f);
+    std::uniform_real_distribution<float> z_dist(0.0f, depth);
+    std::normal_distribution<float> amplitude_dist(0.0f, 1.0f);
+    const bcsim::vector3 cyst_center(0.0f, 0.0f, 0.5f*depth);
+    const float cyst_radius = 0.15f*depth;
+    const auto collection_of = [&](float x) {
+        const auto idx = static_cast<int>((x - x_dist.a())/(x_dist.b() - x_dist.a())*num_collections);
+        return std::min(std::max(idx, 0), num_collections - 1);
+    };
+
+    Phantom res;
+    if (type == "speckle" || type == "cyst") {
+        for (int i = 0; i < num_collections; i++) {
+            res.fixed.push_back(std::make_shared<bcsim::FixedScatterers>());
+        }
+        for (int num_added = 0; num_added < num_scatterers; ) {
+            const bcsim::vector3 pos(x_dist(gen), y_dist(gen), z_dist(gen));
+            if ((type == "cyst") && ((pos - cyst_center).norm() < cyst_radius)) {
+                continue;
+            }
+            bcsim::PointScatterer scatterer;
+            scatterer.pos = pos;
+            scatterer.amplitude = amplitude_dist(gen);
+            res.fixed[collection_of(pos.x)]->scatterers.push_back(scatterer);
+            num_added++;
+        }
+        res.fixed.erase(std::remove_if(res.fixed.begin(), res.fixed.end(), [](const bcsim::FixedScatterers::s_ptr& scatterers) {
+            return scatterers->scatterers.empty();
+        }), res.fixed.end());
+    } else if (type == "spline") {
+        const int spline_degree = 3;
+        const int num_cs = 8;
+        auto scatterers = std::make_shared<bcsim::SplineScatterers>();
+        scatterers->spline_degree = spline_degree;
+        scatterers->knot_vector = bspline_storve::uniform_regular_knot_vector(num_cs, spline_degree, 0.0f, 1.0f);
+        scatterers->control_points.resize(static_cast<size_t>(num_scatterers)*num_cs);
+        scatterers->amplitudes.resize(num_scatterers);
+        for (int scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
+            const bcsim::vector3 p0(x_dist(gen), y_dist(gen), z_dist(gen));
+            for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+                const auto offset = 2e-3f*std::sin(6.2831853f*cs_no/num_cs);
+                scatterers->control_points[static_cast<size_t>(scatterer_no)*num_cs + cs_no] = p0 + bcsim::vector3(0.0f, 0.0f, offset);
+            }
+            scatterers->amplitudes[scatterer_no] = amplitude_dist(gen);
+        }
+        res.spline.push_back(scatterers);
+    } else {
+        throw std::runtime_error("invalid phantom type: " + type);
+    }
+    return res;
+}
+
+// LUT sampled from the Gaussian profile, which shows the error of the
+// lookup table interpolation.
+bcsim::IBeamProfile::s_ptr make_lut_profile(float sigma_lateral, float sigma_elevational, float depth) {
+    const int num_rad = 64, num_lat = 32, num_ele = 32;
+    const float lat_extent = 4.0f*sigma_lateral;
+    const float ele_extent = 4.0f*sigma_elevational;
+    auto lut = std::make_shared<bcsim::LUTBeamProfile>(num_rad, num_lat, num_ele, bcsim::Interval(0.0f, depth),
+                                                       bcsim::Interval(-lat_extent, lat_extent),
+                                                       bcsim::Interval(-ele_extent, ele_extent));
+    bcsim::GaussianBeamProfile gaussian(sigma_lateral, sigma_elevational);
+    for (int ir = 0; ir < num_rad; ir++) {
+        for (int il = 0; il < num_lat; il++) {
+            for (int ie = 0; ie < num_ele; ie++) {
+                const float r = depth*ir/(num_rad-1);
+                const float l = -lat_extent + 2.0f*lat_extent*il/(num_lat-1);
+                const float e = -ele_extent + 2.0f*ele_extent*ie/(num_ele-1);
+                lut->setDiscreteSample(ir, il, ie, gaussian.sampleProfile(r, l, e));
+            }
+        }
+    }
+    return lut;
+}
+
+bcsim::IAlgorithm::s_ptr create_simulator(const Configuration& config, const Phantom& phantom,
+                                          const bcsim::ExcitationSignal& excitation, const po::variables_map& var_map) {
+    auto sim = bcsim::Create(config.sim_type);
+    for (const auto& param : config.parameters) {
+        sim->set_parameter(param.first, param.second);
+    }
+    sim->set_excitation(excitation);
+    const auto sigma_lateral     = var_map["sigma_lateral"].as<float>();
+    const auto sigma_elevational = var_map["sigma_elevational"].as<float>();
+    if (config.beam_profile == "lut") {
+        sim->set_lookup_profile(make_lut_profile(sigma_lateral, sigma_elevational, var_map["depth"].as<float>()));
+    } else {
+        sim->set_analytical_profile(bcsim::IBeamProfile::s_ptr(new bcsim::GaussianBeamProfile(sigma_lateral, sigma_elevational)));
+    }
+    for (const auto& scatterers : phantom.fixed) {
+        sim->add_fixed_scatterers(scatterers);
+    }
+    for (const auto& scatterers : phantom.spline) {
+        sim->add_spline_scatterers(scatterers);
+    }
+    if (config.stop_after_pass > 0) {
+        // Validate a progressive preview instead of the final frame.
+        const auto stop_after_pass = config.stop_after_pass;
+        sim->set_intermediate_frame_callback([=](int pass_no, int, const Frame&) {
+            return pass_no < stop_after_pass;
+        });
+    }
+    return sim;
+}
+
+// Simulate a frame and return the wall-clock time in seconds of the fastest repetition.
+double simulate_frame(bcsim::IAlgorithm::s_ptr sim, bcsim::ScanSequence::s_ptr scan_seq, int num_repetitions, Frame& frame) {
+    sim->set_scan_sequence(scan_seq);
+    double best_sec = 0.0;
+    for (int i = 0; i < num_repetitions; i++) {
+        const auto start = Clock::now();
+        sim->simulate_lines(frame);
+        const auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        best_sec = (i == 0) ? elapsed : std::min(best_sec, elapsed);
+    }
+    return best_sec;
+}
+
+bool run(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("reference_sim_type", po::value<std::string>()->default_value("cpu"), "reference simulator type")
+        ("reference_param", po::value<std::vector<std::string>>(), "reference simulator parameter as key=value (may be repeated)")
+        ("reference_beam_profile", po::value<std::string>()->default_value("gaussian"), "reference beam profile: \"gaussian\" or \"lut\" (sampled Gaussian)")
+        ("reference_stop_after_pass", po::value<int>()->default_value(0), "use the reference's progressive preview after this pass (0: final frame)")
+        ("candidate_sim_type", po::value<std::string>()->default_value("cpu"), "candidate simulator type")
+        ("candidate_param", po::value<std::vector<std::string>>(), "candidate simulator parameter as key=value (may be repeated)")
+        ("candidate_beam_profile", po::value<std::string>()->default_value("gaussian"), "candidate beam profile: \"gaussian\" or \"lut\" (sampled Gaussian)")
+        ("candidate_stop_after_pass", po::value<int>()->default_value(0), "use the candidate's progressive preview after this pass (0: final frame)")
+        ("phantom", po::value<std::string>()->default_value("speckle"), "synthetic phantom: \"speckle\", \"cyst\" or \"spline\"")
+        ("num_scatterers", po::value<int>()->default_value(20000), "number of scatterers in the synthetic phantom")
+        ("seed", po::value<unsigned int>()->default_value(1), "random seed of the synthetic phantom")
+        ("num_collections", po::value<int>()->default_value(1), "number of fixed scatterer collections the synthetic phantom is split into")
+        ("fixed_scatterers", po::value<std::vector<std::string>>(), "HDF5 or native file with fixed scatterers, replaces the synthetic phantom (may be repeated)")
+        ("spline_scatterers", po::value<std::vector<std::string>>(), "HDF5 or native file with spline scatterers, replaces the synthetic phantom (may be repeated)")
+        ("num_lines", po::value<int>()->default_value(32), "number of lines in the sector scan")
+        ("sector_width", po::value<float>()->default_value(1.1f), "width of the sector scan [radians]")
+        ("depth", po::value<float>()->default_value(0.06f), "depth of the sector scan [m]")
+        ("num_frames", po::value<int>()->default_value(2), "number of frames to compare")
+        ("frame_interval", po::value<float>()->default_value(0.1f), "time between frames [s]")
+        ("repetitions", po::value<int>()->default_value(1), "simulations per frame, the fastest is used for the speedup")
+        ("center_freq", po::value<float>()->default_value(2.5e6f), "excitation center frequency [Hz]")
+        ("bandwidth", po::value<float>()->default_value(0.2f), "excitation fractional bandwidth")
+        ("fs", po::value<float>()->default_value(50e6f), "excitation sampling frequency [Hz]")
+        ("sigma_lateral", po::value<float>()->default_value(1e-3f), "Gaussian beam profile lateral sigma [m]")
+        ("sigma_elevational", po::value<float>()->default_value(1e-3f), "Gaussian beam profile elevational sigma [m]")
+        ("max_nrmse", po::value<double>()->default_value(0.05), "max. normalized RMS error in any frame")
+        ("max_peak_error", po::value<double>()->default_value(0.1), "max. absolute error relative to the reference peak")
+        ("min_envelope_correlation", po::value<double>()->default_value(0.99), "min. correlation of the envelopes")
+        ("max_speckle_snr_error", po::value<double>()->default_value(0.05), "max. relative error of the envelope SNR")
+        ("max_mean_envelope_error", po::value<double>()->default_value(0.05), "max. relative error of the mean envelope")
+        ("min_speedup", po::value<double>()->default_value(0.0), "min. speedup of the candidate over the reference")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    po::notify(var_map);
+    if (var_map.count("help") != 0) {
+        std::cout << "Usage: BCSimValidateAccuracy [options]\n" << desc << std::endl;
+        return true;
+    }
+    const auto reference_config = parse_configuration(var_map, "reference");
+    const auto candidate_config = parse_configuration(var_map, "candidate");
+    const auto num_frames  = var_map["num_frames"].as<int>();
+    const auto repetitions = var_map["repetitions"].as<int>();
+    const auto num_collections = var_map["num_collections"].as<int>();
+    if ((num_frames < 1) || (repetitions < 1) || (num_collections < 1)) {
+        throw std::runtime_error("invalid option value");
+    }
+
+    Phantom phantom;
+    if (var_map.count("fixed_scatterers") != 0) {
+        for (const auto& file : var_map["fixed_scatterers"].as<std::vector<std::string>>()) {
+            const auto is_native = !bcsim::getNativePhantomType(file).empty();
+            phantom.fixed.push_back(is_native ? bcsim::loadFixedScatterersFromNative(file)
+                                              : bcsim::loadFixedScatterersFromHdf(file));
+        }
+    }
+    if (var_map.count("spline_scatterers") != 0) {
+        for (const auto& file : var_map["spline_scatterers"].as<std::vector<std::string>>()) {
+            const auto is_native = !bcsim::getNativePhantomType(file).empty();
+            phantom.spline.push_back(is_native ? bcsim::loadSplineScatterersFromNative(file)
+                                               : bcsim::loadSplineScatterersFromHdf(file));
+        }
+    }
+    if (phantom.fixed.empty() && phantom.spline.empty()) {
+        phantom = make_synthetic_phantom(var_map["phantom"].as<std::string>(), var_map["num_scatterers"].as<int>(),
+                                         var_map["depth"].as<float>(), var_map["seed"].as<unsigned int>(), num_collections);
+    }
+
+    bcsim::ExcitationSignal excitation;
+    const auto center_freq = var_map["center_freq"].as<float>();
+    excitation.sampling_frequency = var_map["fs"].as<float>();
+    std::vector<float> dummy_times;
+    bcsim::MakeGaussianExcitation(center_freq, var_map["bandwidth"].as<float>(), excitation.sampling_frequency,
+                                  dummy_times, excitation.samples, excitation.center_index);
+    excitation.demod_freq = center_freq;
+
+    auto reference_sim = create_simulator(reference_config, phantom, excitation, var_map);
+    auto candidate_sim = create_simulator(candidate_config, phantom, excitation, var_map);
+
+    auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+    geometry->width = var_map["sector_width"].as<float>();
+    geometry->depth = var_map["depth"].as<float>();
+    geometry->tilt  = 0.0f;
+    const auto num_lines = var_map["num_lines"].as<int>();
+    const auto frame_interval = var_map["frame_interval"].as<float>();
+
+    const auto max_nrmse                = var_map["max_nrmse"].as<double>();
+    const auto max_peak_error           = var_map["max_peak_error"].as<double>();
+    const auto min_envelope_correlation = var_map["min_envelope_correlation"].as<double>();
+    const auto max_speckle_snr_error    = var_map["max_speckle_snr_error"].as<double>();
+    const auto max_mean_envelope_error  = var_map["max_mean_envelope_error"].as<double>();
+    const auto min_speedup              = var_map["min_speedup"].as<double>();
+
+    std::cout << std::setw(6) << "frame" << std::setw(12) << "nrmse" << std::setw(12) << "peak_err"
+              << std::setw(12) << "env_corr" << std::setw(12) << "snr_ref" << std::setw(12) << "snr_cand"
+              << std::setw(12) << "env_ratio" << std::setw(12) << "speedup" << std::endl;
+    std::vector<std::string> failures;
+    double total_reference_sec = 0.0;
+    double total_candidate_sec = 0.0;
+    for (int frame_no = 0; frame_no < num_frames; frame_no++) {
+        const auto scan_seq = std::make_shared<bcsim::ScanSequence>(bcsim::CreateScanSequence(geometry, num_lines, frame_no*frame_interval));
+        Frame reference, candidate;
+        const auto reference_sec = simulate_frame(reference_sim, scan_seq, repetitions, reference);
+        const auto candidate_sec = simulate_frame(candidate_sim, scan_seq, repetitions, candidate);
+        total_reference_sec += reference_sec;
+        total_candidate_sec += candidate_sec;
+        const auto c = bcsim::compare_frames(reference, candidate);
+        const auto snr_error = std::abs(c.candidate_speckle_snr - c.reference_speckle_snr)/c.reference_speckle_snr;
+
+        std::cout << std::setprecision(4)
+                  << std::setw(6) << frame_no << std::setw(12) << c.nrmse << std::setw(12) << c.peak_error
+                  << std::setw(12) << c.envelope_correlation << std::setw(12) << c.reference_speckle_snr
+                  << std::setw(12) << c.candidate_speckle_snr << std::setw(12) << c.mean_envelope_ratio
+                  << std::setw(12) << reference_sec/candidate_sec << std::endl;
+
+        const auto frame_str = "frame " + std::to_string(frame_no) + ": ";
+        if (!(c.nrmse <= max_nrmse)) {
+            failures.push_back(frame_str + "NRMSE " + std::to_string(c.nrmse) + " > " + std::to_string(max_nrmse));
+        }
+        if (!(c.peak_error <= max_peak_error)) {
+            failures.push_back(frame_str + "peak error " + std::to_string(c.peak_error) + " > " + std::to_string(max_peak_error));
+        }
+        if (!(c.envelope_correlation >= min_envelope_correlation)) {
+            failures.push_back(frame_str + "envelope correlation " + std::to_string(c.envelope_correlation) + " < " + std::to_string(min_envelope_correlation));
+        }
+        if (!(snr_error <= max_speckle_snr_error)) {
+            failures.push_back(frame_str + "speckle SNR error " + std::to_string(snr_error) + " > " + std::to_string(max_speckle_snr_error));
+        }
+        if (!(std::abs(c.mean_envelope_ratio - 1.0) <= max_mean_envelope_error)) {
+            failures.push_back(frame_str + "mean envelope ratio " + std::to_string(c.mean_envelope_ratio) + " outside 1 +/- " + std::to_string(max_mean_envelope_error));
+        }
+    }
+
+    const auto speedup = total_reference_sec/total_candidate_sec;
+    std::cout << "Reference: " << 1e3*total_reference_sec/num_frames << " ms/frame, candidate: "
+              << 1e3*total_candidate_sec/num_frames << " ms/frame, speedup: " << speedup << std::endl;
+    if (speedup < min_speedup) {
+        failures.push_back("speedup " + std::to_string(speedup) + " < " + std::to_string(min_speedup));
+    }
+
+    for (const auto& failure : failures) {
+        std::cout << "FAILED " << failure << std::endl;
+    }
+    if (failures.empty()) {
+        std::cout << "PASSED" << std::endl;
+    }
+    return failures.empty();
+}
+
+}   // end anonymous namespace
+
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv) ? 0 : 1;
+    } catch (std::exception& e) {
+        std::cout << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
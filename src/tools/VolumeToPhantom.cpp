@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "../utils/VolumePhantom.hpp"
+#include "../utils/HDFConvenience.hpp"
+#include "../utils/NativePhantom.hpp"
+
+/*
+ * Convert a 3D intensity volume stored in a HDF5 file to fixed scatterers,
+ * where the local scatterer density (and optionally the amplitude) follows
+ * the voxel values. The scatterers are written chunk by chunk to a HDF5
+ * (.h5) or native phantom file, so the full phantom is never held in memory.
+ */
+
+namespace po = boost::program_options;
+
+namespace {
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return (s.size() >= suffix.size()) && (s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+bcsim::vector3 to_vector3(const std::vector<float>& values, const std::string& key) {
+    if (values.size() != 3) {
+        throw std::runtime_error("--" + key + " needs three values");
+    }
+    return bcsim::vector3(values[0], values[1], values[2]);
+}
+
+void run(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("input", po::value<std::string>(), "HDF5 file with the intensity volume")
+        ("dataset", po::value<std::string>()->default_value("intensity"), "name of the [x, y, z] volume dataset")
+        ("origin", po::value<std::vector<float>>()->multitoken(), "center of the first voxel [m], overrides the file")
+        ("spacing", po::value<std::vector<float>>()->multitoken(), "voxel spacing [m], overrides the file")
+        ("output", po::value<std::string>(), "output phantom, HDF5 if it ends with .h5 and native otherwise")
+        ("num_scatterers", po::value<size_t>()->default_value(1000000), "number of scatterers")
+        ("density_exponent", po::value<float>()->default_value(1.0f), "scatterer density is proportional to intensity^exponent")
+        ("amplitude_exponent", po::value<float>()->default_value(0.0f), "amplitude std. is proportional to intensity^exponent")
+        ("seed", po::value<uint32_t>()->default_value(1), "random seed")
+        ("chunk_size", po::value<size_t>()->default_value(1 << 20), "number of scatterers written at a time")
+    ;
+    po::positional_options_description positional;
+    positional.add("input", 1);
+
+    po::variables_map var_map;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), var_map);
+    po::notify(var_map);
+    if (var_map.count("help") != 0 || var_map.count("input") == 0 || var_map.count("output") == 0) {
+        std::cout << "Usage: BCSimVolumeToPhantom --output <phantom.h5|phantom.bcph> <volume.h5>\n" << desc << std::endl;
+        return;
+    }
+    const auto output = var_map["output"].as<std::string>();
+
+    const auto start = std::chrono::steady_clock::now();
+    auto volume = bcsim::loadIntensityVolumeFromHdf(var_map["input"].as<std::string>(), var_map["dataset"].as<std::string>());
+    if (var_map.count("origin") != 0) {
+        volume.origin = to_vector3(var_map["origin"].as<std::vector<float>>(), "origin");
+    }
+    if (var_map.count("spacing") != 0) {
+        volume.spacing = to_vector3(var_map["spacing"].as<std::vector<float>>(), "spacing");
+    }
+    const auto loaded = std::chrono::steady_clock::now();
+
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers     = var_map["num_scatterers"].as<size_t>();
+    params.density_exponent   = var_map["density_exponent"].as<float>();
+    params.amplitude_exponent = var_map["amplitude_exponent"].as<float>();
+    params.seed               = var_map["seed"].as<uint32_t>();
+    params.chunk_size         = var_map["chunk_size"].as<size_t>();
+
+    size_t num_written = 0;
+    if (ends_with(output, ".h5")) {
+        bcsim::FixedScatterersHdfWriter writer(output);
+        bcsim::sampleIntensityVolume(volume, params, [&](bcsim::FixedScatterers::s_ptr chunk) {
+            writer.append(chunk->scatterers.data(), chunk->scatterers.size());
+        });
+        writer.close();
+        num_written = writer.get_num_written();
+    } else {
+        bcsim::FixedScatterersNativeWriter writer(output);
+        bcsim::sampleIntensityVolume(volume, params, [&](bcsim::FixedScatterers::s_ptr chunk) {
+            writer.append(chunk->scatterers.data(), chunk->scatterers.size());
+        });
+        writer.close();
+        num_written = writer.get_num_written();
+    }
+    const auto done = std::chrono::steady_clock::now();
+    std::cout << "Loaded " << volume.num_voxels[0] << "x" << volume.num_voxels[1] << "x" << volume.num_voxels[2]
+              << " volume in " << std::chrono::duration<double>(loaded - start).count() << " s" << std::endl;
+    std::cout << "Wrote " << num_written << " scatterers to " << output << " in "
+              << std::chrono::duration<double>(done - loaded).count() << " s" << std::endl;
+}
+
+}   // end anonymous namespace
+
+int main(int argc, char** argv) {
+    try {
+        run(argc, argv);
+    } catch (std::exception& e) {
+        std::cout << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
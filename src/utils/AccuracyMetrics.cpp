@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "AccuracyMetrics.hpp"
+
+namespace bcsim {
+
+namespace {
+
+// Mean and standard deviation.
+void mean_and_std(const std::vector<double>& values, double& mean, double& std) {
+    double sum = 0.0;
+    for (auto v : values) {
+        sum += v;
+    }
+    mean = sum/values.size();
+    double sum_sq = 0.0;
+    for (auto v : values) {
+        sum_sq += (v - mean)*(v - mean);
+    }
+    std = std::sqrt(sum_sq/values.size());
+}
+
+}   // end anonymous namespace
+
+FrameComparison compare_frames(const std::vector<std::vector<std::complex<float>>>& reference,
+                               const std::vector<std::vector<std::complex<float>>>& candidate) {
+    if (reference.size() != candidate.size()) {
+        throw std::runtime_error("frames have different number of lines");
+    }
+    std::vector<double> ref_envelope;
+    std::vector<double> cand_envelope;
+    double sum_error_sq = 0.0;
+    double sum_ref_sq = 0.0;
+    double max_error = 0.0;
+    double max_ref = 0.0;
+    for (size_t line_no = 0; line_no < reference.size(); line_no++) {
+        const auto& ref_line = reference[line_no];
+        const auto& cand_line = candidate[line_no];
+        if (ref_line.size() != cand_line.size()) {
+            throw std::runtime_error("frames have different number of samples in line " + std::to_string(line_no));
+        }
+        for (size_t i = 0; i < ref_line.size(); i++) {
+            const std::complex<double> r = ref_line[i];
+            const std::complex<double> c = cand_line[i];
+            const auto error = std::abs(c - r);
+            sum_error_sq += error*error;
+            sum_ref_sq += std::norm(r);
+            max_error = std::max(max_error, error);
+            max_ref = std::max(max_ref, std::abs(r));
+            ref_envelope.push_back(std::abs(r));
+            cand_envelope.push_back(std::abs(c));
+        }
+    }
+    if (sum_ref_sq <= 0.0) {
+        throw std::runtime_error("reference frame is zero");
+    }
+
+    FrameComparison res;
+    res.nrmse = std::sqrt(sum_error_sq/sum_ref_sq);
+    res.peak_error = max_error/max_ref;
+
+    double ref_mean, ref_std, cand_mean, cand_std;
+    mean_and_std(ref_envelope, ref_mean, ref_std);
+    mean_and_std(cand_envelope, cand_mean, cand_std);
+    double covariance = 0.0;
+    for (size_t i = 0; i < ref_envelope.size(); i++) {
+        covariance += (ref_envelope[i] - ref_mean)*(cand_envelope[i] - cand_mean);
+    }
+    covariance /= ref_envelope.size();
+    res.envelope_correlation = ((ref_std > 0.0) && (cand_std > 0.0)) ? covariance/(ref_std*cand_std) : 0.0;
+    res.reference_speckle_snr = (ref_std > 0.0) ? ref_mean/ref_std : 0.0;
+    res.candidate_speckle_snr = (cand_std > 0.0) ? cand_mean/cand_std : 0.0;
+    res.mean_envelope_ratio = cand_mean/ref_mean;
+    return res;
+}
+
+}   // end namespace
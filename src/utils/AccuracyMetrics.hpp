@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <vector>
+#include <complex>
+#include "../core/export_macros.hpp"
+
+namespace bcsim {
+
+// Agreement between a candidate IQ frame and a reference IQ frame, used to
+// validate approximate simulation modes against the exact simulator.
+struct FrameComparison {
+    // Root-mean-square error normalized by the RMS of the reference.
+    double nrmse;
+
+    // Largest absolute error relative to the largest reference magnitude.
+    double peak_error;
+
+    // Pearson correlation coefficient of the envelopes.
+    double envelope_correlation;
+
+    // Envelope SNR (mean/standard deviation) of the frames. Fully
+    // developed speckle has a Rayleigh envelope with SNR 1.91.
+    double reference_speckle_snr;
+    double candidate_speckle_snr;
+
+    // Mean envelope of the candidate relative to the reference. Deviations
+    // from one indicate a bias in scattered energy.
+    double mean_envelope_ratio;
+};
+
+// Compare two frames [line][sample]. Throws std::runtime_error if the
+// frames have different shapes or the reference is all zeros.
+FrameComparison DLL_PUBLIC compare_frames(const std::vector<std::vector<std::complex<float>>>& reference,
+                                          const std::vector<std::vector<std::complex<float>>>& candidate);
+
+}   // end namespace
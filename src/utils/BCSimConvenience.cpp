@@ -30,6 +30,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 #include <stdexcept>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
 #include "BCSimConvenience.hpp"
 #include "../core/bspline.hpp"
@@ -82,6 +85,96 @@ void log_compress_frame(std::vector<std::vector<float> >& image_lines, float dyn
     }
 }
 
+namespace detail {
+    // Approximation of log2(x) for positive x, max. abs. error about 1e-4.
+    // Exponent from the bit pattern, polynomial for the mantissa in [1, 2).
+    inline float fast_log2(float x) {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        const auto exponent = static_cast<float>(static_cast<int>(bits >> 23) - 127);
+        bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+        float m;
+        std::memcpy(&m, &bits, sizeof(m));
+        return exponent + (-2.5128774f + (4.0701350f + (-2.1206994f + (0.64514372f - 0.081614486f*m)*m)*m)*m);
+    }
+}
+
+float log_compress_iq_frame(const std::complex<float>* iq_samples, size_t num_samples, unsigned char* out_pixels,
+                            float dyn_range, float normalize_factor, float gain_factor) {
+    if (num_samples > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("IQ frame is too large");
+    }
+    const int num_samples_int = static_cast<int>(num_samples);
+
+    // The max. power is tracked as the bit pattern, which has the same order
+    // as the value for non-negative floats, so that the reduction vectorizes.
+    uint32_t frame_max_bits = 0;
+    auto bits_to_float = [](uint32_t bits) {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    };
+
+    // Max. envelope value is needed before quantizing if normalizing to this frame.
+    if (normalize_factor <= 0.0f) {
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp parallel
+#endif
+        {
+            uint32_t thread_max_bits = 0;
+#ifdef BCSIM_ENABLE_OPENMP
+            #pragma omp for schedule(static)
+#endif
+            for (int i = 0; i < num_samples_int; i++) {
+                const float power = iq_samples[i].real()*iq_samples[i].real() + iq_samples[i].imag()*iq_samples[i].imag();
+                uint32_t power_bits;
+                std::memcpy(&power_bits, &power, sizeof(power_bits));
+                thread_max_bits = std::max(thread_max_bits, power_bits);
+            }
+#ifdef BCSIM_ENABLE_OPENMP
+            #pragma omp critical
+#endif
+            frame_max_bits = std::max(frame_max_bits, thread_max_bits);
+        }
+        normalize_factor = std::sqrt(bits_to_float(frame_max_bits));
+        if (normalize_factor <= 0.0f) {
+            std::fill(out_pixels, out_pixels + num_samples, static_cast<unsigned char>(0));
+            return 0.0f;
+        }
+    }
+
+    // pixel = (255/dyn_range)*(20*log10(gain*|z|/normalize_factor) + dyn_range)
+    //       = scale*log2(|z|^2) + offset
+    const float scale  = static_cast<float>((255.0/dyn_range)*10.0*std::log10(2.0));
+    const float offset = static_cast<float>((255.0/dyn_range)*(20.0*std::log10(gain_factor/normalize_factor) + dyn_range));
+
+    frame_max_bits = 0;
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        uint32_t thread_max_bits = 0;
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (int i = 0; i < num_samples_int; i++) {
+            const float power = iq_samples[i].real()*iq_samples[i].real() + iq_samples[i].imag()*iq_samples[i].imag();
+            uint32_t power_bits;
+            std::memcpy(&power_bits, &power, sizeof(power_bits));
+            thread_max_bits = std::max(thread_max_bits, power_bits);
+
+            float pixel = scale*detail::fast_log2(power) + offset;
+            pixel = std::min(std::max(pixel, 0.0f), 255.0f);
+            out_pixels[i] = static_cast<unsigned char>(pixel);
+        }
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp critical
+#endif
+        frame_max_bits = std::max(frame_max_bits, thread_max_bits);
+    }
+    return std::sqrt(bits_to_float(frame_max_bits));
+}
+
 Scatterers::s_ptr render_fixed_scatterers(SplineScatterers::s_ptr spline_scatterers, float timestamp) {
     // TODO: can parts of this code be put in a separate function and used both
     // here and in the CPU spline algoritm to reduce code duplication?
@@ -105,8 +198,9 @@ Scatterers::s_ptr render_fixed_scatterers(SplineScatterers::s_ptr spline_scatter
         PointScatterer scatterer;
         scatterer.pos       = vector3(0.0f, 0.0f, 0.0f);
         scatterer.amplitude = spline_scatterers->amplitudes[spline_no];
+        const auto cs = spline_scatterers->control_points.data() + spline_no*num_cs;
         for (size_t i = 0; i < num_cs; i++) {
-            scatterer.pos += spline_scatterers->control_points[spline_no][i]*basis_fn[i];
+            scatterer.pos += cs[i]*basis_fn[i];
         }
         res->scatterers[spline_no] = scatterer;
     }
@@ -172,6 +266,41 @@ ScanSequence CreateScanSequence(std::shared_ptr<LinearScanGeometry> geometry, si
     return res;
 }
 
+ScanSequence CreateScanSequence(std::shared_ptr<PyramidalScanGeometry> geometry,
+                                size_t num_lines_azimuth,
+                                size_t num_lines_elevation,
+                                float timestamp) {
+    if (num_lines_azimuth < 2 || num_lines_elevation < 2) {
+        throw std::runtime_error("a volume scan needs at least two lines in azimuth and elevation");
+    }
+    ScanSequence res(geometry->depth);
+    const vector3 origin(0.0f, 0.0f, 0.0f);
+
+    float min_azimuth, max_azimuth, min_elevation, max_elevation;
+    geometry->get_angle_limits(min_azimuth, max_azimuth, min_elevation, max_elevation);
+
+    for (size_t elevation_no = 0; elevation_no < num_lines_elevation; elevation_no++) {
+        const double elevation = min_elevation + elevation_no*(max_elevation-min_elevation)/(num_lines_elevation-1);
+        for (size_t azimuth_no = 0; azimuth_no < num_lines_azimuth; azimuth_no++) {
+            const double azimuth = min_azimuth + azimuth_no*(max_azimuth-min_azimuth)/(num_lines_azimuth-1);
+
+            // computed in double precision to pass the orthonormality test.
+            const vector3 direction(static_cast<float>(std::cos(elevation)*std::sin(azimuth)),
+                                    static_cast<float>(std::sin(elevation)),
+                                    static_cast<float>(std::cos(elevation)*std::cos(azimuth)));
+            const vector3 lateral_dir(static_cast<float>(std::cos(azimuth)),
+                                      0.0f,
+                                      static_cast<float>(-std::sin(azimuth)));
+            try {
+                res.add_scanline(Scanline(origin, direction, lateral_dir, timestamp));
+            } catch (std::runtime_error& e) {
+                throw std::runtime_error(std::string("failed creating scan line: ") + e.what());
+            }
+        }
+    }
+    return res;
+}
+
 // probe_origin is position of probe's origin in world coordinate system.
 ScanSequence CreateScanSequence(ScanGeometry::ptr geometry, size_t num_lines, float timestamp) {
     auto sector_geo = std::dynamic_pointer_cast<SectorScanGeometry>(geometry); 
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include <vector>
+#include <complex>
 #include "../core/export_macros.hpp"
 #include "../core/BCSimConfig.hpp"
 #include "../core/ScanSequence.hpp"
@@ -52,6 +53,16 @@ float DLL_PUBLIC get_max_value(const std::vector<std::vector<float> >& image_lin
 // gain_factor:         Image gain
 void DLL_PUBLIC log_compress_frame(std::vector<std::vector<float> >& image_lines, float dyn_range, float normalize_factor, float gain_factor);
 
+// Envelope detection and log-compression of a contiguous IQ frame to 8-bit
+// pixels, equivalent to log_compress_frame() on the envelope, but using a
+// fast log2 approximation. The frame max. is computed in the same pass.
+// normalize_factor:    As for log_compress_frame(). If not positive, the max.
+//                      envelope value of this frame is used, which takes an
+//                      extra pass to find.
+// Returns the max. envelope value of the frame.
+float DLL_PUBLIC log_compress_iq_frame(const std::complex<float>* iq_samples, size_t num_samples, unsigned char* out_pixels,
+                                       float dyn_range, float normalize_factor, float gain_factor);
+
 // Evaluate a spline scatterer dataset at a specific time in order to generate
 // a new fixed scatterer dataset.
 // timestamp: the time to evaluate the spline scatterers in
@@ -64,6 +75,13 @@ Scatterers::s_ptr DLL_PUBLIC render_fixed_scatterers(SplineScatterers::s_ptr spl
 // direction is along the x-axis.
 ScanSequence DLL_PUBLIC CreateScanSequence(ScanGeometry::ptr geometry, size_t num_lines, float timestamp);
 
+// Create a pyramidal volume scan with num_lines_azimuth*num_lines_elevation lines,
+// all with the same timestamp. Line index is azimuth_no + num_lines_azimuth*elevation_no.
+ScanSequence DLL_PUBLIC CreateScanSequence(std::shared_ptr<PyramidalScanGeometry> geometry,
+                                           size_t num_lines_azimuth,
+                                           size_t num_lines_elevation,
+                                           float timestamp);
+
 // Orient the lines in a ScanSequence by
 // 1. Rotate using x,y, and z rotation angles, in that order, i.e.
 //      p_rot = R*p where R = R_z*R_y*R_x
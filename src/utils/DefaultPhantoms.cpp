@@ -4,10 +4,11 @@
 #include <utility>
 #include <iostream>
 #include <cassert>
+#include <cmath>
+#include <sstream>
 #include "DefaultPhantoms.hpp"
 #include "CSVReader.hpp"
 #include "../core/bspline.hpp"
-#include "rotation3d.hpp"
 
 namespace default_phantoms {
 
@@ -32,34 +33,6 @@ private:
     std::vector<T> m_ys;
 };
 
-void LeftVentricle3dPhantomFactory::create_random_scatterers_in_box(size_t num_scatterers, float thickness) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> x_distr(m_box_region.x_min - thickness, m_box_region.x_max + thickness);
-    std::uniform_real_distribution<float> y_distr(m_box_region.y_min - thickness, m_box_region.y_max + thickness);
-    std::uniform_real_distribution<float> z_distr(m_box_region.z_min - thickness, m_box_region.z_max + thickness);
-    m_points.reserve(num_scatterers);
-    for (size_t i = 0; i < num_scatterers; i++) {
-        m_points.emplace_back(ellipsoid::Point3D(x_distr(gen), y_distr(gen), z_distr(gen)));
-    }
-}
-
-void LeftVentricle3dPhantomFactory::create_random_amplitudes(size_t num, float low, float high) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> a_distr(low, high);
-    m_amplitudes.reserve(num);
-    for (size_t i = 0; i < num; i++) {
-        m_amplitudes.push_back(a_distr(gen));
-    }
-}
-
-void LeftVentricle3dPhantomFactory::remove_scatterers_outside() {
-    m_points.erase(std::remove_if(std::begin(m_points), std::end(m_points), [&](const ellipsoid::Point3D& p) {
-        return !m_mathematical_model.is_point_inside(p);
-    }), std::end(m_points));
-}
-
 void LeftVentricle3dPhantomFactory::load_csv_scale_signal(std::istream& csv_stream) {
     csv::CSVReader reader(std::move(csv_stream), ';');
     auto times_vector   = reader.get_column<float>("times");
@@ -86,15 +59,17 @@ LeftVentricle3dPhantomFactory::LeftVentricle3dPhantomFactory(const LeftVentricle
     }
     load_csv_scale_signal(csv_stream);
 
-    create_random_scatterers_in_box(par.num_scatterers, par.thickness);
-    remove_scatterers_outside();
-    const auto num_scatterers_left = m_points.size();
-    m_log_callback("After filtering " + std::to_string(num_scatterers_left) + " scatterers remain");
     if (par.lv_max_amplitude < 0.0) {
         throw std::runtime_error("LV max amplitude must be positive");
     }
-    create_random_amplitudes(num_scatterers_left, -par.lv_max_amplitude, par.lv_max_amplitude);
-    create_splines(par);
+
+    // Same density as uniformly filling the box around the myocardium.
+    const double box_volume = static_cast<double>(par.x_max - par.x_min + 2.0f*par.thickness)
+                                                  *(par.y_max - par.y_min + 2.0f*par.thickness)
+                                                  *(par.z_max - par.z_min + 2.0f*par.thickness);
+    const auto num_splines = static_cast<size_t>(std::round(par.num_scatterers*m_mathematical_model.get_volume()/box_volume));
+    m_log_callback("Myocardium contains " + std::to_string(num_splines) + " scatterers");
+    create_splines(par, num_splines);
 }
 
 
@@ -102,7 +77,7 @@ bcsim::SplineScatterers::u_ptr LeftVentricle3dPhantomFactory::get() {
     return std::move(m_spline_scatterers);
 }
 
-void LeftVentricle3dPhantomFactory::create_splines(const LeftVentriclePhantomParameters& par) {
+void LeftVentricle3dPhantomFactory::create_splines(const LeftVentriclePhantomParameters& par, size_t num_splines) {
     const auto knots = bspline_storve::uniform_regular_knot_vector(par.num_cs, par.spline_degree, par.t0, par.t1);
     const auto knot_avgs = bspline_storve::control_points(par.spline_degree, knots);
 
@@ -125,34 +100,55 @@ void LeftVentricle3dPhantomFactory::create_splines(const LeftVentriclePhantomPar
         }
         m_log_callback(ss.str());
     }
-    m_spline_scatterers = std::make_unique<bcsim::SplineScatterers>();
+    // Contraction scale at the knot average of each control point.
+    std::vector<float> scales(par.num_cs);
+    for (int cs_i = 0; cs_i < par.num_cs; cs_i++) {
+        scales[cs_i] = m_scale_function(knot_avgs[cs_i]);
+    }
 
-    const auto num_splines = m_amplitudes.size();
+    m_spline_scatterers = std::make_unique<bcsim::SplineScatterers>();
     m_spline_scatterers->spline_degree = par.spline_degree;
-    m_spline_scatterers->amplitudes = m_amplitudes;
     m_spline_scatterers->knot_vector = knots;
-    m_spline_scatterers->control_points.reserve(num_splines);
-
-    for (size_t spline_no = 0; spline_no < num_splines; spline_no++) {
-        //value in[0, 1] for the normalized z coordinate of each scatterer will be used to control rotation amplitude.
-        const auto zs_fractional = (m_points[spline_no].z - m_box_region.z_min) / (m_box_region.z_max - m_box_region.z_min);
-        std::vector<bcsim::vector3> control_points;
-        control_points.reserve(par.num_cs);
-        for (size_t cs_i = 0; cs_i < par.num_cs; cs_i++) {
-            const auto t_star = knot_avgs[cs_i];
-            const auto cur_scale = m_scale_function(t_star);
-            const auto cur_angle = zs_fractional * cur_scale*par.rotation_scale;
-            const auto rot_matrix = rotation_matrix_z<float>(cur_angle);
-
-            boost::numeric::ublas::vector<float> p(3);
-            p(0) = cur_scale*m_points[spline_no].x;
-            p(1) = cur_scale*m_points[spline_no].y;
-            p(2) = cur_scale*m_points[spline_no].z;
-            
-            const auto p_rotated = boost::numeric::ublas::prod(rot_matrix, p);
-            control_points.emplace_back(bcsim::vector3(p_rotated(0), p_rotated(1), p_rotated(2)));
+    m_spline_scatterers->amplitudes.resize(num_splines);
+    m_spline_scatterers->control_points.resize(num_splines*par.num_cs);
+    auto amplitudes = m_spline_scatterers->amplitudes.data();
+    auto control_points = m_spline_scatterers->control_points.data();
+
+    // Scatterers are generated in chunks, each with a generator seeded by the
+    // chunk number, so that the phantom does not depend on the number of threads.
+    const size_t chunk_size = 16384;
+    const int num_chunks = static_cast<int>((num_splines + chunk_size - 1)/chunk_size);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int chunk_no = 0; chunk_no < num_chunks; chunk_no++) {
+        std::seed_seq seed_seq{par.seed, static_cast<unsigned int>(chunk_no)};
+        std::mt19937 gen(seed_seq);
+        std::uniform_real_distribution<float> u_distr(0.0f, 1.0f);
+        std::uniform_real_distribution<float> a_distr(-par.lv_max_amplitude, par.lv_max_amplitude);
+        const auto first_spline = chunk_no*chunk_size;
+        const auto last_spline = std::min(first_spline + chunk_size, num_splines);
+        for (size_t spline_no = first_spline; spline_no < last_spline; spline_no++) {
+            const auto u_z      = u_distr(gen);
+            const auto u_angle  = u_distr(gen);
+            const auto u_radius = u_distr(gen);
+            const auto p = m_mathematical_model.sample_point(u_z, u_angle, u_radius);
+            amplitudes[spline_no] = a_distr(gen);
+
+            //value in[0, 1] for the normalized z coordinate of each scatterer will be used to control rotation amplitude.
+            const auto zs_fractional = (p.z - m_box_region.z_min) / (m_box_region.z_max - m_box_region.z_min);
+            auto spline_cs = control_points + spline_no*par.num_cs;
+            for (int cs_i = 0; cs_i < par.num_cs; cs_i++) {
+                // scale, then rotate around the z-axis
+                const auto cur_scale = scales[cs_i];
+                const auto cur_angle = zs_fractional*cur_scale*par.rotation_scale;
+                const auto cos_angle = std::cos(cur_angle);
+                const auto sin_angle = std::sin(cur_angle);
+                const auto x = cur_scale*p.x;
+                const auto y = cur_scale*p.y;
+                spline_cs[cs_i] = bcsim::vector3(cos_angle*x - sin_angle*y, sin_angle*x + cos_angle*y, cur_scale*p.z);
+            }
         }
-        m_spline_scatterers->control_points.emplace_back(control_points);
     }
 }
 
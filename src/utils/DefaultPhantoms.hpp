@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <random>
@@ -20,25 +21,27 @@ struct LeftVentriclePhantomParameters {
           spline_degree(2),
           num_cs(10),
           lv_max_amplitude(1.0f),
-          rotation_scale(3.0f)
+          rotation_scale(3.0f),
+          seed(1)
     {
     }
 
     float thickness;                                    // Thickness of myocardium [m]
     float z_ratio;                                      // Ratio in [0,1] of where to cap ellipsoid
     float x_min, x_max, y_min, y_max, z_min, z_max;     // Cartesian extent [m]    
-    size_t num_scatterers;                              // Number of scatterers in box around myocardium prior to filtering
+    size_t num_scatterers;                              // Scatterer density as the number of scatterers in the box around the myocardium
     float motion_amplitude;                             // Amplitude of contraction, higher value gives more contraction
     float t0, t1;                                       // Start and end time [s]
     int spline_degree;                                  // Spline degree to use for individual spline scatterers
     int num_cs;                                         // Number of control points to use for each spline scatterer
     float lv_max_amplitude;                             // Max amplitude for the spline scatterers
     float rotation_scale;                               // "Gain" for rotation. Will use same signal as contraction - higher value gives more rotation.
+    unsigned int seed;                                  // Random seed. The same seed gives the same phantom regardless of number of threads.
 };
 
-// Create a LV spline phantom model by randomly distributing point-scatterers in a box and then removing
-// those who are not inside a 3D capped ellipsoid. The remaining points are then scaled and rotated
-// to generate control points for splines.
+// Create a LV spline phantom model by sampling point-scatterers uniformly inside a thick 3D capped
+// ellipsoid. The points are then scaled and rotated to generate control points for splines.
+// Scatterers are generated in parallel directly into the spline storage.
 class DLL_PUBLIC LeftVentricle3dPhantomFactory {
 public:
     typedef std::function<void(const std::string&)> LogCallback;
@@ -52,23 +55,12 @@ private:
     // creates an interpolated function from samples loaded from CSV
     void load_csv_scale_signal(std::istream&);
 
-    // fill a rectangular region of space with uniformly random scatterers
-    void create_random_scatterers_in_box(size_t num_scatterers, float thickness);
-
-    // create uniformly random amplitudes
-    void create_random_amplitudes(size_t num, float low, float high);
-
-    // use the mathematical shape model to filter out unwanted scatterers
-    void remove_scatterers_outside();
-
-    // create the scatterer splines
-    void create_splines(const LeftVentriclePhantomParameters& params);
+    // create the scatterer splines with random positions inside the mathematical shape model
+    void create_splines(const LeftVentriclePhantomParameters& params, size_t num_splines);
 
 private:
     ellipsoid::Region3D                 m_box_region;
     ellipsoid::ThickCappedZEllipsoid    m_mathematical_model;
-    std::vector<ellipsoid::Point3D>     m_points;
-    std::vector<float>                  m_amplitudes;
     std::function<float(float)>         m_scale_function;
     LogCallback                         m_log_callback;
     bcsim::SplineScatterers::u_ptr      m_spline_scatterers;
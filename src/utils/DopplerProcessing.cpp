@@ -0,0 +1,347 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include "DopplerProcessing.hpp"
+
+namespace bcsim {
+
+namespace {
+
+// Moving average with a centered window of odd length along samples and then
+// along lines. Windows are truncated at the edges.
+void box_average(std::vector<float>& data, int num_lines, int num_samples, int win_lines, int win_samples) {
+    std::vector<float> temp(data.size());
+    const int half_samples = win_samples/2;
+    const int half_lines   = win_lines/2;
+
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const float* in = data.data() + static_cast<size_t>(num_samples)*line_no;
+        float* out = temp.data() + static_cast<size_t>(num_samples)*line_no;
+        std::vector<double> prefix_sum(num_samples + 1, 0.0);
+        for (int i = 0; i < num_samples; i++) {
+            prefix_sum[i+1] = prefix_sum[i] + in[i];
+        }
+        for (int i = 0; i < num_samples; i++) {
+            const int first = std::max(0, i - half_samples);
+            const int last  = std::min(num_samples - 1, i + half_samples);
+            out[i] = static_cast<float>((prefix_sum[last+1] - prefix_sum[first])/(last - first + 1));
+        }
+    }
+
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const int first = std::max(0, line_no - half_lines);
+        const int last  = std::min(num_lines - 1, line_no + half_lines);
+        const float weight = 1.0f/(last - first + 1);
+        float* out = data.data() + static_cast<size_t>(num_samples)*line_no;
+        std::fill(out, out + num_samples, 0.0f);
+        for (int other_line = first; other_line <= last; other_line++) {
+            const float* in = temp.data() + static_cast<size_t>(num_samples)*other_line;
+            for (int i = 0; i < num_samples; i++) {
+                out[i] += weight*in[i];
+            }
+        }
+    }
+}
+
+}   // end anonymous namespace
+
+ColorDopplerProcessor::ColorDopplerProcessor()
+    : m_filter_type(FilterType::NONE),
+      m_polynomial_order(-1),
+      m_iir_num_discard(0),
+      m_averaging_lines(1),
+      m_averaging_samples(1)
+{
+}
+
+void ColorDopplerProcessor::set_polynomial_filter(int order) {
+    if (order < -1) {
+        throw std::runtime_error("invalid polynomial filter order");
+    }
+    m_polynomial_order = order;
+    m_filter_type = (order < 0) ? FilterType::NONE : FilterType::POLYNOMIAL;
+}
+
+void ColorDopplerProcessor::set_iir_filter(const std::vector<float>& b, const std::vector<float>& a, int num_discard) {
+    if (b.empty() || a.empty() || a[0] == 0.0f) {
+        throw std::runtime_error("invalid IIR filter coefficients");
+    }
+    if (num_discard < 0) {
+        throw std::runtime_error("number of discarded samples cannot be negative");
+    }
+    // normalize to a[0] = 1 and pad to equal length
+    const auto num_coeffs = std::max(b.size(), a.size());
+    m_iir_b.assign(num_coeffs, 0.0f);
+    m_iir_a.assign(num_coeffs, 0.0f);
+    for (size_t i = 0; i < b.size(); i++) m_iir_b[i] = b[i]/a[0];
+    for (size_t i = 0; i < a.size(); i++) m_iir_a[i] = a[i]/a[0];
+    m_iir_num_discard = num_discard;
+    m_filter_type = FilterType::IIR;
+}
+
+void ColorDopplerProcessor::set_spatial_averaging(int num_lines, int num_samples) {
+    if (num_lines < 1 || num_samples < 1 || num_lines % 2 == 0 || num_samples % 2 == 0) {
+        throw std::runtime_error("spatial averaging window sizes must be positive and odd");
+    }
+    m_averaging_lines   = num_lines;
+    m_averaging_samples = num_samples;
+}
+
+int ColorDopplerProcessor::get_filtered_packet_size(int packet_size) const {
+    if (m_filter_type == FilterType::IIR) {
+        return packet_size - m_iir_num_discard;
+    }
+    return packet_size;
+}
+
+std::vector<float> ColorDopplerProcessor::get_polynomial_projection(int packet_size) const {
+    if (m_polynomial_order + 1 >= packet_size) {
+        throw std::runtime_error("polynomial filter order is too high for the packet size");
+    }
+    // Orthonormal polynomial basis by Gram-Schmidt on centered powers of slow time.
+    std::vector<std::vector<double>> basis;
+    for (int order = 0; order <= m_polynomial_order; order++) {
+        std::vector<double> v(packet_size);
+        for (int n = 0; n < packet_size; n++) {
+            v[n] = std::pow(n - 0.5*(packet_size-1), order);
+        }
+        for (const auto& u : basis) {
+            double dot = 0.0;
+            for (int n = 0; n < packet_size; n++) dot += u[n]*v[n];
+            for (int n = 0; n < packet_size; n++) v[n] -= dot*u[n];
+        }
+        double norm = 0.0;
+        for (int n = 0; n < packet_size; n++) norm += v[n]*v[n];
+        norm = std::sqrt(norm);
+        for (int n = 0; n < packet_size; n++) v[n] /= norm;
+        basis.push_back(v);
+    }
+    // projection onto the orthogonal complement: I - sum(u*u^T)
+    std::vector<float> projection(packet_size*packet_size);
+    for (int row = 0; row < packet_size; row++) {
+        for (int col = 0; col < packet_size; col++) {
+            double value = (row == col) ? 1.0 : 0.0;
+            for (const auto& u : basis) value -= u[row]*u[col];
+            projection[row*packet_size + col] = static_cast<float>(value);
+        }
+    }
+    return projection;
+}
+
+void ColorDopplerProcessor::filter_line(const float* in_real, const float* in_imag, float* out_real, float* out_imag,
+                                        int packet_size, int num_samples, const std::vector<float>& projection) const {
+    const size_t line_size = static_cast<size_t>(packet_size)*num_samples;
+    switch (m_filter_type) {
+    case FilterType::NONE:
+        std::copy(in_real, in_real + line_size, out_real);
+        std::copy(in_imag, in_imag + line_size, out_imag);
+        break;
+    case FilterType::POLYNOMIAL:
+        for (int row = 0; row < packet_size; row++) {
+            float* y_real = out_real + static_cast<size_t>(row)*num_samples;
+            float* y_imag = out_imag + static_cast<size_t>(row)*num_samples;
+            std::fill(y_real, y_real + num_samples, 0.0f);
+            std::fill(y_imag, y_imag + num_samples, 0.0f);
+            for (int col = 0; col < packet_size; col++) {
+                const float weight = projection[row*packet_size + col];
+                const float* x_real = in_real + static_cast<size_t>(col)*num_samples;
+                const float* x_imag = in_imag + static_cast<size_t>(col)*num_samples;
+                for (int i = 0; i < num_samples; i++) {
+                    y_real[i] += weight*x_real[i];
+                    y_imag[i] += weight*x_imag[i];
+                }
+            }
+        }
+        break;
+    case FilterType::IIR:
+        {
+            // Transposed direct form II with one state vector per sample,
+            // applied to real and imaginary parts separately.
+            const int order = static_cast<int>(m_iir_b.size()) - 1;
+            std::vector<float> state(2*static_cast<size_t>(std::max(order, 1))*num_samples, 0.0f);
+            std::vector<float> y(2*static_cast<size_t>(num_samples));
+            for (int n = 0; n < packet_size; n++) {
+                for (int part = 0; part < 2; part++) {
+                    const float* x = (part == 0 ? in_real : in_imag) + static_cast<size_t>(n)*num_samples;
+                    float* z = state.data() + static_cast<size_t>(part)*std::max(order, 1)*num_samples;
+                    float* y_part = y.data() + static_cast<size_t>(part)*num_samples;
+                    const float* z0 = z;
+                    for (int i = 0; i < num_samples; i++) {
+                        y_part[i] = m_iir_b[0]*x[i] + (order > 0 ? z0[i] : 0.0f);
+                    }
+                    for (int k = 0; k < order; k++) {
+                        float* z_k = z + static_cast<size_t>(k)*num_samples;
+                        const float* z_next = z_k + num_samples;
+                        const bool last = (k == order-1);
+                        for (int i = 0; i < num_samples; i++) {
+                            z_k[i] = m_iir_b[k+1]*x[i] - m_iir_a[k+1]*y_part[i] + (last ? 0.0f : z_next[i]);
+                        }
+                    }
+                }
+                if (n >= m_iir_num_discard) {
+                    const size_t offset = static_cast<size_t>(n - m_iir_num_discard)*num_samples;
+                    std::copy(y.begin(), y.begin() + num_samples, out_real + offset);
+                    std::copy(y.begin() + num_samples, y.end(), out_imag + offset);
+                }
+            }
+        }
+        break;
+    default:
+        throw std::logic_error("invalid clutter filter type");
+    }
+}
+
+void ColorDopplerProcessor::process(const std::complex<float>* ensembles, int num_lines, int packet_size, int num_samples,
+                                    ColorDopplerEstimates& out) const {
+    if (num_lines < 1 || num_samples < 1) {
+        throw std::runtime_error("empty ensemble cube");
+    }
+    const int filtered_packet_size = get_filtered_packet_size(packet_size);
+    if (filtered_packet_size < 2) {
+        throw std::runtime_error("at least two samples are needed in each ensemble after clutter filtering");
+    }
+    std::vector<float> projection;
+    if (m_filter_type == FilterType::POLYNOMIAL) {
+        projection = get_polynomial_projection(packet_size);
+    }
+
+    const size_t num_values = static_cast<size_t>(num_lines)*num_samples;
+    std::vector<float> r0(num_values);
+    std::vector<float> r1_real(num_values);
+    std::vector<float> r1_imag(num_values);
+
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        // scratch buffers [packet][sample] for each thread
+        const size_t line_size = static_cast<size_t>(packet_size)*num_samples;
+        std::vector<float> in_real(line_size), in_imag(line_size);
+        std::vector<float> out_real(line_size), out_imag(line_size);
+
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (int line_no = 0; line_no < num_lines; line_no++) {
+            const auto line_ensembles = ensembles + line_size*line_no;
+            for (size_t i = 0; i < line_size; i++) {
+                in_real[i] = line_ensembles[i].real();
+                in_imag[i] = line_ensembles[i].imag();
+            }
+            filter_line(in_real.data(), in_imag.data(), out_real.data(), out_imag.data(),
+                        packet_size, num_samples, projection);
+
+            float* line_r0      = r0.data()      + static_cast<size_t>(num_samples)*line_no;
+            float* line_r1_real = r1_real.data() + static_cast<size_t>(num_samples)*line_no;
+            float* line_r1_imag = r1_imag.data() + static_cast<size_t>(num_samples)*line_no;
+            std::fill(line_r0,      line_r0      + num_samples, 0.0f);
+            std::fill(line_r1_real, line_r1_real + num_samples, 0.0f);
+            std::fill(line_r1_imag, line_r1_imag + num_samples, 0.0f);
+            for (int n = 0; n < filtered_packet_size; n++) {
+                const float* a_real = out_real.data() + static_cast<size_t>(n)*num_samples;
+                const float* a_imag = out_imag.data() + static_cast<size_t>(n)*num_samples;
+                for (int i = 0; i < num_samples; i++) {
+                    line_r0[i] += a_real[i]*a_real[i] + a_imag[i]*a_imag[i];
+                }
+                if (n + 1 < filtered_packet_size) {
+                    // conj(a)*b
+                    const float* b_real = a_real + num_samples;
+                    const float* b_imag = a_imag + num_samples;
+                    for (int i = 0; i < num_samples; i++) {
+                        line_r1_real[i] += a_real[i]*b_real[i] + a_imag[i]*b_imag[i];
+                        line_r1_imag[i] += a_real[i]*b_imag[i] - a_imag[i]*b_real[i];
+                    }
+                }
+            }
+            const float r0_scale = 1.0f/filtered_packet_size;
+            const float r1_scale = 1.0f/(filtered_packet_size - 1);
+            for (int i = 0; i < num_samples; i++) {
+                line_r0[i]      *= r0_scale;
+                line_r1_real[i] *= r1_scale;
+                line_r1_imag[i] *= r1_scale;
+            }
+        }
+    }
+
+    if (m_averaging_lines > 1 || m_averaging_samples > 1) {
+        box_average(r0,      num_lines, num_samples, m_averaging_lines, m_averaging_samples);
+        box_average(r1_real, num_lines, num_samples, m_averaging_lines, m_averaging_samples);
+        box_average(r1_imag, num_lines, num_samples, m_averaging_lines, m_averaging_samples);
+    }
+
+    out.num_lines   = num_lines;
+    out.num_samples = num_samples;
+    out.power.resize(num_values);
+    out.velocity.resize(num_values);
+    out.variance.resize(num_values);
+    const int num_values_int = static_cast<int>(num_values);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i = 0; i < num_values_int; i++) {
+        const float r1_abs = std::sqrt(r1_real[i]*r1_real[i] + r1_imag[i]*r1_imag[i]);
+        out.power[i]    = r0[i];
+        out.velocity[i] = std::atan2(r1_imag[i], r1_real[i]);
+        out.variance[i] = (r0[i] > 0.0f) ? std::max(0.0f, 1.0f - r1_abs/r0[i]) : 0.0f;
+    }
+}
+
+std::vector<std::complex<float>> make_ensemble_cube(const std::vector<std::vector<std::vector<std::complex<float>>>>& frames) {
+    if (frames.empty() || frames[0].empty()) {
+        throw std::runtime_error("no Doppler frames");
+    }
+    const size_t packet_size = frames.size();
+    const size_t num_lines   = frames[0].size();
+    const size_t num_samples = frames[0][0].size();
+    std::vector<std::complex<float>> res(packet_size*num_lines*num_samples);
+    for (size_t packet_no = 0; packet_no < packet_size; packet_no++) {
+        if (frames[packet_no].size() != num_lines) {
+            throw std::runtime_error("all Doppler frames must have the same number of lines");
+        }
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            const auto& line = frames[packet_no][line_no];
+            if (line.size() != num_samples) {
+                throw std::runtime_error("all Doppler lines must have the same number of samples");
+            }
+            std::copy(line.begin(), line.end(), res.begin() + num_samples*(packet_size*line_no + packet_no));
+        }
+    }
+    return res;
+}
+
+}   // end namespace
@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <complex>
+#include "../core/export_macros.hpp"
+
+namespace bcsim {
+
+// Color Doppler estimates. All arrays are [num_lines, num_samples] with
+// sample index most rapidly varying.
+struct ColorDopplerEstimates {
+    int                 num_lines;
+    int                 num_samples;
+    std::vector<float>  power;      // Lag-0 autocorrelation R0
+    std::vector<float>  velocity;   // Phase of lag-1 autocorrelation R1 in [-pi, pi]
+    std::vector<float>  variance;   // Normalized variance 1-|R1|/R0 in [0, 1]
+};
+
+// Clutter filtering and autocorrelation (Kasai) estimation of color Doppler
+// ensembles. The input is a contiguous ensemble cube [line][packet][sample],
+// i.e. index num_samples*(packet_size*line_no + packet_no) + sample_no, which
+// is processed in parallel over lines and vectorized over samples.
+class DLL_PUBLIC ColorDopplerProcessor {
+public:
+    // No clutter filter and no spatial averaging.
+    ColorDopplerProcessor();
+
+    // Polynomial regression clutter filter removing all polynomials up to and
+    // including order along slow time. -1 disables the filter and 0 removes
+    // the mean.
+    void set_polynomial_filter(int order);
+
+    // IIR clutter filter with coefficients b and a (a[0] non-zero) applied
+    // along slow time from zero initial state. The first num_discard filtered
+    // samples are dropped to remove the transient response.
+    void set_iir_filter(const std::vector<float>& b, const std::vector<float>& a, int num_discard);
+
+    // Average the autocorrelation estimates over a window of num_lines lines
+    // and num_samples samples (both odd) before computing the estimates.
+    void set_spatial_averaging(int num_lines, int num_samples);
+
+    void process(const std::complex<float>* ensembles, int num_lines, int packet_size, int num_samples,
+                 ColorDopplerEstimates& out) const;
+
+private:
+    enum class FilterType {
+        NONE,
+        POLYNOMIAL,
+        IIR
+    };
+
+    // Number of filtered samples in each ensemble.
+    int get_filtered_packet_size(int packet_size) const;
+
+    // Projection matrix of the polynomial regression filter.
+    std::vector<float> get_polynomial_projection(int packet_size) const;
+
+    // Filter one line given as separate real and imaginary parts [packet][sample].
+    void filter_line(const float* in_real, const float* in_imag, float* out_real, float* out_imag,
+                     int packet_size, int num_samples, const std::vector<float>& projection) const;
+
+private:
+    FilterType          m_filter_type;
+    int                 m_polynomial_order;
+    std::vector<float>  m_iir_b;
+    std::vector<float>  m_iir_a;
+    int                 m_iir_num_discard;
+    int                 m_averaging_lines;
+    int                 m_averaging_samples;
+};
+
+// Rearrange a packet of frames [packet][line][sample], as simulated with one
+// call to simulate_lines() per packet, to a contiguous ensemble cube.
+std::vector<std::complex<float>> DLL_PUBLIC make_ensemble_cube(const std::vector<std::vector<std::vector<std::complex<float>>>>& frames);
+
+}   // end namespace
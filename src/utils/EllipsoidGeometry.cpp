@@ -1,5 +1,6 @@
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 #include "EllipsoidGeometry.hpp"
 
 namespace ellipsoid {
@@ -48,6 +49,7 @@ ThickCappedZEllipsoid::ThickCappedZEllipsoid(const Region3D& region, float thick
         region.y_min - thickness, region.y_max + thickness,
         region.z_min - thickness, region.z_max + thickness), z_ratio))
 {
+    compute_z_distribution();
 }
 
 bool ThickCappedZEllipsoid::is_point_inside(const Point3D& p) const {
@@ -56,4 +58,175 @@ bool ThickCappedZEllipsoid::is_point_inside(const Point3D& p) const {
     return is_inside_outer && is_outside_inner;
 }
 
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Area of the sector of an ellipse with semi-axes a and b between polar
+// angle 0 and theta in [0, 2pi), divided by a*b/2.
+double normalized_sector_area(double a, double b, double theta) {
+    const auto phi = std::atan2(a*std::sin(theta), b*std::cos(theta));
+    return (phi < 0.0) ? phi + 2.0*PI : phi;
+}
+
+// Squared radius of an ellipse with semi-axes a and b at polar angle theta.
+double squared_radius(double a, double b, double theta) {
+    const auto c = b*std::cos(theta);
+    const auto s = a*std::sin(theta);
+    return (a*a*b*b)/(c*c + s*s);
+}
+
+}   // end anonymous namespace
+
+void ThickCappedZEllipsoid::get_cross_section_scales(double z, double& k_outer, double& k_inner) const {
+    const auto scale = [z](const CappedZEllipsoid& capped) {
+        const auto& ellipsoid = capped.get_ellipsoid();
+        const auto dz = (z - ellipsoid.get_center().z)/ellipsoid.get_coefficients().c;
+        return ((z <= capped.get_z_cap()) && (dz*dz < 1.0)) ? std::sqrt(1.0 - dz*dz) : 0.0;
+    };
+    k_outer = scale(m_outer);
+    k_inner = scale(m_inner);
+}
+
+double ThickCappedZEllipsoid::get_cross_section_area(double z) const {
+    double k_outer, k_inner;
+    get_cross_section_scales(z, k_outer, k_inner);
+    const auto& outer = m_outer.get_ellipsoid().get_coefficients();
+    const auto& inner = m_inner.get_ellipsoid().get_coefficients();
+    return PI*(k_outer*k_outer*outer.a*outer.b - k_inner*k_inner*inner.a*inner.b);
+}
+
+void ThickCappedZEllipsoid::compute_z_distribution() {
+    const auto& outer = m_outer.get_ellipsoid();
+    const auto& inner = m_inner.get_ellipsoid();
+    const double z_lo = outer.get_center().z - outer.get_coefficients().c;
+    const double z_hi = std::min<double>(outer.get_center().z + outer.get_coefficients().c, m_outer.get_z_cap());
+
+    // The area is smooth except at the poles and cap of the inner ellipsoid,
+    // so these are included as edges and the area is taken as linear within bins.
+    const int num_bins = 4096;
+    m_z_edges.clear();
+    for (int i = 0; i <= num_bins; i++) {
+        m_z_edges.push_back(z_lo + (z_hi - z_lo)*i/num_bins);
+    }
+    for (float z : {inner.get_center().z - inner.get_coefficients().c, inner.get_center().z + inner.get_coefficients().c,
+                    m_inner.get_z_cap()}) {
+        if ((z > z_lo) && (z < z_hi)) {
+            m_z_edges.push_back(z);
+        }
+    }
+    std::sort(m_z_edges.begin(), m_z_edges.end());
+
+    // The area is evaluated just inside each bin, since it jumps at the inner cap.
+    const auto num_edges = m_z_edges.size();
+    m_z_areas_lo.assign(num_edges - 1, 0.0);
+    m_z_areas_hi.assign(num_edges - 1, 0.0);
+    m_z_cdf.assign(num_edges, 0.0);
+    for (size_t i = 0; i + 1 < num_edges; i++) {
+        const auto dz = m_z_edges[i+1] - m_z_edges[i];
+        m_z_areas_lo[i] = std::max(0.0, get_cross_section_area(m_z_edges[i] + 1e-6*dz));
+        m_z_areas_hi[i] = std::max(0.0, get_cross_section_area(m_z_edges[i+1] - 1e-6*dz));
+        m_z_cdf[i+1] = m_z_cdf[i] + 0.5*dz*(m_z_areas_lo[i] + m_z_areas_hi[i]);
+    }
+    m_volume = m_z_cdf.back();
+
+    // Guide table so that the bin search in sample_point() is constant time on average.
+    m_z_guide.assign(num_edges - 1, 0);
+    size_t bin = 0;
+    for (size_t i = 0; i < m_z_guide.size(); i++) {
+        const auto target = m_volume*i/m_z_guide.size();
+        while ((bin + 2 < num_edges) && (m_z_cdf[bin+1] <= target)) {
+            bin++;
+        }
+        m_z_guide[i] = bin;
+    }
+}
+
+Point3D ThickCappedZEllipsoid::sample_point(float u_z, float u_angle, float u_radius) const {
+    const auto& center = m_outer.get_ellipsoid().get_center();
+    if (m_volume <= 0.0) {
+        return center;
+    }
+
+    // z by inverting the piecewise quadratic CDF.
+    const double target = u_z*m_volume;
+    const auto guide_index = std::min<size_t>(static_cast<size_t>(u_z*m_z_guide.size()), m_z_guide.size() - 1);
+    size_t bin = m_z_guide[guide_index];
+    while ((bin + 2 < m_z_cdf.size()) && (m_z_cdf[bin+1] <= target)) {
+        bin++;
+    }
+    const double dz = m_z_edges[bin+1] - m_z_edges[bin];
+    const double area0 = m_z_areas_lo[bin];
+    const double slope = (m_z_areas_hi[bin] - area0)/dz;
+    const double remainder = std::max(0.0, target - m_z_cdf[bin]);
+    double offset;
+    if (std::abs(slope*remainder) < 1e-9*area0*area0) {
+        offset = (area0 > 0.0) ? remainder/area0 : 0.0;
+    } else {
+        offset = (std::sqrt(std::max(0.0, area0*area0 + 2.0*slope*remainder)) - area0)/slope;
+    }
+    const double z = m_z_edges[bin] + std::min(std::max(offset, 0.0), dz);
+
+    // Cross-section between two concentric ellipses. The polar angle has
+    // density proportional to R_outer^2 - R_inner^2, which is inverted with
+    // safeguarded Newton iterations on the difference of sector areas. When
+    // the two ellipses are similar the density is that of the outer alone,
+    // whose sector area is inverted exactly by the initial guess.
+    double k_outer, k_inner;
+    get_cross_section_scales(z, k_outer, k_inner);
+    const auto& outer_coeffs = m_outer.get_ellipsoid().get_coefficients();
+    const auto& inner_coeffs = m_inner.get_ellipsoid().get_coefficients();
+    const double a_outer = k_outer*outer_coeffs.a;
+    const double b_outer = k_outer*outer_coeffs.b;
+    const double a_inner = k_inner*inner_coeffs.a;
+    const double b_inner = k_inner*inner_coeffs.b;
+    const double ab_outer = a_outer*b_outer;
+    const double ab_inner = a_inner*b_inner;
+    if (ab_outer - ab_inner <= 0.0) {
+        return Point3D(center.x, center.y, static_cast<float>(z));
+    }
+    const double angle_target = 2.0*PI*u_angle*(ab_outer - ab_inner);
+    const auto angle_cdf = [&](double theta) {
+        const auto res = ab_outer*normalized_sector_area(a_outer, b_outer, theta);
+        return (ab_inner > 0.0) ? res - ab_inner*normalized_sector_area(a_inner, b_inner, theta) : res;
+    };
+    double lo = 0.0;
+    double hi = 2.0*PI;
+    double theta = normalized_sector_area(b_outer, a_outer, 2.0*PI*u_angle);   // exact without inner ellipse
+    const bool is_similar = std::abs(a_inner*b_outer - a_outer*b_inner) <= 1e-9*ab_outer;
+    const double tolerance = 1e-12*2.0*PI*(ab_outer - ab_inner);
+    for (int iteration = 0; !is_similar && (iteration < 20); iteration++) {
+        const auto error = angle_cdf(theta) - angle_target;
+        if (std::abs(error) <= tolerance) {
+            break;
+        }
+        if (error > 0.0) {
+            hi = theta;
+        } else {
+            lo = theta;
+        }
+        const auto derivative = squared_radius(a_outer, b_outer, theta) - ((ab_inner > 0.0) ? squared_radius(a_inner, b_inner, theta) : 0.0);
+        auto next = (derivative > 0.0) ? theta - error/derivative : 0.5*(lo + hi);
+        if (!(next > lo && next < hi)) {
+            next = 0.5*(lo + hi);
+        }
+        theta = next;
+    }
+
+    // Radius with density proportional to r.
+    const double cos_theta = std::cos(theta);
+    const double sin_theta = std::sin(theta);
+    const auto squared_radius_at_theta = [=](double a, double b) {
+        const auto c = b*cos_theta;
+        const auto s = a*sin_theta;
+        return (a*a*b*b)/(c*c + s*s);
+    };
+    const double r_sq_inner = (ab_inner > 0.0) ? squared_radius_at_theta(a_inner, b_inner) : 0.0;
+    const double r_sq_outer = squared_radius_at_theta(a_outer, b_outer);
+    const double r = std::sqrt(r_sq_inner + u_radius*(r_sq_outer - r_sq_inner));
+    return Point3D(static_cast<float>(center.x + r*cos_theta),
+                   static_cast<float>(center.y + r*sin_theta),
+                   static_cast<float>(z));
+}
+
 }   // end namespace
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstddef>
+#include <vector>
 
 namespace ellipsoid {
 
@@ -27,6 +29,10 @@ public:
 
     bool is_point_inside(const Point3D& p) const;
 
+    const Point3D& get_center() const { return m_center; }
+
+    const EllipseCoefficients& get_coefficients() const { return m_coeffs; }
+
 private:
     void compute_centers(const Region3D& region);
 
@@ -43,6 +49,10 @@ public:
 
     bool is_point_inside(const Point3D& p) const;
 
+    const Ellipsoid& get_ellipsoid() const { return m_ellipsoid; }
+
+    float get_z_cap() const { return m_z_cap; }
+
 private:
     Ellipsoid   m_ellipsoid;
     float       m_z_cap;
@@ -56,9 +66,34 @@ public:
 
     bool is_point_inside(const Point3D& p) const;
 
+    // Volume of the shell.
+    double get_volume() const { return m_volume; }
+
+    // Map three numbers in [0, 1) to a point inside the shell. Uniformly
+    // distributed numbers give uniformly distributed points, so the shell
+    // can be sampled directly instead of by rejection.
+    Point3D sample_point(float u_z, float u_angle, float u_radius) const;
+
+private:
+    // Scale factors of the outer and inner cross-section ellipses at z
+    // relative to the equators. Zero where the ellipsoid is absent.
+    void get_cross_section_scales(double z, double& k_outer, double& k_inner) const;
+
+    double get_cross_section_area(double z) const;
+
+    // Tabulate the distribution of z, which is proportional to the
+    // cross-section area.
+    void compute_z_distribution();
+
 private:
     CappedZEllipsoid    m_inner;
     CappedZEllipsoid    m_outer;
+    std::vector<double> m_z_edges;      // bin edges, including the inner cap and poles
+    std::vector<double> m_z_areas_lo;   // cross-section area at the start of each bin
+    std::vector<double> m_z_areas_hi;   // cross-section area at the end of each bin
+    std::vector<double> m_z_cdf;        // volume below each edge
+    std::vector<size_t> m_z_guide;      // first bin for each of equally spaced volume fractions
+    double              m_volume;
 };
 
 }   // end namespace
@@ -27,8 +27,11 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstdint>
+#include <cstdio>
 #include <memory>
 #include <string>
+#include <vector>
 #include <stdexcept>
 #include <boost/multi_array.hpp>
 #include <algorithm>
@@ -39,70 +42,329 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../core/vector3.hpp"
 #include "SimpleHDF.hpp"
 #include "../core/LibBCSim.hpp"
+#include "../core/Tracing.hpp"
+#ifdef BCSIM_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 namespace bcsim {
+namespace {
 
-FixedScatterers::s_ptr loadFixedScatterersFromHdf(const std::string& h5_file) {
+static_assert(sizeof(PointScatterer) == 4*sizeof(float), "PointScatterer must be four packed floats");
+static_assert(sizeof(vector3) == 3*sizeof(float), "vector3 must be three packed floats");
+
+// Number of rows to read at a time from datasets which are not chunked.
+const hsize_t ROWS_PER_BLOCK = 1 << 18;
+
+// Upper limit on the size of raw chunks read before they are decompressed.
+const size_t MAX_RAW_BATCH_BYTES = 256 << 20;
+
+std::vector<hsize_t> get_dataset_dims(const H5::DataSet& dataset) {
+    auto dataspace = dataset.getSpace();
+    std::vector<hsize_t> dims(dataspace.getSimpleExtentNdims());
+    dataspace.getSimpleExtentDims(dims.data(), nullptr);
+    return dims;
+}
+
+// Read rows [first_row, first_row+num_rows) of a float dataset with a hyperslab
+// selection straight into dest.
+void read_row_range(H5::DataSet& dataset, const std::vector<hsize_t>& dims,
+                    hsize_t first_row, hsize_t num_rows, float* dest) {
+    std::vector<hsize_t> offset(dims.size(), 0);
+    std::vector<hsize_t> count(dims);
+    offset[0] = first_row;
+    count[0]  = num_rows;
+    auto file_space = dataset.getSpace();
+    file_space.selectHyperslab(H5S_SELECT_SET, count.data(), offset.data());
+    H5::DataSpace mem_space(static_cast<int>(count.size()), count.data());
+    dataset.read(dest, H5::PredType::NATIVE_FLOAT, mem_space, file_space);
+}
+
+#ifdef BCSIM_HAVE_ZLIB
+
+// True if the filter pipeline is deflate, optionally preceded by shuffle.
+bool is_deflate_pipeline(const H5::DSetCreatPropList& dcpl, bool& /*out*/ shuffled) {
+    const int num_filters = dcpl.getNfilters();
+    std::vector<H5Z_filter_t> filters;
+    for (int i = 0; i < num_filters; i++) {
+        unsigned int flags;
+        size_t num_values = 0;
+        filters.push_back(H5Pget_filter2(dcpl.getId(), i, &flags, &num_values, nullptr, 0, nullptr, nullptr));
+    }
+    shuffled = (filters.size() == 2) && (filters[0] == H5Z_FILTER_SHUFFLE);
+    return !filters.empty() && filters.back() == H5Z_FILTER_DEFLATE && (filters.size() == 1 || shuffled);
+}
+
+// Read the raw chunks sequentially through HDF5 (which serializes all calls
+// anyway) and inflate them in parallel directly into dest. Chunks that cannot
+// be handled here (unallocated, or with filters skipped) are read normally.
+void read_deflated_chunks(H5::DataSet& dataset, const std::vector<hsize_t>& dims, hsize_t chunk_rows,
+                          bool shuffled, float* dest, const LoadProgressCallback& progress) {
+    const hsize_t num_rows = dims[0];
+    hsize_t row_size = 1;
+    for (size_t i = 1; i < dims.size(); i++) {
+        row_size *= dims[i];
+    }
+    const size_t chunk_num_elements = chunk_rows*row_size;
+    const size_t chunk_num_bytes = chunk_num_elements*sizeof(float);
+    const hsize_t num_chunks = (num_rows + chunk_rows - 1) / chunk_rows;
+    const size_t batch_size = std::max<size_t>(1, std::min<size_t>(MAX_RAW_BATCH_BYTES/chunk_num_bytes, num_chunks));
+
+    std::vector<std::vector<unsigned char>> raw_chunks(batch_size);
+    std::vector<int> use_fallback(batch_size);
+    for (hsize_t first_chunk = 0; first_chunk < num_chunks; first_chunk += batch_size) {
+        const int num_in_batch = static_cast<int>(std::min<hsize_t>(batch_size, num_chunks - first_chunk));
+
+        for (int i = 0; i < num_in_batch; i++) {
+            std::vector<hsize_t> offset(dims.size(), 0);
+            offset[0] = (first_chunk + i)*chunk_rows;
+            hsize_t storage_size = 0;
+            uint32_t filter_mask = 0;
+            use_fallback[i] = 1;
+            if (H5Dget_chunk_storage_size(dataset.getId(), offset.data(), &storage_size) >= 0 && storage_size > 0) {
+                raw_chunks[i].resize(storage_size);
+                if (H5Dread_chunk(dataset.getId(), H5P_DEFAULT, offset.data(), &filter_mask, raw_chunks[i].data()) >= 0) {
+                    use_fallback[i] = (filter_mask != 0) ? 1 : 0;
+                }
+            }
+        }
+
+        int num_failed = 0;
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp parallel reduction(+:num_failed)
+#endif
+        {
+            std::vector<unsigned char> scratch(chunk_num_bytes);
+#ifdef BCSIM_ENABLE_OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for (int i = 0; i < num_in_batch; i++) {
+                if (use_fallback[i]) continue;
+                const hsize_t first_row = (first_chunk + i)*chunk_rows;
+                const size_t num_valid = std::min<hsize_t>(chunk_rows, num_rows - first_row)*row_size;
+                float* chunk_dest = dest + first_row*row_size;
+
+                // Inflate in place when the whole chunk is inside the dataset and needs no unshuffling.
+                const bool direct = !shuffled && (num_valid == chunk_num_elements);
+                auto inflated = direct ? reinterpret_cast<Bytef*>(chunk_dest) : scratch.data();
+                uLongf inflated_size = static_cast<uLongf>(chunk_num_bytes);
+                if (uncompress(inflated, &inflated_size, raw_chunks[i].data(), static_cast<uLong>(raw_chunks[i].size())) != Z_OK
+                    || inflated_size != chunk_num_bytes) {
+                    num_failed++;
+                    continue;
+                }
+                if (direct) continue;
+                auto out = reinterpret_cast<unsigned char*>(chunk_dest);
+                if (shuffled) {
+                    // byte b of element j is stored at b*chunk_num_elements + j.
+                    for (size_t j = 0; j < num_valid; j++) {
+                        for (size_t b = 0; b < sizeof(float); b++) {
+                            out[j*sizeof(float) + b] = scratch[b*chunk_num_elements + j];
+                        }
+                    }
+                } else {
+                    std::copy(scratch.begin(), scratch.begin() + num_valid*sizeof(float), out);
+                }
+            }
+        }
+        if (num_failed > 0) {
+            throw std::runtime_error("failed to decompress HDF5 chunk");
+        }
+
+        for (int i = 0; i < num_in_batch; i++) {
+            if (use_fallback[i]) {
+                const hsize_t first_row = (first_chunk + i)*chunk_rows;
+                read_row_range(dataset, dims, first_row, std::min<hsize_t>(chunk_rows, num_rows - first_row), dest + first_row*row_size);
+            }
+        }
+        if (progress) {
+            progress(std::min<hsize_t>((first_chunk + num_in_batch)*chunk_rows, num_rows), num_rows);
+        }
+    }
+}
+
+#endif  // BCSIM_HAVE_ZLIB
+
+// Read a float dataset with shape [num_rows, ...] into dest, which must have
+// room for the whole dataset. Reads one chunk-aligned block of rows at a time
+// to avoid any intermediate copy of the whole dataset.
+void read_float_rows(H5::DataSet& dataset, float* dest, const LoadProgressCallback& progress) {
+    const auto dims = get_dataset_dims(dataset);
+    if (dims.empty()) {
+        throw std::runtime_error("scalar dataset where array was expected");
+    }
+    const hsize_t num_rows = dims[0];
+    hsize_t row_size = 1;
+    for (size_t i = 1; i < dims.size(); i++) {
+        row_size *= dims[i];
+    }
+
+    hsize_t rows_per_block = ROWS_PER_BLOCK;
+    const auto dcpl = dataset.getCreatePlist();
+    if (dcpl.getLayout() == H5D_CHUNKED) {
+        std::vector<hsize_t> chunk_dims(dims.size());
+        dcpl.getChunk(static_cast<int>(chunk_dims.size()), chunk_dims.data());
+#ifdef BCSIM_HAVE_ZLIB
+        bool whole_rows = true;
+        for (size_t i = 1; i < dims.size(); i++) {
+            whole_rows = whole_rows && (chunk_dims[i] == dims[i]);
+        }
+        bool shuffled;
+        const bool native_float = (dataset.getDataType() == H5::PredType::NATIVE_FLOAT);
+        if (whole_rows && native_float && is_deflate_pipeline(dcpl, shuffled)) {
+            read_deflated_chunks(dataset, dims, chunk_dims[0], shuffled, dest, progress);
+            return;
+        }
+#endif
+        // whole chunks per read so that no chunk is decompressed twice.
+        rows_per_block = std::max<hsize_t>(1, ROWS_PER_BLOCK/chunk_dims[0])*chunk_dims[0];
+    }
+
+    for (hsize_t first_row = 0; first_row < num_rows; first_row += rows_per_block) {
+        const auto block_rows = std::min(rows_per_block, num_rows - first_row);
+        read_row_range(dataset, dims, first_row, block_rows, dest + first_row*row_size);
+        if (progress) {
+            progress(first_row + block_rows, num_rows);
+        }
+    }
+}
+
+}   // end anonymous namespace
+
+FixedScatterers::s_ptr loadFixedScatterersFromHdf(const std::string& h5_file, LoadProgressCallback progress) {
+    ScopedTraceEvent trace_event("load_fixed_scatterers", "io");
     SimpleHDF::SimpleHDF5Reader loader(h5_file);
-    auto res = new FixedScatterers;
+    auto res = std::make_shared<FixedScatterers>();
     try {
-        auto data = loader.readMultiArray<float, 2>("data");
-        auto data_shape = data.shape();
-        size_t num_scatterers = data_shape[0];
-        size_t num_components = data_shape[1];
-        if (num_components != 4) {
+        auto dataset = loader.getDataSet("data");
+        const auto dims = get_dataset_dims(dataset);
+        if (dims.size() != 2 || dims[1] != 4) {
             throw std::runtime_error("Second dimension must have length four");
         }
-        res->scatterers.resize(num_scatterers);
-        for (size_t i = 0; i < num_scatterers; i++) {
-            PointScatterer scatterer;
-            scatterer.pos       = vector3(data[i][0], data[i][1], data[i][2]);
-            scatterer.amplitude = data[i][3];
-            res->scatterers[i]  = scatterer;
-        }
+        // PointScatterer has the same memory layout as one row of the dataset.
+        res->scatterers.resize(dims[0]);
+        read_float_rows(dataset, reinterpret_cast<float*>(res->scatterers.data()), progress);
+        trace_event.set_arg("num_scatterers", static_cast<int64_t>(dims[0]));
     } catch (...) {
-        throw std::runtime_error("failed to load fixed scatterers");
+        SimpleHDF::rethrowWithContext("failed to load fixed scatterers from " + h5_file);
+    }
+    return res;
+}
+
+void saveFixedScatterersToHdf(FixedScatterers::s_ptr scatterers, const std::string& h5_file) {
+    FixedScatterersHdfWriter writer(h5_file);
+    writer.append(scatterers->scatterers.data(), scatterers->scatterers.size());
+    writer.close();
+}
+
+struct FixedScatterersHdfWriter::FileState {
+    explicit FileState(const std::string& h5_file)
+        : file(h5_file, H5F_ACC_TRUNC) { }
+
+    H5::H5File      file;
+    H5::DataSet     dataset;
+};
+
+FixedScatterersHdfWriter::FixedScatterersHdfWriter(const std::string& h5_file)
+    : m_h5_file(h5_file),
+      m_num_written(0) {
+    SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+    H5::Exception::dontPrint();
+    try {
+        m_file_state.reset(new FileState(h5_file));
+        // Chunked like the blocks used when reading.
+        hsize_t dims[]       = {0, 4};
+        hsize_t max_dims[]   = {H5S_UNLIMITED, 4};
+        hsize_t chunk_dims[] = {ROWS_PER_BLOCK, 4};
+        H5::DSetCreatPropList dcpl;
+        dcpl.setChunk(2, chunk_dims);
+        m_file_state->dataset = m_file_state->file.createDataSet("data", H5::PredType::NATIVE_FLOAT, H5::DataSpace(2, dims, max_dims), dcpl);
+    } catch (const H5::Exception& e) {
+        m_file_state.reset();
+        throw std::runtime_error("unable to create " + h5_file + ": " + e.getDetailMsg());
+    }
+}
+
+FixedScatterersHdfWriter::~FixedScatterersHdfWriter() {
+    if (m_file_state) {
+        {
+            SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+            m_file_state.reset();
+        }
+        std::remove(m_h5_file.c_str());
+    }
+}
+
+void FixedScatterersHdfWriter::append(const PointScatterer* scatterers, size_t num_scatterers) {
+    if (!m_file_state) {
+        throw std::runtime_error("FixedScatterersHdfWriter: file is closed");
+    }
+    if (num_scatterers == 0) {
+        return;
+    }
+    ScopedTraceEvent trace_event("save_fixed_scatterers", "io");
+    trace_event.set_arg("num_scatterers", static_cast<int64_t>(num_scatterers));
+    SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+    try {
+        auto& dataset = m_file_state->dataset;
+        hsize_t new_dims[] = {m_num_written + num_scatterers, 4};
+        dataset.extend(new_dims);
+        auto file_space = dataset.getSpace();
+        hsize_t offset[] = {m_num_written, 0};
+        hsize_t count[]  = {num_scatterers, 4};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, offset);
+        H5::DataSpace mem_space(2, count);
+        dataset.write(reinterpret_cast<const float*>(scatterers), H5::PredType::NATIVE_FLOAT, mem_space, file_space);
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to save fixed scatterers to " + m_h5_file + ": " + e.getDetailMsg());
     }
-    return FixedScatterers::s_ptr(res);
+    m_num_written += num_scatterers;
 }
 
-SplineScatterers::s_ptr loadSplineScatterersFromHdf(const std::string& h5_file) {
+void FixedScatterersHdfWriter::close() {
+    if (!m_file_state) {
+        return;
+    }
+    SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+    auto file_state = std::move(m_file_state);
+    try {
+        file_state->dataset.close();
+        file_state->file.close();
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to close " + m_h5_file + ": " + e.getDetailMsg());
+    }
+}
+
+SplineScatterers::s_ptr loadSplineScatterersFromHdf(const std::string& h5_file, LoadProgressCallback progress) {
+    ScopedTraceEvent trace_event("load_spline_scatterers", "io");
     SimpleHDF::SimpleHDF5Reader loader(h5_file);
-    auto res = new SplineScatterers;
+    auto res = std::make_shared<SplineScatterers>();
 
     try {
-        auto control_points = loader.readMultiArray<float, 3>("control_points");
-        auto amplitudes     = loader.readMultiArray<float, 1>("amplitudes");
-        int spline_degree   = loader.readScalar<int>("spline_degree");
-        auto knot_vector    = loader.readStdVector<float>("knot_vector");
-
-        res->spline_degree = spline_degree;
-        res->knot_vector = knot_vector;
-
-        // Copy control points
-        auto shape = control_points.shape();
-        size_t num_scatterers = shape[0];
-        size_t num_cs = shape[1];
-        size_t num_comp = shape[2];
-        if (num_comp != 3) {
+        res->spline_degree = loader.readScalar<int>("spline_degree");
+        res->knot_vector   = loader.readStdVector<float>("knot_vector");
+
+        auto cs_dataset = loader.getDataSet("control_points");
+        const auto cs_dims = get_dataset_dims(cs_dataset);
+        if (cs_dims.size() != 3 || cs_dims[2] != 3) {
             throw std::runtime_error("SplineScatterer illegal number of components (should be 3)");
         }
-        res->control_points.resize(num_scatterers);
-        res->amplitudes.resize(num_scatterers);
-        for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
-            res->amplitudes[scatterer_no] = amplitudes[scatterer_no];
-
-            for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
-                const vector3 pt(control_points[scatterer_no][cs_no][0],
-                                 control_points[scatterer_no][cs_no][1],
-                                 control_points[scatterer_no][cs_no][2]);
-                res->control_points[scatterer_no].push_back(pt);
-            }
+        auto amplitudes_dataset = loader.getDataSet("amplitudes");
+        const auto amplitudes_dims = get_dataset_dims(amplitudes_dataset);
+        if (amplitudes_dims.size() != 1 || amplitudes_dims[0] != cs_dims[0]) {
+            throw std::runtime_error("Mismatch between control_points and amplitudes");
         }
+
+        // Control points are stored with the same layout as the dataset.
+        res->control_points.resize(cs_dims[0]*cs_dims[1]);
+        res->amplitudes.resize(cs_dims[0]);
+        read_float_rows(cs_dataset, reinterpret_cast<float*>(res->control_points.data()), progress);
+        read_float_rows(amplitudes_dataset, res->amplitudes.data(), nullptr);
+        trace_event.set_arg("num_scatterers", static_cast<int64_t>(cs_dims[0]));
     } catch (...) {
-        throw std::runtime_error("failed to load spline scatterers");
+        SimpleHDF::rethrowWithContext("failed to load spline scatterers from " + h5_file);
     }
-    return SplineScatterers::s_ptr(res);
+    return res;
 }
 
 ScanSequence::u_ptr loadScanSequenceFromHdf(const std::string& h5_file) {
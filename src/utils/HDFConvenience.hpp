@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <memory>
 #include <string>
+#include <functional>
 #include "../core/export_macros.hpp"
 #include "../core/LibBCSim.hpp"
 
@@ -39,11 +40,50 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace bcsim {
 
-// Specific loader for fixed scatterers
-FixedScatterers::s_ptr DLL_PUBLIC loadFixedScatterersFromHdf(const std::string& h5_file);
+// Progress reporting for the scatterer loaders: (num_scatterers_read, num_scatterers_total)
+typedef std::function<void(size_t, size_t)> LoadProgressCallback;
 
-// Specific loader for spline scatterers
-SplineScatterers::s_ptr DLL_PUBLIC loadSplineScatterersFromHdf(const std::string& h5_file);
+// Specific loader for fixed scatterers.
+// The data is read in chunks directly into the scatterer array and chunks
+// compressed with deflate are decompressed in parallel.
+FixedScatterers::s_ptr DLL_PUBLIC loadFixedScatterersFromHdf(const std::string& h5_file,
+                                                             LoadProgressCallback progress = nullptr);
+
+// Specific loader for spline scatterers (read the same way as fixed scatterers)
+SplineScatterers::s_ptr DLL_PUBLIC loadSplineScatterersFromHdf(const std::string& h5_file,
+                                                               LoadProgressCallback progress = nullptr);
+
+// Write fixed scatterers as a [num_scatterers, 4] "data" dataset, which is
+// the layout read by loadFixedScatterersFromHdf().
+void DLL_PUBLIC saveFixedScatterersToHdf(FixedScatterers::s_ptr scatterers, const std::string& h5_file);
+
+// Writes fixed scatterers in the same layout a piece at a time, for phantoms
+// that are too large to keep in memory. The dataset is extendable.
+class DLL_PUBLIC FixedScatterersHdfWriter {
+public:
+    // Create (truncate) h5_file.
+    explicit FixedScatterersHdfWriter(const std::string& h5_file);
+
+    // Deletes the file if close() has not been called, since it would
+    // otherwise look like a complete phantom.
+    ~FixedScatterersHdfWriter();
+
+    FixedScatterersHdfWriter(const FixedScatterersHdfWriter&) = delete;
+    FixedScatterersHdfWriter& operator=(const FixedScatterersHdfWriter&) = delete;
+
+    void append(const PointScatterer* scatterers, size_t num_scatterers);
+
+    void close();
+
+    size_t get_num_written() const { return m_num_written; }
+
+private:
+    struct FileState;
+
+    std::string                 m_h5_file;
+    std::unique_ptr<FileState>  m_file_state;
+    size_t                      m_num_written;
+};
 
 // Load a scan sequence.
 ScanSequence::u_ptr DLL_PUBLIC loadScanSequenceFromHdf(const std::string& h5_file);
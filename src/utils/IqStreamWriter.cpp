@@ -0,0 +1,347 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdexcept>
+#include <algorithm>
+#include "IqStreamWriter.hpp"
+#include "SimpleHDF.hpp"
+
+namespace bcsim {
+
+struct IqStreamWriter::FileState {
+    FileState(const std::string& h5_file, const H5::FileAccPropList& fapl)
+        : file(h5_file, H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, fapl) { }
+
+    H5::H5File      file;
+    H5::DataSet     iq_real;
+    H5::DataSet     iq_imag;
+    H5::DataSet     frame_times;
+    bool            datasets_created = false;
+    int             num_lines = 0;
+    int             num_samples = 0;
+    hsize_t         num_frames = 0;
+    std::vector<float> real_part;
+    std::vector<float> imag_part;
+};
+
+namespace {
+
+const hsize_t FRAME_TIMES_CHUNK_SIZE = 1024;
+
+void write_vector3_dataset(H5::H5File& file, const std::string& name, const std::vector<float>& values) {
+    hsize_t dims[] = {values.size()/3, 3};
+    H5::DataSpace dspace(2, dims);
+    auto dset = file.createDataSet(name, H5::PredType::NATIVE_FLOAT, dspace);
+    dset.write(values.data(), H5::PredType::NATIVE_FLOAT);
+}
+
+// Same datasets as read by loadScanSequenceFromHdf()
+void write_scan_sequence(H5::H5File& file, const ScanSequence& scan_seq) {
+    const int num_lines = scan_seq.get_num_lines();
+    std::vector<float> origins, directions, lateral_dirs, timestamps;
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const auto& line = scan_seq.get_scanline(line_no);
+        for (auto& dest_and_v : {std::make_pair(&origins, line.get_origin()),
+                                 std::make_pair(&directions, line.get_direction()),
+                                 std::make_pair(&lateral_dirs, line.get_lateral_dir())}) {
+            dest_and_v.first->push_back(dest_and_v.second.x);
+            dest_and_v.first->push_back(dest_and_v.second.y);
+            dest_and_v.first->push_back(dest_and_v.second.z);
+        }
+        timestamps.push_back(line.get_timestamp());
+    }
+    write_vector3_dataset(file, "origins", origins);
+    write_vector3_dataset(file, "directions", directions);
+    write_vector3_dataset(file, "lateral_dirs", lateral_dirs);
+
+    hsize_t dims[] = {timestamps.size()};
+    auto dset_timestamps = file.createDataSet("timestamps", H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, dims));
+    dset_timestamps.write(timestamps.data(), H5::PredType::NATIVE_FLOAT);
+
+    auto dset_length = file.createDataSet("lengths", H5::PredType::NATIVE_FLOAT, H5::DataSpace());
+    dset_length.write(&scan_seq.line_length, H5::PredType::NATIVE_FLOAT);
+}
+
+}   // end anonymous namespace
+
+IqStreamWriter::IqStreamWriter(const std::string& h5_file, const Settings& settings)
+    : m_h5_file(h5_file),
+      m_settings(settings),
+      m_closing(false),
+      m_closed(false),
+      m_num_frames_written(0)
+{
+    if (settings.queue_capacity <= 0) {
+        throw std::runtime_error("IqStreamWriter: queue capacity must be positive");
+    }
+    if (settings.frames_per_chunk <= 0) {
+        throw std::runtime_error("IqStreamWriter: frames per chunk must be positive");
+    }
+    if (settings.compression_level < 0 || settings.compression_level > 9) {
+        throw std::runtime_error("IqStreamWriter: compression level must be in [0, 9]");
+    }
+
+    SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+    H5::Exception::dontPrint();
+    try {
+        // The chunk cache must hold a whole chunk of each IQ dataset, or partly
+        // written chunks are flushed and re-read for every frame.
+        H5::FileAccPropList fapl;
+        int mdc_num_elements;
+        size_t chunk_cache_num_elements, chunk_cache_num_bytes;
+        double w0;
+        fapl.getCache(mdc_num_elements, chunk_cache_num_elements, chunk_cache_num_bytes, w0);
+        fapl.setCache(mdc_num_elements, chunk_cache_num_elements, std::max<size_t>(chunk_cache_num_bytes, 64 << 20), w0);
+        m_file_state.reset(new FileState(h5_file, fapl));
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("IqStreamWriter: unable to create " + h5_file + ": " + e.getDetailMsg());
+    }
+    try {
+        m_thread = std::thread(&IqStreamWriter::writer_thread_main, this);
+    } catch (...) {
+        m_file_state.reset();
+        throw;
+    }
+}
+
+IqStreamWriter::~IqStreamWriter() {
+    try {
+        close();
+    } catch (...) {
+        // destructor must not throw.
+    }
+}
+
+void IqStreamWriter::set_scan_sequence(ScanSequence::s_ptr scan_sequence) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scan_sequence = scan_sequence;
+}
+
+void IqStreamWriter::append_frame(IqFrame frame, float timestamp) {
+    QueuedFrame queued;
+    queued.num_lines   = static_cast<int>(frame.size());
+    queued.num_samples = frame.empty() ? 0 : static_cast<int>(frame[0].size());
+    for (const auto& line : frame) {
+        if (static_cast<int>(line.size()) != queued.num_samples) {
+            throw std::runtime_error("IqStreamWriter: all lines in a frame must have the same length");
+        }
+    }
+    queued.lines     = std::move(frame);
+    queued.timestamp = timestamp;
+    enqueue(std::move(queued));
+}
+
+void IqStreamWriter::append_frame(const std::complex<float>* samples, int num_lines, int num_samples, float timestamp) {
+    QueuedFrame queued;
+    queued.num_lines   = num_lines;
+    queued.num_samples = num_samples;
+    queued.contiguous.assign(samples, samples + static_cast<size_t>(num_lines)*num_samples);
+    queued.timestamp   = timestamp;
+    enqueue(std::move(queued));
+}
+
+void IqStreamWriter::enqueue(QueuedFrame&& frame) {
+    if (frame.num_lines <= 0 || frame.num_samples <= 0) {
+        throw std::runtime_error("IqStreamWriter: empty frame");
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_closing) {
+        throw std::runtime_error("IqStreamWriter: writer is closed");
+    }
+    m_not_full.wait(lock, [&]() {
+        return static_cast<int>(m_queue.size()) < m_settings.queue_capacity || m_writer_error;
+    });
+    rethrow_writer_error();
+    m_queue.push_back(std::move(frame));
+    lock.unlock();
+    m_not_empty.notify_one();
+}
+
+void IqStreamWriter::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed) {
+            return;
+        }
+        m_closing = true;
+    }
+    m_not_empty.notify_all();
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+    rethrow_writer_error();
+}
+
+size_t IqStreamWriter::get_num_frames_written() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_frames_written;
+}
+
+// Must be called with the mutex held. The error is reported only once.
+void IqStreamWriter::rethrow_writer_error() {
+    if (m_writer_error) {
+        auto error = m_writer_error;
+        m_writer_error = nullptr;
+        m_closing = true;
+        std::rethrow_exception(error);
+    }
+}
+
+void IqStreamWriter::writer_thread_main() {
+    auto& state = *m_file_state;
+    bool failed = false;
+    for (;;) {
+        QueuedFrame frame;
+        ScanSequence::s_ptr scan_sequence;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [&]() { return !m_queue.empty() || m_closing; });
+            if (m_queue.empty()) {
+                break;
+            }
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+            scan_sequence = m_scan_sequence;
+        }
+        m_not_full.notify_one();
+
+        // After a failure the remaining frames are discarded.
+        if (failed) continue;
+
+        try {
+            // Held while writing only, so that other threads can load data meanwhile.
+            SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+            if (!state.datasets_created) {
+                if (scan_sequence) {
+                    write_scan_sequence(state.file, *scan_sequence);
+                }
+                state.num_lines   = frame.num_lines;
+                state.num_samples = frame.num_samples;
+
+                hsize_t dims[]     = {0, static_cast<hsize_t>(state.num_lines), static_cast<hsize_t>(state.num_samples)};
+                hsize_t max_dims[] = {H5S_UNLIMITED, dims[1], dims[2]};
+                hsize_t chunk[]    = {static_cast<hsize_t>(m_settings.frames_per_chunk), dims[1], dims[2]};
+                H5::DSetCreatPropList dcpl;
+                dcpl.setChunk(3, chunk);
+                if (m_settings.compression_level > 0) {
+                    dcpl.setShuffle();
+                    dcpl.setDeflate(m_settings.compression_level);
+                }
+                H5::DataSpace dspace(3, dims, max_dims);
+                state.iq_real = state.file.createDataSet("iq_real", H5::PredType::NATIVE_FLOAT, dspace, dcpl);
+                state.iq_imag = state.file.createDataSet("iq_imag", H5::PredType::NATIVE_FLOAT, dspace, dcpl);
+
+                hsize_t times_dims[]     = {0};
+                hsize_t times_max_dims[] = {H5S_UNLIMITED};
+                hsize_t times_chunk[]    = {FRAME_TIMES_CHUNK_SIZE};
+                H5::DSetCreatPropList times_dcpl;
+                times_dcpl.setChunk(1, times_chunk);
+                state.frame_times = state.file.createDataSet("frame_times", H5::PredType::NATIVE_FLOAT,
+                                                             H5::DataSpace(1, times_dims, times_max_dims), times_dcpl);
+                state.datasets_created = true;
+            }
+            if (frame.num_lines != state.num_lines || frame.num_samples != state.num_samples) {
+                throw std::runtime_error("IqStreamWriter: frame dimensions changed during recording");
+            }
+
+            const size_t num_values = static_cast<size_t>(frame.num_lines)*frame.num_samples;
+            state.real_part.resize(num_values);
+            state.imag_part.resize(num_values);
+            if (frame.contiguous.empty()) {
+                size_t index = 0;
+                for (const auto& line : frame.lines) {
+                    for (const auto& sample : line) {
+                        state.real_part[index] = sample.real();
+                        state.imag_part[index] = sample.imag();
+                        index++;
+                    }
+                }
+            } else {
+                for (size_t i = 0; i < num_values; i++) {
+                    state.real_part[i] = frame.contiguous[i].real();
+                    state.imag_part[i] = frame.contiguous[i].imag();
+                }
+            }
+
+            const hsize_t frame_no = state.num_frames;
+            hsize_t new_dims[] = {frame_no + 1, static_cast<hsize_t>(state.num_lines), static_cast<hsize_t>(state.num_samples)};
+            hsize_t offset[]   = {frame_no, 0, 0};
+            hsize_t count[]    = {1, new_dims[1], new_dims[2]};
+            H5::DataSpace mem_space(3, count);
+            for (auto dset_and_data : {std::make_pair(&state.iq_real, &state.real_part),
+                                       std::make_pair(&state.iq_imag, &state.imag_part)}) {
+                dset_and_data.first->extend(new_dims);
+                auto file_space = dset_and_data.first->getSpace();
+                file_space.selectHyperslab(H5S_SELECT_SET, count, offset);
+                dset_and_data.first->write(dset_and_data.second->data(), H5::PredType::NATIVE_FLOAT, mem_space, file_space);
+            }
+
+            hsize_t new_times_dims[] = {frame_no + 1};
+            hsize_t times_offset[]   = {frame_no};
+            hsize_t times_count[]    = {1};
+            state.frame_times.extend(new_times_dims);
+            auto times_space = state.frame_times.getSpace();
+            times_space.selectHyperslab(H5S_SELECT_SET, times_count, times_offset);
+            state.frame_times.write(&frame.timestamp, H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, times_count), times_space);
+
+            state.num_frames++;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_num_frames_written++;
+        } catch (...) {
+            failed = true;
+            std::exception_ptr error;
+            try {
+                throw;
+            } catch (H5::Exception& e) {
+                error = std::make_exception_ptr(std::runtime_error("IqStreamWriter: HDF5 error: " + e.getDetailMsg()));
+            } catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_writer_error = error;
+            }
+            m_not_full.notify_all();
+        }
+    }
+
+    SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+    try {
+        state.file.close();
+    } catch (H5::Exception& e) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!failed) {
+            m_writer_error = std::make_exception_ptr(std::runtime_error("IqStreamWriter: HDF5 error: " + e.getDetailMsg()));
+        }
+    }
+    m_file_state.reset();
+}
+
+}   // end namespace
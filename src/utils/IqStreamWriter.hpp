@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <complex>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <memory>
+#include "../core/export_macros.hpp"
+#include "../core/ScanSequence.hpp"
+
+namespace bcsim {
+
+// Appends IQ frames to a HDF5 file from a background thread, so that long
+// recordings are not limited by available memory. The file layout is the same
+// as for the IQ buffer saved from the Qt5 GUI:
+//     iq_real, iq_imag : [num_frames, num_lines, num_samples]
+//     frame_times      : [num_frames]
+// where the frame dimension is extendable and chunked (one chunk per
+// frames_per_chunk frames, optionally deflate-compressed). If a scan sequence
+// is given, it is stored with the same datasets as read by
+// loadScanSequenceFromHdf().
+//
+// Frames are queued and append_frame() only blocks when the queue is full.
+// Errors on the writer thread are rethrown by the next call to append_frame()
+// or close(). All HDF5 calls hold SimpleHDF::globalMutex(), as do the loaders
+// in HDFConvenience.hpp, so the HDF5 library need not be built thread-safe.
+class DLL_PUBLIC IqStreamWriter {
+public:
+    typedef std::vector<std::vector<std::complex<float>>> IqFrame;
+
+    struct Settings {
+        Settings() : queue_capacity(8), frames_per_chunk(1), compression_level(0) { }
+
+        // Max. number of frames waiting to be written.
+        int queue_capacity;
+
+        // Number of frames in each HDF5 chunk.
+        int frames_per_chunk;
+
+        // Deflate compression level: 0 for no compression, 1-9 otherwise.
+        int compression_level;
+    };
+
+    // Create (truncate) h5_file and start the writer thread.
+    IqStreamWriter(const std::string& h5_file, const Settings& settings = Settings());
+
+    // Calls close(), but never throws.
+    ~IqStreamWriter();
+
+    IqStreamWriter(const IqStreamWriter&) = delete;
+    IqStreamWriter& operator=(const IqStreamWriter&) = delete;
+
+    // Store the scan geometry. Call before the first frame.
+    void set_scan_sequence(ScanSequence::s_ptr scan_sequence);
+
+    // Queue a frame of IQ lines. All frames must have the same dimensions.
+    void append_frame(IqFrame frame, float timestamp);
+
+    // Queue a frame stored contiguously line by line.
+    void append_frame(const std::complex<float>* samples, int num_lines, int num_samples, float timestamp);
+
+    // Write all queued frames, close the file and stop the writer thread.
+    void close();
+
+    // Number of frames written to the file so far.
+    size_t get_num_frames_written() const;
+
+private:
+    struct QueuedFrame {
+        IqFrame                             lines;
+        std::vector<std::complex<float>>    contiguous;
+        int                                 num_lines;
+        int                                 num_samples;
+        float                               timestamp;
+    };
+
+    void enqueue(QueuedFrame&& frame);
+    void writer_thread_main();
+    void rethrow_writer_error();
+
+    // Used only on the writer thread.
+    struct FileState;
+
+private:
+    std::string                     m_h5_file;
+    Settings                        m_settings;
+    std::unique_ptr<FileState>      m_file_state;
+    ScanSequence::s_ptr             m_scan_sequence;
+
+    mutable std::mutex              m_mutex;
+    std::condition_variable         m_not_empty;
+    std::condition_variable         m_not_full;
+    std::deque<QueuedFrame>         m_queue;
+    bool                            m_closing;
+    bool                            m_closed;
+    size_t                          m_num_frames_written;
+    std::exception_ptr              m_writer_error;
+    std::thread                     m_thread;
+};
+
+}   // end namespace
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "MappedFile.hpp"
+
+namespace bcsim {
+
+#ifndef _WIN32
+
+MappedFile::MappedFile(const std::string& filename, Mode mode) : m_data(nullptr), m_size(0) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("unable to open " + filename + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("unable to stat " + filename);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size > 0) {
+        const int prot  = (mode == COPY_ON_WRITE) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        const int flags = (mode == COPY_ON_WRITE) ? MAP_PRIVATE : MAP_SHARED;
+        void* p = mmap(nullptr, m_size, prot, flags, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("unable to memory-map " + filename + ": " + std::strerror(errno));
+        }
+        m_data = static_cast<char*>(p);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+}
+
+void MappedFile::will_need() {
+    if (m_data) {
+        madvise(m_data, m_size, MADV_WILLNEED);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename, Mode mode) : m_data(nullptr), m_size(0) {
+    throw std::runtime_error("MappedFile is not supported on this platform");
+}
+
+MappedFile::~MappedFile() { }
+
+void MappedFile::will_need() { }
+
+#endif  // _WIN32
+
+}   // end namespace
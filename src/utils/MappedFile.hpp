@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <memory>
+#include "../core/export_macros.hpp"
+
+namespace bcsim {
+
+// Memory mapping of a complete file (POSIX only).
+class DLL_PUBLIC MappedFile {
+public:
+    typedef std::shared_ptr<MappedFile> s_ptr;
+
+    enum Mode {
+        // Read-only shared mapping.
+        READ_ONLY,
+        // Writable private mapping: Pages are shared with the page cache (and
+        // thus with other processes mapping the same file) until written to,
+        // at which point the kernel makes a private copy. The file is never
+        // modified.
+        COPY_ON_WRITE
+    };
+
+    MappedFile(const std::string& filename, Mode mode = READ_ONLY);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char*       data()          { return m_data; }
+    const char* data() const    { return m_data; }
+    size_t      size() const    { return m_size; }
+
+    // Hint that the whole file will be needed soon.
+    void will_need();
+
+private:
+    char*   m_data;
+    size_t  m_size;
+};
+
+}   // end namespace
@@ -0,0 +1,408 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include "MeshPhantom.hpp"
+#include "../core/Tracing.hpp"
+
+namespace bcsim {
+namespace {
+
+// Maximum number of triangles in a leaf of the hierarchy.
+const int MAX_LEAF_TRIANGLES = 4;
+
+// Relative preference for splitting the hierarchy along x.
+const float X_SPLIT_WEIGHT = 0.25f;
+
+// Number of candidate points generated from one seed when filling.
+const size_t CANDIDATES_PER_CHUNK = 65536;
+
+// Interleave the bits of two 16-bit numbers (2D Morton code).
+inline uint32_t interleave_bits(uint32_t a, uint32_t b) {
+    uint32_t res = 0;
+    for (int bit = 0; bit < 16; bit++) {
+        res |= (((a >> bit) & 1u) << (2*bit)) | (((b >> bit) & 1u) << (2*bit + 1));
+    }
+    return res;
+}
+
+inline bool is_blank(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+// Advance past the current line.
+inline const char* skip_line(const char* p, const char* end) {
+    while ((p < end) && (*p != '\n')) {
+        p++;
+    }
+    return (p < end) ? p + 1 : end;
+}
+
+std::string read_file(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open " + filename);
+    }
+    in.seekg(0, std::ios::end);
+    std::string data(static_cast<size_t>(in.tellg()), '\0');
+    in.seekg(0, std::ios::beg);
+    in.read(&data[0], data.size());
+    if (!in) {
+        throw std::runtime_error("Unable to read " + filename);
+    }
+    return data;
+}
+
+}   // end anonymous namespace
+
+TriangleMesh loadTriangleMeshFromObj(const std::string& obj_file) {
+    ScopedTraceEvent trace_event("load_obj_mesh", "io");
+    const auto data = read_file(obj_file);
+    // The string is null-terminated, so strtof/strtol never read past the end.
+    const char* p = data.c_str();
+    const char* end = p + data.size();
+
+    TriangleMesh mesh;
+    std::vector<long> face;
+    size_t line_no = 0;
+    while (p < end) {
+        line_no++;
+        while ((p < end) && is_blank(*p)) {
+            p++;
+        }
+        if ((end - p >= 2) && (p[0] == 'v') && is_blank(p[1])) {
+            char* next;
+            float xyz[3];
+            p += 2;
+            for (int i = 0; i < 3; i++) {
+                xyz[i] = std::strtof(p, &next);
+                if (next == p) {
+                    throw std::runtime_error("Failed to parse vertex on line " + std::to_string(line_no) + " of " + obj_file);
+                }
+                p = next;
+            }
+            mesh.vertices.push_back(vector3(xyz[0], xyz[1], xyz[2]));
+        } else if ((end - p >= 2) && (p[0] == 'f') && is_blank(p[1])) {
+            // Vertex references are "v", "v/vt", "v//vn" or "v/vt/vn"; only v is used.
+            p += 2;
+            face.clear();
+            while (true) {
+                while ((p < end) && is_blank(*p)) {
+                    p++;
+                }
+                if ((p >= end) || (*p == '\n') || (*p == '#')) {
+                    break;
+                }
+                char* next;
+                const auto index = std::strtol(p, &next, 10);
+                if ((next == p) || (index == 0)) {
+                    throw std::runtime_error("Failed to parse face on line " + std::to_string(line_no) + " of " + obj_file);
+                }
+                // Negative indices are relative to the last vertex.
+                face.push_back((index < 0) ? static_cast<long>(mesh.vertices.size()) + index : index - 1);
+                p = next;
+                while ((p < end) && !is_blank(*p) && (*p != '\n')) {
+                    p++;
+                }
+            }
+            if (face.size() < 3) {
+                throw std::runtime_error("Face with less than three vertices on line " + std::to_string(line_no) + " of " + obj_file);
+            }
+            for (auto index : face) {
+                if (index < 0) {
+                    throw std::runtime_error("Invalid vertex index on line " + std::to_string(line_no) + " of " + obj_file);
+                }
+            }
+            for (size_t i = 1; i + 1 < face.size(); i++) {
+                mesh.triangles.push_back({{static_cast<uint32_t>(face[0]), static_cast<uint32_t>(face[i]), static_cast<uint32_t>(face[i+1])}});
+            }
+        }
+        p = skip_line(p, end);
+    }
+
+    for (const auto& triangle : mesh.triangles) {
+        for (auto index : triangle) {
+            if (index >= mesh.vertices.size()) {
+                throw std::runtime_error("Invalid vertex index in " + obj_file);
+            }
+        }
+    }
+    trace_event.set_arg("num_triangles", static_cast<int64_t>(mesh.triangles.size()));
+    return mesh;
+}
+
+double computeMeshVolume(const TriangleMesh& mesh) {
+    // Sum of signed volumes of tetrahedra spanned by the origin and each triangle.
+    double volume = 0.0;
+    for (const auto& triangle : mesh.triangles) {
+        const auto& a = mesh.vertices[triangle[0]];
+        const auto& b = mesh.vertices[triangle[1]];
+        const auto& c = mesh.vertices[triangle[2]];
+        volume += static_cast<double>(a.x)*(static_cast<double>(b.y)*c.z - static_cast<double>(b.z)*c.y)
+                - static_cast<double>(a.y)*(static_cast<double>(b.x)*c.z - static_cast<double>(b.z)*c.x)
+                + static_cast<double>(a.z)*(static_cast<double>(b.x)*c.y - static_cast<double>(b.y)*c.x);
+    }
+    return std::abs(volume)/6.0;
+}
+
+MeshInsideTest::MeshInsideTest(const TriangleMesh& mesh) {
+    if (mesh.triangles.empty()) {
+        throw std::runtime_error("mesh has no triangles");
+    }
+    std::vector<Triangle> triangles;
+    std::vector<vector3> centroids;
+    triangles.reserve(mesh.triangles.size());
+    centroids.reserve(mesh.triangles.size());
+    for (const auto& indices : mesh.triangles) {
+        Triangle triangle;
+        triangle.v0 = mesh.vertices.at(indices[0]);
+        triangle.v1 = mesh.vertices.at(indices[1]);
+        triangle.v2 = mesh.vertices.at(indices[2]);
+        triangles.push_back(triangle);
+        centroids.push_back((triangle.v0 + triangle.v1 + triangle.v2)/3.0f);
+    }
+
+    std::vector<int> order(triangles.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = static_cast<int>(i);
+    }
+    m_nodes.reserve(2*triangles.size()/MAX_LEAF_TRIANGLES + 1);
+    m_nodes.push_back(Node());
+    build(0, order, triangles, centroids, 0, static_cast<int>(triangles.size()));
+
+    m_triangles.reserve(triangles.size());
+    for (auto i : order) {
+        m_triangles.push_back(triangles[i]);
+    }
+    m_min = vector3(m_nodes[0].min[0], m_nodes[0].min[1], m_nodes[0].min[2]);
+    m_max = vector3(m_nodes[0].max[0], m_nodes[0].max[1], m_nodes[0].max[2]);
+}
+
+void MeshInsideTest::build(int node_no, std::vector<int>& order, const std::vector<Triangle>& triangles,
+                           const std::vector<vector3>& centroids, int first, int count) {
+    Node node;
+    float centroid_min[3], centroid_max[3];
+    for (int k = 0; k < 3; k++) {
+        node.min[k] = centroid_min[k] = std::numeric_limits<float>::max();
+        node.max[k] = centroid_max[k] = -std::numeric_limits<float>::max();
+    }
+    for (int i = first; i < first + count; i++) {
+        const auto& triangle = triangles[order[i]];
+        for (const auto& v : {triangle.v0, triangle.v1, triangle.v2}) {
+            const float xyz[3] = {v.x, v.y, v.z};
+            for (int k = 0; k < 3; k++) {
+                node.min[k] = std::min(node.min[k], xyz[k]);
+                node.max[k] = std::max(node.max[k], xyz[k]);
+            }
+        }
+        const auto& c = centroids[order[i]];
+        const float xyz[3] = {c.x, c.y, c.z};
+        for (int k = 0; k < 3; k++) {
+            centroid_min[k] = std::min(centroid_min[k], xyz[k]);
+            centroid_max[k] = std::max(centroid_max[k], xyz[k]);
+        }
+    }
+
+    if (count <= MAX_LEAF_TRIANGLES) {
+        node.first = first;
+        node.count = count;
+        m_nodes[node_no] = node;
+        return;
+    }
+
+    // Median split of the centroids. The rays are parallel to x, so splits
+    // in y and z are preferred since they let a ray skip one of the children.
+    const float axis_weights[3] = {X_SPLIT_WEIGHT, 1.0f, 1.0f};
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if ((centroid_max[k] - centroid_min[k])*axis_weights[k] > (centroid_max[axis] - centroid_min[axis])*axis_weights[axis]) {
+            axis = k;
+        }
+    }
+    const int half = count/2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&](int a, int b) {
+        const float ca[3] = {centroids[a].x, centroids[a].y, centroids[a].z};
+        const float cb[3] = {centroids[b].x, centroids[b].y, centroids[b].z};
+        return ca[axis] < cb[axis];
+    });
+
+    const int child = static_cast<int>(m_nodes.size());
+    node.first = child;
+    node.count = 0;
+    m_nodes[node_no] = node;
+    m_nodes.push_back(Node());
+    m_nodes.push_back(Node());
+    build(child, order, triangles, centroids, first, half);
+    build(child + 1, order, triangles, centroids, first + half, count - half);
+}
+
+bool MeshInsideTest::is_inside(const vector3& point) const {
+    const double py = point.y;
+    const double pz = point.z;
+    int num_crossings = 0;
+
+    // The depth is logarithmic in the number of triangles due to median splits.
+    int stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const auto& node = m_nodes[stack[--stack_size]];
+        if ((point.x > node.max[0]) || (point.y < node.min[1]) || (point.y > node.max[1])
+            || (point.z < node.min[2]) || (point.z > node.max[2])) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack[stack_size++] = node.first;
+            stack[stack_size++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; i++) {
+            const auto& t = m_triangles[i];
+            // Edge functions of the triangle projected onto the yz-plane.
+            const double e0 = (static_cast<double>(t.v1.y) - t.v0.y)*(pz - t.v0.z) - (static_cast<double>(t.v1.z) - t.v0.z)*(py - t.v0.y);
+            const double e1 = (static_cast<double>(t.v2.y) - t.v1.y)*(pz - t.v1.z) - (static_cast<double>(t.v2.z) - t.v1.z)*(py - t.v1.y);
+            const double e2 = (static_cast<double>(t.v0.y) - t.v2.y)*(pz - t.v2.z) - (static_cast<double>(t.v0.z) - t.v2.z)*(py - t.v2.y);
+            const double area = e0 + e1 + e2;
+            if (area == 0.0) {
+                continue;
+            }
+            // A point on an edge shared by two triangles must be counted once, so
+            // edges are half-open: with the triangle oriented to positive area, an
+            // edge only covers its points if it points to +z (or +y if parallel
+            // to y). Adjacent triangles traverse a shared edge in opposite directions.
+            const double sign = (area > 0.0) ? 1.0 : -1.0;
+            const auto covers = [sign](double e, double dy, double dz) {
+                e *= sign;
+                dy *= sign;
+                dz *= sign;
+                return (e > 0.0) || ((e == 0.0) && ((dz > 0.0) || ((dz == 0.0) && (dy > 0.0))));
+            };
+            if (!covers(e0, static_cast<double>(t.v1.y) - t.v0.y, static_cast<double>(t.v1.z) - t.v0.z)
+                || !covers(e1, static_cast<double>(t.v2.y) - t.v1.y, static_cast<double>(t.v2.z) - t.v1.z)
+                || !covers(e2, static_cast<double>(t.v0.y) - t.v2.y, static_cast<double>(t.v0.z) - t.v2.z)) {
+                continue;
+            }
+            // x of the surface at (y, z) by barycentric interpolation.
+            const double x = (e1*t.v0.x + e2*t.v1.x + e0*t.v2.x)/area;
+            if (x > point.x) {
+                num_crossings++;
+            }
+        }
+    }
+    return (num_crossings % 2) == 1;
+}
+
+FixedScatterers::s_ptr fillTriangleMesh(const TriangleMesh& mesh, const MeshFillParameters& params) {
+    ScopedTraceEvent trace_event("fill_triangle_mesh", "phantom");
+    const MeshInsideTest inside_test(mesh);
+    const auto box_min = inside_test.get_min();
+    const auto extent = inside_test.get_max() - box_min;
+    const double box_volume = static_cast<double>(extent.x)*extent.y*extent.z;
+    if (!(box_volume > 0.0)) {
+        throw std::runtime_error("mesh is flat");
+    }
+    // Used to generate enough candidates in one round.
+    const auto fill_ratio = std::min(1.0, std::max(computeMeshVolume(mesh)/box_volume, 1e-4));
+
+    auto res = std::make_shared<FixedScatterers>();
+    res->scatterers.reserve(params.num_scatterers);
+    uint32_t num_chunks_done = 0;
+    std::vector<std::vector<PointScatterer>> chunk_scatterers;
+    while (res->scatterers.size() < params.num_scatterers) {
+        const auto num_remaining = params.num_scatterers - res->scatterers.size();
+        const auto num_chunks = static_cast<int>(std::min(1e5, std::ceil(1.05*num_remaining/fill_ratio/CANDIDATES_PER_CHUNK)));
+        chunk_scatterers.assign(num_chunks, std::vector<PointScatterer>());
+
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for (int chunk_no = 0; chunk_no < num_chunks; chunk_no++) {
+            // Seeded by chunk number so the result does not depend on the threads.
+            std::seed_seq seed_seq{params.seed, num_chunks_done + static_cast<uint32_t>(chunk_no)};
+            std::mt19937 random_engine(seed_seq);
+            std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+            std::normal_distribution<float> amplitude(params.amplitude_mean, params.amplitude_std);
+            std::vector<PointScatterer> candidates(CANDIDATES_PER_CHUNK);
+            std::vector<std::pair<uint32_t, uint32_t>> order(CANDIDATES_PER_CHUNK);
+            for (size_t i = 0; i < CANDIDATES_PER_CHUNK; i++) {
+                const float u[3] = {uniform(random_engine), uniform(random_engine), uniform(random_engine)};
+                candidates[i].pos = box_min + vector3(extent.x*u[0], extent.y*u[1], extent.z*u[2]);
+                candidates[i].amplitude = amplitude(random_engine);
+                order[i] = std::make_pair(interleave_bits(static_cast<uint32_t>(u[1]*65535.0f), static_cast<uint32_t>(u[2]*65535.0f)),
+                                          static_cast<uint32_t>(i));
+            }
+            // Consecutive rays with nearby (y, z) visit the same nodes, which
+            // keeps the hierarchy in cache.
+            std::sort(order.begin(), order.end());
+            std::vector<uint32_t> accepted;
+            for (const auto& entry : order) {
+                if (inside_test.is_inside(candidates[entry.second].pos)) {
+                    accepted.push_back(entry.second);
+                }
+            }
+            // Back in candidate order, so that any prefix of the chunk is
+            // uniform when the last chunk is only used in part.
+            std::sort(accepted.begin(), accepted.end());
+            auto& scatterers = chunk_scatterers[chunk_no];
+            scatterers.reserve(accepted.size());
+            for (auto index : accepted) {
+                scatterers.push_back(candidates[index]);
+            }
+        }
+        num_chunks_done += num_chunks;
+
+        size_t num_accepted = 0;
+        for (const auto& scatterers : chunk_scatterers) {
+            num_accepted += scatterers.size();
+            for (const auto& scatterer : scatterers) {
+                if (res->scatterers.size() == params.num_scatterers) {
+                    break;
+                }
+                res->scatterers.push_back(scatterer);
+            }
+        }
+        if (num_accepted == 0) {
+            throw std::runtime_error("no points inside mesh, it may not be closed");
+        }
+    }
+    trace_event.set_arg("num_candidates", static_cast<int64_t>(num_chunks_done)*static_cast<int64_t>(CANDIDATES_PER_CHUNK));
+    return res;
+}
+
+}   // end namespace
@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+
+// Filling closed triangle meshes, e.g. organ surfaces exported from
+// modelling software, with uniformly distributed point scatterers.
+
+namespace bcsim {
+
+// Indexed triangle mesh.
+struct TriangleMesh {
+    std::vector<vector3>                    vertices;
+    std::vector<std::array<uint32_t, 3>>    triangles;
+};
+
+// Load the vertices and faces of a Wavefront OBJ file. Faces with more than
+// three vertices are split into triangles and everything else is ignored.
+TriangleMesh DLL_PUBLIC loadTriangleMeshFromObj(const std::string& obj_file);
+
+// Volume enclosed by a closed mesh (independent of triangle orientation).
+double DLL_PUBLIC computeMeshVolume(const TriangleMesh& mesh);
+
+// Point-in-mesh test for closed meshes using a bounding volume hierarchy.
+// A ray is cast from the point along +x and the point is inside if it
+// crosses the surface an odd number of times.
+class DLL_PUBLIC MeshInsideTest {
+public:
+    explicit MeshInsideTest(const TriangleMesh& mesh);
+
+    bool is_inside(const vector3& point) const;
+
+    // Axis-aligned bounding box of the mesh.
+    vector3 get_min() const { return m_min; }
+    vector3 get_max() const { return m_max; }
+
+private:
+    struct Node {
+        float   min[3];
+        float   max[3];
+        // Leaves have count > 0 and refer to m_triangles[first, first+count),
+        // inner nodes have their children at first and first+1.
+        int     first;
+        int     count;
+    };
+
+    // Triangle vertices, ordered to match the leaves.
+    struct Triangle {
+        vector3 v0;
+        vector3 v1;
+        vector3 v2;
+    };
+
+    // Make node_no the root of a subtree over order[first, first+count).
+    void build(int node_no, std::vector<int>& order, const std::vector<Triangle>& triangles,
+               const std::vector<vector3>& centroids, int first, int count);
+
+    std::vector<Node>       m_nodes;
+    std::vector<Triangle>   m_triangles;
+    vector3                 m_min;
+    vector3                 m_max;
+};
+
+// Parameters for filling one mesh.
+struct MeshFillParameters {
+    MeshFillParameters()
+        : num_scatterers(100000),
+          amplitude_mean(0.0f),
+          amplitude_std(1.0f),
+          seed(1) { }
+
+    // Number of scatterers inside the mesh.
+    size_t      num_scatterers;
+
+    // Scatterer amplitudes are Gaussian with this mean and standard deviation.
+    float       amplitude_mean;
+    float       amplitude_std;
+
+    // The result only depends on the seed, not on the number of threads.
+    uint32_t    seed;
+};
+
+// Sample scatterers uniformly inside a closed mesh. Candidates from the
+// bounding box are generated and tested in parallel.
+FixedScatterers::s_ptr DLL_PUBLIC fillTriangleMesh(const TriangleMesh& mesh, const MeshFillParameters& params);
+
+}   // end namespace
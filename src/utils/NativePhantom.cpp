@@ -0,0 +1,291 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "NativePhantom.hpp"
+#include "MappedFile.hpp"
+#include "SimpleHDF.hpp"
+
+namespace bcsim {
+namespace {
+
+const char     NATIVE_PHANTOM_MAGIC[8] = {'B', 'C', 'S', 'I', 'M', 'P', 'H', 'N'};
+const uint32_t NATIVE_PHANTOM_VERSION  = 1;
+// Written in host byte order, used to reject files from hosts with different endianness.
+const uint32_t BYTE_ORDER_MARK         = 0x01020304;
+// Arrays start on page boundaries so that views are page-aligned.
+const uint64_t ARRAY_ALIGNMENT         = 4096;
+
+enum NativePhantomType { NATIVE_FIXED = 1, NATIVE_SPLINE = 2 };
+
+struct NativePhantomHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t type;
+    int32_t  spline_degree;         // spline only
+    uint64_t num_scatterers;
+    uint64_t num_cs;                // spline only
+    uint64_t num_knots;             // spline only
+    uint64_t scatterers_offset;     // PointScatterer[] or control points vector3[]
+    uint64_t amplitudes_offset;     // spline only
+    uint64_t knots_offset;          // spline only
+    char     reserved[56];
+};
+
+static_assert(sizeof(NativePhantomHeader) == 128, "unexpected native phantom header size");
+static_assert(sizeof(PointScatterer) == 4*sizeof(float), "PointScatterer must be four packed floats");
+static_assert(sizeof(vector3) == 3*sizeof(float), "vector3 must be three packed floats");
+
+uint64_t align_up(uint64_t offset) {
+    return (offset + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+}
+
+NativePhantomHeader make_header(NativePhantomType type) {
+    NativePhantomHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, NATIVE_PHANTOM_MAGIC, sizeof(header.magic));
+    header.version         = NATIVE_PHANTOM_VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.type            = type;
+    return header;
+}
+
+// Writes the header and the arrays at their offsets, zero-padding in between.
+class NativePhantomWriter {
+public:
+    NativePhantomWriter(const std::string& filename)
+        : m_out(filename, std::ios::binary | std::ios::trunc), m_pos(0)
+    {
+        if (!m_out) {
+            throw std::runtime_error("unable to open native phantom file for writing: " + filename);
+        }
+    }
+
+    void write_at(uint64_t offset, const void* data, uint64_t num_bytes) {
+        static const char zeros[ARRAY_ALIGNMENT] = {0};
+        if (offset < m_pos) {
+            throw std::logic_error("native phantom arrays written out of order");
+        }
+        while (m_pos < offset) {
+            const auto n = std::min<uint64_t>(offset - m_pos, sizeof(zeros));
+            m_out.write(zeros, n);
+            m_pos += n;
+        }
+        m_out.write(static_cast<const char*>(data), num_bytes);
+        m_pos += num_bytes;
+    }
+
+    void finish() {
+        m_out.flush();
+        if (!m_out) {
+            throw std::runtime_error("failed to write native phantom file");
+        }
+    }
+
+private:
+    std::ofstream   m_out;
+    uint64_t        m_pos;
+};
+
+// Map a native phantom file and validate the header.
+MappedFile::s_ptr map_native_phantom(const std::string& filename, NativePhantomType expected_type,
+                                     NativePhantomHeader& /*out*/ header) {
+    auto mapping = std::make_shared<MappedFile>(filename, MappedFile::COPY_ON_WRITE);
+    if (mapping->size() < sizeof(header)) {
+        throw std::runtime_error("not a native phantom file: " + filename);
+    }
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    if (std::memcmp(header.magic, NATIVE_PHANTOM_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("not a native phantom file: " + filename);
+    }
+    if (header.version != NATIVE_PHANTOM_VERSION) {
+        throw std::runtime_error("unsupported native phantom version in " + filename);
+    }
+    if (header.byte_order_mark != BYTE_ORDER_MARK) {
+        throw std::runtime_error("native phantom file has wrong byte order: " + filename);
+    }
+    if (header.type != static_cast<uint32_t>(expected_type)) {
+        throw std::runtime_error("native phantom file has wrong scatterer type: " + filename);
+    }
+    return mapping;
+}
+
+// Pointer to an array in the mapping after checking that it is inside the file.
+template <typename T>
+T* get_array(MappedFile& mapping, uint64_t offset, uint64_t count) {
+    if (offset > mapping.size() || count > (mapping.size() - offset)/sizeof(T)) {
+        throw std::runtime_error("truncated native phantom file");
+    }
+    return reinterpret_cast<T*>(mapping.data() + offset);
+}
+
+}   // end anonymous namespace
+
+void saveFixedScatterersToNative(FixedScatterers::s_ptr scatterers, const std::string& native_file) {
+    FixedScatterersNativeWriter writer(native_file);
+    writer.append(scatterers->scatterers.data(), scatterers->scatterers.size());
+    writer.close();
+}
+
+struct FixedScatterersNativeWriter::FileState {
+    std::ofstream   out;
+};
+
+FixedScatterersNativeWriter::FixedScatterersNativeWriter(const std::string& native_file)
+    : m_native_file(native_file),
+      m_file_state(new FileState),
+      m_num_written(0) {
+    m_file_state->out.open(native_file, std::ios::binary | std::ios::trunc);
+    if (!m_file_state->out) {
+        throw std::runtime_error("unable to open native phantom file for writing: " + native_file);
+    }
+    // Placeholder for the header, which is written when the size is known.
+    const std::vector<char> zeros(align_up(sizeof(NativePhantomHeader)), 0);
+    m_file_state->out.write(zeros.data(), zeros.size());
+}
+
+FixedScatterersNativeWriter::~FixedScatterersNativeWriter() {
+    if (m_file_state) {
+        m_file_state.reset();
+        std::remove(m_native_file.c_str());
+    }
+}
+
+void FixedScatterersNativeWriter::append(const PointScatterer* scatterers, size_t num_scatterers) {
+    if (!m_file_state) {
+        throw std::runtime_error("FixedScatterersNativeWriter: file is closed");
+    }
+    m_file_state->out.write(reinterpret_cast<const char*>(scatterers), num_scatterers*sizeof(PointScatterer));
+    m_num_written += num_scatterers;
+}
+
+void FixedScatterersNativeWriter::close() {
+    if (!m_file_state) {
+        return;
+    }
+    auto file_state = std::move(m_file_state);
+    auto header = make_header(NATIVE_FIXED);
+    header.num_scatterers    = m_num_written;
+    header.scatterers_offset = align_up(sizeof(header));
+    file_state->out.seekp(0);
+    file_state->out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_state->out.flush();
+    if (!file_state->out) {
+        throw std::runtime_error("failed to write native phantom file: " + m_native_file);
+    }
+}
+
+void saveSplineScatterersToNative(SplineScatterers::s_ptr scatterers, const std::string& native_file) {
+    auto header = make_header(NATIVE_SPLINE);
+    header.num_scatterers    = scatterers->amplitudes.size();
+    header.num_cs            = (header.num_scatterers > 0) ? scatterers->get_num_control_points() : 0;
+    header.num_knots         = scatterers->knot_vector.size();
+    header.spline_degree     = scatterers->spline_degree;
+    header.scatterers_offset = align_up(sizeof(header));
+    header.amplitudes_offset = align_up(header.scatterers_offset + header.num_scatterers*header.num_cs*sizeof(vector3));
+    header.knots_offset      = align_up(header.amplitudes_offset + header.num_scatterers*sizeof(float));
+
+    NativePhantomWriter writer(native_file);
+    writer.write_at(0, &header, sizeof(header));
+    writer.write_at(header.scatterers_offset, scatterers->control_points.data(), header.num_scatterers*header.num_cs*sizeof(vector3));
+    writer.write_at(header.amplitudes_offset, scatterers->amplitudes.data(), header.num_scatterers*sizeof(float));
+    writer.write_at(header.knots_offset, scatterers->knot_vector.data(), header.num_knots*sizeof(float));
+    writer.finish();
+}
+
+FixedScatterers::s_ptr loadFixedScatterersFromNative(const std::string& native_file) {
+    NativePhantomHeader header;
+    auto mapping = map_native_phantom(native_file, NATIVE_FIXED, header);
+    auto data = get_array<PointScatterer>(*mapping, header.scatterers_offset, header.num_scatterers);
+
+    auto res = FixedScatterers::s_ptr(new FixedScatterers);
+    res->scatterers = ScattererArray<PointScatterer>::wrap(data, header.num_scatterers, mapping);
+    return res;
+}
+
+SplineScatterers::s_ptr loadSplineScatterersFromNative(const std::string& native_file) {
+    NativePhantomHeader header;
+    auto mapping = map_native_phantom(native_file, NATIVE_SPLINE, header);
+    auto control_points = get_array<vector3>(*mapping, header.scatterers_offset, header.num_scatterers*header.num_cs);
+    auto amplitudes     = get_array<float>(*mapping, header.amplitudes_offset, header.num_scatterers);
+    auto knots          = get_array<float>(*mapping, header.knots_offset, header.num_knots);
+
+    auto res = SplineScatterers::s_ptr(new SplineScatterers);
+    res->spline_degree  = header.spline_degree;
+    res->knot_vector.assign(knots, knots + header.num_knots);
+    res->control_points = ScattererArray<vector3>::wrap(control_points, header.num_scatterers*header.num_cs, mapping);
+    res->amplitudes     = ScattererArray<float>::wrap(amplitudes, header.num_scatterers, mapping);
+    return res;
+}
+
+std::string getNativePhantomType(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    NativePhantomHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return "";
+    }
+    if (std::memcmp(header.magic, NATIVE_PHANTOM_MAGIC, sizeof(header.magic)) != 0) {
+        return "";
+    }
+    switch (header.type) {
+    case NATIVE_FIXED:
+        return "fixed";
+    case NATIVE_SPLINE:
+        return "spline";
+    default:
+        return "";
+    }
+}
+
+void convertHdfPhantomToNative(const std::string& h5_file, const std::string& native_file, LoadProgressCallback progress) {
+    bool is_spline;
+    {
+        SimpleHDF::SimpleHDF5Reader reader(h5_file);
+        try {
+            reader.getDimensions("control_points");
+            is_spline = true;
+        } catch (...) {
+            is_spline = false;
+        }
+    }
+    if (is_spline) {
+        saveSplineScatterersToNative(loadSplineScatterersFromHdf(h5_file, progress), native_file);
+    } else {
+        saveFixedScatterersToNative(loadFixedScatterersFromHdf(h5_file, progress), native_file);
+    }
+}
+
+}   // end namespace
@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <memory>
+#include <string>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+#include "HDFConvenience.hpp"
+
+// Native phantom format for fast startup with large phantoms.
+//
+// A native phantom file is a header followed by page-aligned arrays with the
+// same memory layout as the simulator's scatterer storage (host byte order):
+//     fixed scatterers:  PointScatterer[num_scatterers]  (x, y, z, amplitude)
+//     spline scatterers: vector3[num_scatterers*num_cs]  (control points)
+//                        float[num_scatterers]           (amplitudes)
+//                        float[num_knots]                (knot vector)
+// Loading memory-maps the file and the returned scatterers are views into the
+// mapping, so nothing is parsed or copied and all processes using the same file
+// share its pages in the page cache. The mapping is private: Modifying the
+// scatterers never changes the file.
+
+namespace bcsim {
+
+// Write fixed scatterers to a native phantom file.
+void DLL_PUBLIC saveFixedScatterersToNative(FixedScatterers::s_ptr scatterers, const std::string& native_file);
+
+// Writes fixed scatterers to a native phantom file a piece at a time, for
+// phantoms that are too large to keep in memory. The header is completed
+// by close().
+class DLL_PUBLIC FixedScatterersNativeWriter {
+public:
+    // Create (truncate) native_file.
+    explicit FixedScatterersNativeWriter(const std::string& native_file);
+
+    // Deletes the file if close() has not been called, since it would
+    // otherwise look like a complete phantom.
+    ~FixedScatterersNativeWriter();
+
+    FixedScatterersNativeWriter(const FixedScatterersNativeWriter&) = delete;
+    FixedScatterersNativeWriter& operator=(const FixedScatterersNativeWriter&) = delete;
+
+    void append(const PointScatterer* scatterers, size_t num_scatterers);
+
+    void close();
+
+    size_t get_num_written() const { return m_num_written; }
+
+private:
+    struct FileState;
+
+    std::string                 m_native_file;
+    std::unique_ptr<FileState>  m_file_state;
+    size_t                      m_num_written;
+};
+
+// Write spline scatterers to a native phantom file.
+void DLL_PUBLIC saveSplineScatterersToNative(SplineScatterers::s_ptr scatterers, const std::string& native_file);
+
+// Memory-map fixed scatterers from a native phantom file.
+FixedScatterers::s_ptr DLL_PUBLIC loadFixedScatterersFromNative(const std::string& native_file);
+
+// Memory-map spline scatterers from a native phantom file.
+SplineScatterers::s_ptr DLL_PUBLIC loadSplineScatterersFromNative(const std::string& native_file);
+
+// Returns "fixed" or "spline" for a native phantom file, and an empty string
+// for anything else.
+std::string DLL_PUBLIC getNativePhantomType(const std::string& filename);
+
+// Convert a HDF5 phantom with fixed ("data") or spline ("control_points", ...)
+// scatterers to the native format.
+void DLL_PUBLIC convertHdfPhantomToNative(const std::string& h5_file, const std::string& native_file,
+                                          LoadProgressCallback progress = nullptr);
+
+}   // end namespace
@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include <memory>
+#include <cmath>
+#include <algorithm>
 
 namespace bcsim {
 
@@ -76,6 +78,48 @@ struct LinearScanGeometry : public ScanGeometry {
     }
 };
 
+// Pyramidal volume scan from a matrix probe at origin. The radial direction of
+// a line at azimuth angle phi and elevation angle psi is
+//     (cos(psi)*sin(phi), sin(psi), cos(psi)*cos(phi))
+// i.e. the azimuth plane is the xz-plane and the elevation direction is y.
+// Lines are ordered with azimuth index most rapidly varying.
+struct PyramidalScanGeometry : public ScanGeometry {
+    float width;            // Azimuth sector width [radians]
+    float elevation_width;  // Elevation sector width [radians]
+    float depth;            // Depth [meters]
+    float tilt;             // Azimuth tilt [radians]
+    float elevation_tilt;   // Elevation tilt [radians]
+
+    // Extent of the azimuth plane, with x lateral and y along depth.
+    virtual void get_xy_extent(float& x_min, float& x_max, float& y_min, float& y_max) const {
+        float z_min, z_max, temp_min, temp_max;
+        get_xyz_extent(x_min, x_max, temp_min, temp_max, z_min, z_max);
+        y_min = z_min;
+        y_max = z_max;
+    }
+
+    // Bounding box of the scanned volume in probe coordinates.
+    void get_xyz_extent(float& x_min, float& x_max, float& y_min, float& y_max, float& z_min, float& z_max) const {
+        float min_azimuth, max_azimuth, min_elevation, max_elevation;
+        get_angle_limits(min_azimuth, max_azimuth, min_elevation, max_elevation);
+
+        x_min = std::min(0.0f, static_cast<float>(depth*std::sin(min_azimuth)));
+        x_max = std::max(0.0f, static_cast<float>(depth*std::sin(max_azimuth)));
+        y_min = std::min(0.0f, static_cast<float>(depth*std::sin(min_elevation)));
+        y_max = std::max(0.0f, static_cast<float>(depth*std::sin(max_elevation)));
+        z_min = 0.0f;
+        z_max = depth;
+    }
+
+    void get_angle_limits(float& /*out*/ min_azimuth,   float& /*out*/ max_azimuth,
+                          float& /*out*/ min_elevation, float& /*out*/ max_elevation) const {
+        min_azimuth   = -0.5f*width + tilt;
+        max_azimuth   =  0.5f*width + tilt;
+        min_elevation = -0.5f*elevation_width + elevation_tilt;
+        max_elevation =  0.5f*elevation_width + elevation_tilt;
+    }
+};
+
 inline void GetCartesianDimensions(ScanGeometry::ptr geometry, float& /*out*/ width, float& /*out*/ height) {
     float x_min, x_max, y_min, y_max;
     geometry->get_xy_extent(x_min, x_max, y_min, y_max);
@@ -0,0 +1,906 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <complex>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+#include "ShardedSimulation.hpp"
+#include "MappedFile.hpp"
+#include "SimpleHDF.hpp"
+#include "../core/BeamProfile.hpp"
+#include "../core/ScanSequence.hpp"
+
+namespace bcsim {
+namespace {
+
+const char     JOB_FILE_MAGIC[8]  = {'B', 'C', 'S', 'I', 'M', 'J', 'O', 'B'};
+const uint32_t JOB_FILE_VERSION   = 1;
+// All arrays start at a multiple of this offset from the start of the file.
+const size_t   JOB_FILE_ALIGNMENT = 64;
+// Number of floats per serialized scanline: origin, direction, lateral_dir, timestamp
+const size_t   SCANLINE_NUM_FLOATS = 10;
+
+enum BeamProfileType { BEAM_PROFILE_GAUSSIAN = 0, BEAM_PROFILE_LUT = 1 };
+
+static_assert(sizeof(PointScatterer) == 4*sizeof(float), "PointScatterer must be four packed floats");
+static_assert(sizeof(vector3) == 3*sizeof(float), "vector3 must be three packed floats");
+
+class JobFileWriter {
+public:
+    JobFileWriter(const std::string& filename)
+        : m_out(filename, std::ios::binary | std::ios::trunc), m_pos(0)
+    {
+        if (!m_out) {
+            throw std::runtime_error("unable to open job file for writing: " + filename);
+        }
+    }
+
+    template <typename T>
+    void write_scalar(T value) {
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_string(const std::string& s) {
+        write_scalar<uint64_t>(s.size());
+        write_bytes(s.data(), s.size());
+    }
+
+    template <typename T>
+    void write_array(const T* data, size_t count) {
+        write_scalar<uint64_t>(count);
+        pad_to_alignment();
+        write_bytes(data, count*sizeof(T));
+    }
+
+    void finish() {
+        m_out.flush();
+        if (!m_out) {
+            throw std::runtime_error("failed to write job file");
+        }
+    }
+
+private:
+    void write_bytes(const void* data, size_t num_bytes) {
+        m_out.write(static_cast<const char*>(data), num_bytes);
+        m_pos += num_bytes;
+    }
+
+    void pad_to_alignment() {
+        static const char zeros[JOB_FILE_ALIGNMENT] = {0};
+        const auto remainder = m_pos % JOB_FILE_ALIGNMENT;
+        if (remainder != 0) {
+            write_bytes(zeros, JOB_FILE_ALIGNMENT - remainder);
+        }
+    }
+
+private:
+    std::ofstream   m_out;
+    size_t          m_pos;
+};
+
+class JobFileReader {
+public:
+    JobFileReader(const char* data, size_t size)
+        : m_data(data), m_size(size), m_pos(0) { }
+
+    template <typename T>
+    T read_scalar() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string read_string() {
+        const auto length = read_scalar<uint64_t>();
+        const auto p = take(length);
+        return std::string(p, p + length);
+    }
+
+    // Returns a pointer into the mapped file.
+    template <typename T>
+    const T* read_array(size_t& count) {
+        count = static_cast<size_t>(read_scalar<uint64_t>());
+        const auto remainder = m_pos % JOB_FILE_ALIGNMENT;
+        if (remainder != 0) {
+            take(JOB_FILE_ALIGNMENT - remainder);
+        }
+        if (count > (m_size - m_pos)/sizeof(T)) {
+            throw std::runtime_error("truncated job file");
+        }
+        return reinterpret_cast<const T*>(take(count*sizeof(T)));
+    }
+
+    template <typename T>
+    std::vector<T> read_vector() {
+        size_t count;
+        const auto p = read_array<T>(count);
+        return std::vector<T>(p, p + count);
+    }
+
+private:
+    const char* take(size_t num_bytes) {
+        if (num_bytes > m_size - m_pos) {
+            throw std::runtime_error("truncated job file");
+        }
+        const auto res = m_data + m_pos;
+        m_pos += num_bytes;
+        return res;
+    }
+
+private:
+    const char* m_data;
+    size_t      m_size;
+    size_t      m_pos;
+};
+
+#ifndef _WIN32
+
+// Wire format on the task pipe: three int32 [frame_no, first_line, num_lines]
+// where num_lines <= 0 tells the worker to exit.
+// Wire format on the result pipe: four int32 [frame_no, first_line, num_lines, num_samples]
+// followed by num_lines*num_samples complex floats, or num_lines = -1 and
+// num_samples = length of an error message which follows.
+const int32_t RESULT_IS_ERROR = -1;
+
+void write_all(int fd, const void* data, size_t num_bytes) {
+    auto p = static_cast<const char*>(data);
+    while (num_bytes > 0) {
+        const auto n = write(fd, p, num_bytes);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("pipe write failed: ") + std::strerror(errno));
+        }
+        p += n;
+        num_bytes -= static_cast<size_t>(n);
+    }
+}
+
+// Returns false on end-of-file before the first byte.
+bool read_all(int fd, void* data, size_t num_bytes) {
+    auto p = static_cast<char*>(data);
+    size_t num_read = 0;
+    while (num_read < num_bytes) {
+        const auto n = read(fd, p + num_read, num_bytes - num_read);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("pipe read failed: ") + std::strerror(errno));
+        }
+        if (n == 0) {
+            if (num_read == 0) return false;
+            throw std::runtime_error("unexpected end of pipe");
+        }
+        num_read += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void send_error(int fd, const std::string& msg) {
+    const int32_t header[4] = {0, 0, RESULT_IS_ERROR, static_cast<int32_t>(msg.size())};
+    write_all(fd, header, sizeof(header));
+    write_all(fd, msg.data(), msg.size());
+}
+
+// The merged output. HDF5 objects must also be destroyed with the HDF5 lock held.
+struct OutputFile {
+    explicit OutputFile(const std::string& h5_file)
+        : file(h5_file, H5F_ACC_TRUNC) { }
+
+    H5::H5File      file;
+    H5::DataSet     iq_real;
+    H5::DataSet     iq_imag;
+};
+
+struct OutputFileDeleter {
+    void operator()(OutputFile* output) const {
+        SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+        delete output;
+    }
+};
+
+typedef std::unique_ptr<OutputFile, OutputFileDeleter> OutputFilePtr;
+
+struct WorkerProcess {
+    pid_t           pid;
+    int             task_fd;
+    int             result_fd;
+    bool            busy;
+    SimulationShard shard;
+};
+
+// Owns the worker processes and makes sure they are gone when leaving scope.
+class WorkerPool {
+public:
+    WorkerPool() {
+        // a worker dying must surface as an error, not kill the coordinator.
+        struct sigaction ignore;
+        std::memset(&ignore, 0, sizeof(ignore));
+        ignore.sa_handler = SIG_IGN;
+        sigaction(SIGPIPE, &ignore, &m_old_sigpipe);
+    }
+
+    ~WorkerPool() {
+        for (auto& worker : workers) {
+            if (worker.task_fd >= 0) close(worker.task_fd);
+            if (worker.result_fd >= 0) close(worker.result_fd);
+            if (worker.pid > 0) {
+                kill(worker.pid, SIGTERM);
+                waitpid(worker.pid, nullptr, 0);
+            }
+        }
+        sigaction(SIGPIPE, &m_old_sigpipe, nullptr);
+    }
+
+    // The worker is restricted to the given CPUs, which the CPU algorithm in
+    // it then uses for its threads.
+    void spawn(const std::vector<std::string>& command, const std::string& job_file, const std::vector<int>& cpus) {
+        int to_worker[2];
+        int from_worker[2];
+        if (pipe(to_worker) != 0) {
+            throw std::runtime_error("pipe() failed");
+        }
+        if (pipe(from_worker) != 0) {
+            close(to_worker[0]); close(to_worker[1]);
+            throw std::runtime_error("pipe() failed");
+        }
+        for (int fd : {to_worker[0], to_worker[1], from_worker[0], from_worker[1]}) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        // argv must be ready before fork(): only async-signal-safe calls in the child.
+        std::vector<std::string> args(command);
+        args.push_back(job_file);
+        args.push_back(std::to_string(to_worker[0]));
+        args.push_back(std::to_string(from_worker[1]));
+        std::vector<char*> argv;
+        for (auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+#ifdef __linux__
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+        }
+#endif
+
+        const pid_t pid = fork();
+        if (pid < 0) {
+            for (int fd : {to_worker[0], to_worker[1], from_worker[0], from_worker[1]}) close(fd);
+            throw std::runtime_error("fork() failed");
+        }
+        if (pid == 0) {
+            fcntl(to_worker[0], F_SETFD, 0);
+            fcntl(from_worker[1], F_SETFD, 0);
+#ifdef __linux__
+            // Failure leaves the worker on all CPUs, which is still correct.
+            if (!cpus.empty()) sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+#endif
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        close(to_worker[0]);
+        close(from_worker[1]);
+
+        WorkerProcess worker;
+        worker.pid       = pid;
+        worker.task_fd   = to_worker[1];
+        worker.result_fd = from_worker[0];
+        worker.busy      = false;
+        workers.push_back(worker);
+    }
+
+    // Tell all workers to exit and wait for them. Throws if one did not exit cleanly.
+    void shutdown() {
+        for (auto& worker : workers) {
+            const int32_t stop[3] = {0, 0, 0};
+            write_all(worker.task_fd, stop, sizeof(stop));
+            close(worker.task_fd);
+            worker.task_fd = -1;
+        }
+        bool all_ok = true;
+        for (auto& worker : workers) {
+            int status;
+            while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) { }
+            worker.pid = -1;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                all_ok = false;
+            }
+            close(worker.result_fd);
+            worker.result_fd = -1;
+        }
+        if (!all_ok) {
+            throw std::runtime_error("simulation worker did not exit cleanly");
+        }
+    }
+
+public:
+    std::vector<WorkerProcess> workers;
+
+private:
+    struct sigaction m_old_sigpipe;
+};
+
+#endif  // _WIN32
+
+}   // end anonymous namespace
+
+std::vector<SimulationShard> make_simulation_shards(int num_frames, int num_lines, int lines_per_shard) {
+    if (lines_per_shard <= 0) {
+        throw std::runtime_error("lines per shard must be positive");
+    }
+    std::vector<SimulationShard> shards;
+    for (int frame_no = 0; frame_no < num_frames; frame_no++) {
+        for (int first_line = 0; first_line < num_lines; first_line += lines_per_shard) {
+            SimulationShard shard;
+            shard.frame_no   = frame_no;
+            shard.first_line = first_line;
+            shard.num_lines  = std::min(lines_per_shard, num_lines - first_line);
+            shards.push_back(shard);
+        }
+    }
+    return shards;
+}
+
+std::vector<std::vector<int>> split_worker_cpus(const NumaTopology& topology, int num_workers) {
+    if (num_workers <= 0) {
+        throw std::runtime_error("number of workers must be positive");
+    }
+    std::vector<int> cpus;
+    for (int node_idx = 0; node_idx < topology.get_num_nodes(); node_idx++) {
+        const auto& node_cpus = topology.get_node_cpus(node_idx);
+        cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+    }
+    const size_t num_cpus = cpus.size();
+    std::vector<std::vector<int>> worker_cpus(num_workers);
+    for (size_t i = 0; i < worker_cpus.size(); i++) {
+        if (num_cpus == 0) {
+            break;
+        } else if (num_cpus < worker_cpus.size()) {
+            worker_cpus[i].push_back(cpus[i % num_cpus]);
+        } else {
+            worker_cpus[i].assign(cpus.begin() + i*num_cpus/num_workers, cpus.begin() + (i + 1)*num_cpus/num_workers);
+        }
+    }
+    return worker_cpus;
+}
+
+void write_simulation_job(const SimulationJob& job, const std::string& job_file) {
+    JobFileWriter writer(job_file);
+    for (char c : JOB_FILE_MAGIC) {
+        writer.write_scalar(c);
+    }
+    writer.write_scalar<uint32_t>(JOB_FILE_VERSION);
+    writer.write_string(job.sim_type);
+
+    writer.write_scalar<uint64_t>(job.parameters.size());
+    for (const auto& param : job.parameters) {
+        writer.write_string(param.first);
+        writer.write_string(param.second);
+    }
+
+    const auto& excitation = job.excitation;
+    writer.write_array(excitation.samples.data(), excitation.samples.size());
+    writer.write_scalar<int32_t>(excitation.center_index);
+    writer.write_scalar<float>(excitation.sampling_frequency);
+    writer.write_scalar<float>(excitation.demod_freq);
+
+    if (auto gaussian = std::dynamic_pointer_cast<GaussianBeamProfile>(job.beam_profile)) {
+        writer.write_scalar<int32_t>(BEAM_PROFILE_GAUSSIAN);
+        writer.write_scalar<float>(gaussian->getSigmaLateral());
+        writer.write_scalar<float>(gaussian->getSigmaElevational());
+    } else if (auto lut = std::dynamic_pointer_cast<LUTBeamProfile>(job.beam_profile)) {
+        const int num_rad = lut->getNumSamplesRadial();
+        const int num_lat = lut->getNumSamplesLateral();
+        const int num_ele = lut->getNumSamplesElevational();
+        writer.write_scalar<int32_t>(BEAM_PROFILE_LUT);
+        writer.write_scalar<int32_t>(num_rad);
+        writer.write_scalar<int32_t>(num_lat);
+        writer.write_scalar<int32_t>(num_ele);
+        for (const auto& interval : {lut->getRangeRange(), lut->getLateralRange(), lut->getElevationalRange()}) {
+            writer.write_scalar<float>(interval.first);
+            writer.write_scalar<float>(interval.last);
+        }
+        std::vector<float> samples;
+        samples.reserve(static_cast<size_t>(num_rad)*num_lat*num_ele);
+        for (int ir = 0; ir < num_rad; ir++) {
+            for (int il = 0; il < num_lat; il++) {
+                for (int ie = 0; ie < num_ele; ie++) {
+                    samples.push_back(lut->getDiscreteSample(ir, il, ie));
+                }
+            }
+        }
+        writer.write_array(samples.data(), samples.size());
+    } else {
+        throw std::runtime_error("unsupported beam profile type in simulation job");
+    }
+
+    writer.write_scalar<uint64_t>(job.frames.size());
+    for (const auto& frame : job.frames) {
+        writer.write_scalar<float>(frame->line_length);
+        const int num_lines = frame->get_num_lines();
+        std::vector<float> lines;
+        lines.reserve(num_lines*SCANLINE_NUM_FLOATS);
+        for (int line_no = 0; line_no < num_lines; line_no++) {
+            const auto& line = frame->get_scanline(line_no);
+            for (const auto& v : {line.get_origin(), line.get_direction(), line.get_lateral_dir()}) {
+                lines.push_back(v.x);
+                lines.push_back(v.y);
+                lines.push_back(v.z);
+            }
+            lines.push_back(line.get_timestamp());
+        }
+        writer.write_array(lines.data(), lines.size());
+    }
+
+    writer.write_scalar<uint64_t>(job.fixed_scatterers.size());
+    for (const auto& fixed : job.fixed_scatterers) {
+        const auto& scatterers = fixed->scatterers;
+        writer.write_array(reinterpret_cast<const float*>(scatterers.data()), 4*scatterers.size());
+    }
+
+    writer.write_scalar<uint64_t>(job.spline_scatterers.size());
+    for (const auto& spline : job.spline_scatterers) {
+        const size_t num_scatterers = spline->num_scatterers();
+        const size_t num_cs = (num_scatterers > 0) ? spline->get_num_control_points() : 0;
+        writer.write_scalar<int32_t>(spline->spline_degree);
+        writer.write_array(spline->knot_vector.data(), spline->knot_vector.size());
+        writer.write_scalar<uint64_t>(num_cs);
+        const auto& control_points = spline->control_points;
+        writer.write_array(reinterpret_cast<const float*>(control_points.data()), 3*control_points.size());
+        writer.write_array(spline->amplitudes.data(), spline->amplitudes.size());
+    }
+    writer.finish();
+}
+
+#ifndef _WIN32
+
+SimulationJob read_simulation_job(const std::string& job_file) {
+    // Scatterers are views into the mapping, which stays alive as long as they do.
+    auto mapping = std::make_shared<MappedFile>(job_file, MappedFile::COPY_ON_WRITE);
+    JobFileReader reader(mapping->data(), mapping->size());
+
+    for (char c : JOB_FILE_MAGIC) {
+        if (reader.read_scalar<char>() != c) {
+            throw std::runtime_error("not a simulation job file: " + job_file);
+        }
+    }
+    if (reader.read_scalar<uint32_t>() != JOB_FILE_VERSION) {
+        throw std::runtime_error("unsupported simulation job file version");
+    }
+
+    SimulationJob job;
+    job.sim_type = reader.read_string();
+
+    const auto num_parameters = reader.read_scalar<uint64_t>();
+    for (uint64_t i = 0; i < num_parameters; i++) {
+        auto key = reader.read_string();
+        auto value = reader.read_string();
+        job.parameters.push_back(std::make_pair(key, value));
+    }
+
+    job.excitation.samples            = reader.read_vector<float>();
+    job.excitation.center_index       = reader.read_scalar<int32_t>();
+    job.excitation.sampling_frequency = reader.read_scalar<float>();
+    job.excitation.demod_freq         = reader.read_scalar<float>();
+
+    const auto beam_profile_type = reader.read_scalar<int32_t>();
+    if (beam_profile_type == BEAM_PROFILE_GAUSSIAN) {
+        const auto sigma_lateral     = reader.read_scalar<float>();
+        const auto sigma_elevational = reader.read_scalar<float>();
+        job.beam_profile = IBeamProfile::s_ptr(new GaussianBeamProfile(sigma_lateral, sigma_elevational));
+    } else if (beam_profile_type == BEAM_PROFILE_LUT) {
+        const auto num_rad = reader.read_scalar<int32_t>();
+        const auto num_lat = reader.read_scalar<int32_t>();
+        const auto num_ele = reader.read_scalar<int32_t>();
+        float extents[6];
+        for (auto& v : extents) {
+            v = reader.read_scalar<float>();
+        }
+        auto lut = new LUTBeamProfile(num_rad, num_lat, num_ele, Interval(extents[0], extents[1]),
+                                      Interval(extents[2], extents[3]), Interval(extents[4], extents[5]));
+        job.beam_profile = IBeamProfile::s_ptr(lut);
+        size_t num_samples;
+        const auto samples = reader.read_array<float>(num_samples);
+        if (num_samples != static_cast<size_t>(num_rad)*num_lat*num_ele) {
+            throw std::runtime_error("invalid beam profile in simulation job file");
+        }
+        size_t index = 0;
+        for (int ir = 0; ir < num_rad; ir++) {
+            for (int il = 0; il < num_lat; il++) {
+                for (int ie = 0; ie < num_ele; ie++) {
+                    lut->setDiscreteSample(ir, il, ie, samples[index++]);
+                }
+            }
+        }
+    } else {
+        throw std::runtime_error("invalid beam profile type in simulation job file");
+    }
+
+    const auto num_frames = reader.read_scalar<uint64_t>();
+    for (uint64_t frame_no = 0; frame_no < num_frames; frame_no++) {
+        const auto line_length = reader.read_scalar<float>();
+        size_t num_floats;
+        const auto lines = reader.read_array<float>(num_floats);
+        auto frame = ScanSequence::s_ptr(new ScanSequence(line_length));
+        for (size_t i = 0; i + SCANLINE_NUM_FLOATS <= num_floats; i += SCANLINE_NUM_FLOATS) {
+            const auto p = lines + i;
+            frame->add_scanline(Scanline(vector3(p[0], p[1], p[2]),
+                                         vector3(p[3], p[4], p[5]),
+                                         vector3(p[6], p[7], p[8]),
+                                         p[9]));
+        }
+        job.frames.push_back(frame);
+    }
+
+    const auto num_fixed = reader.read_scalar<uint64_t>();
+    for (uint64_t i = 0; i < num_fixed; i++) {
+        size_t num_floats;
+        const auto data = reader.read_array<float>(num_floats);
+        auto fixed = FixedScatterers::s_ptr(new FixedScatterers);
+        // the mapping is private and writable, so dropping const is safe.
+        auto scatterers = reinterpret_cast<PointScatterer*>(const_cast<float*>(data));
+        fixed->scatterers = ScattererArray<PointScatterer>::wrap(scatterers, num_floats/4, mapping);
+        job.fixed_scatterers.push_back(fixed);
+    }
+
+    const auto num_spline = reader.read_scalar<uint64_t>();
+    for (uint64_t i = 0; i < num_spline; i++) {
+        auto spline = SplineScatterers::s_ptr(new SplineScatterers);
+        spline->spline_degree = reader.read_scalar<int32_t>();
+        spline->knot_vector   = reader.read_vector<float>();
+        const auto num_cs     = static_cast<size_t>(reader.read_scalar<uint64_t>());
+        size_t num_floats;
+        const auto control_points = reader.read_array<float>(num_floats);
+        size_t num_scatterers;
+        const auto amplitudes = reader.read_array<float>(num_scatterers);
+        if (num_floats != num_scatterers*num_cs*3) {
+            throw std::runtime_error("invalid spline scatterers in simulation job file");
+        }
+        auto cs = reinterpret_cast<vector3*>(const_cast<float*>(control_points));
+        spline->control_points = ScattererArray<vector3>::wrap(cs, num_scatterers*num_cs, mapping);
+        spline->amplitudes     = ScattererArray<float>::wrap(const_cast<float*>(amplitudes), num_scatterers, mapping);
+        job.spline_scatterers.push_back(spline);
+    }
+    return job;
+}
+
+#else
+
+SimulationJob read_simulation_job(const std::string& job_file) {
+    throw std::runtime_error("read_simulation_job() is not supported on this platform");
+}
+
+#endif  // _WIN32
+
+IAlgorithm::s_ptr create_simulator_from_job(const SimulationJob& job) {
+    auto sim = Create(job.sim_type);
+    for (const auto& param : job.parameters) {
+        sim->set_parameter(param.first, param.second);
+    }
+    sim->set_excitation(job.excitation);
+    if (std::dynamic_pointer_cast<GaussianBeamProfile>(job.beam_profile)) {
+        sim->set_analytical_profile(job.beam_profile);
+    } else {
+        sim->set_lookup_profile(job.beam_profile);
+    }
+    for (const auto& fixed : job.fixed_scatterers) {
+        sim->add_fixed_scatterers(fixed);
+    }
+    for (const auto& spline : job.spline_scatterers) {
+        sim->add_spline_scatterers(spline);
+    }
+    return sim;
+}
+
+#ifndef _WIN32
+
+int run_simulation_shard_worker(const std::string& job_file, int task_fd, int result_fd) {
+    try {
+        const auto job = read_simulation_job(job_file);
+        auto sim = create_simulator_from_job(job);
+
+        std::vector<std::vector<std::complex<float>>> rf_lines;
+        for (;;) {
+            int32_t task[3];
+            if (!read_all(task_fd, task, sizeof(task)) || task[2] <= 0) {
+                break;
+            }
+            const int frame_no   = task[0];
+            const int first_line = task[1];
+            const int num_lines  = task[2];
+            if (frame_no < 0 || frame_no >= static_cast<int>(job.frames.size())) {
+                throw std::runtime_error("invalid frame number in shard");
+            }
+            const auto& frame = job.frames[frame_no];
+            if (first_line < 0 || first_line + num_lines > frame->get_num_lines()) {
+                throw std::runtime_error("invalid line range in shard");
+            }
+
+            auto scan_seq = ScanSequence::s_ptr(new ScanSequence(frame->line_length));
+            for (int line_no = first_line; line_no < first_line + num_lines; line_no++) {
+                scan_seq->add_scanline(frame->get_scanline(line_no));
+            }
+            // All lines in a job have the same length, so the simulator keeps
+            // the convolvers it made for the first shard.
+            sim->set_scan_sequence(scan_seq);
+            sim->simulate_lines(rf_lines);
+
+            const auto num_samples = rf_lines.empty() ? 0 : rf_lines[0].size();
+            for (const auto& line : rf_lines) {
+                if (line.size() != num_samples) {
+                    throw std::runtime_error("simulated lines have different lengths");
+                }
+            }
+            const int32_t header[4] = {frame_no, first_line, num_lines, static_cast<int32_t>(num_samples)};
+            write_all(result_fd, header, sizeof(header));
+            for (const auto& line : rf_lines) {
+                write_all(result_fd, line.data(), line.size()*sizeof(std::complex<float>));
+            }
+        }
+    } catch (std::exception& e) {
+        try {
+            send_error(result_fd, e.what());
+        } catch (...) {
+            // coordinator is gone.
+        }
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+int run_simulation_shard_worker(const std::string& job_file, int task_fd, int result_fd) {
+    throw std::runtime_error("run_simulation_shard_worker() is not supported on this platform");
+}
+
+#endif  // _WIN32
+
+ShardedSimulationRunner::ShardedSimulationRunner(const std::vector<std::string>& worker_command, int num_workers)
+    : m_worker_command(worker_command),
+      m_num_workers(num_workers),
+      m_lines_per_shard(16)
+{
+    if (worker_command.empty()) {
+        throw std::runtime_error("empty worker command");
+    }
+    if (num_workers <= 0) {
+        throw std::runtime_error("number of workers must be positive");
+    }
+}
+
+void ShardedSimulationRunner::set_lines_per_shard(int lines_per_shard) {
+    if (lines_per_shard <= 0) {
+        throw std::runtime_error("lines per shard must be positive");
+    }
+    m_lines_per_shard = lines_per_shard;
+}
+
+void ShardedSimulationRunner::set_progress_callback(ProgressCallback callback) {
+    m_progress_callback = callback;
+}
+
+#ifndef _WIN32
+
+void ShardedSimulationRunner::run(const SimulationJob& job, const std::string& job_file, const std::string& h5_file) {
+    if (job.frames.empty()) {
+        throw std::runtime_error("simulation job has no frames");
+    }
+    const int num_lines = job.frames[0]->get_num_lines();
+    for (const auto& frame : job.frames) {
+        if (frame->get_num_lines() != num_lines || frame->line_length != job.frames[0]->line_length) {
+            throw std::runtime_error("all frames must have the same number of lines and line length");
+        }
+    }
+    if (num_lines == 0) {
+        throw std::runtime_error("simulation job has no scanlines");
+    }
+    const int num_frames = static_cast<int>(job.frames.size());
+    const auto shards = make_simulation_shards(num_frames, num_lines, m_lines_per_shard);
+    const int num_workers = std::min(m_num_workers, static_cast<int>(shards.size()));
+
+    // Each worker gets its own CPUs, or the thread binding of the CPU
+    // algorithm would put all workers on the same cores.
+    const auto worker_cpus = split_worker_cpus(NumaTopology(), num_workers);
+
+    // Unless told otherwise, use as many threads as a worker has CPUs.
+    SimulationJob worker_job(job);
+    const bool has_num_cores = std::any_of(job.parameters.begin(), job.parameters.end(),
+        [](const std::pair<std::string, std::string>& param) { return param.first == "num_cpu_cores"; });
+    if (job.sim_type == "cpu" && !has_num_cores) {
+        size_t num_cores = worker_cpus[0].size();
+        for (const auto& cpus : worker_cpus) {
+            num_cores = std::min(num_cores, cpus.size());
+        }
+        num_cores = std::max<size_t>(1, num_cores);
+        worker_job.parameters.push_back(std::make_pair("num_cpu_cores", std::to_string(num_cores)));
+    }
+    write_simulation_job(worker_job, job_file);
+
+    WorkerPool pool;
+    for (int i = 0; i < num_workers; i++) {
+        pool.spawn(m_worker_command, job_file, worker_cpus[i]);
+    }
+
+    // The output file is open until all shards are merged, but the HDF5 lock
+    // is only held while it is used, so that other threads can load data meanwhile.
+    H5::Exception::dontPrint();
+    try {
+        OutputFilePtr output;
+        {
+            SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+            output.reset(new OutputFile(h5_file));
+        }
+        int num_samples = -1;
+
+        size_t next_shard = 0;
+        auto dispatch = [&](WorkerProcess& worker) {
+            if (next_shard < shards.size()) {
+                const auto& shard = shards[next_shard++];
+                const int32_t task[3] = {shard.frame_no, shard.first_line, shard.num_lines};
+                write_all(worker.task_fd, task, sizeof(task));
+                worker.shard = shard;
+                worker.busy = true;
+            } else {
+                worker.busy = false;
+            }
+        };
+
+        std::vector<float> real_part;
+        std::vector<float> imag_part;
+        std::vector<std::complex<float>> buffer;
+        auto receive = [&](WorkerProcess& worker) {
+            int32_t header[4];
+            if (!read_all(worker.result_fd, header, sizeof(header))) {
+                throw std::runtime_error("simulation worker exited unexpectedly");
+            }
+            if (header[2] == RESULT_IS_ERROR) {
+                std::string msg(std::max(0, header[3]), ' ');
+                if (!msg.empty() && !read_all(worker.result_fd, &msg[0], msg.size())) {
+                    throw std::runtime_error("simulation worker exited unexpectedly");
+                }
+                throw std::runtime_error("simulation worker failed: " + msg);
+            }
+            if (header[0] != worker.shard.frame_no || header[1] != worker.shard.first_line || header[2] != worker.shard.num_lines) {
+                throw std::runtime_error("simulation worker returned wrong shard");
+            }
+            const size_t num_values = static_cast<size_t>(header[2])*header[3];
+            buffer.resize(num_values);
+            if (num_values > 0 && !read_all(worker.result_fd, buffer.data(), num_values*sizeof(std::complex<float>))) {
+                throw std::runtime_error("simulation worker exited unexpectedly");
+            }
+            if (num_samples >= 0 && header[3] != num_samples) {
+                throw std::runtime_error("simulation workers returned lines of different length");
+            }
+
+            real_part.resize(num_values);
+            imag_part.resize(num_values);
+            for (size_t i = 0; i < num_values; i++) {
+                real_part[i] = buffer[i].real();
+                imag_part[i] = buffer[i].imag();
+            }
+
+            SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+            if (num_samples < 0) {
+                num_samples = header[3];
+                hsize_t dims[] = {static_cast<hsize_t>(num_frames), static_cast<hsize_t>(num_lines), static_cast<hsize_t>(num_samples)};
+                H5::DataSpace dspace(3, dims);
+                output->iq_real = output->file.createDataSet("iq_real", H5::PredType::NATIVE_FLOAT, dspace);
+                output->iq_imag = output->file.createDataSet("iq_imag", H5::PredType::NATIVE_FLOAT, dspace);
+            }
+            hsize_t offset[] = {static_cast<hsize_t>(header[0]), static_cast<hsize_t>(header[1]), 0};
+            hsize_t count[]  = {1, static_cast<hsize_t>(header[2]), static_cast<hsize_t>(num_samples)};
+            H5::DataSpace mem_space(3, count);
+            for (auto dset_and_data : {std::make_pair(&output->iq_real, &real_part), std::make_pair(&output->iq_imag, &imag_part)}) {
+                auto file_space = dset_and_data.first->getSpace();
+                file_space.selectHyperslab(H5S_SELECT_SET, count, offset);
+                dset_and_data.first->write(dset_and_data.second->data(), H5::PredType::NATIVE_FLOAT, mem_space, file_space);
+            }
+        };
+
+        for (auto& worker : pool.workers) {
+            dispatch(worker);
+        }
+        int num_completed = 0;
+        const int num_total = static_cast<int>(shards.size());
+        std::vector<pollfd> poll_fds;
+        std::vector<size_t> poll_workers;
+        while (num_completed < num_total) {
+            poll_fds.clear();
+            poll_workers.clear();
+            for (size_t i = 0; i < pool.workers.size(); i++) {
+                if (pool.workers[i].busy) {
+                    pollfd p;
+                    p.fd      = pool.workers[i].result_fd;
+                    p.events  = POLLIN;
+                    p.revents = 0;
+                    poll_fds.push_back(p);
+                    poll_workers.push_back(i);
+                }
+            }
+            if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("poll() failed");
+            }
+            for (size_t i = 0; i < poll_fds.size(); i++) {
+                if (poll_fds[i].revents == 0) continue;
+                auto& worker = pool.workers[poll_workers[i]];
+                receive(worker);
+                num_completed++;
+                if (m_progress_callback) {
+                    m_progress_callback(num_completed, num_total);
+                }
+                dispatch(worker);
+            }
+        }
+        pool.shutdown();
+
+        // Frame time is the timestamp of the first line in each frame.
+        std::vector<float> frame_times;
+        for (const auto& frame : job.frames) {
+            frame_times.push_back(frame->get_num_lines() > 0 ? frame->get_scanline(0).get_timestamp() : 0.0f);
+        }
+        SimpleHDF::ScopedLock hdf5_lock(SimpleHDF::globalMutex());
+        hsize_t dims_frame_times[] = {static_cast<hsize_t>(num_frames)};
+        H5::DataSpace dspace_frame_times(1, dims_frame_times);
+        auto dset_frame_times = output->file.createDataSet("frame_times", H5::PredType::NATIVE_FLOAT, dspace_frame_times);
+        dset_frame_times.write(frame_times.data(), H5::PredType::NATIVE_FLOAT);
+        dset_frame_times.close();
+        output->iq_real.close();
+        output->iq_imag.close();
+        output->file.close();
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("failed to write " + h5_file + ": " + e.getDetailMsg());
+    }
+}
+
+#else
+
+void ShardedSimulationRunner::run(const SimulationJob& job, const std::string& job_file, const std::string& h5_file) {
+    throw std::runtime_error("ShardedSimulationRunner is not supported on this platform");
+}
+
+#endif  // _WIN32
+
+}   // end namespace
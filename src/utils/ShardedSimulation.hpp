@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include "../core/export_macros.hpp"
+#include "../core/LibBCSim.hpp"
+#include "../core/algorithm/NumaTopology.hpp"
+
+// Multi-process simulation of long scan sequences and Doppler ensembles.
+//
+// The coordinator writes everything needed to set up a simulator (parameters,
+// excitation, beam profile, scan lines and phantom) to a single job file which
+// the worker processes memory-map. The phantom is used in place from the
+// mapping, so all workers share one copy in the page cache. The work is split
+// into shards of consecutive lines within a frame which are handed out over
+// pipes to the workers as they become idle, and the resulting IQ lines are
+// gathered into one HDF5 file with the same layout as the IQ buffer saved
+// from the Qt5 GUI:
+//     iq_real, iq_imag : [num_frames, num_lines, num_samples]
+//     frame_times      : [num_frames]
+//
+// Workers are started with fork()+exec() because the OpenMP runtime is not safe
+// to use in a forked child once the parent has created its thread pool.
+// POSIX only.
+
+namespace bcsim {
+
+// Everything needed to configure a simulator in another process.
+struct SimulationJob {
+    SimulationJob() : sim_type("cpu") { }
+
+    // Simulator type passed to bcsim::Create()
+    std::string sim_type;
+
+    // Applied with set_parameter() in order.
+    std::vector<std::pair<std::string, std::string>> parameters;
+
+    ExcitationSignal excitation;
+
+    // Either a GaussianBeamProfile or a LUTBeamProfile.
+    IBeamProfile::s_ptr beam_profile;
+
+    // One scan sequence per frame. All frames must have the same number
+    // of lines and the same line length.
+    std::vector<ScanSequence::s_ptr> frames;
+
+    std::vector<FixedScatterers::s_ptr>  fixed_scatterers;
+    std::vector<SplineScatterers::s_ptr> spline_scatterers;
+};
+
+// A range of consecutive lines within one frame.
+struct SimulationShard {
+    int frame_no;
+    int first_line;
+    int num_lines;
+};
+
+// Split num_frames frames of num_lines lines each into shards of at most
+// lines_per_shard lines. Shards never cross frame boundaries.
+std::vector<SimulationShard> DLL_PUBLIC make_simulation_shards(int num_frames, int num_lines, int lines_per_shard);
+
+// Split the CPUs of a topology into num_workers disjoint sets of consecutive
+// CPUs in node order, so that a worker stays on one node where possible.
+// With fewer CPUs than workers, each worker gets a single, shared CPU.
+std::vector<std::vector<int>> DLL_PUBLIC split_worker_cpus(const NumaTopology& topology, int num_workers);
+
+// Serialize a job to a file suitable for memory-mapping by the workers.
+void DLL_PUBLIC write_simulation_job(const SimulationJob& job, const std::string& job_file);
+
+// Memory-map a job file and reconstruct the job.
+SimulationJob DLL_PUBLIC read_simulation_job(const std::string& job_file);
+
+// Create a simulator and configure it with everything in a job except the scan sequence.
+IAlgorithm::s_ptr DLL_PUBLIC create_simulator_from_job(const SimulationJob& job);
+
+// Entry point for a worker process: Simulate shards read from task_fd and
+// write the results to result_fd until told to stop. Returns process exit code.
+int DLL_PUBLIC run_simulation_shard_worker(const std::string& job_file, int task_fd, int result_fd);
+
+class DLL_PUBLIC ShardedSimulationRunner {
+public:
+    // Called after each completed shard with (num_completed, num_total).
+    typedef std::function<void(int, int)> ProgressCallback;
+
+    // worker_command is the argv prefix of the worker executable. The job file
+    // and the task and result pipe descriptors are appended as three extra
+    // arguments, which the worker must pass on to run_simulation_shard_worker().
+    ShardedSimulationRunner(const std::vector<std::string>& worker_command, int num_workers);
+
+    // Shards per frame are made with at most this many lines (default: 16)
+    void set_lines_per_shard(int lines_per_shard);
+
+    void set_progress_callback(ProgressCallback callback);
+
+    // Write the job file, simulate all frames with the worker processes and
+    // store the gathered IQ data in h5_file. Throws std::runtime_error if a
+    // worker fails.
+    void run(const SimulationJob& job, const std::string& job_file, const std::string& h5_file);
+
+private:
+    std::vector<std::string>    m_worker_command;
+    int                         m_num_workers;
+    int                         m_lines_per_shard;
+    ProgressCallback            m_progress_callback;
+};
+
+}   // end namespace
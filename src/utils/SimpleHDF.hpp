@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <stdexcept>
 #include <vector>
+#include <mutex>
 #ifdef _MSC_VER
 #   pragma warning(push)
 #   pragma warning(disable:4251) // needs to have dll-interface...
@@ -42,6 +43,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace SimpleHDF {
 
+// HDF5 is only thread-safe when built with --enable-threadsafe, so all use of
+// the library, including destruction of HDF5 objects, must hold this lock.
+// It is recursive since the readers below take it as well.
+inline std::recursive_mutex& globalMutex() {
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+typedef std::lock_guard<std::recursive_mutex> ScopedLock;
+
+// Call from a catch block to throw the exception being handled as a
+// std::runtime_error with context prepended to its message. Exceptions that
+// are neither HDF5 exceptions nor std::exception are rethrown unchanged.
+[[noreturn]] inline void rethrowWithContext(const std::string& context) {
+    try {
+        throw;
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error(context + ": " + e.getDetailMsg());
+    } catch (const std::exception& e) {
+        throw std::runtime_error(context + ": " + e.what());
+    }
+}
+
 namespace detail {
     // Template trick for typemapping from C++ data types to HDF5 data type
     // through templates:
@@ -68,11 +92,13 @@ namespace detail {
     }
 }
 
-// Convenice class for using HDF5 functionality.
+// Convenice class for using HDF5 functionality. Holds the global HDF5 lock
+// until it is destroyed.
 class SimpleHDF5Reader {
 public:
     // Open a HDF5 file for reading.
-    SimpleHDF5Reader(const std::string& filename) {
+    SimpleHDF5Reader(const std::string& filename)
+        : hdf5_lock(globalMutex()) {
         H5::Exception::dontPrint();
         try {
             hdf5_file = H5::H5File(filename, H5F_ACC_RDONLY);
@@ -156,6 +182,16 @@ public:
         H5::DataSet dataset = hdf5_file.openDataSet(dataset_name);
         return getDimensions(dataset);
     }
+
+    // Open a dataset for direct access through the HDF5 API.
+    H5::DataSet getDataSet(const std::string& dataset_name) {
+        return hdf5_file.openDataSet(dataset_name);
+    }
+
+    // Check if a dataset (or other object) exists.
+    bool exists(const std::string& name) {
+        return H5Lexists(hdf5_file.getId(), name.c_str(), H5P_DEFAULT) > 0;
+    }
        
     ~SimpleHDF5Reader() {
         hdf5_file.close();   
@@ -174,6 +210,8 @@ protected:
     }
     
 protected:
+    // Declared first to be released after the file is closed.
+    std::unique_lock<std::recursive_mutex> hdf5_lock;
     H5::H5File hdf5_file;
 };
 
@@ -0,0 +1,325 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdexcept>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include "SpectralDoppler.hpp"
+#include "BCSimConvenience.hpp"
+#include "../core/fft.hpp"
+
+namespace bcsim {
+
+namespace {
+
+template <typename T>
+void write_little_endian(std::ofstream& out, T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out.put(static_cast<char>((static_cast<uint32_t>(value) >> (8*i)) & 0xff));
+    }
+}
+
+// samples are interleaved if there is more than one channel.
+void write_wav_file(const std::string& wav_file, const std::vector<int16_t>& samples, int num_channels, int sample_rate) {
+    std::ofstream out(wav_file, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("unable to open " + wav_file + " for writing");
+    }
+    const uint32_t data_size = static_cast<uint32_t>(samples.size()*sizeof(int16_t));
+    out.write("RIFF", 4);
+    write_little_endian<uint32_t>(out, 36 + data_size);
+    out.write("WAVE", 4);
+    out.write("fmt ", 4);
+    write_little_endian<uint32_t>(out, 16);             // size of fmt chunk
+    write_little_endian<uint16_t>(out, 1);              // PCM
+    write_little_endian<uint16_t>(out, num_channels);
+    write_little_endian<uint32_t>(out, sample_rate);
+    write_little_endian<uint32_t>(out, sample_rate*2*num_channels);  // byte rate
+    write_little_endian<uint16_t>(out, 2*num_channels);              // block align
+    write_little_endian<uint16_t>(out, 16);             // bits per sample
+    out.write("data", 4);
+    write_little_endian<uint32_t>(out, data_size);
+    for (auto sample : samples) {
+        write_little_endian<uint16_t>(out, static_cast<uint16_t>(sample));
+    }
+    if (!out) {
+        throw std::runtime_error("failed writing " + wav_file);
+    }
+}
+
+}   // end anonymous namespace
+
+SpectralDopplerProcessor::SpectralDopplerProcessor(const Settings& settings)
+    : m_settings(settings),
+      m_first_firing(0),
+      m_num_spectra(0),
+      m_max_magnitude(0.0f)
+{
+    const auto fft_length = m_settings.fft_length;
+    if (fft_length < 2 || next_power_of_two(fft_length) != static_cast<size_t>(fft_length)) {
+        throw std::runtime_error("FFT length must be a power of two");
+    }
+    if (m_settings.hop < 1) {
+        throw std::runtime_error("hop must be positive");
+    }
+    if (m_settings.gate_start < 0 || m_settings.gate_length < 1) {
+        throw std::runtime_error("invalid range gate");
+    }
+    if (m_settings.max_spectra < 1) {
+        throw std::runtime_error("max. number of spectra must be positive");
+    }
+    // Hann window
+    const float pi = 4.0f*std::atan(1.0f);
+    m_window.resize(fft_length);
+    for (int i = 0; i < fft_length; i++) {
+        m_window[i] = 0.5f - 0.5f*std::cos(2.0f*pi*i/(fft_length-1));
+    }
+}
+
+void SpectralDopplerProcessor::add_firing(const std::complex<float>* iq_samples, int num_samples) {
+    add_firings(iq_samples, 1, num_samples);
+}
+
+void SpectralDopplerProcessor::add_firings(const std::vector<std::vector<std::complex<float>>>& iq_lines) {
+    const int gate_end = m_settings.gate_start + m_settings.gate_length;
+    for (const auto& line : iq_lines) {
+        if (static_cast<int>(line.size()) < gate_end) {
+            throw std::runtime_error("range gate is outside the IQ line");
+        }
+        std::complex<float> sum(0.0f, 0.0f);
+        for (int i = m_settings.gate_start; i < gate_end; i++) {
+            sum += line[i];
+        }
+        m_slowtime_samples.push_back(sum/static_cast<float>(m_settings.gate_length));
+    }
+    compute_new_spectra();
+    discard_old_samples();
+}
+
+void SpectralDopplerProcessor::add_firings(const std::complex<float>* iq_samples, int num_firings, int num_samples) {
+    const int gate_end = m_settings.gate_start + m_settings.gate_length;
+    if (num_samples < gate_end) {
+        throw std::runtime_error("range gate is outside the IQ line");
+    }
+    for (int firing_no = 0; firing_no < num_firings; firing_no++) {
+        const auto firing = iq_samples + static_cast<size_t>(num_samples)*firing_no;
+        std::complex<float> sum(0.0f, 0.0f);
+        for (int i = m_settings.gate_start; i < gate_end; i++) {
+            sum += firing[i];
+        }
+        m_slowtime_samples.push_back(sum/static_cast<float>(m_settings.gate_length));
+    }
+    compute_new_spectra();
+    discard_old_samples();
+}
+
+void SpectralDopplerProcessor::clear() {
+    m_slowtime_samples.clear();
+    m_first_firing = 0;
+    m_spectra.clear();
+    m_num_spectra = 0;
+    m_max_magnitude = 0.0f;
+}
+
+size_t SpectralDopplerProcessor::get_num_firings() const {
+    return m_first_firing + m_slowtime_samples.size();
+}
+
+size_t SpectralDopplerProcessor::get_num_spectra() const {
+    return m_num_spectra;
+}
+
+size_t SpectralDopplerProcessor::get_first_spectrum() const {
+    const size_t max_spectra = m_settings.max_spectra;
+    return (m_num_spectra > max_spectra) ? m_num_spectra - max_spectra : 0;
+}
+
+std::vector<std::complex<float>> SpectralDopplerProcessor::get_slowtime_samples() const {
+    const auto first_kept = get_first_spectrum()*m_settings.hop - m_first_firing;
+    return std::vector<std::complex<float>>(m_slowtime_samples.begin() + first_kept, m_slowtime_samples.end());
+}
+
+std::vector<std::complex<float>> SpectralDopplerProcessor::get_spectra() const {
+    const size_t fft_length = m_settings.fft_length;
+    std::vector<std::complex<float>> res;
+    res.reserve((m_num_spectra - get_first_spectrum())*fft_length);
+    for (size_t spectrum_no = get_first_spectrum(); spectrum_no < m_num_spectra; spectrum_no++) {
+        const auto first = m_spectra.begin() + (spectrum_no % m_settings.max_spectra)*fft_length;
+        res.insert(res.end(), first, first + fft_length);
+    }
+    return res;
+}
+
+void SpectralDopplerProcessor::discard_old_samples() {
+    // Erased in bulk when at least half of the samples are unused, which
+    // keeps the cost per firing constant.
+    const auto num_unused = get_first_spectrum()*m_settings.hop - m_first_firing;
+    if (num_unused > 0 && 2*num_unused >= m_slowtime_samples.size()) {
+        m_slowtime_samples.erase(m_slowtime_samples.begin(), m_slowtime_samples.begin() + num_unused);
+        m_first_firing += num_unused;
+    }
+}
+
+void SpectralDopplerProcessor::compute_new_spectra() {
+    const size_t fft_length  = m_settings.fft_length;
+    const size_t hop         = m_settings.hop;
+    const size_t max_spectra = m_settings.max_spectra;
+    const size_t num_firings = get_num_firings();
+    if (num_firings < fft_length) {
+        return;
+    }
+    const size_t total_num_spectra = (num_firings - fft_length)/hop + 1;
+    if (total_num_spectra <= m_num_spectra) {
+        return;
+    }
+    m_spectra.resize(std::min(total_num_spectra, max_spectra)*fft_length);
+
+    // Spectra that would be discarded right away are skipped.
+    const size_t first_new = std::max(m_num_spectra, (total_num_spectra > max_spectra) ? total_num_spectra - max_spectra : 0);
+    const int num_new = static_cast<int>(total_num_spectra - first_new);
+    float max_magnitude = m_max_magnitude;
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        std::vector<std::complex<float>> windowed(fft_length);
+        float thread_max = 0.0f;
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (int new_no = 0; new_no < num_new; new_no++) {
+            const size_t spectrum_no = first_new + new_no;
+            const auto first_sample = m_slowtime_samples.data() + (spectrum_no*hop - m_first_firing);
+            for (size_t i = 0; i < fft_length; i++) {
+                windowed[i] = first_sample[i]*m_window[i];
+            }
+            const auto spectrum = fft(windowed);
+            // FFT shift: negative frequencies first
+            auto dest = m_spectra.data() + (spectrum_no % max_spectra)*fft_length;
+            std::copy(spectrum.begin() + fft_length/2, spectrum.end(), dest);
+            std::copy(spectrum.begin(), spectrum.begin() + fft_length/2, dest + fft_length/2);
+            for (size_t i = 0; i < fft_length; i++) {
+                thread_max = std::max(thread_max, std::abs(dest[i]));
+            }
+        }
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp critical
+#endif
+        {
+            max_magnitude = std::max(max_magnitude, thread_max);
+        }
+    }
+    m_max_magnitude = max_magnitude;
+    m_num_spectra   = total_num_spectra;
+}
+
+std::vector<unsigned char> SpectralDopplerProcessor::get_spectrogram() const {
+    return get_spectrogram(get_first_spectrum());
+}
+
+std::vector<unsigned char> SpectralDopplerProcessor::get_spectrogram(size_t first_spectrum) const {
+    if (first_spectrum > m_num_spectra) {
+        throw std::runtime_error("first spectrum is out of range");
+    }
+    if (first_spectrum < get_first_spectrum()) {
+        throw std::runtime_error("first spectrum has been discarded");
+    }
+    const size_t fft_length = m_settings.fft_length;
+    std::vector<unsigned char> pixels((m_num_spectra - first_spectrum)*fft_length);
+    float normalize_factor = m_settings.normalize_factor;
+    if (normalize_factor <= 0.0f) {
+        // all zero input: avoid that the kernel searches for the max. itself
+        normalize_factor = (m_max_magnitude > 0.0f) ? m_max_magnitude : 1.0f;
+    }
+    // The requested spectra are at most two contiguous parts of the ring.
+    const size_t max_spectra = m_settings.max_spectra;
+    size_t spectrum_no = first_spectrum;
+    auto dest = pixels.data();
+    while (spectrum_no < m_num_spectra) {
+        const size_t slot = spectrum_no % max_spectra;
+        const size_t num_contiguous = std::min(m_num_spectra - spectrum_no, max_spectra - slot);
+        log_compress_iq_frame(m_spectra.data() + slot*fft_length, num_contiguous*fft_length, dest,
+                              m_settings.dyn_range, normalize_factor, m_settings.gain_factor);
+        spectrum_no += num_contiguous;
+        dest += num_contiguous*fft_length;
+    }
+    return pixels;
+}
+
+void SpectralDopplerProcessor::write_audio(const std::string& wav_file, float prf, int audio_sample_rate) const {
+    if (prf <= 0.0f || audio_sample_rate <= 0) {
+        throw std::runtime_error("PRF and audio sample rate must be positive");
+    }
+    const auto slowtime_samples = get_slowtime_samples();
+    const auto num_firings = slowtime_samples.size();
+    if (num_firings < 2) {
+        throw std::runtime_error("too few firings for audio");
+    }
+
+    // Split the slow-time signal into positive and negative Doppler
+    // frequencies. The real part of each half is an audible signal.
+    const size_t padded_length = next_power_of_two(num_firings);
+    std::vector<std::complex<float>> padded(padded_length);
+    std::copy(slowtime_samples.begin(), slowtime_samples.end(), padded.begin());
+    const auto spectrum = fft(padded);
+    std::vector<std::complex<float>> forward_spectrum(padded_length);
+    std::vector<std::complex<float>> reverse_spectrum(padded_length);
+    for (size_t k = 1; k < padded_length/2; k++) {
+        forward_spectrum[k] = spectrum[k];
+        reverse_spectrum[padded_length - k] = spectrum[padded_length - k];
+    }
+    // The Nyquist frequency is shared, and DC is silent.
+    forward_spectrum[padded_length/2] = 0.5f*spectrum[padded_length/2];
+    reverse_spectrum[padded_length/2] = 0.5f*spectrum[padded_length/2];
+    const auto forward = ifft(forward_spectrum);
+    const auto reverse = ifft(reverse_spectrum);
+
+    const double duration = (num_firings - 1)/static_cast<double>(prf);
+    const size_t num_audio_samples = static_cast<size_t>(duration*audio_sample_rate) + 1;
+    std::vector<float> resampled(2*num_audio_samples);
+    float max_value = 0.0f;
+    for (size_t i = 0; i < num_audio_samples; i++) {
+        const double pos = i*static_cast<double>(prf)/audio_sample_rate;
+        const size_t index = std::min(static_cast<size_t>(pos), num_firings - 2);
+        const float frac = static_cast<float>(pos - index);
+        resampled[2*i]     = (1.0f - frac)*forward[index].real() + frac*forward[index+1].real();
+        resampled[2*i + 1] = (1.0f - frac)*reverse[index].real() + frac*reverse[index+1].real();
+        max_value = std::max(max_value, std::max(std::abs(resampled[2*i]), std::abs(resampled[2*i + 1])));
+    }
+    const float scale = (max_value > 0.0f) ? 32000.0f/max_value : 0.0f;
+    std::vector<int16_t> audio_samples(2*num_audio_samples);
+    for (size_t i = 0; i < audio_samples.size(); i++) {
+        audio_samples[i] = static_cast<int16_t>(scale*resampled[i]);
+    }
+    write_wav_file(wav_file, audio_samples, 2, audio_sample_rate);
+}
+
+}   // end namespace
@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <complex>
+#include <string>
+#include "../core/export_macros.hpp"
+
+namespace bcsim {
+
+// Spectral (PW) Doppler processing of a stream of firings along the same
+// line. Every firing is reduced to one slow-time sample by averaging the IQ
+// samples inside the range gate. Spectra are computed with a sliding
+// Hann-windowed FFT of fft_length slow-time samples, advanced by hop samples.
+// Firings can be added one at a time or in batches as they are simulated, and
+// new spectra are computed as soon as enough samples are available.
+//
+// Only the last max_spectra spectra are kept, together with the slow-time
+// samples they were computed from, so memory stays bounded when streaming.
+// Spectra are numbered from the first firing, also after older ones have
+// been discarded.
+//
+// Spectra are stored FFT-shifted, i.e. bin 0 is the frequency -PRF/2 and bin
+// fft_length/2 is zero frequency.
+class DLL_PUBLIC SpectralDopplerProcessor {
+public:
+    struct Settings {
+        Settings() : fft_length(256), hop(5), gate_start(0), gate_length(1),
+                     dyn_range(60.0f), normalize_factor(0.0f), gain_factor(1.0f),
+                     max_spectra(1024) { }
+
+        // FFT length in slow-time samples. Must be a power of two.
+        int fft_length;
+
+        // Number of slow-time samples between consecutive spectra.
+        int hop;
+
+        // Range gate: first sample index and number of samples.
+        int gate_start;
+        int gate_length;
+
+        // Log-compression of the spectrogram, see log_compress_frame().
+        // If normalize_factor is not positive, the max. spectral magnitude so
+        // far is used.
+        float dyn_range;
+        float normalize_factor;
+        float gain_factor;
+
+        // Number of most recent spectra to keep.
+        int max_spectra;
+    };
+
+    SpectralDopplerProcessor(const Settings& settings = Settings());
+
+    // Add one firing of num_samples IQ samples. Must cover the range gate.
+    void add_firing(const std::complex<float>* iq_samples, int num_samples);
+
+    // Add a batch of firings, e.g. all lines returned by simulate_lines().
+    void add_firings(const std::vector<std::vector<std::complex<float>>>& iq_lines);
+
+    // Add a batch of firings stored contiguously firing by firing.
+    void add_firings(const std::complex<float>* iq_samples, int num_firings, int num_samples);
+
+    // Remove all firings and spectra.
+    void clear();
+
+    // Number of firings added since construction or clear().
+    size_t get_num_firings() const;
+
+    // Number of spectra computed since construction or clear().
+    size_t get_num_spectra() const;
+
+    // Number of the oldest spectrum that is kept.
+    size_t get_first_spectrum() const;
+
+    // Gated slow-time signal of the kept firings, one sample per firing.
+    std::vector<std::complex<float>> get_slowtime_samples() const;
+
+    // Kept complex spectra [num_spectra-first_spectrum, fft_length], oldest first.
+    std::vector<std::complex<float>> get_spectra() const;
+
+    // Log-compressed spectrogram [num_spectra-first_spectrum, fft_length] of
+    // the spectra starting at first_spectrum, which must not have been
+    // discarded. For streaming display, pass the number of spectra already
+    // fetched.
+    std::vector<unsigned char> get_spectrogram(size_t first_spectrum) const;
+
+    // Log-compressed spectrogram of all kept spectra, starting at get_first_spectrum().
+    std::vector<unsigned char> get_spectrogram() const;
+
+    // Store the audible Doppler signal of the kept firings as a stereo 16-bit
+    // WAV file. The positive Doppler frequencies (flow towards the
+    // transducer) are in the left channel and the negative frequencies in the
+    // right channel. Both are resampled from the PRF to audio_sample_rate
+    // with linear interpolation and normalized to full scale together.
+    void write_audio(const std::string& wav_file, float prf, int audio_sample_rate = 44100) const;
+
+private:
+    void compute_new_spectra();
+
+    // Drop the slow-time samples that no kept or future spectrum needs.
+    void discard_old_samples();
+
+private:
+    Settings                            m_settings;
+    std::vector<float>                  m_window;
+    // Slow-time samples from firing number m_first_firing and on.
+    std::vector<std::complex<float>>    m_slowtime_samples;
+    size_t                              m_first_firing;
+    // Ring of max_spectra spectra, spectrum n is in slot n % max_spectra.
+    std::vector<std::complex<float>>    m_spectra;
+    size_t                              m_num_spectra;
+    float                               m_max_magnitude;
+};
+
+}   // end namespace
@@ -0,0 +1,266 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include "VolumePhantom.hpp"
+#include "SimpleHDF.hpp"
+#include "../core/Tracing.hpp"
+
+namespace bcsim {
+namespace {
+
+// The voxels with non-zero probability and an alias table over them, so that
+// a voxel can be drawn in constant time (Vose's method).
+struct VoxelAliasTable {
+    std::vector<uint32_t>   voxel_indices;
+    std::vector<float>      probabilities;
+    std::vector<uint32_t>   aliases;
+};
+
+// Number of blocks used to collect the non-empty voxels in parallel.
+const int NUM_COMPACTION_BLOCKS = 256;
+
+VoxelAliasTable create_alias_table(const IntensityVolume& volume, float density_exponent) {
+    ScopedTraceEvent trace_event("create_alias_table", "phantom");
+    const auto num_voxels = volume.values.size();
+    const auto voxel_weight = [&](size_t i) {
+        const auto v = volume.values[i];
+        if (!(v > 0.0f)) {
+            return 0.0;
+        }
+        return (density_exponent == 1.0f) ? static_cast<double>(v) : std::pow(static_cast<double>(v), static_cast<double>(density_exponent));
+    };
+
+    // Collect the non-empty voxels, keeping their order.
+    std::vector<size_t> block_offsets(NUM_COMPACTION_BLOCKS + 1, 0);
+    const auto block_size = (num_voxels + NUM_COMPACTION_BLOCKS - 1)/NUM_COMPACTION_BLOCKS;
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int block_no = 0; block_no < NUM_COMPACTION_BLOCKS; block_no++) {
+        const auto end = std::min(num_voxels, (block_no + 1)*block_size);
+        for (size_t i = block_no*block_size; i < end; i++) {
+            block_offsets[block_no + 1] += (voxel_weight(i) > 0.0) ? 1 : 0;
+        }
+    }
+    for (int block_no = 0; block_no < NUM_COMPACTION_BLOCKS; block_no++) {
+        block_offsets[block_no + 1] += block_offsets[block_no];
+    }
+    const auto num_entries = block_offsets.back();
+    if (num_entries == 0) {
+        throw std::runtime_error("intensity volume has no positive voxels");
+    }
+
+    VoxelAliasTable table;
+    table.voxel_indices.resize(num_entries);
+    std::vector<double> weights(num_entries);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int block_no = 0; block_no < NUM_COMPACTION_BLOCKS; block_no++) {
+        auto entry_no = block_offsets[block_no];
+        const auto end = std::min(num_voxels, (block_no + 1)*block_size);
+        for (size_t i = block_no*block_size; i < end; i++) {
+            const auto weight = voxel_weight(i);
+            if (weight > 0.0) {
+                table.voxel_indices[entry_no] = static_cast<uint32_t>(i);
+                weights[entry_no] = weight;
+                entry_no++;
+            }
+        }
+    }
+
+    // Scale so that the mean is one and pair each entry below one with one above.
+    double weight_sum = 0.0;
+    for (auto weight : weights) {
+        weight_sum += weight;
+    }
+    const auto scale = num_entries/weight_sum;
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < num_entries; i++) {
+        weights[i] *= scale;
+        if (weights[i] < 1.0) {
+            small.push_back(static_cast<uint32_t>(i));
+        } else {
+            large.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    table.probabilities.assign(num_entries, 1.0f);
+    table.aliases.resize(num_entries);
+    for (size_t i = 0; i < num_entries; i++) {
+        table.aliases[i] = static_cast<uint32_t>(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        const auto s = small.back();
+        const auto l = large.back();
+        small.pop_back();
+        table.probabilities[s] = static_cast<float>(weights[s]);
+        table.aliases[s] = l;
+        weights[l] = (weights[l] + weights[s]) - 1.0;
+        if (weights[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Entries left in either list are one up to rounding errors.
+    trace_event.set_arg("num_entries", static_cast<int64_t>(num_entries));
+    return table;
+}
+
+// Draw the scatterers of one chunk.
+FixedScatterers::s_ptr sample_chunk(const IntensityVolume& volume, const VolumeSamplingParameters& params,
+                                    const VoxelAliasTable& table, uint32_t chunk_no, size_t num_scatterers) {
+    std::seed_seq seed_seq{params.seed, chunk_no};
+    std::mt19937_64 random_engine(seed_seq);
+    std::normal_distribution<float> normal_dist(0.0f, 1.0f);
+    const auto uniform = [&]() {
+        return static_cast<float>(random_engine() >> 40)*(1.0f/16777216.0f);
+    };
+    const auto num_entries = table.voxel_indices.size();
+    std::uniform_int_distribution<size_t> entry_dist(0, num_entries - 1);
+    const auto num_yz = static_cast<size_t>(volume.num_voxels[1])*volume.num_voxels[2];
+
+    auto res = std::make_shared<FixedScatterers>();
+    res->scatterers.resize(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        const auto entry_no = entry_dist(random_engine);
+        const auto voxel = table.voxel_indices[(uniform() < table.probabilities[entry_no]) ? entry_no : table.aliases[entry_no]];
+        const auto ix = voxel/num_yz;
+        const auto iy = (voxel/volume.num_voxels[2]) % volume.num_voxels[1];
+        const auto iz = voxel % volume.num_voxels[2];
+
+        // Uniform jitter within the voxel.
+        auto& scatterer = res->scatterers[i];
+        scatterer.pos = volume.origin + vector3(volume.spacing.x*(ix + uniform() - 0.5f),
+                                                volume.spacing.y*(iy + uniform() - 0.5f),
+                                                volume.spacing.z*(iz + uniform() - 0.5f));
+        scatterer.amplitude = normal_dist(random_engine);
+        if (params.amplitude_exponent != 0.0f) {
+            scatterer.amplitude *= std::pow(volume.values[voxel], params.amplitude_exponent);
+        }
+    }
+    return res;
+}
+
+}   // end anonymous namespace
+
+IntensityVolume loadIntensityVolumeFromHdf(const std::string& h5_file, const std::string& dataset_name) {
+    ScopedTraceEvent trace_event("load_intensity_volume", "io");
+    SimpleHDF::SimpleHDF5Reader reader(h5_file);
+    IntensityVolume volume;
+    try {
+        auto dataset = reader.getDataSet(dataset_name);
+        const auto dims = SimpleHDF::SimpleHDF5Reader::getDimensions(dataset);
+        if (dims.size() != 3) {
+            throw std::runtime_error("intensity volume must have three dimensions");
+        }
+        for (int k = 0; k < 3; k++) {
+            volume.num_voxels[k] = dims[k];
+        }
+        volume.values.resize(static_cast<size_t>(dims[0])*dims[1]*dims[2]);
+        dataset.read(volume.values.data(), H5::PredType::NATIVE_FLOAT);
+    } catch (...) {
+        SimpleHDF::rethrowWithContext("failed to load intensity volume " + dataset_name + " from " + h5_file);
+    }
+
+    // Optional datasets.
+    const auto read_vector = [&](const std::string& name, float default_value) {
+        if (!reader.exists(name)) {
+            return vector3(default_value, default_value, default_value);
+        }
+        const auto values = reader.readStdVector<float>(name);
+        if (values.size() != 3) {
+            throw std::runtime_error(name + " in " + h5_file + " must have three elements");
+        }
+        return vector3(values[0], values[1], values[2]);
+    };
+    volume.origin  = read_vector("origin", 0.0f);
+    volume.spacing = read_vector("spacing", 1e-3f);
+    return volume;
+}
+
+void sampleIntensityVolume(const IntensityVolume& volume, const VolumeSamplingParameters& params, ScattererChunkCallback callback) {
+    ScopedTraceEvent trace_event("sample_intensity_volume", "phantom");
+    const auto num_voxels = static_cast<size_t>(volume.num_voxels[0])*volume.num_voxels[1]*volume.num_voxels[2];
+    if ((volume.num_voxels[0] <= 0) || (volume.num_voxels[1] <= 0) || (volume.num_voxels[2] <= 0) || (volume.values.size() != num_voxels)) {
+        throw std::runtime_error("invalid intensity volume dimensions");
+    }
+    if (num_voxels > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("intensity volume has too many voxels");
+    }
+    if (params.chunk_size == 0) {
+        throw std::runtime_error("chunk size must be positive");
+    }
+    const auto table = create_alias_table(volume, params.density_exponent);
+
+    // Chunks are made in rounds of one per thread and passed on in order.
+#ifdef BCSIM_ENABLE_OPENMP
+    const int round_size = omp_get_max_threads();
+#else
+    const int round_size = 1;
+#endif
+    const auto num_chunks = (params.num_scatterers + params.chunk_size - 1)/params.chunk_size;
+    std::vector<FixedScatterers::s_ptr> chunks(round_size);
+    for (size_t first_chunk = 0; first_chunk < num_chunks; first_chunk += round_size) {
+        const auto num_round_chunks = static_cast<int>(std::min<size_t>(round_size, num_chunks - first_chunk));
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < num_round_chunks; i++) {
+            const auto chunk_no = first_chunk + i;
+            const auto chunk_size = std::min(params.chunk_size, params.num_scatterers - chunk_no*params.chunk_size);
+            chunks[i] = sample_chunk(volume, params, table, static_cast<uint32_t>(chunk_no), chunk_size);
+        }
+        for (int i = 0; i < num_round_chunks; i++) {
+            callback(chunks[i]);
+            chunks[i].reset();
+        }
+    }
+}
+
+FixedScatterers::s_ptr sampleIntensityVolume(const IntensityVolume& volume, const VolumeSamplingParameters& params) {
+    auto res = std::make_shared<FixedScatterers>();
+    res->scatterers.reserve(params.num_scatterers);
+    sampleIntensityVolume(volume, params, [&](FixedScatterers::s_ptr chunk) {
+        for (const auto& scatterer : chunk->scatterers) {
+            res->scatterers.push_back(scatterer);
+        }
+    });
+    return res;
+}
+
+}   // end namespace
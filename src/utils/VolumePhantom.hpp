@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+
+// Phantoms from 3D intensity volumes, e.g. echogenicity maps derived from
+// CT or MR data, where the density and amplitude of the scatterers follow
+// the voxel values.
+
+namespace bcsim {
+
+// Voxel values on a regular grid. Voxel (i, j, k) is centered at
+// origin + (i*spacing.x, j*spacing.y, k*spacing.z).
+struct IntensityVolume {
+    int                 num_voxels[3];
+    vector3             origin;
+    vector3             spacing;
+    // Row-major [x, y, z] order.
+    std::vector<float>  values;
+};
+
+// Load a volume from a [num_x, num_y, num_z] dataset. The geometry is read from
+// the "origin" and "spacing" datasets of length three if they exist, otherwise
+// the origin is zero and the spacing is one millimeter.
+IntensityVolume DLL_PUBLIC loadIntensityVolumeFromHdf(const std::string& h5_file, const std::string& dataset = "intensity");
+
+struct VolumeSamplingParameters {
+    VolumeSamplingParameters()
+        : num_scatterers(1000000),
+          density_exponent(1.0f),
+          amplitude_exponent(0.0f),
+          seed(1),
+          chunk_size(1 << 20) { }
+
+    size_t      num_scatterers;
+
+    // A voxel with value v > 0 gets scatterers with probability proportional
+    // to v^density_exponent. Voxels with v <= 0 are empty.
+    float       density_exponent;
+
+    // Amplitudes are standard Gaussian times v^amplitude_exponent.
+    float       amplitude_exponent;
+
+    // The result only depends on the seed and the chunk size, not on the
+    // number of threads.
+    uint32_t    seed;
+
+    // Number of scatterers in each chunk passed to the callback.
+    size_t      chunk_size;
+};
+
+// Receives the chunks of a phantom in order.
+typedef std::function<void(FixedScatterers::s_ptr)> ScattererChunkCallback;
+
+// Draw scatterers by importance sampling of the voxels with an alias table,
+// with uniform jitter inside each voxel. Chunks are generated in parallel,
+// and at most one chunk per thread is kept in memory at a time.
+void DLL_PUBLIC sampleIntensityVolume(const IntensityVolume& volume, const VolumeSamplingParameters& params,
+                                      ScattererChunkCallback callback);
+
+// Same as above, but returns all scatterers at once.
+FixedScatterers::s_ptr DLL_PUBLIC sampleIntensityVolume(const IntensityVolume& volume, const VolumeSamplingParameters& params);
+
+}   // end namespace
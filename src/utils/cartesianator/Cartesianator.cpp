@@ -29,13 +29,34 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
 #include "Cartesianator.hpp"
+#include "../../core/Tracing.hpp"
+
+namespace {
+
+// Parameters which determine the interpolation table for a geometry.
+std::vector<float> get_geometry_params(bcsim::ScanGeometry::ptr geometry) {
+    auto sector_geo = std::dynamic_pointer_cast<bcsim::SectorScanGeometry>(geometry);
+    auto linear_geo = std::dynamic_pointer_cast<bcsim::LinearScanGeometry>(geometry);
+    if (sector_geo) {
+        return {0.0f, sector_geo->width, sector_geo->depth, sector_geo->tilt};
+    } else if (linear_geo) {
+        return {1.0f, linear_geo->width, linear_geo->range_max};
+    }
+    return {};
+}
+
+}   // end anonymous namespace
 
 template <typename T>
 CpuCartesianator<T>::CpuCartesianator() 
     : m_num_samples_x(512),
       m_num_samples_y(512),
-      m_geometry(nullptr)
+      m_geometry(nullptr),
+      m_lut_valid(false),
+      m_lut_num_beams(0),
+      m_lut_num_range(0)
 {
     UpdateOutputBuffer();           
 }
@@ -44,6 +65,13 @@ template <typename T>
 void CpuCartesianator<T>::SetGeometry(bcsim::ScanGeometry::ptr geometry) {
     m_geometry = geometry;
     geometry->get_xy_extent(m_x_min, m_x_max, m_y_min, m_y_max);
+
+    // Setting an identical geometry for every frame is cheap.
+    auto geometry_params = get_geometry_params(geometry);
+    if (geometry_params != m_geometry_params) {
+        m_geometry_params = geometry_params;
+        m_lut_valid = false;
+    }
 }
 
 template <typename T>
@@ -54,9 +82,13 @@ const T* CpuCartesianator<T>::GetOutputBuffer() {
 template <typename T>
 void CpuCartesianator<T>::SetOutputSize(size_t num_samples_x,
                                         size_t num_samples_y) {
+    if (num_samples_x == m_num_samples_x && num_samples_y == m_num_samples_y) {
+        return;
+    }
     m_num_samples_x = num_samples_x;
     m_num_samples_y = num_samples_y;
     UpdateOutputBuffer();
+    m_lut_valid = false;
 }
 
 template <typename T>
@@ -71,26 +103,115 @@ void CpuCartesianator<T>::Process(T* in_buffer, int num_beams, int num_samples)
     if (!m_geometry) {
         throw std::runtime_error("geometry not configured");
     }
+    if (num_beams < 2 || num_samples < 2) {
+        throw std::runtime_error("at least two beams with two samples are required");
+    }
+    bcsim::ScopedTraceEvent trace_event("scan_conversion", "display");
+    if (!m_lut_valid || num_beams != m_lut_num_beams || num_samples != m_lut_num_range) {
+        UpdateLookupTable(num_beams, num_samples);
+    }
+
+    // Gather and blend row by row, so that writes are contiguous.
+    const int num_rows = static_cast<int>(m_num_samples_y);
+    const size_t num_cols = m_num_samples_x;
+    const size_t beam_stride = static_cast<size_t>(num_samples);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int yi = 0; yi < num_rows; yi++) {
+        const size_t row_offset = num_cols*yi;
+        const int*   index = m_lut_index.data() + row_offset;
+        const float* w00   = m_lut_w00.data() + row_offset;
+        const float* w10   = m_lut_w10.data() + row_offset;
+        const float* w01   = m_lut_w01.data() + row_offset;
+        const float* w11   = m_lut_w11.data() + row_offset;
+        T* out = m_output_buffer.data() + row_offset;
+        for (size_t xi = 0; xi < num_cols; xi++) {
+            const T* taps = in_buffer + index[xi];
+            const float value = w00[xi]*taps[0]
+                              + w10[xi]*taps[1]
+                              + w01[xi]*taps[beam_stride]
+                              + w11[xi]*taps[beam_stride+1];
+            out[xi] = static_cast<T>(value);
+        }
+    }
+}
+
+template <typename T>
+void CpuCartesianator<T>::UpdateOutputBuffer() {
+    auto num_samples = m_num_samples_x*m_num_samples_y;
+    m_output_buffer.resize(num_samples);
+}
+
+template <typename T>
+void CpuCartesianator<T>::UpdateLookupTable(int num_beams, int num_range) {
     auto sector_geo = std::dynamic_pointer_cast<bcsim::SectorScanGeometry>(m_geometry);
     auto linear_geo = std::dynamic_pointer_cast<bcsim::LinearScanGeometry>(m_geometry);
     if (sector_geo) {
-        DoSectorTransform(in_buffer, num_beams, num_samples, sector_geo);
+        SetupSectorTable(num_beams, num_range, sector_geo);
     } else if (linear_geo) {
-        DoLinearTransform(in_buffer, num_beams, num_samples, linear_geo);
+        SetupLinearTable(num_beams, num_range, linear_geo);
     } else {
         throw std::runtime_error("unknown geometry");
     }
+    m_lut_num_beams = num_beams;
+    m_lut_num_range = num_range;
+    m_lut_valid = true;
 }
 
 template <typename T>
-void CpuCartesianator<T>::UpdateOutputBuffer() {
-    auto num_samples = m_num_samples_x*m_num_samples_y;
-    m_output_buffer.resize(num_samples);
+template <typename MapFunc>
+void CpuCartesianator<T>::FillLookupTable(int num_beams, int num_range, MapFunc map_to_beamspace) {
+    const auto num_pixels = m_num_samples_x*m_num_samples_y;
+    m_lut_index.resize(num_pixels);
+    m_lut_w00.resize(num_pixels);
+    m_lut_w10.resize(num_pixels);
+    m_lut_w01.resize(num_pixels);
+    m_lut_w11.resize(num_pixels);
+
+    const int num_rows = static_cast<int>(m_num_samples_y);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int yi = 0; yi < num_rows; yi++) {
+        for (size_t xi = 0; xi < m_num_samples_x; xi++) {
+            float range_pos, beam_pos;
+            map_to_beamspace(xi, static_cast<size_t>(yi), range_pos, beam_pos);
+
+            const int r_idx0 = static_cast<int>(std::floor(range_pos));
+            const int t_idx0 = static_cast<int>(std::floor(beam_pos));
+            const float r_frac = range_pos - r_idx0;
+            const float t_frac = beam_pos - t_idx0;
+
+            // Taps outside of beam space contribute zero. The base index is
+            // clamped so that all four reads are inside the input buffer, and
+            // the weights of the remaining taps are moved accordingly.
+            const int r_base = std::min(std::max(r_idx0, 0), num_range-2);
+            const int t_base = std::min(std::max(t_idx0, 0), num_beams-2);
+            float weights[2][2] = {{0.0f, 0.0f}, {0.0f, 0.0f}};
+            for (int dr = 0; dr < 2; dr++) {
+                for (int dt = 0; dt < 2; dt++) {
+                    const int r_idx = r_idx0 + dr;
+                    const int t_idx = t_idx0 + dt;
+                    if (r_idx < 0 || r_idx >= num_range || t_idx < 0 || t_idx >= num_beams) continue;
+                    const float weight = (dr ? r_frac : 1.0f-r_frac)*(dt ? t_frac : 1.0f-t_frac);
+                    weights[r_idx-r_base][t_idx-t_base] += weight;
+                }
+            }
+
+            const size_t offset = m_num_samples_x*yi + xi;
+            m_lut_index[offset] = num_range*t_base + r_base;
+            m_lut_w00[offset] = weights[0][0];
+            m_lut_w10[offset] = weights[1][0];
+            m_lut_w01[offset] = weights[0][1];
+            m_lut_w11[offset] = weights[1][1];
+        }
+    }
 }
 
 template <typename T>
-void CpuCartesianator<T>::DoSectorTransform(T* in_buffer, int num_beams, int num_range,
-                                            std::shared_ptr<bcsim::SectorScanGeometry> geometry) {
+void CpuCartesianator<T>::SetupSectorTable(int num_beams, int num_range,
+                                           std::shared_ptr<bcsim::SectorScanGeometry> geometry) {
 
     // deltas for cartesian grid
     const auto dx = (m_x_max - m_x_min) / (m_num_samples_x-1);
@@ -106,54 +227,27 @@ void CpuCartesianator<T>::DoSectorTransform(T* in_buffer, int num_beams, int num
     const auto dr = (range_max - range_min) / (num_range-1);
     const auto dt = (theta_max - theta_min) / (num_beams-1);
 
-    // For each output sample determine index of closest beamspace sample
-    for (size_t xi = 0; xi < m_num_samples_x; xi++) {
-        for (size_t yi = 0; yi < m_num_samples_y; yi++) {
-            float x = m_x_min + xi*dx;
-            float y = m_y_min + yi*dy;
-
-            // Map (x, y) to (r, theta)
-            float r = std::sqrt(x*x+y*y);
-            float theta;
-            if (std::abs(x) > 1e-6) {
-                theta = std::atan2(y, x);
-            } else {
-                // Avoid division by zero. TODO: Can this be solved more elegant?
-                theta = static_cast<float>(std::atan(1)*2);
-            }
-
-            float value = 0.0f;
-
-            int r_idx0 = static_cast<int>(std::floor( (r - range_min) / dr ));
-            int t_idx0 = static_cast<int>(std::floor( (theta - theta_min) / dt));
-            int r_idx1 = r_idx0 + 1;
-            int t_idx1 = t_idx0 + 1;
-
-            float sample00 = (r_idx0 >= 0 && r_idx0 < num_range && t_idx0 >= 0 && t_idx0 < num_beams) ? in_buffer[num_range*t_idx0 + r_idx0] : 0.0f;
-            float sample01 = (r_idx0 >= 0 && r_idx0 < num_range && t_idx1 >= 0 && t_idx1 < num_beams) ? in_buffer[num_range*t_idx1 + r_idx0] : 0.0f;
-            float sample10 = (r_idx1 >= 0 && r_idx1 < num_range && t_idx0 >= 0 && t_idx0 < num_beams) ? in_buffer[num_range*t_idx0 + r_idx1] : 0.0f;
-            float sample11 = (r_idx1 >= 0 && r_idx1 < num_range && t_idx1 >= 0 && t_idx1 < num_beams) ? in_buffer[num_range*t_idx1 + r_idx1] : 0.0f;
-            float range0 = range_min + r_idx0*dr;
-            float range1 = range0 + dr;
-            float theta0 = theta_min + t_idx0*dt;
-            float theta1 = theta0 + dt;
-
-            // Use Wikipedia formula
-            value = 1.0f/((range1-range0)*(theta1-theta0))*( sample00*(range1-r)*(theta1-theta)
-                                                            +sample10*(r-range0)*(theta1-theta)
-                                                            +sample01*(range1-r)*(theta-theta0)
-                                                            +sample11*(r-range0)*(theta-theta0));
-
-
-            size_t res_offset = static_cast<size_t>(m_num_samples_x*yi + xi);
-            m_output_buffer[res_offset] = static_cast<T>(value);
+    FillLookupTable(num_beams, num_range, [&](size_t xi, size_t yi, float& range_pos, float& beam_pos) {
+        float x = m_x_min + xi*dx;
+        float y = m_y_min + yi*dy;
+
+        // Map (x, y) to (r, theta)
+        float r = std::sqrt(x*x+y*y);
+        float theta;
+        if (std::abs(x) > 1e-6) {
+            theta = std::atan2(y, x);
+        } else {
+            // Avoid division by zero. TODO: Can this be solved more elegant?
+            theta = static_cast<float>(std::atan(1)*2);
         }
-    }
+        range_pos = (r - range_min) / dr;
+        beam_pos  = (theta - theta_min) / dt;
+    });
 }
 
 template <typename T>
-void CpuCartesianator<T>::DoLinearTransform(T* in_buffer, int num_beams, int num_range,
-                                            std::shared_ptr<bcsim::LinearScanGeometry> geometry) {
+void CpuCartesianator<T>::SetupLinearTable(int num_beams, int num_range,
+                                           std::shared_ptr<bcsim::LinearScanGeometry> geometry) {
     // deltas for cartesian grid
     const auto dx = (m_x_max - m_x_min) / (m_num_samples_x-1);
     const auto dy = (m_y_max - m_y_min) / (m_num_samples_y-1);
@@ -168,40 +262,12 @@ void CpuCartesianator<T>::DoLinearTransform(T* in_buffer, int num_beams, int num
     const float bs_dx = (x_max-x_min) / (num_beams-1);
     const float bs_dy = (y_max-y_min) / (num_range-1);
 
-    // for each output sample determine index of closest beamspace sample
-    for (size_t xi = 0; xi < m_num_samples_x; xi++) {
-        for (size_t yi = 0; yi < m_num_samples_y; yi++) {
-            float x = m_x_min + xi*dx;
-            float y = m_y_min + yi*dy;
-
-            // map to inds
-            int x_idx0 = static_cast<int>(std::floor( (x - x_min) / bs_dx ));
-            int y_idx0 = static_cast<int>(std::floor( (y - y_min) / bs_dy ));
-            int x_idx1 = x_idx0 + 1;
-            int y_idx1 = y_idx0 + 1;
-
-            float value = 0.0f;
-
-
-            float sample00 = (y_idx0 >= 0 && y_idx0 < num_range && x_idx0 >= 0 && x_idx0 < num_beams) ? in_buffer[num_range*x_idx0 + y_idx0] : 0.0f;
-            float sample01 = (y_idx0 >= 0 && y_idx0 < num_range && x_idx1 >= 0 && x_idx1 < num_beams) ? in_buffer[num_range*x_idx1 + y_idx0] : 0.0f;
-            float sample10 = (y_idx1 >= 0 && y_idx1 < num_range && x_idx0 >= 0 && x_idx0 < num_beams) ? in_buffer[num_range*x_idx0 + y_idx1] : 0.0f;
-            float sample11 = (y_idx1 >= 0 && y_idx1 < num_range && x_idx1 >= 0 && x_idx1 < num_beams) ? in_buffer[num_range*x_idx1 + y_idx1] : 0.0f;
-            float y0 = y_min + y_idx0*bs_dy;
-            float y1 = y0 + bs_dy;
-            float x0 = x_min + x_idx0*bs_dx;
-            float x1 = x0 + bs_dx;
-
-            // Use Wikipedia formula
-            value = 1.0f/((y1-y0)*(x1-x0))*( sample00*(y1-y)*(x1-x)
-                                            +sample10*(y-y0)*(x1-x)
-                                            +sample01*(y1-y)*(x-x0)
-                                            +sample11*(y-y0)*(x-x0));
-
-            size_t res_offset = static_cast<size_t>(m_num_samples_x*yi + xi);
-            m_output_buffer[res_offset] = static_cast<T>(value);
-        }
-    }
+    FillLookupTable(num_beams, num_range, [&](size_t xi, size_t yi, float& range_pos, float& beam_pos) {
+        float x = m_x_min + xi*dx;
+        float y = m_y_min + yi*dy;
+        range_pos = (y - y_min) / bs_dy;
+        beam_pos  = (x - x_min) / bs_dx;
+    });
 }
 
 // explicit instantiations for the required datatypes.
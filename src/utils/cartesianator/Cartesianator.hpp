@@ -63,6 +63,9 @@ public:
                          int num_samples)                       = 0;
 };
 
+// Uses a bilinear interpolation table with one entry per output pixel, which
+// is rebuilt only when the geometry, the output size or the beam space
+// dimensions change.
 template <typename T>
 class DLL_PUBLIC CpuCartesianator : public ICartesianator<T> {
 public:
@@ -84,11 +87,18 @@ private:
 
     void UpdateOutputBuffer();
 
-    void DoSectorTransform(T* in_buffer, int num_beams, int num_range,
-                           std::shared_ptr<bcsim::SectorScanGeometry> geometry);
+    void UpdateLookupTable(int num_beams, int num_range);
 
-    void DoLinearTransform(T* in_buffer, int num_beams, int num_range,
-                           std::shared_ptr<bcsim::LinearScanGeometry> geometry);
+    void SetupSectorTable(int num_beams, int num_range,
+                          std::shared_ptr<bcsim::SectorScanGeometry> geometry);
+
+    void SetupLinearTable(int num_beams, int num_range,
+                          std::shared_ptr<bcsim::LinearScanGeometry> geometry);
+
+    // Fill the table given a mapping from output pixel (xi, yi) to
+    // fractional beam space indices (range, beam).
+    template <typename MapFunc>
+    void FillLookupTable(int num_beams, int num_range, MapFunc map_to_beamspace);
 
 private:
     bcsim::ScanGeometry::ptr    m_geometry;
@@ -96,6 +106,20 @@ private:
     size_t                      m_num_samples_x;
     size_t                      m_num_samples_y;
 
+    // Interpolation table. The taps of output pixel i are
+    // in_buffer[m_lut_index[i] + {0, 1, num_range, num_range+1}], i.e.
+    // (range, beam), (range+1, beam), (range, beam+1), (range+1, beam+1),
+    // with weights m_lut_w00, m_lut_w10, m_lut_w01 and m_lut_w11.
+    std::vector<int>            m_lut_index;
+    std::vector<float>          m_lut_w00;
+    std::vector<float>          m_lut_w10;
+    std::vector<float>          m_lut_w01;
+    std::vector<float>          m_lut_w11;
+    bool                        m_lut_valid;
+    int                         m_lut_num_beams;
+    int                         m_lut_num_range;
+    std::vector<float>          m_geometry_params;
+
     // auto-computed extents
     float   m_x_min;
     float   m_x_max;
@@ -0,0 +1,328 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include "Cartesianator3D.hpp"
+
+namespace {
+
+const float FRAC_SCALE = 65535.0f;
+
+// Fractional index is accepted as inside beam space with this tolerance, so
+// that grid points on the boundary are not lost to rounding.
+const float INDEX_TOLERANCE = 1e-3f;
+
+// Split a fractional index into base index in [0, num_samples-2] and
+// quantized fraction. Returns false if outside [0, num_samples-1].
+bool split_index(float pos, int num_samples, int& base, uint16_t& frac) {
+    if (!(pos >= -INDEX_TOLERANCE && pos <= num_samples-1+INDEX_TOLERANCE)) {
+        return false;
+    }
+    pos = std::min(std::max(pos, 0.0f), static_cast<float>(num_samples-1));
+    base = std::min(static_cast<int>(pos), num_samples-2);
+    frac = static_cast<uint16_t>((pos-base)*FRAC_SCALE + 0.5f);
+    return true;
+}
+
+}   // end anonymous namespace
+
+template <typename T>
+CpuCartesianator3D<T>::CpuCartesianator3D()
+    : m_num_samples_x(128),
+      m_num_samples_y(128),
+      m_num_samples_z(128),
+      m_num_azimuth(0),
+      m_num_elevation(0),
+      m_num_range(0),
+      m_x_min(0.0f), m_x_max(0.0f),
+      m_y_min(0.0f), m_y_max(0.0f),
+      m_z_min(0.0f), m_z_max(0.0f)
+{
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::SetGeometry(std::shared_ptr<bcsim::PyramidalScanGeometry> geometry) {
+    if (!geometry) {
+        throw std::runtime_error("invalid geometry");
+    }
+    m_geometry = geometry;
+    geometry->get_xyz_extent(m_x_min, m_x_max, m_y_min, m_y_max, m_z_min, m_z_max);
+
+    // Setting an identical geometry for every volume is cheap.
+    const std::vector<float> geometry_params = {geometry->width, geometry->elevation_width, geometry->depth,
+                                                geometry->tilt, geometry->elevation_tilt};
+    if (geometry_params != m_geometry_params) {
+        m_geometry_params = geometry_params;
+        InvalidateTables();
+    }
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::GetExtent(float& x_min, float& x_max, float& y_min, float& y_max, float& z_min, float& z_max) const {
+    x_min = m_x_min; x_max = m_x_max;
+    y_min = m_y_min; y_max = m_y_max;
+    z_min = m_z_min; z_max = m_z_max;
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::SetOutputSize(size_t num_samples_x, size_t num_samples_y, size_t num_samples_z) {
+    if (num_samples_x < 2 || num_samples_y < 2 || num_samples_z < 2) {
+        throw std::runtime_error("at least two output samples are required in each dimension");
+    }
+    if (num_samples_x == m_num_samples_x && num_samples_y == m_num_samples_y && num_samples_z == m_num_samples_z) {
+        return;
+    }
+    m_num_samples_x = num_samples_x;
+    m_num_samples_y = num_samples_y;
+    m_num_samples_z = num_samples_z;
+    InvalidateTables();
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::GetOutputSize(size_t& num_samples_x, size_t& num_samples_y, size_t& num_samples_z) const {
+    num_samples_x = m_num_samples_x;
+    num_samples_y = m_num_samples_y;
+    num_samples_z = m_num_samples_z;
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::Process(const T* in_buffer, int num_azimuth, int num_elevation, int num_range) {
+    CheckInput(num_azimuth, num_elevation, num_range);
+    auto& table = m_volume_table;
+    if (!table.valid) {
+        const auto dx = (m_x_max - m_x_min) / (m_num_samples_x-1);
+        const auto dy = (m_y_max - m_y_min) / (m_num_samples_y-1);
+        const auto dz = (m_z_max - m_z_min) / (m_num_samples_z-1);
+        const auto num_x = m_num_samples_x;
+        const auto num_xy = m_num_samples_x*m_num_samples_y;
+        FillLookupTable(table, num_xy*m_num_samples_z, [&](size_t i, float& x, float& y, float& z) {
+            x = m_x_min + (i % num_x)*dx;
+            y = m_y_min + ((i / num_x) % m_num_samples_y)*dy;
+            z = m_z_min + (i / num_xy)*dz;
+        });
+    }
+    Interpolate(table, in_buffer);
+}
+
+template <typename T>
+const T* CpuCartesianator3D<T>::GetOutputBuffer() const {
+    return m_volume_table.output.data();
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::ProcessSlice(const T* in_buffer, int num_azimuth, int num_elevation, int num_range,
+                                         SlicePlane plane, float position) {
+    CheckInput(num_azimuth, num_elevation, num_range);
+    auto& table = m_slice_tables[static_cast<int>(plane)];
+    if (!table.valid || table.position != position) {
+        const auto dx = (m_x_max - m_x_min) / (m_num_samples_x-1);
+        const auto dy = (m_y_max - m_y_min) / (m_num_samples_y-1);
+        const auto dz = (m_z_max - m_z_min) / (m_num_samples_z-1);
+        size_t num_cols, num_rows;
+        GetSliceSize(plane, num_cols, num_rows);
+        switch (plane) {
+        case SlicePlane::AZIMUTH:
+            FillLookupTable(table, num_cols*num_rows, [&](size_t i, float& x, float& y, float& z) {
+                x = m_x_min + (i % num_cols)*dx;
+                y = position;
+                z = m_z_min + (i / num_cols)*dz;
+            });
+            break;
+        case SlicePlane::ELEVATION:
+            FillLookupTable(table, num_cols*num_rows, [&](size_t i, float& x, float& y, float& z) {
+                x = position;
+                y = m_y_min + (i % num_cols)*dy;
+                z = m_z_min + (i / num_cols)*dz;
+            });
+            break;
+        case SlicePlane::CONSTANT_DEPTH:
+            FillLookupTable(table, num_cols*num_rows, [&](size_t i, float& x, float& y, float& z) {
+                x = m_x_min + (i % num_cols)*dx;
+                y = m_y_min + (i / num_cols)*dy;
+                z = position;
+            });
+            break;
+        default:
+            throw std::runtime_error("invalid slice plane");
+        }
+        table.position = position;
+    }
+    Interpolate(table, in_buffer);
+}
+
+template <typename T>
+const T* CpuCartesianator3D<T>::GetSliceBuffer(SlicePlane plane) const {
+    return m_slice_tables[static_cast<int>(plane)].output.data();
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::GetSliceSize(SlicePlane plane, size_t& num_cols, size_t& num_rows) const {
+    switch (plane) {
+    case SlicePlane::AZIMUTH:
+        num_cols = m_num_samples_x;
+        num_rows = m_num_samples_z;
+        break;
+    case SlicePlane::ELEVATION:
+        num_cols = m_num_samples_y;
+        num_rows = m_num_samples_z;
+        break;
+    case SlicePlane::CONSTANT_DEPTH:
+        num_cols = m_num_samples_x;
+        num_rows = m_num_samples_y;
+        break;
+    default:
+        throw std::runtime_error("invalid slice plane");
+    }
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::CheckInput(int num_azimuth, int num_elevation, int num_range) {
+    if (!m_geometry) {
+        throw std::runtime_error("geometry not configured");
+    }
+    if (num_azimuth < 2 || num_elevation < 2 || num_range < 2) {
+        throw std::runtime_error("at least two samples are required in azimuth, elevation and range");
+    }
+    if (num_azimuth != m_num_azimuth || num_elevation != m_num_elevation || num_range != m_num_range) {
+        m_num_azimuth   = num_azimuth;
+        m_num_elevation = num_elevation;
+        m_num_range     = num_range;
+        InvalidateTables();
+    }
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::InvalidateTables() {
+    m_volume_table.valid = false;
+    for (auto& table : m_slice_tables) {
+        table.valid = false;
+    }
+}
+
+template <typename T>
+template <typename PointFunc>
+void CpuCartesianator3D<T>::FillLookupTable(LookupTable& table, size_t num_points, PointFunc get_point) {
+    table.index.resize(num_points);
+    table.range_frac.resize(num_points);
+    table.azimuth_frac.resize(num_points);
+    table.elevation_frac.resize(num_points);
+    table.output.resize(num_points);
+
+    float min_azimuth, max_azimuth, min_elevation, max_elevation;
+    m_geometry->get_angle_limits(min_azimuth, max_azimuth, min_elevation, max_elevation);
+    const auto center_azimuth   = 0.5f*(min_azimuth + max_azimuth);
+    const auto center_elevation = 0.5f*(min_elevation + max_elevation);
+
+    // deltas for beam space
+    const auto dr = m_geometry->depth / (m_num_range-1);
+    const auto da = (max_azimuth - min_azimuth) / (m_num_azimuth-1);
+    const auto de = (max_elevation - min_elevation) / (m_num_elevation-1);
+
+    const int num_points_int = static_cast<int>(num_points);
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int point_no = 0; point_no < num_points_int; point_no++) {
+        float x, y, z;
+        get_point(static_cast<size_t>(point_no), x, y, z);
+
+        // Map (x, y, z) to (r, azimuth, elevation). Angles are undefined at origin.
+        const float r = std::sqrt(x*x + y*y + z*z);
+        float azimuth   = center_azimuth;
+        float elevation = center_elevation;
+        if (r > 0.0f) {
+            azimuth   = std::atan2(x, z);
+            elevation = std::asin(std::min(std::max(y/r, -1.0f), 1.0f));
+        }
+
+        int r_base, a_base, e_base;
+        uint16_t r_frac, a_frac, e_frac;
+        if (split_index(r/dr, m_num_range, r_base, r_frac) &&
+            split_index((azimuth-min_azimuth)/da, m_num_azimuth, a_base, a_frac) &&
+            split_index((elevation-min_elevation)/de, m_num_elevation, e_base, e_frac)) {
+            table.index[point_no] = m_num_range*(m_num_azimuth*e_base + a_base) + r_base;
+            table.range_frac[point_no]     = r_frac;
+            table.azimuth_frac[point_no]   = a_frac;
+            table.elevation_frac[point_no] = e_frac;
+        } else {
+            table.index[point_no] = -1;
+            table.range_frac[point_no]     = 0;
+            table.azimuth_frac[point_no]   = 0;
+            table.elevation_frac[point_no] = 0;
+        }
+    }
+    table.valid = true;
+}
+
+template <typename T>
+void CpuCartesianator3D<T>::Interpolate(LookupTable& table, const T* in_buffer) {
+    const size_t azimuth_stride   = static_cast<size_t>(m_num_range);
+    const size_t elevation_stride = static_cast<size_t>(m_num_range)*m_num_azimuth;
+    const float scale = 1.0f/FRAC_SCALE;
+
+    const int*      index          = table.index.data();
+    const uint16_t* range_frac     = table.range_frac.data();
+    const uint16_t* azimuth_frac   = table.azimuth_frac.data();
+    const uint16_t* elevation_frac = table.elevation_frac.data();
+    T* out = table.output.data();
+
+    const int num_points = static_cast<int>(table.index.size());
+#ifdef BCSIM_ENABLE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int point_no = 0; point_no < num_points; point_no++) {
+        const int base = index[point_no];
+        if (base < 0) {
+            out[point_no] = static_cast<T>(0);
+            continue;
+        }
+        const float fr = range_frac[point_no]*scale;
+        const float fa = azimuth_frac[point_no]*scale;
+        const float fe = elevation_frac[point_no]*scale;
+
+        // interpolate along range, then azimuth, then elevation.
+        const T* p00 = in_buffer + base;
+        const T* p10 = p00 + azimuth_stride;
+        const T* p01 = p00 + elevation_stride;
+        const T* p11 = p01 + azimuth_stride;
+        const float c00 = p00[0] + fr*(static_cast<float>(p00[1]) - p00[0]);
+        const float c10 = p10[0] + fr*(static_cast<float>(p10[1]) - p10[0]);
+        const float c01 = p01[0] + fr*(static_cast<float>(p01[1]) - p01[0]);
+        const float c11 = p11[0] + fr*(static_cast<float>(p11[1]) - p11[0]);
+        const float c0 = c00 + fa*(c10 - c00);
+        const float c1 = c01 + fa*(c11 - c01);
+        out[point_no] = static_cast<T>(c0 + fe*(c1 - c0));
+    }
+}
+
+// explicit instantiations for the required datatypes.
+template class CpuCartesianator3D<unsigned char>;
+template class CpuCartesianator3D<float>;
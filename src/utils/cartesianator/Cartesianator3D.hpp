@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "../ScanGeometry.hpp"
+#include "core/export_macros.hpp"
+
+// Volume beam space data + pyramidal geometry => Cartesian voxel grid or
+// orthogonal slices through it, using trilinear interpolation. Voxels outside
+// of the scanned volume are zero.
+//
+// Input indexing: num_range*(num_azimuth*elevation_idx + azimuth_idx) + range_idx
+// Voxel indexing: num_samples_x*(num_samples_y*z_idx + y_idx) + x_idx
+//
+// Interpolation tables are built the first time the voxel grid or a slice
+// is processed, and reused until the geometry, the output size or the beam
+// space dimensions change.
+template <typename T>
+class DLL_PUBLIC CpuCartesianator3D {
+public:
+    typedef std::unique_ptr<CpuCartesianator3D<T>> u_ptr;
+    typedef std::shared_ptr<CpuCartesianator3D<T>> s_ptr;
+
+    // Orthogonal slices through the voxel grid.
+    enum class SlicePlane {
+        AZIMUTH = 0,        // xz-plane at constant y. Columns along x, rows along z.
+        ELEVATION,          // yz-plane at constant x. Columns along y, rows along z.
+        CONSTANT_DEPTH,     // xy-plane at constant z. Columns along x, rows along y.
+    };
+
+    CpuCartesianator3D();
+
+    // Also computes Cartesian xyz extents.
+    void SetGeometry(std::shared_ptr<bcsim::PyramidalScanGeometry> geometry);
+
+    // Get the Cartesian extents of the voxel grid.
+    void GetExtent(float& x_min, float& x_max, float& y_min, float& y_max, float& z_min, float& z_max) const;
+
+    // Set the number of voxels in each dimension.
+    void SetOutputSize(size_t num_samples_x, size_t num_samples_y, size_t num_samples_z);
+
+    void GetOutputSize(size_t& num_samples_x, size_t& num_samples_y, size_t& num_samples_z) const;
+
+    // Scan convert to the full voxel grid.
+    void Process(const T* in_buffer, int num_azimuth, int num_elevation, int num_range);
+
+    const T* GetOutputBuffer() const;
+
+    // Scan convert a single slice only. position is the y, x or z coordinate
+    // of the slice [meters]. The slice is sampled at the voxel grid positions.
+    void ProcessSlice(const T* in_buffer, int num_azimuth, int num_elevation, int num_range,
+                      SlicePlane plane, float position);
+
+    const T* GetSliceBuffer(SlicePlane plane) const;
+
+    void GetSliceSize(SlicePlane plane, size_t& num_cols, size_t& num_rows) const;
+
+private:
+    // Base index of the eight taps (-1 if outside) and the fractional offsets
+    // in range, azimuth and elevation in 1/65535 units.
+    struct LookupTable {
+        LookupTable() : valid(false), position(0.0f) { }
+        std::vector<int>        index;
+        std::vector<uint16_t>   range_frac;
+        std::vector<uint16_t>   azimuth_frac;
+        std::vector<uint16_t>   elevation_frac;
+        std::vector<T>          output;
+        bool                    valid;
+        float                   position;
+    };
+
+    void CheckInput(int num_azimuth, int num_elevation, int num_range);
+
+    void InvalidateTables();
+
+    // Fill the table for points 0, ..., num_points-1 given their Cartesian
+    // coordinates from get_point(point_no, x, y, z).
+    template <typename PointFunc>
+    void FillLookupTable(LookupTable& table, size_t num_points, PointFunc get_point);
+
+    void Interpolate(LookupTable& table, const T* in_buffer);
+
+private:
+    std::shared_ptr<bcsim::PyramidalScanGeometry>   m_geometry;
+    std::vector<float>                              m_geometry_params;
+    size_t                                          m_num_samples_x;
+    size_t                                          m_num_samples_y;
+    size_t                                          m_num_samples_z;
+    int                                             m_num_azimuth;
+    int                                             m_num_elevation;
+    int                                             m_num_range;
+
+    LookupTable                                     m_volume_table;
+    LookupTable                                     m_slice_tables[3];
+
+    // auto-computed extents
+    float   m_x_min;
+    float   m_x_max;
+    float   m_y_min;
+    float   m_y_max;
+    float   m_z_min;
+    float   m_z_max;
+};
@@ -0,0 +1,61 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_AccuracyMetrics
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <cmath>
+#include "../AccuracyMetrics.hpp"
+
+typedef std::vector<std::vector<std::complex<float>>> Frame;
+
+// Circular complex Gaussian samples, i.e. fully developed speckle.
+Frame make_speckle_frame(int num_lines, int num_samples, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    Frame frame(num_lines, std::vector<std::complex<float>>(num_samples));
+    for (auto& line : frame) {
+        for (auto& v : line) {
+            v = std::complex<float>(dist(gen), dist(gen));
+        }
+    }
+    return frame;
+}
+
+BOOST_AUTO_TEST_CASE(IdenticalFrames) {
+    const auto frame = make_speckle_frame(8, 1000, 1);
+    const auto res = bcsim::compare_frames(frame, frame);
+    BOOST_CHECK_SMALL(res.nrmse, 1e-12);
+    BOOST_CHECK_SMALL(res.peak_error, 1e-12);
+    BOOST_CHECK_CLOSE(res.envelope_correlation, 1.0, 1e-6);
+    BOOST_CHECK_CLOSE(res.mean_envelope_ratio, 1.0, 1e-6);
+    BOOST_CHECK_CLOSE(res.reference_speckle_snr, 1.91, 3.0);
+    BOOST_CHECK_CLOSE(res.candidate_speckle_snr, res.reference_speckle_snr, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(ScaledFrame) {
+    const auto reference = make_speckle_frame(4, 500, 2);
+    auto candidate = reference;
+    for (auto& line : candidate) {
+        for (auto& v : line) v *= 1.1f;
+    }
+    const auto res = bcsim::compare_frames(reference, candidate);
+    BOOST_CHECK_CLOSE(res.nrmse, 0.1, 1e-3);
+    BOOST_CHECK_CLOSE(res.peak_error, 0.1, 1e-3);
+    BOOST_CHECK_CLOSE(res.envelope_correlation, 1.0, 1e-6);
+    BOOST_CHECK_CLOSE(res.mean_envelope_ratio, 1.1, 1e-3);
+    BOOST_CHECK_CLOSE(res.candidate_speckle_snr, res.reference_speckle_snr, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(IndependentSpeckle) {
+    const auto res = bcsim::compare_frames(make_speckle_frame(8, 1000, 3), make_speckle_frame(8, 1000, 4));
+    BOOST_CHECK_CLOSE(res.nrmse, std::sqrt(2.0), 3.0);
+    BOOST_CHECK_SMALL(res.envelope_correlation, 0.05);
+    BOOST_CHECK_CLOSE(res.mean_envelope_ratio, 1.0, 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidInput) {
+    const auto frame = make_speckle_frame(2, 10, 5);
+    BOOST_CHECK_THROW(bcsim::compare_frames(frame, make_speckle_frame(3, 10, 5)), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::compare_frames(frame, make_speckle_frame(2, 11, 5)), std::runtime_error);
+    const Frame zeros(2, std::vector<std::complex<float>>(10));
+    BOOST_CHECK_THROW(bcsim::compare_frames(zeros, frame), std::runtime_error);
+}
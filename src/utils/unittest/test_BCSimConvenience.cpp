@@ -0,0 +1,72 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_BCSimConvenience
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <cstdlib>
+#include "../BCSimConvenience.hpp"
+
+// Reference: envelope detection followed by log_compress_frame().
+std::vector<unsigned char> reference_log_compress(const std::vector<std::complex<float>>& iq_samples,
+                                                  size_t num_lines, float dyn_range, float normalize_factor, float gain) {
+    const auto num_samples = iq_samples.size()/num_lines;
+    std::vector<std::vector<float>> env_lines(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t i = 0; i < num_samples; i++) {
+            env_lines[line_no].push_back(std::abs(iq_samples[line_no*num_samples + i]));
+        }
+    }
+    if (normalize_factor <= 0.0f) {
+        normalize_factor = bcsim::get_max_value(env_lines);
+    }
+    bcsim::log_compress_frame(env_lines, dyn_range, normalize_factor, gain);
+    std::vector<unsigned char> res;
+    for (const auto& line : env_lines) {
+        for (auto v : line) res.push_back(static_cast<unsigned char>(v));
+    }
+    return res;
+}
+
+std::vector<std::complex<float>> random_iq_frame(size_t num_samples) {
+    // Rayleigh-like speckle spanning a large dynamic range.
+    std::mt19937 gen(5678);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::uniform_real_distribution<float> exponent(-5.0f, 0.0f);
+    std::vector<std::complex<float>> res(num_samples);
+    for (auto& v : res) {
+        const float scale = std::pow(10.0f, exponent(gen));
+        v = std::complex<float>(scale*dist(gen), scale*dist(gen));
+    }
+    res[17] = std::complex<float>(0.0f, 0.0f);
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(FusedLogCompressionMatchesReference) {
+    const size_t num_lines   = 32;
+    const size_t num_samples = 1000;
+    const auto iq_samples = random_iq_frame(num_lines*num_samples);
+
+    for (float normalize_factor : {0.0f, 2.5f}) {
+        const auto expected = reference_log_compress(iq_samples, num_lines, 60.0f, normalize_factor, 1.5f);
+        std::vector<unsigned char> pixels(iq_samples.size());
+        const auto max_value = bcsim::log_compress_iq_frame(iq_samples.data(), iq_samples.size(), pixels.data(),
+                                                            60.0f, normalize_factor, 1.5f);
+        float expected_max = 0.0f;
+        for (const auto& v : iq_samples) expected_max = std::max(expected_max, std::abs(v));
+        BOOST_CHECK_CLOSE(max_value, expected_max, 1e-3);
+
+        for (size_t i = 0; i < pixels.size(); i++) {
+            BOOST_REQUIRE(std::abs(static_cast<int>(pixels[i]) - static_cast<int>(expected[i])) <= 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(FusedLogCompressionOfZeroFrame) {
+    std::vector<std::complex<float>> iq_samples(100);
+    std::vector<unsigned char> pixels(iq_samples.size(), 1);
+    const auto max_value = bcsim::log_compress_iq_frame(iq_samples.data(), iq_samples.size(), pixels.data(),
+                                                        50.0f, 0.0f, 1.0f);
+    BOOST_CHECK(max_value == 0.0f);
+    for (auto pixel : pixels) {
+        BOOST_REQUIRE(pixel == 0);
+    }
+}
@@ -0,0 +1,223 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_Cartesianator
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <random>
+#include "../cartesianator/Cartesianator.hpp"
+#include "../cartesianator/Cartesianator3D.hpp"
+
+// Direct bilinear interpolation of beam space data at fractional
+// indices, with zero outside of beam space.
+float reference_sample(const std::vector<float>& in_buffer, int num_beams, int num_range,
+                       float range_pos, float beam_pos) {
+    const int r0 = static_cast<int>(std::floor(range_pos));
+    const int t0 = static_cast<int>(std::floor(beam_pos));
+    const float fr = range_pos - r0;
+    const float ft = beam_pos - t0;
+    auto get = [&](int r, int t) {
+        return (r >= 0 && r < num_range && t >= 0 && t < num_beams) ? in_buffer[num_range*t + r] : 0.0f;
+    };
+    return get(r0, t0)*(1.0f-fr)*(1.0f-ft) + get(r0+1, t0)*fr*(1.0f-ft)
+         + get(r0, t0+1)*(1.0f-fr)*ft + get(r0+1, t0+1)*fr*ft;
+}
+
+std::vector<float> random_beamspace(int num_beams, int num_range) {
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> dist(0.0f, 255.0f);
+    std::vector<float> res(num_beams*num_range);
+    for (auto& v : res) v = dist(gen);
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(LinearGeometryMatchesDirectInterpolation) {
+    auto geometry = std::make_shared<bcsim::LinearScanGeometry>();
+    geometry->width     = 0.04f;
+    geometry->range_max = 0.08f;
+    const int num_beams = 64;
+    const int num_range = 300;
+    auto in_buffer = random_beamspace(num_beams, num_range);
+
+    CpuCartesianator<float> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(97, 131);
+    cartesianator.Process(in_buffer.data(), num_beams, num_range);
+    const auto out = cartesianator.GetOutputBuffer();
+
+    const float dx = geometry->width/96;
+    const float dy = geometry->range_max/130;
+    for (int yi = 0; yi < 131; yi++) {
+        for (int xi = 0; xi < 97; xi++) {
+            const float x = -0.5f*geometry->width + xi*dx;
+            const float y = yi*dy;
+            const float range_pos = y/(geometry->range_max/(num_range-1));
+            const float beam_pos  = (x + 0.5f*geometry->width)/(geometry->width/(num_beams-1));
+            const auto expected = reference_sample(in_buffer, num_beams, num_range, range_pos, beam_pos);
+            BOOST_REQUIRE_SMALL(out[97*yi + xi] - expected, 1e-2f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SectorGeometryMatchesDirectInterpolation) {
+    auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+    geometry->width = 1.2f;
+    geometry->depth = 0.12f;
+    geometry->tilt  = 0.1f;
+    const int num_beams = 48;
+    const int num_range = 400;
+    auto in_buffer = random_beamspace(num_beams, num_range);
+
+    CpuCartesianator<float> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(120, 100);
+    cartesianator.Process(in_buffer.data(), num_beams, num_range);
+    const auto out = cartesianator.GetOutputBuffer();
+
+    float x_min, x_max, y_min, y_max, theta_min, theta_max;
+    geometry->get_xy_extent(x_min, x_max, y_min, y_max);
+    geometry->get_angle_limits(theta_min, theta_max);
+    size_t num_nonzero = 0;
+    for (int yi = 0; yi < 100; yi++) {
+        for (int xi = 0; xi < 120; xi++) {
+            const float x = x_min + xi*(x_max-x_min)/119;
+            const float y = y_min + yi*(y_max-y_min)/99;
+            const float range_pos = std::sqrt(x*x+y*y)/(geometry->depth/(num_range-1));
+            const float beam_pos  = (std::atan2(y, x)-theta_min)/((theta_max-theta_min)/(num_beams-1));
+            const auto expected = reference_sample(in_buffer, num_beams, num_range, range_pos, beam_pos);
+            BOOST_REQUIRE_SMALL(out[120*yi + xi] - expected, 1e-1f);
+            if (expected > 0.0f) num_nonzero++;
+        }
+    }
+    BOOST_CHECK(num_nonzero > 1000);
+}
+
+BOOST_AUTO_TEST_CASE(TableIsRebuiltOnChanges) {
+    auto geometry = std::make_shared<bcsim::LinearScanGeometry>();
+    geometry->width     = 0.02f;
+    geometry->range_max = 0.05f;
+
+    // constant input must map to constant output inside beam space.
+    CpuCartesianator<float> cartesianator;
+    for (int num_beams : {16, 33}) {
+        for (size_t out_size : {40, 71}) {
+            geometry->range_max += 0.01f;
+            std::vector<float> in_buffer(num_beams*100, 3.0f);
+            cartesianator.SetGeometry(geometry);
+            cartesianator.SetOutputSize(out_size, out_size);
+            cartesianator.Process(in_buffer.data(), num_beams, 100);
+            for (size_t i = 0; i < out_size*out_size; i++) {
+                BOOST_REQUIRE_CLOSE(cartesianator.GetOutputBuffer()[i], 3.0f, 1e-3);
+            }
+        }
+    }
+}
+
+std::shared_ptr<bcsim::PyramidalScanGeometry> default_pyramidal_geometry() {
+    auto geometry = std::make_shared<bcsim::PyramidalScanGeometry>();
+    geometry->width           = 1.0f;
+    geometry->elevation_width = 0.8f;
+    geometry->depth           = 0.1f;
+    geometry->tilt            = 0.1f;
+    geometry->elevation_tilt  = -0.05f;
+    return geometry;
+}
+
+BOOST_AUTO_TEST_CASE(VolumeMatchesLinearFunctionsOfBeamSpace) {
+    auto geometry = default_pyramidal_geometry();
+    const int num_azimuth   = 20;
+    const int num_elevation = 15;
+    const int num_range     = 50;
+
+    // trilinear interpolation reproduces a function which is linear in
+    // each of the beam space indices.
+    std::vector<float> in_buffer(num_azimuth*num_elevation*num_range);
+    for (int e = 0; e < num_elevation; e++) {
+        for (int a = 0; a < num_azimuth; a++) {
+            for (int r = 0; r < num_range; r++) {
+                in_buffer[num_range*(num_azimuth*e + a) + r] = 1.0f + r + 100.0f*a + 1000.0f*e;
+            }
+        }
+    }
+
+    CpuCartesianator3D<float> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(30, 25, 40);
+    cartesianator.Process(in_buffer.data(), num_azimuth, num_elevation, num_range);
+    const auto out = cartesianator.GetOutputBuffer();
+
+    float x_min, x_max, y_min, y_max, z_min, z_max;
+    cartesianator.GetExtent(x_min, x_max, y_min, y_max, z_min, z_max);
+    float min_az, max_az, min_el, max_el;
+    geometry->get_angle_limits(min_az, max_az, min_el, max_el);
+    size_t num_inside = 0;
+    for (int zi = 0; zi < 40; zi++) {
+        for (int yi = 0; yi < 25; yi++) {
+            for (int xi = 0; xi < 30; xi++) {
+                const float x = x_min + xi*(x_max-x_min)/29;
+                const float y = y_min + yi*(y_max-y_min)/24;
+                const float z = z_min + zi*(z_max-z_min)/39;
+                const float r = std::sqrt(x*x + y*y + z*z);
+                const float range_pos = r/(geometry->depth/(num_range-1));
+                const float az_pos = (std::atan2(x, z)-min_az)/((max_az-min_az)/(num_azimuth-1));
+                const float el_pos = (std::asin(y/r)-min_el)/((max_el-min_el)/(num_elevation-1));
+                const float value = out[30*(25*zi + yi) + xi];
+                const float margin = 0.01f;
+                if (range_pos > margin && range_pos < num_range-1-margin &&
+                    az_pos > margin && az_pos < num_azimuth-1-margin &&
+                    el_pos > margin && el_pos < num_elevation-1-margin) {
+                    BOOST_REQUIRE_CLOSE(value, 1.0f + range_pos + 100.0f*az_pos + 1000.0f*el_pos, 0.05);
+                    num_inside++;
+                } else if (range_pos > num_range || az_pos < -1.0f || el_pos < -1.0f) {
+                    BOOST_REQUIRE(value == 0.0f);
+                }
+            }
+        }
+    }
+    BOOST_CHECK(num_inside > 1000);
+}
+
+BOOST_AUTO_TEST_CASE(SlicesMatchVolume) {
+    auto geometry = default_pyramidal_geometry();
+    const int num_azimuth   = 16;
+    const int num_elevation = 12;
+    const int num_range     = 64;
+    std::vector<unsigned char> in_buffer(num_azimuth*num_elevation*num_range);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (auto& v : in_buffer) v = static_cast<unsigned char>(dist(gen));
+
+    const size_t nx = 21, ny = 17, nz = 33;
+    CpuCartesianator3D<unsigned char> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(nx, ny, nz);
+    cartesianator.Process(in_buffer.data(), num_azimuth, num_elevation, num_range);
+    const auto volume = cartesianator.GetOutputBuffer();
+
+    float x_min, x_max, y_min, y_max, z_min, z_max;
+    cartesianator.GetExtent(x_min, x_max, y_min, y_max, z_min, z_max);
+    typedef CpuCartesianator3D<unsigned char>::SlicePlane SlicePlane;
+
+    const size_t xi0 = 7, yi0 = 9, zi0 = 20;
+    cartesianator.ProcessSlice(in_buffer.data(), num_azimuth, num_elevation, num_range,
+                               SlicePlane::AZIMUTH, y_min + yi0*(y_max-y_min)/(ny-1));
+    cartesianator.ProcessSlice(in_buffer.data(), num_azimuth, num_elevation, num_range,
+                               SlicePlane::ELEVATION, x_min + xi0*(x_max-x_min)/(nx-1));
+    cartesianator.ProcessSlice(in_buffer.data(), num_azimuth, num_elevation, num_range,
+                               SlicePlane::CONSTANT_DEPTH, z_min + zi0*(z_max-z_min)/(nz-1));
+    const auto azimuth_slice   = cartesianator.GetSliceBuffer(SlicePlane::AZIMUTH);
+    const auto elevation_slice = cartesianator.GetSliceBuffer(SlicePlane::ELEVATION);
+    const auto depth_slice     = cartesianator.GetSliceBuffer(SlicePlane::CONSTANT_DEPTH);
+
+    for (size_t zi = 0; zi < nz; zi++) {
+        for (size_t xi = 0; xi < nx; xi++) {
+            BOOST_REQUIRE_EQUAL(azimuth_slice[nx*zi + xi], volume[nx*(ny*zi + yi0) + xi]);
+        }
+        for (size_t yi = 0; yi < ny; yi++) {
+            BOOST_REQUIRE_EQUAL(elevation_slice[ny*zi + yi], volume[nx*(ny*zi + yi) + xi0]);
+        }
+    }
+    for (size_t yi = 0; yi < ny; yi++) {
+        for (size_t xi = 0; xi < nx; xi++) {
+            BOOST_REQUIRE_EQUAL(depth_slice[nx*yi + xi], volume[nx*(ny*zi0 + yi) + xi]);
+        }
+    }
+}
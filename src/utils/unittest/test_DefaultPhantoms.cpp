@@ -0,0 +1,87 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_DefaultPhantoms
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <sstream>
+#include <cmath>
+#include "../EllipsoidGeometry.hpp"
+#include "../DefaultPhantoms.hpp"
+
+// Capped shell with different semi-axes in x and y.
+ellipsoid::ThickCappedZEllipsoid make_shell() {
+    return ellipsoid::ThickCappedZEllipsoid(ellipsoid::Region3D(-0.02f, 0.02f, -0.015f, 0.015f, 0.01f, 0.09f), 8e-3f, 0.7f);
+}
+
+BOOST_AUTO_TEST_CASE(SampledPointsAreInside) {
+    const auto shell = make_shell();
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    int num_outside = 0;
+    const int num_points = 100000;
+    for (int i = 0; i < num_points; i++) {
+        if (!shell.is_point_inside(shell.sample_point(u(gen), u(gen), u(gen)))) {
+            num_outside++;
+        }
+    }
+    // only points on the boundary may end up outside due to rounding
+    BOOST_CHECK_LT(num_outside, num_points/1000);
+}
+
+BOOST_AUTO_TEST_CASE(VolumeAndUniformity) {
+    const auto shell = make_shell();
+    const float x_min = -0.028f, x_max = 0.028f, y_min = -0.023f, y_max = 0.023f, z_min = 0.002f, z_max = 0.098f;
+    const double box_volume = static_cast<double>(x_max - x_min)*(y_max - y_min)*(z_max - z_min);
+
+    // Monte Carlo estimate of the volume and of the fraction in one octant-like sub-box.
+    std::mt19937 gen(2);
+    std::uniform_real_distribution<float> x_dist(x_min, x_max), y_dist(y_min, y_max), z_dist(z_min, z_max);
+    const int num_box_points = 400000;
+    int num_inside = 0, num_inside_sub = 0;
+    for (int i = 0; i < num_box_points; i++) {
+        const ellipsoid::Point3D p(x_dist(gen), y_dist(gen), z_dist(gen));
+        if (shell.is_point_inside(p)) {
+            num_inside++;
+            if (p.x > 0.005f && p.y < 0.0f && p.z < 0.05f) num_inside_sub++;
+        }
+    }
+    BOOST_CHECK_CLOSE(shell.get_volume(), box_volume*num_inside/num_box_points, 2.0);
+
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    const int num_samples = 200000;
+    int num_sampled_sub = 0;
+    for (int i = 0; i < num_samples; i++) {
+        const auto p = shell.sample_point(u(gen), u(gen), u(gen));
+        if (p.x > 0.005f && p.y < 0.0f && p.z < 0.05f) num_sampled_sub++;
+    }
+    BOOST_CHECK_CLOSE(static_cast<double>(num_sampled_sub)/num_samples, static_cast<double>(num_inside_sub)/num_inside, 3.0);
+}
+
+bcsim::SplineScatterers::u_ptr make_lv_phantom(unsigned int seed) {
+    default_phantoms::LeftVentriclePhantomParameters params;
+    params.num_scatterers = 100000;
+    params.seed = seed;
+    std::stringstream csv_stream;
+    csv_stream << "times;factors\n0;1.0\n0.5;0.8\n1;1.0\n";
+    default_phantoms::LeftVentricle3dPhantomFactory factory(params, csv_stream);
+    return factory.get();
+}
+
+BOOST_AUTO_TEST_CASE(LeftVentricleIsDeterministic) {
+    const auto a = make_lv_phantom(7);
+    const auto b = make_lv_phantom(7);
+    const auto c = make_lv_phantom(8);
+    BOOST_REQUIRE_EQUAL(a->num_scatterers(), b->num_scatterers());
+    BOOST_REQUIRE_EQUAL(a->control_points.size(), a->amplitudes.size()*10);
+    BOOST_CHECK(a->num_scatterers() > 5000);
+    bool all_equal = true;
+    bool any_different = false;
+    for (size_t i = 0; i < a->amplitudes.size(); i++) {
+        all_equal = all_equal && (a->amplitudes[i] == b->amplitudes[i]);
+    }
+    for (size_t i = 0; i < a->control_points.size(); i++) {
+        all_equal = all_equal && (a->control_points[i].x == b->control_points[i].x) && (a->control_points[i].z == b->control_points[i].z);
+        any_different = any_different || (a->control_points[i].x != c->control_points[i].x);
+    }
+    BOOST_CHECK(all_equal);
+    BOOST_CHECK(any_different);
+}
@@ -0,0 +1,108 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_DopplerProcessing
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include "../DopplerProcessing.hpp"
+
+// Ensemble cube [line][packet][sample] with a constant clutter term and a
+// blood signal rotating by 'phase_shift' radians between firings.
+std::vector<std::complex<float>> make_test_cube(int num_lines, int packet_size, int num_samples,
+                                                float clutter, float phase_shift) {
+    std::vector<std::complex<float>> cube;
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        for (int n = 0; n < packet_size; n++) {
+            for (int i = 0; i < num_samples; i++) {
+                const auto blood = std::polar(1.0f, phase_shift*n + 0.1f*i);
+                cube.push_back(blood + std::complex<float>(clutter, 0.0f));
+            }
+        }
+    }
+    return cube;
+}
+
+BOOST_AUTO_TEST_CASE(TestVelocityWithoutFilter) {
+    const int num_lines = 3, packet_size = 8, num_samples = 17;
+    const float phase_shift = 0.7f;
+    const auto cube = make_test_cube(num_lines, packet_size, num_samples, 0.0f, phase_shift);
+    bcsim::ColorDopplerProcessor processor;
+    bcsim::ColorDopplerEstimates estimates;
+    processor.process(cube.data(), num_lines, packet_size, num_samples, estimates);
+    BOOST_CHECK_EQUAL(estimates.num_lines, num_lines);
+    BOOST_CHECK_EQUAL(estimates.num_samples, num_samples);
+    BOOST_REQUIRE_EQUAL(estimates.velocity.size(), static_cast<size_t>(num_lines*num_samples));
+    for (size_t i = 0; i < estimates.velocity.size(); i++) {
+        BOOST_CHECK_SMALL(estimates.velocity[i] - phase_shift, 1e-4f);
+        BOOST_CHECK_SMALL(estimates.power[i] - 1.0f, 1e-4f);
+        BOOST_CHECK_SMALL(estimates.variance[i], 1e-4f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestPolynomialFilterRemovesClutter) {
+    const int num_lines = 2, packet_size = 10, num_samples = 5;
+    const float phase_shift = -1.2f;
+    const auto cube = make_test_cube(num_lines, packet_size, num_samples, 50.0f, phase_shift);
+    bcsim::ColorDopplerProcessor processor;
+    processor.set_polynomial_filter(0);
+    bcsim::ColorDopplerEstimates estimates;
+    processor.process(cube.data(), num_lines, packet_size, num_samples, estimates);
+    for (size_t i = 0; i < estimates.velocity.size(); i++) {
+        BOOST_CHECK_SMALL(estimates.velocity[i] - phase_shift, 0.05f);
+        BOOST_CHECK(estimates.power[i] < 2.0f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestIirFilterRemovesClutter) {
+    const int num_lines = 2, packet_size = 16, num_samples = 5;
+    const float phase_shift = 1.5f;
+    const auto cube = make_test_cube(num_lines, packet_size, num_samples, 50.0f, phase_shift);
+    bcsim::ColorDopplerProcessor processor;
+    // first order high-pass with a zero at DC
+    processor.set_iir_filter({1.0f, -1.0f}, {1.0f, -0.2f}, 6);
+    bcsim::ColorDopplerEstimates estimates;
+    processor.process(cube.data(), num_lines, packet_size, num_samples, estimates);
+    for (size_t i = 0; i < estimates.velocity.size(); i++) {
+        BOOST_CHECK_SMALL(estimates.velocity[i] - phase_shift, 0.05f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSpatialAveraging) {
+    const int num_lines = 5, packet_size = 4, num_samples = 9;
+    auto cube = make_test_cube(num_lines, packet_size, num_samples, 0.0f, 0.3f);
+    // double the amplitude of the center line
+    for (int n = 0; n < packet_size; n++) {
+        for (int i = 0; i < num_samples; i++) {
+            cube[(2*packet_size + n)*num_samples + i] *= 2.0f;
+        }
+    }
+    bcsim::ColorDopplerProcessor processor;
+    processor.set_spatial_averaging(3, 5);
+    bcsim::ColorDopplerEstimates estimates;
+    processor.process(cube.data(), num_lines, packet_size, num_samples, estimates);
+    // center line power is averaged with its unit-power neighbours: (1+4+1)/3
+    BOOST_CHECK_SMALL(estimates.power[2*num_samples + 4] - 2.0f, 1e-4f);
+    BOOST_CHECK_SMALL(estimates.power[0] - 1.0f, 1e-4f);
+    BOOST_CHECK_SMALL(estimates.velocity[2*num_samples + 4] - 0.3f, 1e-4f);
+    BOOST_CHECK_THROW(processor.set_spatial_averaging(2, 3), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(TestMakeEnsembleCube) {
+    // [packet][line][sample] -> [line][packet][sample]
+    std::vector<std::vector<std::vector<std::complex<float>>>> frames(3);
+    for (int n = 0; n < 3; n++) {
+        frames[n].resize(2);
+        for (int line_no = 0; line_no < 2; line_no++) {
+            for (int i = 0; i < 4; i++) {
+                frames[n][line_no].push_back(std::complex<float>(static_cast<float>(100*line_no + 10*n + i), 0.0f));
+            }
+        }
+    }
+    const auto cube = bcsim::make_ensemble_cube(frames);
+    BOOST_REQUIRE_EQUAL(cube.size(), 24u);
+    for (int line_no = 0; line_no < 2; line_no++) {
+        for (int n = 0; n < 3; n++) {
+            for (int i = 0; i < 4; i++) {
+                BOOST_CHECK_EQUAL(cube[(line_no*3 + n)*4 + i].real(), static_cast<float>(100*line_no + 10*n + i));
+            }
+        }
+    }
+}
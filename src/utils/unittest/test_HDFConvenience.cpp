@@ -0,0 +1,148 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_HDFConvenience
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <H5Cpp.h>
+#include "../HDFConvenience.hpp"
+
+// Built twice: test_HDFConvenience uses the library, which inflates deflated
+// chunks itself when zlib is found, and test_HDFConvenience_nozlib compiles
+// HDFConvenience.cpp without BCSIM_HAVE_ZLIB so that HDF5 reads all chunks.
+
+enum class Filters { NONE, DEFLATE, SHUFFLE_DEFLATE };
+
+// Random values spanning many exponents, so that any lossy step is detected.
+std::vector<float> make_test_values(size_t num_values) {
+    std::mt19937 random_engine(1234);
+    std::normal_distribution<float> normal_dist;
+    std::uniform_int_distribution<int> exponent_dist(-20, 20);
+    std::vector<float> values(num_values);
+    for (auto& v : values) {
+        v = std::ldexp(normal_dist(random_engine), exponent_dist(random_engine));
+    }
+    return values;
+}
+
+void write_float_dataset(H5::H5File& file, const std::string& name, const std::vector<hsize_t>& dims,
+                         hsize_t chunk_rows, Filters filters, const std::vector<float>& values) {
+    H5::DSetCreatPropList dcpl;
+    if (chunk_rows > 0) {
+        auto chunk_dims = dims;
+        chunk_dims[0] = chunk_rows;
+        dcpl.setChunk(static_cast<int>(chunk_dims.size()), chunk_dims.data());
+        if (filters == Filters::SHUFFLE_DEFLATE) {
+            dcpl.setShuffle();
+        }
+        if (filters != Filters::NONE) {
+            dcpl.setDeflate(4);
+        }
+    }
+    H5::DataSpace dspace(static_cast<int>(dims.size()), dims.data());
+    file.createDataSet(name, H5::PredType::NATIVE_FLOAT, dspace, dcpl).write(values.data(), H5::PredType::NATIVE_FLOAT);
+}
+
+void check_fixed_round_trip(hsize_t chunk_rows, Filters filters) {
+    const std::string filename = "test_HDFConvenience_fixed.h5";
+    // Not a multiple of the chunk size, so that the last chunk is partial.
+    const hsize_t num_scatterers = 2500;
+    const auto values = make_test_values(num_scatterers*4);
+    {
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        write_float_dataset(file, "data", {num_scatterers, 4}, chunk_rows, filters, values);
+    }
+    const auto scatterers = bcsim::loadFixedScatterersFromHdf(filename);
+    BOOST_REQUIRE_EQUAL(static_cast<hsize_t>(scatterers->num_scatterers()), num_scatterers);
+    BOOST_CHECK(std::memcmp(scatterers->scatterers.data(), values.data(), values.size()*sizeof(float)) == 0);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(LoadContiguous) {
+    check_fixed_round_trip(0, Filters::NONE);
+}
+
+BOOST_AUTO_TEST_CASE(LoadChunked) {
+    check_fixed_round_trip(1000, Filters::NONE);
+}
+
+BOOST_AUTO_TEST_CASE(LoadDeflated) {
+    check_fixed_round_trip(1000, Filters::DEFLATE);
+    check_fixed_round_trip(2500, Filters::DEFLATE);
+}
+
+BOOST_AUTO_TEST_CASE(LoadShuffledAndDeflated) {
+    check_fixed_round_trip(1000, Filters::SHUFFLE_DEFLATE);
+    check_fixed_round_trip(3, Filters::SHUFFLE_DEFLATE);
+}
+
+BOOST_AUTO_TEST_CASE(LoadDeflatedSplines) {
+    const std::string filename = "test_HDFConvenience_spline.h5";
+    const hsize_t num_scatterers = 1100;
+    const hsize_t num_cs = 4;
+    const auto control_points = make_test_values(num_scatterers*num_cs*3);
+    const auto amplitudes = make_test_values(num_scatterers);
+    const std::vector<float> knots = {0.0f, 0.0f, 0.0f, 0.5f, 1.0f, 1.0f, 1.0f};
+    {
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        write_float_dataset(file, "control_points", {num_scatterers, num_cs, 3}, 256, Filters::SHUFFLE_DEFLATE, control_points);
+        write_float_dataset(file, "amplitudes", {num_scatterers}, 256, Filters::DEFLATE, amplitudes);
+        write_float_dataset(file, "knot_vector", {knots.size()}, 0, Filters::NONE, knots);
+        const int spline_degree = 2;
+        file.createDataSet("spline_degree", H5::PredType::NATIVE_INT, H5::DataSpace()).write(&spline_degree, H5::PredType::NATIVE_INT);
+    }
+    const auto splines = bcsim::loadSplineScatterersFromHdf(filename);
+    BOOST_CHECK_EQUAL(splines->spline_degree, 2);
+    BOOST_REQUIRE_EQUAL(static_cast<hsize_t>(splines->num_scatterers()), num_scatterers);
+    BOOST_REQUIRE_EQUAL(splines->control_points.size(), num_scatterers*num_cs);
+    BOOST_CHECK(std::memcmp(splines->control_points.data(), control_points.data(), control_points.size()*sizeof(float)) == 0);
+    BOOST_CHECK(std::memcmp(splines->amplitudes.data(), amplitudes.data(), amplitudes.size()*sizeof(float)) == 0);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(WriterRoundTrip) {
+    const std::string filename = "test_HDFConvenience_writer.h5";
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    const auto values = make_test_values(300*4);
+    for (size_t i = 0; i < values.size(); i += 4) {
+        scatterers->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(values[i], values[i + 1], values[i + 2]), values[i + 3]});
+    }
+    bcsim::saveFixedScatterersToHdf(scatterers, filename);
+    const auto loaded = bcsim::loadFixedScatterersFromHdf(filename);
+    BOOST_REQUIRE_EQUAL(loaded->num_scatterers(), 300);
+    BOOST_CHECK(std::memcmp(loaded->scatterers.data(), values.data(), values.size()*sizeof(float)) == 0);
+    std::remove(filename.c_str());
+}
+
+// A writer destroyed without close() must not leave a valid phantom behind.
+BOOST_AUTO_TEST_CASE(UnclosedWriterDeletesFile) {
+    const std::string filename = "test_HDFConvenience_unclosed.h5";
+    const auto values = make_test_values(4*10);
+    {
+        bcsim::FixedScatterersHdfWriter writer(filename);
+        writer.append(reinterpret_cast<const bcsim::PointScatterer*>(values.data()), 10);
+    }
+    BOOST_CHECK(std::fopen(filename.c_str(), "rb") == nullptr);
+    BOOST_CHECK_THROW(bcsim::loadFixedScatterersFromHdf(filename), std::runtime_error);
+}
+
+// The cause of a failed load is part of the error message.
+BOOST_AUTO_TEST_CASE(ErrorsKeepTheirCause) {
+    const std::string filename = "test_HDFConvenience_error.h5";
+    {
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        write_float_dataset(file, "data", {10, 3}, 0, Filters::NONE, make_test_values(30));
+    }
+    try {
+        bcsim::loadFixedScatterersFromHdf(filename);
+        BOOST_ERROR("expected an exception");
+    } catch (const std::runtime_error& e) {
+        const std::string message = e.what();
+        BOOST_CHECK(message.find(filename) != std::string::npos);
+        BOOST_CHECK(message.find("Second dimension must have length four") != std::string::npos);
+    }
+    BOOST_CHECK_THROW(bcsim::loadSplineScatterersFromHdf(filename), std::runtime_error);
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,145 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_IqStreamWriter
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "../IqStreamWriter.hpp"
+#include "../HDFConvenience.hpp"
+#include "../SimpleHDF.hpp"
+
+const int NUM_FRAMES  = 11;
+const int NUM_LINES   = 3;
+const int NUM_SAMPLES = 17;
+
+std::complex<float> test_sample(int frame_no, int line_no, int sample_no) {
+    return std::complex<float>(frame_no + 0.01f*line_no + 0.0001f*sample_no, -0.5f*frame_no - line_no + sample_no);
+}
+
+bcsim::IqStreamWriter::IqFrame make_test_frame(int frame_no) {
+    bcsim::IqStreamWriter::IqFrame frame(NUM_LINES, std::vector<std::complex<float>>(NUM_SAMPLES));
+    for (int line_no = 0; line_no < NUM_LINES; line_no++) {
+        for (int sample_no = 0; sample_no < NUM_SAMPLES; sample_no++) {
+            frame[line_no][sample_no] = test_sample(frame_no, line_no, sample_no);
+        }
+    }
+    return frame;
+}
+
+// Alternates between the two ways of appending frames.
+void stream_test_frames(bcsim::IqStreamWriter& writer) {
+    for (int frame_no = 0; frame_no < NUM_FRAMES; frame_no++) {
+        auto frame = make_test_frame(frame_no);
+        if (frame_no % 2 == 0) {
+            writer.append_frame(frame, 0.1f*frame_no);
+        } else {
+            std::vector<std::complex<float>> contiguous;
+            for (const auto& line : frame) {
+                contiguous.insert(contiguous.end(), line.begin(), line.end());
+            }
+            writer.append_frame(contiguous.data(), NUM_LINES, NUM_SAMPLES, 0.1f*frame_no);
+        }
+    }
+}
+
+void check_streamed_file(const std::string& filename) {
+    SimpleHDF::SimpleHDF5Reader reader(filename);
+    const auto iq_real = reader.readMultiArray<float, 3>("iq_real");
+    const auto iq_imag = reader.readMultiArray<float, 3>("iq_imag");
+    for (const auto& iq : {&iq_real, &iq_imag}) {
+        BOOST_REQUIRE_EQUAL(iq->shape()[0], NUM_FRAMES);
+        BOOST_REQUIRE_EQUAL(iq->shape()[1], NUM_LINES);
+        BOOST_REQUIRE_EQUAL(iq->shape()[2], NUM_SAMPLES);
+    }
+    for (int frame_no = 0; frame_no < NUM_FRAMES; frame_no++) {
+        for (int line_no = 0; line_no < NUM_LINES; line_no++) {
+            for (int sample_no = 0; sample_no < NUM_SAMPLES; sample_no++) {
+                const auto expected = test_sample(frame_no, line_no, sample_no);
+                BOOST_CHECK_EQUAL(iq_real[frame_no][line_no][sample_no], expected.real());
+                BOOST_CHECK_EQUAL(iq_imag[frame_no][line_no][sample_no], expected.imag());
+            }
+        }
+    }
+    const auto frame_times = reader.readStdVector<float>("frame_times");
+    BOOST_REQUIRE_EQUAL(frame_times.size(), NUM_FRAMES);
+    for (int frame_no = 0; frame_no < NUM_FRAMES; frame_no++) {
+        BOOST_CHECK_EQUAL(frame_times[frame_no], 0.1f*frame_no);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(StreamAndReadBack) {
+    const std::string filename = "test_IqStreamWriter.h5";
+    {
+        bcsim::IqStreamWriter::Settings settings;
+        settings.queue_capacity = 2;
+        settings.frames_per_chunk = 4;
+        bcsim::IqStreamWriter writer(filename, settings);
+
+        auto scan_seq = std::make_shared<bcsim::ScanSequence>(0.08f);
+        for (int line_no = 0; line_no < NUM_LINES; line_no++) {
+            scan_seq->add_scanline(bcsim::Scanline(bcsim::vector3(0.01f*line_no, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                                   bcsim::vector3(1.0f, 0.0f, 0.0f), 0.001f*line_no));
+        }
+        writer.set_scan_sequence(scan_seq);
+        stream_test_frames(writer);
+        writer.close();
+        BOOST_CHECK_EQUAL(writer.get_num_frames_written(), NUM_FRAMES);
+    }
+    check_streamed_file(filename);
+
+    const auto scan_seq = bcsim::loadScanSequenceFromHdf(filename);
+    BOOST_REQUIRE_EQUAL(scan_seq->get_num_lines(), NUM_LINES);
+    BOOST_CHECK_EQUAL(scan_seq->line_length, 0.08f);
+    BOOST_CHECK_EQUAL(scan_seq->get_scanline(2).get_origin().x, 0.02f);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(StreamCompressed) {
+    const std::string filename = "test_IqStreamWriter_compressed.h5";
+    {
+        bcsim::IqStreamWriter::Settings settings;
+        settings.frames_per_chunk = 3;
+        settings.compression_level = 6;
+        bcsim::IqStreamWriter writer(filename, settings);
+        stream_test_frames(writer);
+    }
+    check_streamed_file(filename);
+    std::remove(filename.c_str());
+}
+
+// The writer thread and the loaders share the HDF5 library.
+BOOST_AUTO_TEST_CASE(LoadWhileStreaming) {
+    const std::string iq_filename = "test_IqStreamWriter_concurrent.h5";
+    const std::string phantom_filename = "test_IqStreamWriter_phantom.h5";
+    auto phantom = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < 100; i++) {
+        phantom->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.001f*i), 1.0f});
+    }
+    {
+        bcsim::IqStreamWriter writer(iq_filename);
+        std::thread producer([&]() {
+            for (int i = 0; i < 10; i++) {
+                stream_test_frames(writer);
+            }
+        });
+        for (int i = 0; i < 20; i++) {
+            bcsim::saveFixedScatterersToHdf(phantom, phantom_filename);
+            BOOST_CHECK_EQUAL(bcsim::loadFixedScatterersFromHdf(phantom_filename)->num_scatterers(), 100);
+        }
+        producer.join();
+        writer.close();
+        BOOST_CHECK_EQUAL(writer.get_num_frames_written(), 10*NUM_FRAMES);
+    }
+    std::remove(iq_filename.c_str());
+    std::remove(phantom_filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(DimensionChangeIsReported) {
+    const std::string filename = "test_IqStreamWriter_error.h5";
+    bcsim::IqStreamWriter writer(filename);
+    writer.append_frame(make_test_frame(0), 0.0f);
+    writer.append_frame(bcsim::IqStreamWriter::IqFrame(NUM_LINES + 1, std::vector<std::complex<float>>(NUM_SAMPLES)), 0.1f);
+    BOOST_CHECK_THROW(writer.close(), std::runtime_error);
+    BOOST_CHECK_EQUAL(writer.get_num_frames_written(), 1);
+    std::remove(filename.c_str());
+}
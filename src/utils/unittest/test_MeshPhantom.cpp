@@ -0,0 +1,195 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_MeshPhantom
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include "../MeshPhantom.hpp"
+#include "../HDFConvenience.hpp"
+
+// Cube [-1, 1]^3 using the different face formats, quads and negative indices.
+void write_cube_obj(const std::string& filename) {
+    std::ofstream out(filename);
+    out << "# cube\n"
+        << "o cube\n"
+        << "v -1 -1 -1\nv 1 -1 -1\nv 1 1 -1\nv -1 1 -1\n"
+        << "v -1 -1 1\nv 1 -1 1\nv 1 1 1\n  v\t-1 1 1\r\n"
+        << "vn 0 0 1\nvt 0 0\n"
+        << "f 1 4 3 2\n"
+        << "f 5/1 6/1 7/1 8/1\n"
+        << "f 1//1 2//1 6//1 5//1\n"
+        << "f 2/1/1 3/1/1 7/1/1 6/1/1\n"
+        << "f -5 -1 -2 -6\n"
+        << "f 4 1 5 8 # left\n";
+}
+
+// Sphere of radius one with a grid of latitudes and longitudes.
+bcsim::TriangleMesh make_sphere(int num_lat, int num_lon) {
+    bcsim::TriangleMesh mesh;
+    mesh.vertices.push_back(bcsim::vector3(0.0f, 0.0f, 1.0f));
+    for (int i = 1; i < num_lat; i++) {
+        const double theta = 3.141592653589793*i/num_lat;
+        for (int j = 0; j < num_lon; j++) {
+            const double phi = 2.0*3.141592653589793*j/num_lon;
+            mesh.vertices.push_back(bcsim::vector3(static_cast<float>(std::sin(theta)*std::cos(phi)),
+                                                   static_cast<float>(std::sin(theta)*std::sin(phi)),
+                                                   static_cast<float>(std::cos(theta))));
+        }
+    }
+    mesh.vertices.push_back(bcsim::vector3(0.0f, 0.0f, -1.0f));
+    const auto ring = [num_lon](int i, int j) { return static_cast<uint32_t>(1 + (i - 1)*num_lon + (j % num_lon)); };
+    const auto south = static_cast<uint32_t>(mesh.vertices.size() - 1);
+    for (int j = 0; j < num_lon; j++) {
+        mesh.triangles.push_back({{0, ring(1, j), ring(1, j + 1)}});
+        mesh.triangles.push_back({{south, ring(num_lat - 1, j + 1), ring(num_lat - 1, j)}});
+        for (int i = 1; i + 1 < num_lat; i++) {
+            mesh.triangles.push_back({{ring(i, j), ring(i + 1, j), ring(i + 1, j + 1)}});
+            mesh.triangles.push_back({{ring(i, j), ring(i + 1, j + 1), ring(i, j + 1)}});
+        }
+    }
+    return mesh;
+}
+
+BOOST_AUTO_TEST_CASE(LoadObj) {
+    const std::string filename = "test_MeshPhantom_cube.obj";
+    write_cube_obj(filename);
+    const auto mesh = bcsim::loadTriangleMeshFromObj(filename);
+    std::remove(filename.c_str());
+    BOOST_CHECK_EQUAL(mesh.vertices.size(), 8u);
+    BOOST_CHECK_EQUAL(mesh.triangles.size(), 12u);
+    BOOST_CHECK_EQUAL(mesh.vertices[7].x, -1.0f);
+    BOOST_CHECK_EQUAL(mesh.triangles[8][0], 3u);
+    BOOST_CHECK_CLOSE(bcsim::computeMeshVolume(mesh), 8.0, 1e-6);
+
+    BOOST_CHECK_THROW(bcsim::loadTriangleMeshFromObj("no_such_file.obj"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(InsideTestMatchesSphere) {
+    const auto mesh = make_sphere(48, 96);
+    const bcsim::MeshInsideTest inside_test(mesh);
+    BOOST_CHECK_CLOSE(inside_test.get_max().z, 1.0f, 1e-4);
+
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> u(-1.2f, 1.2f);
+    int num_checked = 0;
+    for (int i = 0; i < 100000; i++) {
+        const bcsim::vector3 p(u(gen), u(gen), u(gen));
+        // the mesh is within 0.003 of the sphere
+        if (std::abs(p.norm() - 1.0f) > 0.005f) {
+            num_checked++;
+            if (inside_test.is_inside(p) != (p.norm() < 1.0f)) {
+                BOOST_ERROR("wrong inside test");
+                break;
+            }
+        }
+    }
+    BOOST_CHECK_GT(num_checked, 90000);
+}
+
+// Rays through shared edges and vertices must not be counted twice.
+BOOST_AUTO_TEST_CASE(InsideTestOnEdgesAndVertices) {
+    const std::string filename = "test_MeshPhantom_cube.obj";
+    write_cube_obj(filename);
+    const bcsim::MeshInsideTest cube(bcsim::loadTriangleMeshFromObj(filename));
+    std::remove(filename.c_str());
+    for (float y : {-0.5f, 0.0f, 0.5f}) {
+        for (float z : {-0.5f, 0.0f, 0.5f}) {
+            for (float x : {-1.5f, -0.5f, 0.0f, 0.5f, 1.5f}) {
+                BOOST_CHECK_EQUAL(cube.is_inside(bcsim::vector3(x, y, z)), std::abs(x) < 1.0f);
+            }
+        }
+    }
+
+    bcsim::TriangleMesh octahedron;
+    octahedron.vertices = {bcsim::vector3(1.0f, 0.0f, 0.0f), bcsim::vector3(-1.0f, 0.0f, 0.0f),
+                           bcsim::vector3(0.0f, 1.0f, 0.0f), bcsim::vector3(0.0f, -1.0f, 0.0f),
+                           bcsim::vector3(0.0f, 0.0f, 1.0f), bcsim::vector3(0.0f, 0.0f, -1.0f)};
+    for (uint32_t sx : {0u, 1u}) {
+        for (uint32_t sy : {2u, 3u}) {
+            for (uint32_t sz : {4u, 5u}) {
+                octahedron.triangles.push_back({{sx, sy, sz}});
+            }
+        }
+    }
+    const bcsim::MeshInsideTest inside_test(octahedron);
+    for (float y : {-0.5f, -0.25f, 0.0f, 0.25f}) {
+        for (float z : {-0.25f, 0.0f, 0.5f}) {
+            for (float x : {-0.9f, -0.1f, 0.0f, 0.1f, 0.9f}) {
+                const auto inside = std::abs(x) + std::abs(y) + std::abs(z) < 1.0f;
+                BOOST_CHECK_EQUAL(inside_test.is_inside(bcsim::vector3(x, y, z)), inside);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(FillIsUniformAndDeterministic) {
+    const auto mesh = make_sphere(24, 48);
+    bcsim::MeshFillParameters params;
+    params.num_scatterers = 50000;
+    params.amplitude_mean = 2.0f;
+    params.amplitude_std = 0.5f;
+    params.seed = 3;
+    const auto scatterers = bcsim::fillTriangleMesh(mesh, params);
+    BOOST_REQUIRE_EQUAL(scatterers->scatterers.size(), params.num_scatterers);
+
+    // Inside, uniform in volume (a quarter of the radius cubed within half
+    // the radius) and with the requested amplitudes.
+    int num_inner = 0;
+    double sum = 0.0, sum_squared = 0.0;
+    for (const auto& s : scatterers->scatterers) {
+        BOOST_REQUIRE_LE(s.pos.norm(), 1.0f);
+        num_inner += (s.pos.norm() < 0.5f) ? 1 : 0;
+        sum += s.amplitude;
+        sum_squared += s.amplitude*s.amplitude;
+    }
+    const double mean = sum/params.num_scatterers;
+    BOOST_CHECK_CLOSE(static_cast<double>(num_inner)/params.num_scatterers, 0.125/computeMeshVolume(mesh)*4.18879, 5.0);
+    BOOST_CHECK_CLOSE(mean, 2.0, 1.0);
+    BOOST_CHECK_CLOSE(std::sqrt(sum_squared/params.num_scatterers - mean*mean), 0.5, 3.0);
+
+    const auto again = bcsim::fillTriangleMesh(mesh, params);
+    params.seed = 4;
+    const auto other = bcsim::fillTriangleMesh(mesh, params);
+    for (size_t i = 0; i < params.num_scatterers; i++) {
+        BOOST_REQUIRE_EQUAL(again->scatterers[i].pos.x, scatterers->scatterers[i].pos.x);
+        BOOST_REQUIRE_EQUAL(again->scatterers[i].amplitude, scatterers->scatterers[i].amplitude);
+    }
+    BOOST_CHECK_NE(other->scatterers[0].pos.x, scatterers->scatterers[0].pos.x);
+}
+
+// The last chunk of candidates is only used in part, which must not favour
+// any region. The cube is filled by two chunks.
+BOOST_AUTO_TEST_CASE(FillIsUniformPerOctant) {
+    const std::string filename = "test_MeshPhantom_octants.obj";
+    write_cube_obj(filename);
+    const auto mesh = bcsim::loadTriangleMeshFromObj(filename);
+    std::remove(filename.c_str());
+    bcsim::MeshFillParameters params;
+    params.num_scatterers = 100000;
+    const auto scatterers = bcsim::fillTriangleMesh(mesh, params);
+    BOOST_REQUIRE_EQUAL(scatterers->scatterers.size(), params.num_scatterers);
+
+    int octant_counts[8] = {0};
+    for (const auto& s : scatterers->scatterers) {
+        octant_counts[(s.pos.x > 0.0f ? 1 : 0) + (s.pos.y > 0.0f ? 2 : 0) + (s.pos.z > 0.0f ? 4 : 0)]++;
+    }
+    for (int count : octant_counts) {
+        BOOST_CHECK_CLOSE(static_cast<double>(count), params.num_scatterers/8.0, 4.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SaveToHdf) {
+    bcsim::MeshFillParameters params;
+    params.num_scatterers = 1000;
+    const auto scatterers = bcsim::fillTriangleMesh(make_sphere(8, 16), params);
+    const std::string filename = "test_MeshPhantom.h5";
+    bcsim::saveFixedScatterersToHdf(scatterers, filename);
+    const auto loaded = bcsim::loadFixedScatterersFromHdf(filename);
+    std::remove(filename.c_str());
+    BOOST_REQUIRE_EQUAL(loaded->scatterers.size(), scatterers->scatterers.size());
+    for (size_t i = 0; i < loaded->scatterers.size(); i++) {
+        BOOST_REQUIRE_EQUAL(loaded->scatterers[i].pos.z, scatterers->scatterers[i].pos.z);
+        BOOST_REQUIRE_EQUAL(loaded->scatterers[i].amplitude, scatterers->scatterers[i].amplitude);
+    }
+}
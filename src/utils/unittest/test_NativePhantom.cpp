@@ -0,0 +1,149 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_NativePhantom
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "../NativePhantom.hpp"
+
+bcsim::FixedScatterers::s_ptr make_fixed_scatterers(int num_scatterers) {
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < num_scatterers; i++) {
+        scatterers->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(0.001f*i, -0.002f*i, 0.5f + i), 0.25f*i - 1.0f});
+    }
+    return scatterers;
+}
+
+void check_equal(const bcsim::PointScatterer& a, const bcsim::PointScatterer& b) {
+    BOOST_CHECK_EQUAL(a.pos.x, b.pos.x);
+    BOOST_CHECK_EQUAL(a.pos.y, b.pos.y);
+    BOOST_CHECK_EQUAL(a.pos.z, b.pos.z);
+    BOOST_CHECK_EQUAL(a.amplitude, b.amplitude);
+}
+
+BOOST_AUTO_TEST_CASE(FixedRoundTrip) {
+    const std::string filename = "test_NativePhantom_fixed.bin";
+    const auto original = make_fixed_scatterers(1000);
+    bcsim::saveFixedScatterersToNative(original, filename);
+    BOOST_CHECK_EQUAL(bcsim::getNativePhantomType(filename), "fixed");
+
+    const auto loaded = bcsim::loadFixedScatterersFromNative(filename);
+    BOOST_CHECK(loaded->scatterers.is_view());
+    BOOST_REQUIRE_EQUAL(loaded->num_scatterers(), original->num_scatterers());
+    for (size_t i = 0; i < original->scatterers.size(); i++) {
+        check_equal(loaded->scatterers[i], original->scatterers[i]);
+    }
+
+    // The mapping is private, so changing a scatterer does not change the file.
+    loaded->scatterers[0].amplitude = 100.0f;
+    BOOST_CHECK_EQUAL(bcsim::loadFixedScatterersFromNative(filename)->scatterers[0].amplitude, original->scatterers[0].amplitude);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(SplineRoundTrip) {
+    const std::string filename = "test_NativePhantom_spline.bin";
+    auto original = std::make_shared<bcsim::SplineScatterers>();
+    original->spline_degree = 2;
+    original->knot_vector = {0.0f, 0.0f, 0.0f, 0.5f, 1.0f, 1.0f, 1.0f};
+    const int num_scatterers = 50;
+    for (int i = 0; i < num_scatterers; i++) {
+        for (int cs_no = 0; cs_no < 4; cs_no++) {
+            original->control_points.push_back(bcsim::vector3(0.1f*i, 0.01f*cs_no, 1.0f));
+        }
+        original->amplitudes.push_back(-0.5f*i);
+    }
+    bcsim::saveSplineScatterersToNative(original, filename);
+    BOOST_CHECK_EQUAL(bcsim::getNativePhantomType(filename), "spline");
+
+    const auto loaded = bcsim::loadSplineScatterersFromNative(filename);
+    BOOST_CHECK(loaded->control_points.is_view());
+    BOOST_CHECK_EQUAL(loaded->spline_degree, original->spline_degree);
+    BOOST_CHECK(loaded->knot_vector == original->knot_vector);
+    BOOST_REQUIRE_EQUAL(loaded->num_scatterers(), original->num_scatterers());
+    BOOST_REQUIRE_EQUAL(loaded->get_num_control_points(), 4);
+    for (size_t i = 0; i < original->control_points.size(); i++) {
+        BOOST_CHECK_EQUAL(loaded->control_points[i].x, original->control_points[i].x);
+        BOOST_CHECK_EQUAL(loaded->control_points[i].y, original->control_points[i].y);
+    }
+    for (size_t i = 0; i < original->amplitudes.size(); i++) {
+        BOOST_CHECK_EQUAL(loaded->amplitudes[i], original->amplitudes[i]);
+    }
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(WriterAppendsPieces) {
+    const std::string filename = "test_NativePhantom_writer.bin";
+    const auto original = make_fixed_scatterers(777);
+    {
+        bcsim::FixedScatterersNativeWriter writer(filename);
+        for (size_t first = 0; first < original->scatterers.size(); first += 100) {
+            const auto num = std::min<size_t>(100, original->scatterers.size() - first);
+            writer.append(original->scatterers.data() + first, num);
+        }
+        BOOST_CHECK_EQUAL(writer.get_num_written(), original->scatterers.size());
+        writer.close();
+    }
+    const auto loaded = bcsim::loadFixedScatterersFromNative(filename);
+    BOOST_REQUIRE_EQUAL(loaded->num_scatterers(), original->num_scatterers());
+    for (size_t i = 0; i < original->scatterers.size(); i++) {
+        check_equal(loaded->scatterers[i], original->scatterers[i]);
+    }
+    std::remove(filename.c_str());
+}
+
+// A writer destroyed without close() must not leave a valid phantom behind.
+BOOST_AUTO_TEST_CASE(UnclosedWriterDeletesFile) {
+    const std::string filename = "test_NativePhantom_unclosed.bin";
+    const auto original = make_fixed_scatterers(10);
+    {
+        bcsim::FixedScatterersNativeWriter writer(filename);
+        writer.append(original->scatterers.data(), original->scatterers.size());
+    }
+    BOOST_CHECK(std::fopen(filename.c_str(), "rb") == nullptr);
+    BOOST_CHECK_THROW(bcsim::loadFixedScatterersFromNative(filename), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(ViewLifetime) {
+    const std::string filename = "test_NativePhantom_lifetime.bin";
+    const auto original = make_fixed_scatterers(300);
+    bcsim::saveFixedScatterersToNative(original, filename);
+
+    // A view keeps the mapping alive after the loaded object and the file are gone.
+    bcsim::ScattererArray<bcsim::PointScatterer> view;
+    {
+        auto loaded = bcsim::loadFixedScatterersFromNative(filename);
+        view.swap(loaded->scatterers);
+    }
+    std::remove(filename.c_str());
+    BOOST_REQUIRE(view.is_view());
+    BOOST_REQUIRE_EQUAL(view.size(), original->scatterers.size());
+    check_equal(view[299], original->scatterers[299]);
+
+    // A copy owns its elements.
+    auto copy = view;
+    BOOST_CHECK(!copy.is_view());
+    check_equal(copy[10], original->scatterers[10]);
+
+    // Growing a view from one of its own elements, and assigning a view from
+    // itself, must copy the elements before the mapping is released.
+    bcsim::ScattererArray<bcsim::PointScatterer> grown;
+    grown.swap(view);
+    grown.push_back(grown[5]);
+    BOOST_CHECK(!grown.is_view());
+    BOOST_REQUIRE_EQUAL(grown.size(), 301u);
+    check_equal(grown[300], original->scatterers[5]);
+
+    {
+        const auto filename2 = filename + "2";
+        bcsim::saveFixedScatterersToNative(original, filename2);
+        auto loaded = bcsim::loadFixedScatterersFromNative(filename2);
+        std::remove(filename2.c_str());
+        auto& scatterers = loaded->scatterers;
+        BOOST_REQUIRE(scatterers.is_view());
+        scatterers.assign(scatterers.begin() + 100, scatterers.end());
+        BOOST_CHECK(!scatterers.is_view());
+        BOOST_REQUIRE_EQUAL(scatterers.size(), 200u);
+        check_equal(scatterers[0], original->scatterers[100]);
+        check_equal(scatterers[199], original->scatterers[299]);
+    }
+}
@@ -0,0 +1,280 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_ShardedSimulation
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include "../ShardedSimulation.hpp"
+#include "../SimpleHDF.hpp"
+
+const int NUM_FRAMES = 3;
+const int NUM_LINES  = 7;
+
+bcsim::ExcitationSignal make_test_excitation() {
+    bcsim::ExcitationSignal ex;
+    ex.sampling_frequency = 50e6f;
+    ex.demod_freq = 2.5e6f;
+    const int half_length = 40;
+    for (int i = -half_length; i <= half_length; i++) {
+        const float t = i/ex.sampling_frequency;
+        ex.samples.push_back(std::exp(-t*t/(2.0f*0.25e-6f*0.25e-6f))*std::cos(2.0f*3.1415927f*ex.demod_freq*t));
+    }
+    ex.center_index = half_length;
+    return ex;
+}
+
+// Parallel lines along z which move a little from frame to frame.
+bcsim::ScanSequence::s_ptr make_test_frame(int frame_no, float line_length) {
+    auto scan_seq = std::make_shared<bcsim::ScanSequence>(line_length);
+    for (int line_no = 0; line_no < NUM_LINES; line_no++) {
+        const bcsim::vector3 origin(-0.006f + 0.002f*line_no + 0.0005f*frame_no, 0.0f, 0.0f);
+        scan_seq->add_scanline(bcsim::Scanline(origin, bcsim::vector3(0.0f, 0.0f, 1.0f), bcsim::vector3(1.0f, 0.0f, 0.0f),
+                                               0.01f*frame_no + 0.0001f*line_no));
+    }
+    return scan_seq;
+}
+
+bcsim::SimulationJob make_test_job() {
+    bcsim::SimulationJob job;
+    job.parameters.push_back(std::make_pair("num_cpu_cores", "1"));
+    job.parameters.push_back(std::make_pair("radial_decimation", "5"));
+    job.excitation = make_test_excitation();
+    job.beam_profile = std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 3e-3f);
+    for (int frame_no = 0; frame_no < NUM_FRAMES; frame_no++) {
+        job.frames.push_back(make_test_frame(frame_no, 0.04f));
+    }
+
+    auto fixed = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < 50; i++) {
+        fixed->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(-0.008f + 0.0003f*i, 0.0f, 0.005f + 0.0006f*i), 1.0f + 0.1f*i});
+    }
+    job.fixed_scatterers.push_back(fixed);
+
+    auto spline = std::make_shared<bcsim::SplineScatterers>();
+    spline->spline_degree = 1;
+    spline->knot_vector = {0.0f, 0.0f, 1.0f, 1.0f};
+    for (int i = 0; i < 10; i++) {
+        spline->control_points.push_back(bcsim::vector3(-0.004f + 0.001f*i, 0.0f, 0.01f));
+        spline->control_points.push_back(bcsim::vector3(-0.004f + 0.001f*i, 0.0f, 0.02f));
+        spline->amplitudes.push_back(2.0f);
+    }
+    job.spline_scatterers.push_back(spline);
+    return job;
+}
+
+void check_same_frame(const bcsim::ScanSequence::s_ptr& expected, const bcsim::ScanSequence::s_ptr& actual) {
+    BOOST_CHECK_EQUAL(actual->line_length, expected->line_length);
+    BOOST_REQUIRE_EQUAL(actual->get_num_lines(), expected->get_num_lines());
+    for (int line_no = 0; line_no < expected->get_num_lines(); line_no++) {
+        const auto& e = expected->get_scanline(line_no);
+        const auto& a = actual->get_scanline(line_no);
+        BOOST_CHECK_EQUAL(a.get_origin().x, e.get_origin().x);
+        BOOST_CHECK_EQUAL(a.get_direction().z, e.get_direction().z);
+        BOOST_CHECK_EQUAL(a.get_lateral_dir().x, e.get_lateral_dir().x);
+        BOOST_CHECK_EQUAL(a.get_timestamp(), e.get_timestamp());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MakeShards) {
+    const auto shards = bcsim::make_simulation_shards(2, 7, 3);
+    BOOST_REQUIRE_EQUAL(shards.size(), 6);
+    const int expected[][3] = {{0, 0, 3}, {0, 3, 3}, {0, 6, 1}, {1, 0, 3}, {1, 3, 3}, {1, 6, 1}};
+    for (size_t i = 0; i < shards.size(); i++) {
+        BOOST_CHECK_EQUAL(shards[i].frame_no,   expected[i][0]);
+        BOOST_CHECK_EQUAL(shards[i].first_line, expected[i][1]);
+        BOOST_CHECK_EQUAL(shards[i].num_lines,  expected[i][2]);
+    }
+
+    // Shards never cross frame boundaries.
+    const auto whole_frames = bcsim::make_simulation_shards(3, 5, 100);
+    BOOST_REQUIRE_EQUAL(whole_frames.size(), 3);
+    for (int frame_no = 0; frame_no < 3; frame_no++) {
+        BOOST_CHECK_EQUAL(whole_frames[frame_no].frame_no, frame_no);
+        BOOST_CHECK_EQUAL(whole_frames[frame_no].first_line, 0);
+        BOOST_CHECK_EQUAL(whole_frames[frame_no].num_lines, 5);
+    }
+
+    BOOST_CHECK(bcsim::make_simulation_shards(0, 5, 2).empty());
+    BOOST_CHECK_THROW(bcsim::make_simulation_shards(1, 5, 0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(SplitWorkerCpus) {
+    const bcsim::NumaTopology topology({0, 1}, {{0, 1, 2, 3}, {4, 5, 6, 7}});
+
+    // Disjoint sets covering all CPUs, not crossing nodes when it can be avoided.
+    const auto two_workers = bcsim::split_worker_cpus(topology, 2);
+    BOOST_REQUIRE_EQUAL(two_workers.size(), 2);
+    BOOST_CHECK(two_workers[0] == std::vector<int>({0, 1, 2, 3}));
+    BOOST_CHECK(two_workers[1] == std::vector<int>({4, 5, 6, 7}));
+
+    const auto three_workers = bcsim::split_worker_cpus(topology, 3);
+    BOOST_REQUIRE_EQUAL(three_workers.size(), 3);
+    std::vector<int> all_cpus;
+    for (const auto& cpus : three_workers) {
+        BOOST_CHECK(cpus.size() == 2 || cpus.size() == 3);
+        all_cpus.insert(all_cpus.end(), cpus.begin(), cpus.end());
+    }
+    BOOST_CHECK(all_cpus == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+
+    // More workers than CPUs: one CPU each, shared.
+    const auto ten_workers = bcsim::split_worker_cpus(topology, 10);
+    BOOST_REQUIRE_EQUAL(ten_workers.size(), 10);
+    for (size_t i = 0; i < ten_workers.size(); i++) {
+        BOOST_CHECK(ten_workers[i] == std::vector<int>(1, static_cast<int>(i % 8)));
+    }
+
+    BOOST_CHECK_THROW(bcsim::split_worker_cpus(topology, 0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(JobFileRoundTrip) {
+    const std::string job_file = "test_ShardedSimulation_roundtrip.job";
+    auto job = make_test_job();
+    job.sim_type = "cpu";
+    auto lut = std::make_shared<bcsim::LUTBeamProfile>(4, 3, 2, bcsim::Interval(0.0f, 0.05f),
+                                                       bcsim::Interval(-0.01f, 0.01f), bcsim::Interval(-0.02f, 0.02f));
+    for (int ir = 0; ir < 4; ir++) {
+        for (int il = 0; il < 3; il++) {
+            for (int ie = 0; ie < 2; ie++) {
+                lut->setDiscreteSample(ir, il, ie, 0.1f*ir + 0.01f*il + 0.001f*ie);
+            }
+        }
+    }
+    job.beam_profile = lut;
+    bcsim::write_simulation_job(job, job_file);
+    {
+        const auto loaded = bcsim::read_simulation_job(job_file);
+        BOOST_CHECK_EQUAL(loaded.sim_type, "cpu");
+        BOOST_REQUIRE_EQUAL(loaded.parameters.size(), job.parameters.size());
+        for (size_t i = 0; i < job.parameters.size(); i++) {
+            BOOST_CHECK(loaded.parameters[i] == job.parameters[i]);
+        }
+
+        BOOST_CHECK(loaded.excitation.samples == job.excitation.samples);
+        BOOST_CHECK_EQUAL(loaded.excitation.center_index, job.excitation.center_index);
+        BOOST_CHECK_EQUAL(loaded.excitation.sampling_frequency, job.excitation.sampling_frequency);
+        BOOST_CHECK_EQUAL(loaded.excitation.demod_freq, job.excitation.demod_freq);
+
+        const auto loaded_lut = std::dynamic_pointer_cast<bcsim::LUTBeamProfile>(loaded.beam_profile);
+        BOOST_REQUIRE(loaded_lut);
+        BOOST_CHECK_EQUAL(loaded_lut->getNumSamplesRadial(), 4);
+        BOOST_CHECK_EQUAL(loaded_lut->getNumSamplesLateral(), 3);
+        BOOST_CHECK_EQUAL(loaded_lut->getNumSamplesElevational(), 2);
+        BOOST_CHECK_EQUAL(loaded_lut->getLateralRange().first, -0.01f);
+        BOOST_CHECK_EQUAL(loaded_lut->getElevationalRange().last, 0.02f);
+        for (int ir = 0; ir < 4; ir++) {
+            for (int il = 0; il < 3; il++) {
+                for (int ie = 0; ie < 2; ie++) {
+                    BOOST_CHECK_EQUAL(loaded_lut->getDiscreteSample(ir, il, ie), lut->getDiscreteSample(ir, il, ie));
+                }
+            }
+        }
+
+        BOOST_REQUIRE_EQUAL(loaded.frames.size(), job.frames.size());
+        for (size_t frame_no = 0; frame_no < job.frames.size(); frame_no++) {
+            check_same_frame(job.frames[frame_no], loaded.frames[frame_no]);
+        }
+
+        // The phantom is used in place from the mapping.
+        BOOST_REQUIRE_EQUAL(loaded.fixed_scatterers.size(), 1);
+        const auto& fixed = job.fixed_scatterers[0]->scatterers;
+        const auto& loaded_fixed = loaded.fixed_scatterers[0]->scatterers;
+        BOOST_CHECK(loaded_fixed.is_view());
+        BOOST_REQUIRE_EQUAL(loaded_fixed.size(), fixed.size());
+        for (size_t i = 0; i < fixed.size(); i++) {
+            BOOST_CHECK_EQUAL(loaded_fixed[i].pos.z, fixed[i].pos.z);
+            BOOST_CHECK_EQUAL(loaded_fixed[i].amplitude, fixed[i].amplitude);
+        }
+
+        BOOST_REQUIRE_EQUAL(loaded.spline_scatterers.size(), 1);
+        const auto& spline = *job.spline_scatterers[0];
+        const auto& loaded_spline = *loaded.spline_scatterers[0];
+        BOOST_CHECK(loaded_spline.control_points.is_view());
+        BOOST_CHECK_EQUAL(loaded_spline.spline_degree, spline.spline_degree);
+        BOOST_CHECK(loaded_spline.knot_vector == spline.knot_vector);
+        BOOST_REQUIRE_EQUAL(loaded_spline.num_scatterers(), spline.num_scatterers());
+        BOOST_CHECK_EQUAL(loaded_spline.get_num_control_points(), spline.get_num_control_points());
+        for (size_t i = 0; i < spline.control_points.size(); i++) {
+            BOOST_CHECK_EQUAL(loaded_spline.control_points[i].x, spline.control_points[i].x);
+            BOOST_CHECK_EQUAL(loaded_spline.control_points[i].z, spline.control_points[i].z);
+        }
+    }
+
+    // The Gaussian beam profile is stored by its parameters.
+    job.beam_profile = std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 3e-3f);
+    bcsim::write_simulation_job(job, job_file);
+    {
+        const auto loaded = bcsim::read_simulation_job(job_file);
+        const auto gaussian = std::dynamic_pointer_cast<bcsim::GaussianBeamProfile>(loaded.beam_profile);
+        BOOST_REQUIRE(gaussian);
+        BOOST_CHECK_EQUAL(gaussian->getSigmaLateral(), 1e-3f);
+        BOOST_CHECK_EQUAL(gaussian->getSigmaElevational(), 3e-3f);
+    }
+    std::remove(job_file.c_str());
+    BOOST_CHECK_THROW(bcsim::read_simulation_job(job_file), std::runtime_error);
+}
+
+// The workers finish shards in any order, but each must end up in its own place.
+BOOST_AUTO_TEST_CASE(RunnerMergesShardsInOrder) {
+    const std::string job_file = "test_ShardedSimulation.job";
+    const std::string h5_file = "test_ShardedSimulation.h5";
+    const auto job = make_test_job();
+
+    bcsim::ShardedSimulationRunner runner({SHARDED_SIMULATION_WORKER}, 2);
+    runner.set_lines_per_shard(3);
+    int num_progress_calls = 0;
+    runner.set_progress_callback([&](int num_completed, int num_total) {
+        num_progress_calls++;
+        BOOST_CHECK_EQUAL(num_completed, num_progress_calls);
+        BOOST_CHECK_EQUAL(num_total, NUM_FRAMES*3);
+    });
+    runner.run(job, job_file, h5_file);
+    BOOST_CHECK_EQUAL(num_progress_calls, NUM_FRAMES*3);
+
+    SimpleHDF::SimpleHDF5Reader reader(h5_file);
+    const auto iq_real = reader.readMultiArray<float, 3>("iq_real");
+    const auto iq_imag = reader.readMultiArray<float, 3>("iq_imag");
+    const auto frame_times = reader.readStdVector<float>("frame_times");
+    BOOST_REQUIRE_EQUAL(iq_real.shape()[0], NUM_FRAMES);
+    BOOST_REQUIRE_EQUAL(iq_real.shape()[1], NUM_LINES);
+    BOOST_REQUIRE_EQUAL(frame_times.size(), NUM_FRAMES);
+
+    auto sim = bcsim::create_simulator_from_job(job);
+    std::vector<std::vector<std::complex<float>>> rf_lines;
+    for (int frame_no = 0; frame_no < NUM_FRAMES; frame_no++) {
+        BOOST_CHECK_EQUAL(frame_times[frame_no], job.frames[frame_no]->get_scanline(0).get_timestamp());
+        sim->set_scan_sequence(job.frames[frame_no]);
+        sim->simulate_lines(rf_lines);
+        BOOST_REQUIRE_EQUAL(iq_real.shape()[2], rf_lines[0].size());
+        for (int line_no = 0; line_no < NUM_LINES; line_no++) {
+            for (size_t sample_no = 0; sample_no < rf_lines[line_no].size(); sample_no++) {
+                BOOST_CHECK_EQUAL(iq_real[frame_no][line_no][sample_no], rf_lines[line_no][sample_no].real());
+                BOOST_CHECK_EQUAL(iq_imag[frame_no][line_no][sample_no], rf_lines[line_no][sample_no].imag());
+            }
+        }
+    }
+    std::remove(job_file.c_str());
+    std::remove(h5_file.c_str());
+}
+
+class ConvolverCountLog : public bcsim::ILog {
+public:
+    ConvolverCountLog() : num_recreated(0) { }
+    virtual void write(LogType, const std::string& msg) override {
+        if (msg == "Recreating convolvers") {
+            num_recreated++;
+        }
+    }
+    int num_recreated;
+};
+
+// A worker sets one scan sequence per shard, which must not recreate the convolvers.
+BOOST_AUTO_TEST_CASE(ConvolversKeptBetweenShards) {
+    auto sim = bcsim::create_simulator_from_job(make_test_job());
+    auto log = std::make_shared<ConvolverCountLog>();
+    sim->set_logger(log);
+    sim->set_scan_sequence(make_test_frame(0, 0.04f));
+    sim->set_scan_sequence(make_test_frame(1, 0.04f));
+    BOOST_CHECK_EQUAL(log->num_recreated, 1);
+    sim->set_scan_sequence(make_test_frame(2, 0.05f));
+    BOOST_CHECK_EQUAL(log->num_recreated, 2);
+}
@@ -0,0 +1,12 @@
+#include <iostream>
+#include <string>
+#include "../ShardedSimulation.hpp"
+
+// Worker executable for test_ShardedSimulation.
+int main(int argc, char* argv[]) {
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <job_file> <task_fd> <result_fd>\n";
+        return 1;
+    }
+    return bcsim::run_simulation_shard_worker(argv[1], std::stoi(argv[2]), std::stoi(argv[3]));
+}
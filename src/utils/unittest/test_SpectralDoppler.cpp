@@ -0,0 +1,182 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_SpectralDoppler
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include "../SpectralDoppler.hpp"
+
+// Firings with num_samples samples where the samples inside the gate rotate
+// with 'bin' cycles per fft_length firings.
+std::vector<std::vector<std::complex<float>>> make_firings(int num_firings, int num_samples, int fft_length, int bin) {
+    const float pi = 4.0f*std::atan(1.0f);
+    std::vector<std::vector<std::complex<float>>> res(num_firings);
+    for (int n = 0; n < num_firings; n++) {
+        res[n].assign(num_samples, std::complex<float>(0.0f, 0.0f));
+        for (int i = 0; i < num_samples; i++) {
+            res[n][i] = std::polar(1.0f, 2.0f*pi*bin*n/fft_length + 0.3f*i);
+        }
+    }
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(TestSpectralPeak) {
+    bcsim::SpectralDopplerProcessor::Settings settings;
+    settings.fft_length  = 64;
+    settings.hop         = 4;
+    settings.gate_start  = 10;
+    settings.gate_length = 1;
+    bcsim::SpectralDopplerProcessor processor(settings);
+    const int bin = -12;
+    const auto firings = make_firings(200, 32, settings.fft_length, bin);
+    processor.add_firings(firings);
+    BOOST_CHECK_EQUAL(processor.get_num_firings(), 200u);
+    BOOST_REQUIRE_EQUAL(processor.get_num_spectra(), static_cast<size_t>((200-64)/4 + 1));
+
+    // peak at the bin of the signal frequency after FFT shift
+    const auto& spectra = processor.get_spectra();
+    for (size_t spectrum_no = 0; spectrum_no < processor.get_num_spectra(); spectrum_no++) {
+        const auto first = spectra.begin() + spectrum_no*settings.fft_length;
+        const auto peak = std::max_element(first, first + settings.fft_length,
+            [](std::complex<float> a, std::complex<float> b) { return std::abs(a) < std::abs(b); });
+        BOOST_CHECK_EQUAL(peak - first, settings.fft_length/2 + bin);
+    }
+    const auto pixels = processor.get_spectrogram();
+    BOOST_REQUIRE_EQUAL(pixels.size(), spectra.size());
+    BOOST_CHECK_EQUAL(pixels[settings.fft_length/2 + bin], 255);
+}
+
+BOOST_AUTO_TEST_CASE(TestStreamingEqualsBatch) {
+    bcsim::SpectralDopplerProcessor::Settings settings;
+    settings.fft_length  = 32;
+    settings.hop         = 3;
+    settings.gate_start  = 2;
+    settings.gate_length = 5;
+    const auto firings = make_firings(150, 16, settings.fft_length, 5);
+
+    bcsim::SpectralDopplerProcessor batch(settings);
+    batch.add_firings(firings);
+
+    bcsim::SpectralDopplerProcessor streaming(settings);
+    size_t num_fetched = 0;
+    std::vector<unsigned char> streamed_pixels;
+    for (const auto& firing : firings) {
+        streaming.add_firing(firing.data(), static_cast<int>(firing.size()));
+        const auto new_pixels = streaming.get_spectrogram(num_fetched);
+        num_fetched = streaming.get_num_spectra();
+        streamed_pixels.insert(streamed_pixels.end(), new_pixels.begin(), new_pixels.end());
+    }
+    BOOST_REQUIRE_EQUAL(streaming.get_num_spectra(), batch.get_num_spectra());
+    const auto& a = streaming.get_spectra();
+    const auto& b = batch.get_spectra();
+    for (size_t i = 0; i < a.size(); i++) {
+        BOOST_CHECK_SMALL(std::abs(a[i] - b[i]), 1e-3f);
+    }
+    BOOST_CHECK_EQUAL(streamed_pixels.size(), batch.get_spectrogram().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestInvalidSettings) {
+    bcsim::SpectralDopplerProcessor::Settings settings;
+    settings.fft_length = 100;
+    BOOST_CHECK_THROW(bcsim::SpectralDopplerProcessor processor(settings), std::runtime_error);
+
+    settings.fft_length = 16;
+    settings.gate_start = 20;
+    bcsim::SpectralDopplerProcessor processor(settings);
+    const auto firings = make_firings(1, 10, 16, 0);
+    BOOST_CHECK_THROW(processor.add_firings(firings), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(TestWriteAudio) {
+    bcsim::SpectralDopplerProcessor processor;
+    processor.add_firings(make_firings(1000, 4, 256, 10));
+    const std::string wav_file = "test_spectral_doppler.wav";
+    processor.write_audio(wav_file, 5000.0f, 44100);
+
+    std::ifstream in(wav_file, std::ios::binary | std::ios::ate);
+    BOOST_REQUIRE(in.good());
+    // 1000 firings at 5 kHz resampled to 44.1 kHz, 44 byte header, two channels
+    const size_t expected_num_samples = static_cast<size_t>(999/5000.0*44100) + 1;
+    BOOST_CHECK_EQUAL(static_cast<size_t>(in.tellg()), 44 + 4*expected_num_samples);
+    in.close();
+    std::remove(wav_file.c_str());
+}
+
+// Mean absolute value of the left and right channel of a 16-bit stereo WAV file.
+std::pair<double, double> read_channel_levels(const std::string& wav_file) {
+    std::ifstream in(wav_file, std::ios::binary);
+    in.seekg(44);
+    double left = 0.0;
+    double right = 0.0;
+    size_t num_frames = 0;
+    int16_t frame[2];
+    while (in.read(reinterpret_cast<char*>(frame), sizeof(frame))) {
+        left  += std::abs(frame[0]);
+        right += std::abs(frame[1]);
+        num_frames++;
+    }
+    return std::make_pair(left/num_frames, right/num_frames);
+}
+
+// Flow direction is kept: positive Doppler frequencies go to the left channel.
+BOOST_AUTO_TEST_CASE(TestAudioDirection) {
+    const std::string wav_file = "test_spectral_doppler_direction.wav";
+    for (int bin : {10, -10}) {
+        bcsim::SpectralDopplerProcessor processor;
+        processor.add_firings(make_firings(1000, 4, 256, bin));
+        processor.write_audio(wav_file, 5000.0f, 44100);
+        const auto levels = read_channel_levels(wav_file);
+        const auto forward = (bin > 0) ? levels.first : levels.second;
+        const auto reverse = (bin > 0) ? levels.second : levels.first;
+        BOOST_CHECK_GT(forward, 10000.0);
+        BOOST_CHECK_LT(reverse, 0.05*forward);
+    }
+    std::remove(wav_file.c_str());
+}
+
+// Only the last max_spectra spectra and the firings they need are kept.
+BOOST_AUTO_TEST_CASE(TestBoundedMemory) {
+    bcsim::SpectralDopplerProcessor::Settings settings;
+    settings.fft_length  = 32;
+    settings.hop         = 3;
+    settings.max_spectra = 10;
+    const int num_firings = 500;
+    const auto firings = make_firings(num_firings, 4, settings.fft_length, 5);
+
+    auto unbounded_settings = settings;
+    unbounded_settings.max_spectra = num_firings;
+    bcsim::SpectralDopplerProcessor unbounded(unbounded_settings);
+    unbounded.add_firings(firings);
+    const auto all_spectra = unbounded.get_spectra();
+
+    bcsim::SpectralDopplerProcessor streaming(settings);
+    for (const auto& firing : firings) {
+        streaming.add_firing(firing.data(), static_cast<int>(firing.size()));
+        BOOST_CHECK_LE(streaming.get_slowtime_samples().size(),
+                       static_cast<size_t>((settings.max_spectra - 1)*settings.hop + settings.fft_length + settings.hop));
+    }
+    const size_t num_spectra = (num_firings - settings.fft_length)/settings.hop + 1;
+    BOOST_CHECK_EQUAL(streaming.get_num_firings(), static_cast<size_t>(num_firings));
+    BOOST_REQUIRE_EQUAL(streaming.get_num_spectra(), num_spectra);
+    BOOST_REQUIRE_EQUAL(streaming.get_first_spectrum(), num_spectra - settings.max_spectra);
+
+    const auto spectra = streaming.get_spectra();
+    BOOST_REQUIRE_EQUAL(spectra.size(), static_cast<size_t>(settings.max_spectra*settings.fft_length));
+    const auto offset = streaming.get_first_spectrum()*settings.fft_length;
+    for (size_t i = 0; i < spectra.size(); i++) {
+        BOOST_CHECK_SMALL(std::abs(spectra[i] - all_spectra[offset + i]), 1e-3f);
+    }
+    BOOST_CHECK(streaming.get_spectrogram(streaming.get_first_spectrum()) == unbounded.get_spectrogram(streaming.get_first_spectrum()));
+    BOOST_CHECK_THROW(streaming.get_spectrogram(0), std::runtime_error);
+    // Without an argument, all kept spectra.
+    BOOST_CHECK(streaming.get_spectrogram() == streaming.get_spectrogram(streaming.get_first_spectrum()));
+
+    // A batch larger than the ring gives the same result.
+    bcsim::SpectralDopplerProcessor batch(settings);
+    batch.add_firings(firings);
+    BOOST_CHECK_EQUAL(batch.get_first_spectrum(), streaming.get_first_spectrum());
+    BOOST_CHECK(batch.get_spectrogram(batch.get_first_spectrum()) == streaming.get_spectrogram(batch.get_first_spectrum()));
+}
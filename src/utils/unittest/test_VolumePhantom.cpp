@@ -0,0 +1,206 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_VolumePhantom
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <H5Cpp.h>
+#include "../VolumePhantom.hpp"
+#include "../HDFConvenience.hpp"
+#include "../NativePhantom.hpp"
+
+// 4x3x2 volume with one empty voxel and one negative voxel.
+bcsim::IntensityVolume make_volume() {
+    bcsim::IntensityVolume volume;
+    volume.num_voxels[0] = 4;
+    volume.num_voxels[1] = 3;
+    volume.num_voxels[2] = 2;
+    volume.origin = bcsim::vector3(-0.01f, 0.0f, 0.02f);
+    volume.spacing = bcsim::vector3(1e-3f, 2e-3f, 0.5e-3f);
+    for (int i = 0; i < 24; i++) {
+        volume.values.push_back(1.0f + i % 5);
+    }
+    volume.values[7] = 0.0f;
+    volume.values[13] = -2.0f;
+    return volume;
+}
+
+// Index of the voxel containing a point, allowing for rounding at the boundary.
+int voxel_index(const bcsim::IntensityVolume& volume, const bcsim::vector3& pos) {
+    const float offsets[3] = {(pos.x - volume.origin.x)/volume.spacing.x + 0.5f,
+                              (pos.y - volume.origin.y)/volume.spacing.y + 0.5f,
+                              (pos.z - volume.origin.z)/volume.spacing.z + 0.5f};
+    int index = 0;
+    for (int k = 0; k < 3; k++) {
+        if (offsets[k] < -1e-4f || offsets[k] > volume.num_voxels[k] + 1e-4f) {
+            return -1;
+        }
+        const auto i = std::min(std::max(static_cast<int>(std::floor(offsets[k])), 0), volume.num_voxels[k] - 1);
+        index = index*volume.num_voxels[k] + i;
+    }
+    return index;
+}
+
+BOOST_AUTO_TEST_CASE(DensityFollowsIntensity) {
+    const auto volume = make_volume();
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers = 400000;
+    params.chunk_size = 30000;
+    const auto scatterers = bcsim::sampleIntensityVolume(volume, params);
+    BOOST_REQUIRE_EQUAL(scatterers->scatterers.size(), params.num_scatterers);
+
+    std::vector<double> counts(volume.values.size(), 0.0);
+    for (const auto& s : scatterers->scatterers) {
+        const auto i = voxel_index(volume, s.pos);
+        BOOST_REQUIRE(i >= 0);
+        counts[i] += 1.0;
+    }
+    double weight_sum = 0.0;
+    for (auto v : volume.values) weight_sum += std::max(v, 0.0f);
+    BOOST_CHECK_EQUAL(counts[7], 0.0);
+    BOOST_CHECK_EQUAL(counts[13], 0.0);
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (volume.values[i] > 0.0f) {
+            BOOST_CHECK_CLOSE(counts[i], params.num_scatterers*volume.values[i]/weight_sum, 3.0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DensityExponent) {
+    auto volume = make_volume();
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers = 200000;
+    params.density_exponent = 0.0f;
+    const auto scatterers = bcsim::sampleIntensityVolume(volume, params);
+    std::vector<double> counts(volume.values.size(), 0.0);
+    for (const auto& s : scatterers->scatterers) {
+        const auto i = voxel_index(volume, s.pos);
+        BOOST_REQUIRE(i >= 0);
+        counts[i] += 1.0;
+    }
+    // All 22 positive voxels are equally likely, the others stay empty.
+    BOOST_CHECK_EQUAL(counts[13], 0.0);
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (volume.values[i] > 0.0f) {
+            BOOST_CHECK_CLOSE(counts[i], params.num_scatterers/22.0, 3.0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AmplitudeExponent) {
+    auto volume = make_volume();
+    for (auto& v : volume.values) v = 0.0f;
+    volume.values[3] = 1.0f;
+    volume.values[20] = 4.0f;
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers = 100000;
+    params.density_exponent = 0.0f;
+    params.amplitude_exponent = 0.5f;
+    const auto scatterers = bcsim::sampleIntensityVolume(volume, params);
+    double sum_sq[2] = {0.0, 0.0};
+    double num[2] = {0.0, 0.0};
+    for (const auto& s : scatterers->scatterers) {
+        const auto k = (voxel_index(volume, s.pos) == 20) ? 1 : 0;
+        sum_sq[k] += s.amplitude*s.amplitude;
+        num[k] += 1.0;
+    }
+    BOOST_CHECK_CLOSE(std::sqrt(sum_sq[0]/num[0]), 1.0, 2.0);
+    BOOST_CHECK_CLOSE(std::sqrt(sum_sq[1]/num[1]), 2.0, 2.0);
+}
+
+BOOST_AUTO_TEST_CASE(ChunksAreDeterministicAndOrdered) {
+    const auto volume = make_volume();
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers = 10500;
+    params.chunk_size = 1000;
+    std::vector<size_t> chunk_sizes;
+    auto streamed = std::make_shared<bcsim::FixedScatterers>();
+    bcsim::sampleIntensityVolume(volume, params, [&](bcsim::FixedScatterers::s_ptr chunk) {
+        chunk_sizes.push_back(chunk->scatterers.size());
+        for (const auto& s : chunk->scatterers) {
+            streamed->scatterers.push_back(s);
+        }
+    });
+    BOOST_REQUIRE_EQUAL(chunk_sizes.size(), 11u);
+    BOOST_CHECK_EQUAL(chunk_sizes.back(), 500u);
+
+    const auto all = bcsim::sampleIntensityVolume(volume, params);
+    BOOST_REQUIRE_EQUAL(all->scatterers.size(), streamed->scatterers.size());
+    for (size_t i = 0; i < all->scatterers.size(); i++) {
+        BOOST_CHECK_EQUAL(all->scatterers[i].pos.x, streamed->scatterers[i].pos.x);
+        BOOST_CHECK_EQUAL(all->scatterers[i].amplitude, streamed->scatterers[i].amplitude);
+    }
+
+    params.seed = 2;
+    const auto other = bcsim::sampleIntensityVolume(volume, params);
+    BOOST_CHECK(other->scatterers[0].pos.x != all->scatterers[0].pos.x);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidVolumes) {
+    auto volume = make_volume();
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers = 10;
+    volume.values.pop_back();
+    BOOST_CHECK_THROW(bcsim::sampleIntensityVolume(volume, params), std::runtime_error);
+    volume = make_volume();
+    for (auto& v : volume.values) v = 0.0f;
+    BOOST_CHECK_THROW(bcsim::sampleIntensityVolume(volume, params), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(LoadVolumeFromHdf) {
+    const std::string filename = "test_VolumePhantom_volume.h5";
+    {
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        const hsize_t dims[3] = {4, 3, 2};
+        H5::DataSpace space(3, dims);
+        std::vector<unsigned char> values(24);
+        for (int i = 0; i < 24; i++) values[i] = static_cast<unsigned char>(i);
+        file.createDataSet("ct", H5::PredType::NATIVE_UCHAR, space).write(values.data(), H5::PredType::NATIVE_UCHAR);
+        const hsize_t vector_dims[1] = {3};
+        H5::DataSpace vector_space(1, vector_dims);
+        const float spacing[3] = {1e-3f, 2e-3f, 3e-3f};
+        file.createDataSet("spacing", H5::PredType::NATIVE_FLOAT, vector_space).write(spacing, H5::PredType::NATIVE_FLOAT);
+    }
+    const auto volume = bcsim::loadIntensityVolumeFromHdf(filename, "ct");
+    BOOST_CHECK_EQUAL(volume.num_voxels[0], 4);
+    BOOST_CHECK_EQUAL(volume.num_voxels[1], 3);
+    BOOST_CHECK_EQUAL(volume.num_voxels[2], 2);
+    BOOST_REQUIRE_EQUAL(volume.values.size(), 24u);
+    BOOST_CHECK_EQUAL(volume.values[23], 23.0f);
+    BOOST_CHECK_EQUAL(volume.origin.x, 0.0f);
+    BOOST_CHECK_EQUAL(volume.spacing.z, 3e-3f);
+    BOOST_CHECK_THROW(bcsim::loadIntensityVolumeFromHdf(filename, "missing"), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(StreamingWriters) {
+    bcsim::VolumeSamplingParameters params;
+    params.num_scatterers = 25000;
+    params.chunk_size = 4096;
+    const auto volume = make_volume();
+    const auto reference = bcsim::sampleIntensityVolume(volume, params);
+
+    const std::string h5_file = "test_VolumePhantom.h5";
+    const std::string native_file = "test_VolumePhantom.bcph";
+    {
+        bcsim::FixedScatterersHdfWriter h5_writer(h5_file);
+        bcsim::FixedScatterersNativeWriter native_writer(native_file);
+        bcsim::sampleIntensityVolume(volume, params, [&](bcsim::FixedScatterers::s_ptr chunk) {
+            h5_writer.append(chunk->scatterers.data(), chunk->scatterers.size());
+            native_writer.append(chunk->scatterers.data(), chunk->scatterers.size());
+        });
+        BOOST_CHECK_EQUAL(h5_writer.get_num_written(), params.num_scatterers);
+        BOOST_CHECK_EQUAL(native_writer.get_num_written(), params.num_scatterers);
+        h5_writer.close();
+        native_writer.close();
+    }
+    for (const auto& loaded : {bcsim::loadFixedScatterersFromHdf(h5_file), bcsim::loadFixedScatterersFromNative(native_file)}) {
+        BOOST_REQUIRE_EQUAL(loaded->scatterers.size(), reference->scatterers.size());
+        for (size_t i = 0; i < loaded->scatterers.size(); i += 997) {
+            BOOST_CHECK_EQUAL(loaded->scatterers[i].pos.y, reference->scatterers[i].pos.y);
+            BOOST_CHECK_EQUAL(loaded->scatterers[i].amplitude, reference->scatterers[i].amplitude);
+        }
+    }
+    std::remove(h5_file.c_str());
+    std::remove(native_file.c_str());
+}